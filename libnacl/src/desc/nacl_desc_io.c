@@ -30,6 +30,7 @@
 #include "src/service_runtime/include/sys/mman.h"
 #include "src/service_runtime/internal_errno.h"
 #include "src/service_runtime/nacl_config.h"
+#include "src/service_runtime/nacl_slab.h"
 
 
 /*
@@ -54,6 +55,7 @@ int NaClDescIoDescCtor(struct NaClDescIoDesc  *self,
     return 0;
   }
   self->hd = hd;
+  self->hd_slab = NULL;
   basep->base.vtbl = (struct NaClRefCountVtbl const *) &kNaClDescIoDescVtbl;
   return 1;
 }
@@ -64,7 +66,7 @@ static void NaClDescIoDescDtor(struct NaClRefCount *vself) {
   NaClLog(4, "NaClDescIoDescDtor(0x%08"NACL_PRIxPTR").\n",
           (uintptr_t) vself);
   NaClHostDescClose(self->hd);
-  free(self->hd);
+  NaClSlabFree(self->hd_slab, self->hd);
   self->hd = NULL;
   vself->vtbl = (struct NaClRefCountVtbl const *) &kNaClDescVtbl;
   (*vself->vtbl->Dtor)(vself);
@@ -90,6 +92,14 @@ struct NaClDescIoDesc *NaClDescIoDescMake(struct NaClHostDesc *nhdp) {
   return ndp;
 }
 
+struct NaClDescIoDesc *NaClDescIoDescMakeSlab(struct NaClHostDesc *nhdp,
+                                              struct NaClSlab     *slab) {
+  struct NaClDescIoDesc *ndp = NaClDescIoDescMake(nhdp);
+
+  ndp->hd_slab = slab;
+  return ndp;
+}
+
 struct NaClDescIoDesc *NaClDescIoDescOpen(char  *path,
                                           int   mode,
                                           int   perms) {
@@ -21,6 +21,7 @@ struct NaClDescEffector;
 struct NaClDescXferState;
 struct NaClHostDesc;
 struct NaClMessageHeader;
+struct NaClSlab;
 
 /*
  * I/O descriptors
@@ -35,6 +36,7 @@ struct NaClDescIoDesc {
    * If we later added state that needs locking, beware lock order.
    */
   struct NaClHostDesc       *hd;
+  struct NaClSlab           *hd_slab;  /* owner of hd, NULL if malloc'ed */
 };
 
 int NaClDescIoInternalize(struct NaClDesc          **baseptr,
@@ -45,6 +47,13 @@ int NaClDescIoDescCtor(struct NaClDescIoDesc  *self,
 
 struct NaClDescIoDesc *NaClDescIoDescMake(struct NaClHostDesc *nhdp);
 
+/*
+ * The same as above, but nhdp was allocated from slab (normally the
+ * host_descs slab of NaClApp) and is returned there by the Dtor.
+ */
+struct NaClDescIoDesc *NaClDescIoDescMakeSlab(struct NaClHostDesc *nhdp,
+                                              struct NaClSlab     *slab);
+
 /* a simple factory */
 struct NaClDescIoDesc *NaClDescIoDescOpen(char  *path,
                                           int   mode,
@@ -0,0 +1,75 @@
+/*
+ * the nexe limits budgets
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+#include "src/platform/nacl_log.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/accounting.h"
+
+struct Accounting accounting;
+
+/* SyscallsMax. not set - no limit */
+static int64_t SyscallsLimit(struct SetupList *policy)
+{
+  return policy->max_syscalls > 0 ? policy->max_syscalls : INT64_MAX;
+}
+
+void AccountingCtor(struct NaClApp *nap)
+{
+  struct SetupList *policy;
+  enum ChannelType ch;
+
+  if(nap->manifest == NULL) return;
+  policy = nap->manifest->user_setup;
+
+  accounting.syscalls = SyscallsLimit(policy) - policy->cnt_syscalls;
+  for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+  {
+    struct PreOpenedFileDesc *channel = &policy->channels[ch];
+    struct ChannelBudget *budget = &accounting.channels[ch];
+
+    budget->gets = channel->max_gets - channel->cnt_gets;
+    budget->puts = channel->max_puts - channel->cnt_puts;
+    budget->get_size = channel->max_get_size - channel->cnt_get_size;
+    budget->put_size = channel->max_put_size - channel->cnt_put_size;
+  }
+}
+
+void AccountingSync(struct NaClApp *nap)
+{
+  struct SetupList *policy;
+  enum ChannelType ch;
+
+  if(nap->manifest == NULL) return;
+  policy = nap->manifest->user_setup;
+
+  /* the exceeding trap is counted, but not served */
+  policy->cnt_syscalls = SyscallsLimit(policy) - accounting.syscalls;
+  for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+  {
+    struct PreOpenedFileDesc *channel = &policy->channels[ch];
+    struct ChannelBudget *budget = &accounting.channels[ch];
+
+    channel->cnt_gets = channel->max_gets - budget->gets;
+    channel->cnt_puts = channel->max_puts - budget->puts;
+    channel->cnt_get_size = channel->max_get_size - budget->get_size;
+    channel->cnt_put_size = channel->max_put_size - budget->put_size;
+  }
+}
+
+int32_t AccountingViolation(enum ChannelType ch, enum AccountingLimits limit)
+{
+  static const char *names[] = LIMIT_NAMES;
+
+  if(!(accounting.violations & 1 << limit))
+    NaClLog(1, "%s limit exceeded\n", names[limit]);
+  accounting.violations |= 1 << limit;
+  if(ch < CHANNELS_COUNT)
+    accounting.channel_violations[ch] |= 1 << limit;
+  if(limit == LimitSyscalls) StopNexe(RetCodeSyscallsLimit, 0);
+  return -OUT_OF_LIMITS;
+}
@@ -0,0 +1,74 @@
+/*
+ * the nexe limits on the trap path. SyscallsMax and the channels limits
+ * are turned to the remaining budgets when the nexe starts, so a trap
+ * pays one decrement and a sign check for its limit. the SetupList
+ * counters are only made from the budgets (AccountingSync) when
+ * somebody needs them: the setup call and the report. SyscallsMax not
+ * set (or 0) means no limit. TrapExit is always served
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+
+#ifndef ACCOUNTING_H_
+#define ACCOUNTING_H_
+
+#include <stdint.h>
+#include "api/zvm.h"
+
+EXTERN_C_BEGIN
+
+struct NaClApp;
+
+/* the limits, bit numbers of the violations */
+enum AccountingLimits {
+  LimitSyscalls,
+  LimitGets,
+  LimitPuts,
+  LimitGetSize,
+  LimitPutSize,
+  LIMITS_COUNT
+};
+
+/* names must answer to enum "AccountingLimits" */
+#define LIMIT_NAMES {"syscalls", "gets", "puts", "get_size", "put_size"}
+
+/* remaining budgets of a channel */
+struct ChannelBudget
+{
+  int64_t gets;
+  int64_t puts;
+  int64_t get_size;
+  int64_t put_size;
+};
+
+/* the trap path data. one writer: the traps and the i/o ring serialize */
+struct Accounting
+{
+  int64_t syscalls; /* remaining traps. below zero - SyscallsMax exceeded */
+  struct ChannelBudget channels[CHANNELS_COUNT];
+  uint32_t violations; /* bits of the limits ever exceeded, any channel */
+  uint8_t channel_violations[CHANNELS_COUNT]; /* bits of the limits per channel */
+} __attribute__((aligned(64)));
+
+extern struct Accounting accounting;
+
+/*
+ * make the budgets from the SetupList limits and counters. must be
+ * called before the nexe start and after the limits change
+ */
+void AccountingCtor(struct NaClApp *nap);
+
+/* put the used budgets to the SetupList counters */
+void AccountingSync(struct NaClApp *nap);
+
+/*
+ * record the violation of "limit" by the channel "ch" (CHANNELS_COUNT -
+ * not a channel limit). SyscallsMax also stops the nexe. the cold path
+ * of the trap. return -OUT_OF_LIMITS
+ */
+int32_t AccountingViolation(enum ChannelType ch, enum AccountingLimits limit);
+
+EXTERN_C_END
+
+#endif /* ACCOUNTING_H_ */
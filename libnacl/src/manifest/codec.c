@@ -0,0 +1,377 @@
+/*
+ * host side codec of the preloaded channels
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <zlib.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_threads.h"
+#include "src/manifest/manifest_parser.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/etag.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/codec.h"
+
+#define CODEC_BUFFER (256 << 10)
+#define CODEC_PIPE (1 << 20) /* the plain output the encoder can lag behind */
+#define CODEC_THREAD_STACK (256 << 10)
+#define GZIP_WINDOW (15 + 16) /* deflate window of the gzip stream */
+#define AUTO_WINDOW (15 + 32) /* inflate window, zlib or gzip header */
+
+struct Codec
+{
+  enum ChannelCodecs codec;
+  struct PreOpenedFileDesc *channel;
+  int encoder; /* output: plain -> packed. input: packed -> plain */
+  int packed; /* the channel handle */
+  int plain; /* input: the decoded memfd. output: the pipe to the encoder */
+  int pipe; /* output: the encoder end of the pipe */
+  int64_t limit; /* plain bytes allowed (max_size) */
+  int64_t size; /* input: plain bytes decoded. output: plain bytes written */
+  int64_t packed_size; /* output: packed bytes written */
+  volatile uint32_t seq; /* futex. moved when "size" grows and at the end */
+  volatile sig_atomic_t waiting; /* the nexe waits for the decoder */
+  volatile sig_atomic_t stop; /* the decoder must exit */
+  volatile sig_atomic_t done; /* the thread is over */
+  int error;
+  char *in;
+  char *out;
+  struct NaClThread thread;
+};
+
+struct Codec *codecs[CHANNELS_COUNT];
+static struct Codec slots[CHANNELS_COUNT];
+
+static int Futex(volatile uint32_t *addr, int op, uint32_t value)
+{
+  return syscall(SYS_futex, addr, op, value, NULL, NULL, 0);
+}
+
+/* write "size" bytes at "offset". return 0 if successful */
+static int PutAll(int handle, const char *buffer, size_t size, int64_t offset)
+{
+  ssize_t n;
+
+  while(size > 0)
+  {
+    n = pwrite(handle, buffer, size, offset);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return -1;
+    buffer += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+/* publish the decoded size (or the end) and wake the nexe */
+static void Publish(struct Codec *c, int64_t size)
+{
+  __atomic_store_n(&c->size, size, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  if(c->waiting) Futex(&c->seq, FUTEX_WAKE_PRIVATE, INT32_MAX);
+}
+
+static void Fail(struct Codec *c, const char *message)
+{
+  NaClLog(LOG_ERROR, "%s codec: %s\n", (char*)(uintptr_t)c->channel->name, message);
+  c->error = 1;
+}
+
+/* the input thread. decode the packed channel to the memfd */
+static void WINAPI DecoderThread(void *state)
+{
+  struct Codec *c = state;
+  z_stream z;
+  int64_t size = 0;
+  ssize_t n;
+  size_t have;
+  int ended = 0; /* the last member is complete */
+  int full = 0; /* the output buffer was filled, the decoder may hold more */
+  int code;
+
+  memset(&z, 0, sizeof z);
+  if(inflateInit2(&z, AUTO_WINDOW) != Z_OK)
+  {
+    Fail(c, "cannot start the decoder");
+    goto end;
+  }
+
+  while(!c->stop)
+  {
+    /* the decoder is drained before the next input (or the end) */
+    if(z.avail_in == 0 && !full)
+    {
+      n = read(c->packed, c->in, CODEC_BUFFER);
+      if(n < 0 && errno == EINTR) continue;
+      if(n < 0) Fail(c, "cannot read the packed channel");
+      if(n <= 0) break;
+      z.next_in = (Bytef*)c->in;
+      z.avail_in = n;
+    }
+
+    /* concatenated members are decoded as one stream */
+    if(ended)
+    {
+      inflateReset(&z);
+      ended = 0;
+    }
+    z.next_out = (Bytef*)c->out;
+    z.avail_out = CODEC_BUFFER;
+    code = inflate(&z, Z_NO_FLUSH);
+    full = code != Z_STREAM_END && z.avail_out == 0;
+    if(code == Z_STREAM_END) ended = 1;
+    else if(code != Z_OK && code != Z_BUF_ERROR)
+    {
+      Fail(c, z.msg ? z.msg : "broken packed stream");
+      break;
+    }
+
+    have = CODEC_BUFFER - z.avail_out;
+    if(have == 0) continue;
+    if(size + (int64_t)have > c->limit)
+    {
+      Fail(c, "plain stream exceeds the channel limit");
+      have = c->limit - size;
+    }
+    if(PutAll(c->plain, c->out, have, size) != 0)
+    {
+      Fail(c, "cannot store the decoded data");
+      break;
+    }
+    size += have;
+    Publish(c, size);
+    if(c->error) break;
+  }
+  if(!ended && !c->error && !c->stop) Fail(c, "packed stream is truncated");
+  inflateEnd(&z);
+
+end:
+  __atomic_store_n(&c->channel->fsize, size, __ATOMIC_RELAXED);
+  c->done = 1;
+  Publish(c, size);
+}
+
+/* the output thread. encode the pipe to the channel */
+static void WINAPI EncoderThread(void *state)
+{
+  struct Codec *c = state;
+  z_stream z;
+  ssize_t n;
+  size_t have;
+  int flush = Z_NO_FLUSH;
+
+  memset(&z, 0, sizeof z);
+  if(deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+      GZIP_WINDOW, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    /* the pipe is still drained, the nexe must not block */
+    Fail(c, "cannot start the encoder");
+    while((n = read(c->pipe, c->in, CODEC_BUFFER)) > 0 || (n < 0 && errno == EINTR));
+    goto end;
+  }
+
+  do
+  {
+    n = read(c->pipe, c->in, CODEC_BUFFER);
+    if(n < 0 && errno == EINTR) continue;
+    flush = n <= 0 ? Z_FINISH : Z_NO_FLUSH; /* the pipe is closed by CodecDtor() */
+    z.next_in = (Bytef*)c->in;
+    z.avail_in = n > 0 ? n : 0;
+
+    do
+    {
+      z.next_out = (Bytef*)c->out;
+      z.avail_out = CODEC_BUFFER;
+      deflate(&z, flush);
+      have = CODEC_BUFFER - z.avail_out;
+      if(have == 0 || c->error) continue;
+      if(PutAll(c->packed, c->out, have, c->packed_size) != 0)
+      {
+        Fail(c, "cannot store the encoded data");
+        continue;
+      }
+      EtagWrite(c->out, c->packed_size, have);
+      c->packed_size += have;
+    } while(z.avail_out == 0);
+  } while(flush != Z_FINISH);
+  deflateEnd(&z);
+
+end:
+  c->done = 1;
+}
+
+/* return the codec by the manifest value, -1 if unknown */
+static int CodecByName(const char *name)
+{
+  static const char *names[] = CODEC_NAMES;
+  int i;
+
+  for(i = 0; i < (int)(sizeof names / sizeof *names); ++i)
+    if(strcmp(name, names[i]) == 0) return i;
+  return -1;
+}
+
+/* anonymous file for the decoded input */
+static int AnonymousFile()
+{
+  char name[] = "/tmp/zerovm_codecXXXXXX";
+  int fd;
+
+#ifdef SYS_memfd_create
+  fd = syscall(SYS_memfd_create, "codec", 0);
+  if(fd >= 0) return fd;
+#endif
+  fd = mkstemp(name);
+  if(fd >= 0) unlink(name);
+  return fd;
+}
+
+int CodecCtor(struct NaClApp *nap, struct PreOpenedFileDesc *channel)
+{
+  static const char *prefixes[] = CHANNEL_PREFIXES;
+  struct Codec *c;
+  char key[64];
+  char *name;
+  int codec;
+  int fds[2];
+
+  /* the codec is asked by the manifest */
+  snprintf(key, sizeof key, "%sCodec", prefixes[channel->type]);
+  name = GetValueByKey(nap, key);
+  if(name == NULL) return 0;
+  codec = CodecByName(name);
+  if(codec < 0)
+  {
+    NaClLog(LOG_ERROR, "unknown codec %s\n", name);
+    return -1;
+  }
+  if(codec == CodecNone) return 0;
+  if(channel->type != InputChannel && channel->type != OutputChannel)
+  {
+    NaClLog(LOG_ERROR, "%s cannot have codec\n", key);
+    return -1;
+  }
+
+  c = &slots[channel->type];
+  memset(c, 0, sizeof *c);
+  c->codec = codec;
+  c->channel = channel;
+  c->encoder = channel->type == OutputChannel;
+  c->packed = channel->handle;
+  c->limit = channel->max_size;
+  c->in = malloc(CODEC_BUFFER);
+  c->out = malloc(CODEC_BUFFER);
+  if(c->in == NULL || c->out == NULL) return -1;
+
+  /* the plain side the traps use */
+  if(c->encoder)
+  {
+    if(pipe(fds) != 0) return -1;
+    fcntl(fds[1], F_SETPIPE_SZ, CODEC_PIPE);
+    c->pipe = fds[0];
+    c->plain = fds[1];
+    if(ftruncate(c->packed, 0) != 0) return -1;
+  }
+  else
+  {
+    c->plain = AnonymousFile();
+    if(c->plain < 0) return -1;
+  }
+
+  /* the nexe signals (CPUMax and Timeout timers) must go to the nexe thread */
+  if(!NaClThreadCreateJoinableNoSignals(&c->thread,
+      c->encoder ? EncoderThread : DecoderThread, c, CODEC_THREAD_STACK)) return -1;
+
+  /* the plain stream size is not known yet */
+  channel->handle = c->plain;
+  channel->fsize = c->limit;
+  codecs[channel->type] = c;
+  NaClLog(2, "%s codec %s\n", prefixes[channel->type], name);
+  return 0;
+}
+
+int CodecDtor(struct PreOpenedFileDesc *channel)
+{
+  struct Codec *c = codecs[channel->type];
+
+  if(c == NULL) return 0;
+  codecs[channel->type] = NULL;
+
+  /* the encoder gets the end of the pipe, the decoder is stopped */
+  if(c->encoder) close(c->plain);
+  else c->stop = 1;
+  NaClThreadJoin(&c->thread);
+
+  if(c->encoder)
+  {
+    close(c->pipe);
+    if(ftruncate(c->packed, c->packed_size) != 0) Fail(c, "cannot trim the channel");
+    channel->fsize = c->packed_size;
+    NaClLog(1, "%s: %ld plain bytes packed to %ld\n",
+        (char*)(uintptr_t)channel->name, c->size, c->packed_size);
+  }
+  else
+    close(c->plain);
+
+  channel->handle = c->packed;
+  free(c->in);
+  free(c->out);
+  return c->error ? -1 : 0;
+}
+
+int32_t CodecRead(struct Codec *c, char *buffer, int32_t size, int64_t offset)
+{
+  uint32_t seq;
+  int64_t ready;
+
+  if(c->encoder) return -INVALID_MODE;
+
+  /* wait until the decoder passes the requested part or ends */
+  for(;;)
+  {
+    seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+    ready = __atomic_load_n(&c->size, __ATOMIC_ACQUIRE);
+    if(ready >= offset + size || c->done) break;
+    if(GetStopCode()) break; /* Timeout, the nexe is stopped on the return */
+
+    c->waiting = 1;
+    __sync_synchronize();
+    if(c->seq == seq) Futex(&c->seq, FUTEX_WAIT_PRIVATE, seq);
+    c->waiting = 0;
+  }
+
+  if(offset >= ready) return c->done && c->error ? -INTERNAL_ERR : 0;
+  if(size > ready - offset) size = ready - offset;
+  return pread(c->plain, buffer, (size_t)size, (off_t)offset);
+}
+
+int32_t CodecWrite(struct Codec *c, const char *buffer, int32_t size, int64_t offset)
+{
+  ssize_t n;
+  int32_t written = 0;
+
+  if(!c->encoder) return -INVALID_MODE;
+  if(offset != c->size) return -INSANE_OFFSET; /* the packed stream cannot be rewritten */
+
+  while(written < size)
+  {
+    n = write(c->plain, buffer + written, size - written);
+    if(n < 0 && errno == EINTR && !GetStopCode()) continue;
+    if(n <= 0) break;
+    written += n;
+  }
+  c->size += written;
+  return written > 0 ? written : -INTERNAL_ERR;
+}
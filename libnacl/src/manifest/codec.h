@@ -0,0 +1,64 @@
+/*
+ * host side codec of the preloaded (LOADED) channels, set per channel
+ * with "<Channel>Codec" manifest key (e.g. "InputCodec = gzip"). the
+ * nexe reads and writes the plain bytes, a zerovm thread per channel
+ * does the codec work on another core:
+ *
+ * Input: the decoder thread streams the packed channel to an anonymous
+ * file (memfd) ahead of the nexe. a read of the part not decoded yet
+ * waits for it. the channel size is not known until the end, the reads
+ * after the end return 0
+ *
+ * Output: the writes must come in order (a packed stream cannot be
+ * rewritten), they go to the encoder thread through a pipe. the etag
+ * is made from the packed output
+ *
+ * the channel sizes and limits (max_size, max_get_size,..) are of the
+ * plain stream. the codecs: "gzip" (the decoder also takes zlib streams
+ * and concatenated gzip members)
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+
+#ifndef CODEC_H_
+#define CODEC_H_
+
+#include "api/zvm.h"
+#include "src/service_runtime/sel_ldr.h"
+
+EXTERN_C_BEGIN
+
+enum ChannelCodecs {
+  CodecNone,
+  CodecGzip
+};
+
+/* names must answer to enum "ChannelCodecs" */
+#define CODEC_NAMES {"none", "gzip"}
+
+/* channel codec, NULL - the channel is served as is */
+struct Codec;
+extern struct Codec *codecs[CHANNELS_COUNT];
+
+/*
+ * start the codec of the preloaded "channel" if the manifest asks it.
+ * the channel handle is replaced with the plain side. return 0 if
+ * successful or there is no codec, otherwise -1
+ */
+int CodecCtor(struct NaClApp *nap, struct PreOpenedFileDesc *channel);
+
+/*
+ * finish the codec: the output is flushed and trimmed, the packed
+ * handle and size are put back to the channel. return 0 if successful
+ * or there is no codec, -1 if the codec failed (the output is broken)
+ */
+int CodecDtor(struct PreOpenedFileDesc *channel);
+
+/* TrapRead/TrapWrite of the channel with codec. return as pread/pwrite or negative error code */
+int32_t CodecRead(struct Codec *codec, char *buffer, int32_t size, int64_t offset);
+int32_t CodecWrite(struct Codec *codec, const char *buffer, int32_t size, int64_t offset);
+
+EXTERN_C_END
+
+#endif /* CODEC_H_ */
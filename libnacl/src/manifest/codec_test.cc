@@ -0,0 +1,353 @@
+/*
+ * codec_test.cc
+ * unit test over google testing framework
+ * checks the channels codec: the nexe reads the plain stream of the
+ * packed input at any offset and writes the plain output in order,
+ * the limits hold for the plain stream. measures the decoding
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <zlib.h>
+#include <string>
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/codec.h"
+
+#define PLAIN_SIZE (3 << 20) /* spans several codec buffers */
+#define BENCH_SIZE (64 << 20)
+#define CODEC_BUFFER (256 << 10) /* the decoder output, as in codec.c */
+
+// Test harness for the codec. the channel files are temporary
+class CodecTests : public ::testing::Test {
+ protected:
+  CodecTests()
+  {
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    manifest.user_setup = &setup;
+    manifest.master = records;
+    app.manifest = &manifest;
+    records[0].key = (char*)"InputCodec";
+    records[0].value = (char*)"gzip";
+    records[1].key = (char*)"OutputCodec";
+    records[1].value = (char*)"gzip";
+    manifest.master_records = 2;
+    strcpy(name, "/tmp/codec_testXXXXXX");
+    close(mkstemp(name));
+  }
+
+  ~CodecTests()
+  {
+    CodecDtor(&setup.channels[InputChannel]);
+    CodecDtor(&setup.channels[OutputChannel]);
+    unlink(name);
+  }
+
+  // the channel of "type" over the test file with "data" in it
+  struct PreOpenedFileDesc *Channel(enum ChannelType type, const std::string &data)
+  {
+    struct PreOpenedFileDesc *channel = &setup.channels[type];
+    FILE *f = fopen(name, "w");
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+    channel->name = (uint64_t)(uintptr_t)name;
+    channel->type = type;
+    channel->mounted = LOADED;
+    channel->handle = open(name, O_RDWR);
+    channel->fsize = data.size();
+    channel->max_size = 1LL << 40;
+    return channel;
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+  struct MasterManifestRecord records[2];
+  char name[32];
+};
+
+// "size" bytes of the plain stream, compressible but not trivial
+static std::string Plain(int size)
+{
+  std::string data(size, '\0');
+  uint32_t x = 1;
+  int i;
+
+  for(i = 0; i < size; ++i)
+  {
+    x = x * 1103515245 + 12345;
+    data[i] = "zerovm "[(x >> 16) % 7];
+  }
+  return data;
+}
+
+// one gzip member of "data"
+static std::string Pack(const std::string &data)
+{
+  std::string packed(compressBound(data.size()) + 32, '\0');
+  z_stream z;
+
+  memset(&z, 0, sizeof z);
+  deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  z.next_in = (Bytef*)data.data();
+  z.avail_in = data.size();
+  z.next_out = (Bytef*)&packed[0];
+  z.avail_out = packed.size();
+  EXPECT_EQ(Z_STREAM_END, deflate(&z, Z_FINISH));
+  packed.resize(z.total_out);
+  deflateEnd(&z);
+  return packed;
+}
+
+// gzip (or zlib) stream "packed" decoded
+static std::string Unpack(const std::string &packed)
+{
+  std::string data(PLAIN_SIZE * 2, '\0');
+  z_stream z;
+
+  memset(&z, 0, sizeof z);
+  inflateInit2(&z, 15 + 32);
+  z.next_in = (Bytef*)packed.data();
+  z.avail_in = packed.size();
+  z.next_out = (Bytef*)&data[0];
+  z.avail_out = data.size();
+  EXPECT_EQ(Z_STREAM_END, inflate(&z, Z_FINISH));
+  data.resize(z.total_out);
+  inflateEnd(&z);
+  return data;
+}
+
+// w/o codec key the channel is not touched, unknown codec fails
+TEST_F(CodecTests, NoCodecTest)
+{
+  struct PreOpenedFileDesc *channel;
+
+  manifest.master_records = 0;
+  channel = Channel(InputChannel, "data");
+  ASSERT_EQ(0, CodecCtor(&app, channel));
+  EXPECT_TRUE(codecs[InputChannel] == NULL);
+  EXPECT_EQ(4, channel->fsize);
+
+  manifest.master_records = 1;
+  records[0].value = (char*)"lzma";
+  EXPECT_EQ(-1, CodecCtor(&app, channel));
+  EXPECT_TRUE(codecs[InputChannel] == NULL);
+  close(channel->handle);
+}
+
+// the plain stream is read at any offset, the reads after the end get 0
+TEST_F(CodecTests, DecodeTest)
+{
+  std::string plain = Plain(PLAIN_SIZE);
+  std::string half = plain.substr(0, PLAIN_SIZE / 2);
+  struct PreOpenedFileDesc *channel;
+  int packed;
+  char buffer[4096];
+
+  /* two gzip members make one stream */
+  channel = Channel(InputChannel,
+      Pack(half) + Pack(plain.substr(PLAIN_SIZE / 2)));
+  packed = channel->handle;
+  ASSERT_EQ(0, CodecCtor(&app, channel));
+  ASSERT_TRUE(codecs[InputChannel] != NULL);
+  EXPECT_NE(packed, channel->handle);
+
+  ASSERT_EQ(100, CodecRead(codecs[InputChannel], buffer, 100, PLAIN_SIZE - 100));
+  EXPECT_EQ(0, memcmp(buffer, plain.data() + PLAIN_SIZE - 100, 100));
+  ASSERT_EQ(4096, CodecRead(codecs[InputChannel], buffer, 4096, 12345));
+  EXPECT_EQ(0, memcmp(buffer, plain.data() + 12345, 4096));
+  EXPECT_EQ(100, CodecRead(codecs[InputChannel], buffer, 4096, PLAIN_SIZE - 100));
+  EXPECT_EQ(0, CodecRead(codecs[InputChannel], buffer, 4096, PLAIN_SIZE));
+  EXPECT_EQ(PLAIN_SIZE, channel->fsize);
+  EXPECT_EQ(-INVALID_MODE, CodecWrite(codecs[InputChannel], buffer, 1, 0));
+
+  EXPECT_EQ(0, CodecDtor(channel));
+  EXPECT_TRUE(codecs[InputChannel] == NULL);
+  EXPECT_EQ(packed, channel->handle);
+  close(packed);
+}
+
+// the plain stream is cut at max_size, broken stream is an error after its data
+TEST_F(CodecTests, DecodeLimitsTest)
+{
+  std::string plain = Plain(PLAIN_SIZE);
+  std::string packed = Pack(plain);
+  struct PreOpenedFileDesc *channel;
+  char buffer[4096];
+
+  channel = Channel(InputChannel, packed);
+  channel->max_size = 10000;
+  ASSERT_EQ(0, CodecCtor(&app, channel));
+  EXPECT_EQ(4096, CodecRead(codecs[InputChannel], buffer, 4096, 8192 - 4096));
+  EXPECT_EQ(10000 - 8192, CodecRead(codecs[InputChannel], buffer, 4096, 8192));
+  EXPECT_EQ(-INTERNAL_ERR, CodecRead(codecs[InputChannel], buffer, 4096, 10000));
+  EXPECT_EQ(-1, CodecDtor(channel));
+  close(channel->handle);
+
+  channel = Channel(InputChannel, packed.substr(0, packed.size() / 2));
+  ASSERT_EQ(0, CodecCtor(&app, channel));
+  EXPECT_EQ(4096, CodecRead(codecs[InputChannel], buffer, 4096, 0));
+  EXPECT_EQ(-INTERNAL_ERR, CodecRead(codecs[InputChannel], buffer, 4096, PLAIN_SIZE));
+  EXPECT_EQ(-1, CodecDtor(channel));
+  close(channel->handle);
+}
+
+// gzip stream of "size" zeros w/o its last 10 bytes (the end of block and
+// the trailer). "expected" gets what zlib can decode from it
+static std::string PackZerosCut(size_t size, std::string *expected)
+{
+  std::string plain(size, '\0');
+  std::string packed;
+  z_stream z;
+
+  memset(&z, 0, sizeof z);
+  deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  packed.resize(deflateBound(&z, size));
+  z.next_in = (Bytef*)plain.data();
+  z.avail_in = size;
+  z.next_out = (Bytef*)&packed[0];
+  z.avail_out = packed.size();
+  EXPECT_EQ(Z_STREAM_END, deflate(&z, Z_FINISH));
+  packed.resize(z.total_out - 10);
+  deflateEnd(&z);
+
+  memset(&z, 0, sizeof z);
+  expected->assign(size, '\0');
+  inflateInit2(&z, 15 + 32);
+  z.next_in = (Bytef*)packed.data();
+  z.avail_in = packed.size();
+  z.next_out = (Bytef*)&(*expected)[0];
+  z.avail_out = expected->size();
+  EXPECT_EQ(Z_OK, inflate(&z, Z_SYNC_FLUSH));
+  expected->resize(z.total_out);
+  inflateEnd(&z);
+  return packed;
+}
+
+// the input ends while the decoder still holds the output: the last match
+// crosses the codec buffer. all of it is decoded before the error
+TEST_F(CodecTests, DecodeDrainTest)
+{
+  std::string expected;
+  std::string packed;
+  struct PreOpenedFileDesc *channel;
+  size_t size = 64 * CODEC_BUFFER + 100;
+  char buffer[4096];
+  int i;
+
+  /* move the end of the decodable data just past the codec buffer */
+  for(i = 0; i < 8; ++i)
+  {
+    packed = PackZerosCut(size, &expected);
+    if(expected.size() % CODEC_BUFFER > 0 && expected.size() % CODEC_BUFFER < 200) break;
+    size += CODEC_BUFFER + 100 - expected.size() % CODEC_BUFFER;
+  }
+  ASSERT_LT(0u, expected.size() % CODEC_BUFFER);
+  ASSERT_GT(200u, expected.size() % CODEC_BUFFER);
+
+  channel = Channel(InputChannel, packed);
+  ASSERT_EQ(0, CodecCtor(&app, channel));
+  EXPECT_EQ(1, CodecRead(codecs[InputChannel], buffer, 1, expected.size() - 1));
+  EXPECT_EQ(-INTERNAL_ERR, CodecRead(codecs[InputChannel], buffer, 1, expected.size()));
+  EXPECT_EQ((int64_t)expected.size(), channel->fsize);
+  EXPECT_EQ(-1, CodecDtor(channel));
+  close(channel->handle);
+}
+
+// the output is packed in order to the channel, which is trimmed at the end
+TEST_F(CodecTests, EncodeTest)
+{
+  std::string plain = Plain(PLAIN_SIZE);
+  std::string packed(PLAIN_SIZE, '\0');
+  struct PreOpenedFileDesc *channel;
+  int64_t offset;
+  int handle;
+
+  channel = Channel(OutputChannel, "old content of the output");
+  handle = channel->handle;
+  ASSERT_EQ(0, CodecCtor(&app, channel));
+  ASSERT_TRUE(codecs[OutputChannel] != NULL);
+
+  for(offset = 0; offset < PLAIN_SIZE; offset += 100000)
+  {
+    int32_t size = PLAIN_SIZE - offset < 100000 ? PLAIN_SIZE - offset : 100000;
+    ASSERT_EQ(size, CodecWrite(codecs[OutputChannel], plain.data() + offset, size, offset));
+  }
+  EXPECT_EQ(-INSANE_OFFSET, CodecWrite(codecs[OutputChannel], plain.data(), 1, 0));
+  EXPECT_EQ(-INVALID_MODE, CodecRead(codecs[OutputChannel], &packed[0], 1, 0));
+
+  EXPECT_EQ(0, CodecDtor(channel));
+  EXPECT_EQ(handle, channel->handle);
+  ASSERT_LT(0, channel->fsize);
+  ASSERT_EQ(channel->fsize, pread(handle, &packed[0], PLAIN_SIZE, 0));
+  packed.resize(channel->fsize);
+  EXPECT_TRUE(Unpack(packed) == plain);
+  close(handle);
+}
+
+// the packed output which cannot be written (the file size limit) fails the channel at the end
+TEST_F(CodecTests, EncodeFailTest)
+{
+  std::string plain = Plain(PLAIN_SIZE);
+  struct PreOpenedFileDesc *channel = Channel(OutputChannel, "");
+  struct rlimit old;
+  struct rlimit limit;
+
+  getrlimit(RLIMIT_FSIZE, &old);
+  limit = old;
+  limit.rlim_cur = 4096;
+  signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+
+  ASSERT_EQ(0, CodecCtor(&app, channel));
+  EXPECT_EQ(PLAIN_SIZE, CodecWrite(codecs[OutputChannel], plain.data(), PLAIN_SIZE, 0));
+  EXPECT_EQ(-1, CodecDtor(channel));
+  EXPECT_TRUE(codecs[OutputChannel] == NULL);
+  close(channel->handle);
+
+  setrlimit(RLIMIT_FSIZE, &old);
+  signal(SIGXFSZ, SIG_DFL);
+}
+
+// return monotonic clock in nanoseconds
+static int64_t Now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// the nexe reads the decoded input in 64kb
+TEST_F(CodecTests, DecodeBenchTest)
+{
+  static char buffer[1 << 16];
+  struct PreOpenedFileDesc *channel = Channel(InputChannel, Pack(Plain(BENCH_SIZE)));
+  int64_t start = Now();
+  int64_t offset;
+
+  ASSERT_EQ(0, CodecCtor(&app, channel));
+  for(offset = 0; offset < BENCH_SIZE; offset += sizeof buffer)
+    ASSERT_EQ((int32_t)sizeof buffer,
+        CodecRead(codecs[InputChannel], buffer, sizeof buffer, offset));
+  printf("gzip input: %.1f MB/s\n", BENCH_SIZE / 1e6 / ((Now() - start) / 1e9));
+  CodecDtor(channel);
+  close(channel->handle);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
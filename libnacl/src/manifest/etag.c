@@ -0,0 +1,137 @@
+/*
+ * incremental etag of the output channel
+ *
+ *  Created on: Jan 22, 2012
+ *      Author: d'b
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/manifest/etag.h"
+#include "src/manifest/hash.h"
+#include "src/manifest/manifest_setup.h"
+
+#define ETAG_DEFAULT HashMd5 /* swift etag */
+#define ETAG_READ_BUFFER 0x10000
+
+/* the etag state. there is only one nexe (so one output) per zerovm */
+static struct HashCtx ctx;
+static int enabled; /* the output is hashed */
+static int streaming; /* writes come in order, "hashed" is the next one */
+static int64_t hashed; /* bytes hashed from the channel start */
+static char etag[HASH_HEX_MAX + 1];
+static const char *result; /* NULL - no etag */
+
+int EtagCtor(struct NaClApp *nap, struct PreOpenedFileDesc *channel)
+{
+  char *name = nap->manifest->system_setup->etag_hash;
+  int algorithm = name ? HashByName(name) : ETAG_DEFAULT;
+
+  result = NULL;
+  enabled = 0;
+  if(algorithm < 0)
+  {
+    NaClLog(LOG_ERROR, "unknown etag hash %s\n", name);
+    return -1;
+  }
+  if(algorithm == HashNone)
+  {
+    result = "etag disabled";
+    return 0;
+  }
+
+  HashInit(&ctx, algorithm);
+  enabled = streaming = 1;
+  hashed = 0;
+  return 0;
+}
+
+void EtagWrite(const char *buffer, int64_t offset, int32_t size)
+{
+  if(!enabled || size < 1) return;
+
+  /* the data hashed is overwritten, everything will be read back */
+  if(offset < hashed)
+  {
+    HashInit(&ctx, ctx.algorithm);
+    hashed = 0;
+    streaming = 0;
+  }
+  if(!streaming) return;
+
+  /* a gap. the data hashed stays valid, the rest will be read back */
+  if(offset > hashed)
+  {
+    streaming = 0;
+    return;
+  }
+
+  HashUpdate(&ctx, buffer, size);
+  hashed += size;
+}
+
+/* put the final digest */
+static void Finish()
+{
+  HashFinalHex(&ctx, etag);
+  result = etag;
+  enabled = 0;
+}
+
+void EtagUnmap(const char *buffer, size_t size, const unsigned char *data)
+{
+  static const char zeros[NACL_PAGESIZE];
+  size_t page;
+  size_t n;
+
+  if(!enabled) return;
+
+  /* the whole data is hashed here. a hole of the file is zeros, the map is not touched there */
+  for(page = 0; page * NACL_PAGESIZE < size; ++page)
+  {
+    n = size - page * NACL_PAGESIZE < NACL_PAGESIZE ? size - page * NACL_PAGESIZE : NACL_PAGESIZE;
+    if(data[page])
+      HashUpdate(&ctx, buffer + page * NACL_PAGESIZE, n);
+    else
+      HashUpdate(&ctx, zeros, n);
+  }
+  Finish();
+}
+
+void EtagUnload(int handle)
+{
+  static char data[ETAG_READ_BUFFER];
+  struct stat fs;
+  ssize_t n;
+
+  if(!enabled) return;
+
+  /* read back the part not hashed */
+  if(fstat(handle, &fs) < 0) goto fail;
+  if(hashed > fs.st_size)
+  {
+    HashInit(&ctx, ctx.algorithm);
+    hashed = 0;
+  }
+  while(hashed < fs.st_size)
+  {
+    n = pread(handle, data, sizeof data, hashed);
+    if(n <= 0) goto fail;
+    HashUpdate(&ctx, data, n);
+    hashed += n;
+  }
+  if(!streaming) NaClLog(2, "output written out of order, etag read it back\n");
+  Finish();
+  return;
+
+fail:
+  NaClLog(LOG_ERROR, "cannot read the output to make etag\n");
+  enabled = 0;
+}
+
+const char *EtagGet(void)
+{
+  return result;
+}
@@ -0,0 +1,50 @@
+/*
+ * incremental etag of the output channel. the hash follows the data as
+ * the nexe writes it (TrapWrite of the preloaded output), so the digest
+ * of the preloaded output is ready when the nexe exits. the algorithm
+ * is given by "EtagHash" (md5 by default, see HASH_NAMES). out of order
+ * writes stop the streaming, the part not hashed is read back from the
+ * channel at the unmount
+ *
+ * note: the premapped output is written by plain stores, the host sees
+ * nothing until the nexe is over. so it still pays one pass over its
+ * data at the unmount (from the map, the pages are mostly resident).
+ * only the holes of the file are hashed w/o touching the map
+ *
+ *  Created on: Jan 22, 2012
+ *      Author: d'b
+ */
+
+#ifndef ETAG_H_
+#define ETAG_H_
+
+#include "api/zvm.h"
+#include "src/service_runtime/sel_ldr.h"
+
+EXTERN_C_BEGIN
+
+/*
+ * start the etag of the output "channel" (opened, measured, not
+ * preallocated yet). return 0 if successful
+ */
+int EtagCtor(struct NaClApp *nap, struct PreOpenedFileDesc *channel);
+
+/* "size" bytes from "buffer" are written to the output at "offset" */
+void EtagWrite(const char *buffer, int64_t offset, int32_t size);
+
+/*
+ * finish the premapped output of "size" bytes mapped at "buffer". pages
+ * w/o data ("data" holds a byte per page, zero - the hole of the file)
+ * are zeros and are not touched
+ */
+void EtagUnmap(const char *buffer, size_t size, const unsigned char *data);
+
+/* finish the preloaded output. the part not hashed is read from "handle" */
+void EtagUnload(int handle);
+
+/* return the etag (asciiz hex), "etag disabled" or NULL if there is no etag */
+const char *EtagGet(void);
+
+EXTERN_C_END
+
+#endif /* ETAG_H_ */
@@ -0,0 +1,143 @@
+/*
+ * etag_test.cc
+ * unit test over google testing framework
+ * checks the incremental output etag: the hash selection, in order
+ * writes, out of order writes read back from the channel, the premapped
+ * output with untouched pages. the hashes are checked by hash_test
+ *
+ *  Created on: Jan 22, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/etag.h"
+#include "src/manifest/hash.h"
+
+#define CHANNEL_SIZE 10000
+
+// Test harness for the etag. the output is a temporary file
+class EtagTests : public ::testing::Test {
+ protected:
+  EtagTests()
+  {
+    char name[] = "/tmp/etag_testXXXXXX";
+    int i;
+
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&system, 0, sizeof system);
+    memset(&channel, 0, sizeof channel);
+    manifest.system_setup = &system;
+    app.manifest = &manifest;
+    channel.type = OutputChannel;
+    channel.handle = mkstemp(name);
+    unlink(name);
+    for(i = 0; i < CHANNEL_SIZE; ++i) data[i] = (char)(i * 7);
+  }
+
+  ~EtagTests()
+  {
+    close(channel.handle);
+  }
+
+  // return hex digest of "size" bytes of "buffer"
+  const char *Digest(enum HashAlgorithm algorithm, const void *buffer, size_t size)
+  {
+    struct HashCtx ctx;
+    HashInit(&ctx, algorithm);
+    HashUpdate(&ctx, buffer, size);
+    HashFinalHex(&ctx, hex);
+    return hex;
+  }
+
+  // write "size" bytes of data at "offset" the way TrapWrite does
+  void Write(int64_t offset, int32_t size)
+  {
+    ASSERT_EQ(size, pwrite(channel.handle, data + offset, size, offset));
+    EtagWrite(data + offset, offset, size);
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SystemList system;
+  struct PreOpenedFileDesc channel;
+  char data[CHANNEL_SIZE];
+  char hex[HASH_HEX_MAX + 1];
+};
+
+// "EtagHash" selects the hash, md5 by default
+TEST_F(EtagTests, SelectTest)
+{
+  system.etag_hash = (char*)"none";
+  EXPECT_EQ(0, EtagCtor(&app, &channel));
+  EXPECT_STREQ("etag disabled", EtagGet());
+  system.etag_hash = (char*)"sha1024";
+  EXPECT_EQ(-1, EtagCtor(&app, &channel));
+  EXPECT_EQ(NULL, EtagGet());
+
+  system.etag_hash = (char*)"xxh64";
+  EXPECT_EQ(0, EtagCtor(&app, &channel));
+  EtagUnload(channel.handle);
+  EXPECT_STREQ("ef46db3751d8e999", EtagGet());
+}
+
+// in order writes are hashed as they come
+TEST_F(EtagTests, StreamingTest)
+{
+  EXPECT_EQ(0, EtagCtor(&app, &channel));
+  Write(0, 1000);
+  Write(1000, 5000);
+  Write(6000, CHANNEL_SIZE - 6000);
+  EtagUnload(channel.handle);
+  EXPECT_STREQ(Digest(HashMd5, data, CHANNEL_SIZE), EtagGet());
+}
+
+// gaps and overwrites are read back from the channel
+TEST_F(EtagTests, OutOfOrderTest)
+{
+  EXPECT_EQ(0, EtagCtor(&app, &channel));
+  Write(0, 1000);
+  Write(5000, CHANNEL_SIZE - 5000);
+  Write(1000, 4000);
+  EtagUnload(channel.handle);
+  EXPECT_STREQ(Digest(HashMd5, data, CHANNEL_SIZE), EtagGet());
+
+  EXPECT_EQ(0, EtagCtor(&app, &channel));
+  Write(0, CHANNEL_SIZE);
+  data[10] = 'x';
+  Write(0, 100);
+  EtagUnload(channel.handle);
+  EXPECT_STREQ(Digest(HashMd5, data, CHANNEL_SIZE), EtagGet());
+}
+
+// premapped output: the holes of the channel are zeros
+TEST_F(EtagTests, UnmapTest)
+{
+  static char buffer[4 * NACL_PAGESIZE];
+  unsigned char data[] = {1, 0, 1, 0};
+
+  memset(buffer, 0, sizeof buffer);
+  memset(buffer, 'a', NACL_PAGESIZE);
+  memset(buffer + 2 * NACL_PAGESIZE, 'b', 100);
+  EXPECT_EQ(0, EtagCtor(&app, &channel));
+  EtagUnmap(buffer, 2 * NACL_PAGESIZE + 100, data);
+  EXPECT_STREQ(Digest(HashMd5, buffer, 2 * NACL_PAGESIZE + 100), EtagGet());
+
+  /* the page with data is hashed from the map, written by nexe or not */
+  buffer[NACL_PAGESIZE] = 'c';
+  data[1] = 1;
+  EXPECT_EQ(0, EtagCtor(&app, &channel));
+  EtagUnmap(buffer, 2 * NACL_PAGESIZE + 100, data);
+  EXPECT_STREQ(Digest(HashMd5, buffer, 2 * NACL_PAGESIZE + 100), EtagGet());
+}
+
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,491 @@
+/*
+ * streaming hashes of the channels data. the block functions have
+ * scalar and simd versions, HashAccel() picks them
+ *
+ *  Created on: Jan 22, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <string.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "src/manifest/hash.h"
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+/* unaligned little endian loads. x86 only */
+static inline uint32_t Load32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+static inline uint64_t Load64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+/*
+ * md5 (rfc 1321). the message words are loaded once per block, every
+ * step is unrolled
+ */
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, x, s, ac) \
+  (a) += f((b), (c), (d)) + (x) + (uint32_t)(ac); \
+  (a) = ROTL32((a), (s)) + (b)
+
+static void Md5Blocks(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+  uint32_t a, b, c, d;
+  uint32_t x[16];
+  int i;
+
+  for(; blocks > 0; --blocks, data += 64)
+  {
+    for(i = 0; i < 16; ++i) x[i] = Load32(data + i * 4);
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+
+    MD5_STEP(MD5_F, a, b, c, d, x[ 0],  7, 0xd76aa478);
+    MD5_STEP(MD5_F, d, a, b, c, x[ 1], 12, 0xe8c7b756);
+    MD5_STEP(MD5_F, c, d, a, b, x[ 2], 17, 0x242070db);
+    MD5_STEP(MD5_F, b, c, d, a, x[ 3], 22, 0xc1bdceee);
+    MD5_STEP(MD5_F, a, b, c, d, x[ 4],  7, 0xf57c0faf);
+    MD5_STEP(MD5_F, d, a, b, c, x[ 5], 12, 0x4787c62a);
+    MD5_STEP(MD5_F, c, d, a, b, x[ 6], 17, 0xa8304613);
+    MD5_STEP(MD5_F, b, c, d, a, x[ 7], 22, 0xfd469501);
+    MD5_STEP(MD5_F, a, b, c, d, x[ 8],  7, 0x698098d8);
+    MD5_STEP(MD5_F, d, a, b, c, x[ 9], 12, 0x8b44f7af);
+    MD5_STEP(MD5_F, c, d, a, b, x[10], 17, 0xffff5bb1);
+    MD5_STEP(MD5_F, b, c, d, a, x[11], 22, 0x895cd7be);
+    MD5_STEP(MD5_F, a, b, c, d, x[12],  7, 0x6b901122);
+    MD5_STEP(MD5_F, d, a, b, c, x[13], 12, 0xfd987193);
+    MD5_STEP(MD5_F, c, d, a, b, x[14], 17, 0xa679438e);
+    MD5_STEP(MD5_F, b, c, d, a, x[15], 22, 0x49b40821);
+
+    MD5_STEP(MD5_G, a, b, c, d, x[ 1],  5, 0xf61e2562);
+    MD5_STEP(MD5_G, d, a, b, c, x[ 6],  9, 0xc040b340);
+    MD5_STEP(MD5_G, c, d, a, b, x[11], 14, 0x265e5a51);
+    MD5_STEP(MD5_G, b, c, d, a, x[ 0], 20, 0xe9b6c7aa);
+    MD5_STEP(MD5_G, a, b, c, d, x[ 5],  5, 0xd62f105d);
+    MD5_STEP(MD5_G, d, a, b, c, x[10],  9, 0x02441453);
+    MD5_STEP(MD5_G, c, d, a, b, x[15], 14, 0xd8a1e681);
+    MD5_STEP(MD5_G, b, c, d, a, x[ 4], 20, 0xe7d3fbc8);
+    MD5_STEP(MD5_G, a, b, c, d, x[ 9],  5, 0x21e1cde6);
+    MD5_STEP(MD5_G, d, a, b, c, x[14],  9, 0xc33707d6);
+    MD5_STEP(MD5_G, c, d, a, b, x[ 3], 14, 0xf4d50d87);
+    MD5_STEP(MD5_G, b, c, d, a, x[ 8], 20, 0x455a14ed);
+    MD5_STEP(MD5_G, a, b, c, d, x[13],  5, 0xa9e3e905);
+    MD5_STEP(MD5_G, d, a, b, c, x[ 2],  9, 0xfcefa3f8);
+    MD5_STEP(MD5_G, c, d, a, b, x[ 7], 14, 0x676f02d9);
+    MD5_STEP(MD5_G, b, c, d, a, x[12], 20, 0x8d2a4c8a);
+
+    MD5_STEP(MD5_H, a, b, c, d, x[ 5],  4, 0xfffa3942);
+    MD5_STEP(MD5_H, d, a, b, c, x[ 8], 11, 0x8771f681);
+    MD5_STEP(MD5_H, c, d, a, b, x[11], 16, 0x6d9d6122);
+    MD5_STEP(MD5_H, b, c, d, a, x[14], 23, 0xfde5380c);
+    MD5_STEP(MD5_H, a, b, c, d, x[ 1],  4, 0xa4beea44);
+    MD5_STEP(MD5_H, d, a, b, c, x[ 4], 11, 0x4bdecfa9);
+    MD5_STEP(MD5_H, c, d, a, b, x[ 7], 16, 0xf6bb4b60);
+    MD5_STEP(MD5_H, b, c, d, a, x[10], 23, 0xbebfbc70);
+    MD5_STEP(MD5_H, a, b, c, d, x[13],  4, 0x289b7ec6);
+    MD5_STEP(MD5_H, d, a, b, c, x[ 0], 11, 0xeaa127fa);
+    MD5_STEP(MD5_H, c, d, a, b, x[ 3], 16, 0xd4ef3085);
+    MD5_STEP(MD5_H, b, c, d, a, x[ 6], 23, 0x04881d05);
+    MD5_STEP(MD5_H, a, b, c, d, x[ 9],  4, 0xd9d4d039);
+    MD5_STEP(MD5_H, d, a, b, c, x[12], 11, 0xe6db99e5);
+    MD5_STEP(MD5_H, c, d, a, b, x[15], 16, 0x1fa27cf8);
+    MD5_STEP(MD5_H, b, c, d, a, x[ 2], 23, 0xc4ac5665);
+
+    MD5_STEP(MD5_I, a, b, c, d, x[ 0],  6, 0xf4292244);
+    MD5_STEP(MD5_I, d, a, b, c, x[ 7], 10, 0x432aff97);
+    MD5_STEP(MD5_I, c, d, a, b, x[14], 15, 0xab9423a7);
+    MD5_STEP(MD5_I, b, c, d, a, x[ 5], 21, 0xfc93a039);
+    MD5_STEP(MD5_I, a, b, c, d, x[12],  6, 0x655b59c3);
+    MD5_STEP(MD5_I, d, a, b, c, x[ 3], 10, 0x8f0ccc92);
+    MD5_STEP(MD5_I, c, d, a, b, x[10], 15, 0xffeff47d);
+    MD5_STEP(MD5_I, b, c, d, a, x[ 1], 21, 0x85845dd1);
+    MD5_STEP(MD5_I, a, b, c, d, x[ 8],  6, 0x6fa87e4f);
+    MD5_STEP(MD5_I, d, a, b, c, x[15], 10, 0xfe2ce6e0);
+    MD5_STEP(MD5_I, c, d, a, b, x[ 6], 15, 0xa3014314);
+    MD5_STEP(MD5_I, b, c, d, a, x[13], 21, 0x4e0811a1);
+    MD5_STEP(MD5_I, a, b, c, d, x[ 4],  6, 0xf7537e82);
+    MD5_STEP(MD5_I, d, a, b, c, x[11], 10, 0xbd3af235);
+    MD5_STEP(MD5_I, c, d, a, b, x[ 2], 15, 0x2ad7d2bb);
+    MD5_STEP(MD5_I, b, c, d, a, x[ 9], 21, 0xeb86d391);
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  }
+}
+
+/* xxh64. 32 bytes stripes of 4 lanes, seed 0 */
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t XxhRound(uint64_t acc, uint64_t input)
+{
+  acc += input * XXH_P2;
+  return ROTL64(acc, 31) * XXH_P1;
+}
+
+static inline uint64_t XxhMerge(uint64_t acc, uint64_t v)
+{
+  acc ^= XxhRound(0, v);
+  return acc * XXH_P1 + XXH_P4;
+}
+
+static void XxhStripes(uint64_t *v, const unsigned char *data, size_t stripes)
+{
+  uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+
+  for(; stripes > 0; --stripes, data += 32)
+  {
+    v0 = XxhRound(v0, Load64(data));
+    v1 = XxhRound(v1, Load64(data + 8));
+    v2 = XxhRound(v2, Load64(data + 16));
+    v3 = XxhRound(v3, Load64(data + 24));
+  }
+  v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+}
+
+/* the tail "data" is less than a stripe */
+static uint64_t XxhFinal(const uint64_t *v, uint64_t size,
+    const unsigned char *data, uint32_t tail)
+{
+  uint64_t h;
+
+  if(size >= 32)
+  {
+    h = ROTL64(v[0], 1) + ROTL64(v[1], 7) + ROTL64(v[2], 12) + ROTL64(v[3], 18);
+    h = XxhMerge(h, v[0]);
+    h = XxhMerge(h, v[1]);
+    h = XxhMerge(h, v[2]);
+    h = XxhMerge(h, v[3]);
+  }
+  else
+    h = XXH_P5;
+  h += size;
+
+  for(; tail >= 8; tail -= 8, data += 8)
+  {
+    h ^= XxhRound(0, Load64(data));
+    h = ROTL64(h, 27) * XXH_P1 + XXH_P4;
+  }
+  if(tail >= 4)
+  {
+    h ^= Load32(data) * XXH_P1;
+    h = ROTL64(h, 23) * XXH_P2 + XXH_P3;
+    tail -= 4;
+    data += 4;
+  }
+  for(; tail > 0; --tail, ++data)
+  {
+    h ^= *data * XXH_P5;
+    h = ROTL64(h, 11) * XXH_P1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_P2;
+  h ^= h >> 29;
+  h *= XXH_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+/* sha256 (fips 180-4) */
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void Sha256BlocksScalar(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  for(; blocks > 0; --blocks, data += 64)
+  {
+    for(i = 0; i < 16; ++i) w[i] = __builtin_bswap32(Load32(data + i * 4));
+    for(i = 16; i < 64; ++i)
+      w[i] = w[i - 16] + w[i - 7]
+          + (ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3))
+          + (ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+    for(i = 0; i < 64; ++i)
+    {
+      t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25))
+          + (g ^ (e & (f ^ g))) + sha256_k[i] + w[i];
+      t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) | (c & (a | b)));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+}
+
+/*
+ * sha-ni: 4 rounds per message group, the state is kept as ABEF/CDGH.
+ * group i+1 message is msg2(msg1(W[i-3], W[i-2]) + W[i-1:i], W[i])
+ */
+#define SHA_GROUP(i, m0, m1, m2, m3) \
+  msg = _mm_add_epi32(m0, _mm_loadu_si128((const __m128i*)&sha256_k[(i) * 4])); \
+  state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+  if((i) >= 3 && (i) <= 14) \
+  { \
+    m1 = _mm_add_epi32(m1, _mm_alignr_epi8(m0, m3, 4)); \
+    m1 = _mm_sha256msg2_epu32(m1, m0); \
+  } \
+  state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e)); \
+  if((i) >= 1 && (i) <= 12) m3 = _mm_sha256msg1_epu32(m3, m0)
+
+__attribute__((target("sha,sse4.1")))
+static void Sha256BlocksNi(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+  const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i state0, state1, msg, tmp, w0, w1, w2, w3, abef, cdgh;
+
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xb1); /* CDAB */
+  state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1b); /* EFGH */
+  state0 = _mm_alignr_epi8(tmp, state1, 8); /* ABEF */
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0); /* CDGH */
+
+  for(; blocks > 0; --blocks, data += 64)
+  {
+    abef = state0;
+    cdgh = state1;
+    w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), swap);
+    w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), swap);
+    w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), swap);
+    w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), swap);
+
+    SHA_GROUP(0, w0, w1, w2, w3);
+    SHA_GROUP(1, w1, w2, w3, w0);
+    SHA_GROUP(2, w2, w3, w0, w1);
+    SHA_GROUP(3, w3, w0, w1, w2);
+    SHA_GROUP(4, w0, w1, w2, w3);
+    SHA_GROUP(5, w1, w2, w3, w0);
+    SHA_GROUP(6, w2, w3, w0, w1);
+    SHA_GROUP(7, w3, w0, w1, w2);
+    SHA_GROUP(8, w0, w1, w2, w3);
+    SHA_GROUP(9, w1, w2, w3, w0);
+    SHA_GROUP(10, w2, w3, w0, w1);
+    SHA_GROUP(11, w3, w0, w1, w2);
+    SHA_GROUP(12, w0, w1, w2, w3);
+    SHA_GROUP(13, w1, w2, w3, w0);
+    SHA_GROUP(14, w2, w3, w0, w1);
+    SHA_GROUP(15, w3, w0, w1, w2);
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b); /* FEBA */
+  state1 = _mm_shuffle_epi32(state1, 0xb1); /* DCHG */
+  _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xf0)); /* DCBA */
+  _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8)); /* HGFE */
+}
+
+/* cpu extensions. probed once, -1 - not probed yet */
+static int accel = -1;
+static void (*sha256_blocks)(uint32_t *state, const unsigned char *data, size_t blocks);
+
+static int CpuAccel()
+{
+  unsigned eax, ebx, ecx, edx;
+  int features = 0;
+
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse4.1") && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+      && (ebx & bit_SHA)) features |= HASH_ACCEL_SHA;
+  return features;
+}
+
+int HashAccel(int allowed)
+{
+  accel = CpuAccel() & allowed;
+  sha256_blocks = accel & HASH_ACCEL_SHA ? Sha256BlocksNi : Sha256BlocksScalar;
+  return accel;
+}
+
+/* block size of the algorithm */
+static size_t BlockSize(enum HashAlgorithm algorithm)
+{
+  return algorithm == HashXxh64 ? 32 : 64;
+}
+
+/* hash whole blocks of "data" */
+static void Blocks(struct HashCtx *ctx, const unsigned char *data, size_t blocks)
+{
+  switch(ctx->algorithm)
+  {
+    case HashMd5:
+      Md5Blocks(ctx->state.md5, data, blocks);
+      break;
+    case HashXxh64:
+      XxhStripes(ctx->state.xxh64, data, blocks);
+      break;
+    case HashSha256:
+      sha256_blocks(ctx->state.sha256, data, blocks);
+      break;
+    case HashNone:
+    default:
+      break;
+  }
+}
+
+int HashByName(const char *name)
+{
+  const char *names[] = HASH_NAMES;
+  int i;
+
+  if(name == NULL) return -1;
+  for(i = 0; i < (int)(sizeof names / sizeof *names); ++i)
+    if(!strcmp(name, names[i])) return i;
+  return -1;
+}
+
+void HashInit(struct HashCtx *ctx, enum HashAlgorithm algorithm)
+{
+  memset(ctx, 0, sizeof *ctx);
+  ctx->algorithm = algorithm;
+  switch(algorithm)
+  {
+    case HashMd5:
+      ctx->state.md5[0] = 0x67452301;
+      ctx->state.md5[1] = 0xefcdab89;
+      ctx->state.md5[2] = 0x98badcfe;
+      ctx->state.md5[3] = 0x10325476;
+      break;
+    case HashXxh64:
+      ctx->state.xxh64[0] = XXH_P1 + XXH_P2;
+      ctx->state.xxh64[1] = XXH_P2;
+      ctx->state.xxh64[2] = 0;
+      ctx->state.xxh64[3] = -XXH_P1;
+      break;
+    case HashSha256:
+      if(accel < 0) HashAccel(HASH_ACCEL_ALL);
+      ctx->state.sha256[0] = 0x6a09e667;
+      ctx->state.sha256[1] = 0xbb67ae85;
+      ctx->state.sha256[2] = 0x3c6ef372;
+      ctx->state.sha256[3] = 0xa54ff53a;
+      ctx->state.sha256[4] = 0x510e527f;
+      ctx->state.sha256[5] = 0x9b05688c;
+      ctx->state.sha256[6] = 0x1f83d9ab;
+      ctx->state.sha256[7] = 0x5be0cd19;
+      break;
+    case HashNone:
+    default:
+      break;
+  }
+}
+
+void HashUpdate(struct HashCtx *ctx, const void *data, size_t size)
+{
+  const unsigned char *p = data;
+  size_t block = BlockSize(ctx->algorithm);
+  size_t n;
+
+  if(ctx->algorithm == HashNone) return;
+  ctx->size += size;
+
+  /* complete the buffered block */
+  if(ctx->fill > 0)
+  {
+    n = block - ctx->fill < size ? block - ctx->fill : size;
+    memcpy(ctx->block + ctx->fill, p, n);
+    ctx->fill += n;
+    p += n;
+    size -= n;
+    if(ctx->fill < block) return;
+    Blocks(ctx, ctx->block, 1);
+    ctx->fill = 0;
+  }
+
+  /* whole blocks right from the data, keep the tail */
+  Blocks(ctx, p, size / block);
+  p += size / block * block;
+  ctx->fill = size % block;
+  memcpy(ctx->block, p, ctx->fill);
+}
+
+int HashFinal(struct HashCtx *ctx, unsigned char *digest)
+{
+  uint64_t bits;
+  uint64_t h;
+  int i;
+
+  switch(ctx->algorithm)
+  {
+    case HashMd5:
+    case HashSha256:
+      /* 0x80, zeros up to 56 mod 64, length in bits. md5 is little endian */
+      bits = ctx->size * 8;
+      if(ctx->algorithm == HashSha256) bits = __builtin_bswap64(bits);
+      ctx->block[ctx->fill++] = 0x80;
+      if(ctx->fill > 56)
+      {
+        memset(ctx->block + ctx->fill, 0, 64 - ctx->fill);
+        Blocks(ctx, ctx->block, 1);
+        ctx->fill = 0;
+      }
+      memset(ctx->block + ctx->fill, 0, 56 - ctx->fill);
+      memcpy(ctx->block + 56, &bits, sizeof bits);
+      Blocks(ctx, ctx->block, 1);
+      if(ctx->algorithm == HashMd5)
+      {
+        memcpy(digest, ctx->state.md5, 16);
+        return 16;
+      }
+      for(i = 0; i < 8; ++i)
+      {
+        uint32_t word = __builtin_bswap32(ctx->state.sha256[i]);
+        memcpy(digest + i * 4, &word, sizeof word);
+      }
+      return 32;
+    case HashXxh64:
+      /* canonical (big endian) form */
+      h = XxhFinal(ctx->state.xxh64, ctx->size, ctx->block, ctx->fill);
+      for(i = 0; i < 8; ++i) digest[i] = (unsigned char)(h >> (56 - i * 8));
+      return 8;
+    case HashNone:
+    default:
+      return 0;
+  }
+}
+
+void HashFinalHex(struct HashCtx *ctx, char *hex)
+{
+  static const char digits[] = "0123456789abcdef";
+  unsigned char digest[HASH_DIGEST_MAX];
+  int size = HashFinal(ctx, digest);
+  int i;
+
+  for(i = 0; i < size; ++i)
+  {
+    hex[i * 2] = digits[digest[i] >> 4];
+    hex[i * 2 + 1] = digits[digest[i] & 0xf];
+  }
+  hex[size * 2] = '\0';
+}
@@ -0,0 +1,70 @@
+/*
+ * streaming hashes of the channels data. one api for every algorithm:
+ * HashInit(), any number of HashUpdate(), HashFinal(). md5 is the swift
+ * etag, sha256 is for integrity checks, xxh64 is a fast non cryptographic
+ * checksum. sha256 uses sha-ni when the cpu has it
+ *
+ *  Created on: Jan 22, 2012
+ *      Author: d'b
+ */
+
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* hash algorithms. must answer to HASH_NAMES */
+enum HashAlgorithm {
+  HashNone, /* nothing is hashed */
+  HashMd5,
+  HashXxh64,
+  HashSha256
+};
+
+#define HASH_NAMES {"none", "md5", "xxh64", "sha256"}
+#define HASH_BLOCK 64 /* biggest block of the algorithms */
+#define HASH_DIGEST_MAX 32 /* biggest digest, bytes */
+
+/* cpu extensions the hashes can use */
+#define HASH_ACCEL_SHA 1 /* sha-ni for sha256 */
+#define HASH_ACCEL_ALL HASH_ACCEL_SHA
+#define HASH_HEX_MAX (2 * HASH_DIGEST_MAX) /* biggest digest as hex string w/o '\0' */
+
+struct HashCtx
+{
+  enum HashAlgorithm algorithm;
+  uint64_t size; /* bytes hashed */
+  uint32_t fill; /* bytes in "block" */
+  union {
+    uint32_t md5[4];
+    uint64_t xxh64[4];
+    uint32_t sha256[8];
+  } state;
+  unsigned char block[HASH_BLOCK]; /* tail not hashed yet */
+};
+
+/* return algorithm by its name or -1 if unknown */
+int HashByName(const char *name);
+
+/*
+ * allow the hashes only the cpu extensions given (HASH_ACCEL_*, the cpu
+ * must have them anyway). return the extensions in use
+ */
+int HashAccel(int allowed);
+
+void HashInit(struct HashCtx *ctx, enum HashAlgorithm algorithm);
+void HashUpdate(struct HashCtx *ctx, const void *data, size_t size);
+
+/* put the digest to "digest" (HASH_DIGEST_MAX bytes), return its size */
+int HashFinal(struct HashCtx *ctx, unsigned char *digest);
+
+/* put the digest as asciiz hex string to "hex" (HASH_HEX_MAX + 1 bytes) */
+void HashFinalHex(struct HashCtx *ctx, char *hex);
+
+EXTERN_C_END
+
+#endif /* HASH_H_ */
@@ -0,0 +1,156 @@
+/*
+ * hash_test.cc
+ * unit test over google testing framework
+ * checks the hashes against known digests, the simd versions against
+ * the scalar ones, streaming in pieces against one piece. the
+ * throughput of every hash is measured in GB/s
+ *
+ *  Created on: Jan 23, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gtest/gtest.h"
+#include "src/manifest/hash.h"
+
+#define DATA_SIZE (1 << 20)
+#define BENCH_BYTES (1LL << 28)
+
+// Test harness for the hashes. "data" is a pseudo random buffer
+class HashTests : public ::testing::Test {
+ protected:
+  HashTests()
+  {
+    int i;
+    data = (unsigned char*)malloc(DATA_SIZE);
+    for(i = 0; i < DATA_SIZE; ++i) data[i] = (unsigned char)(i * 2654435761U >> 13);
+  }
+
+  ~HashTests()
+  {
+    HashAccel(HASH_ACCEL_ALL);
+    free(data);
+  }
+
+  // return hex digest of "size" bytes of "buffer"
+  const char *Digest(enum HashAlgorithm algorithm, const void *buffer, size_t size)
+  {
+    struct HashCtx ctx;
+    HashInit(&ctx, algorithm);
+    HashUpdate(&ctx, buffer, size);
+    HashFinalHex(&ctx, hex);
+    return hex;
+  }
+
+  unsigned char *data;
+  char hex[HASH_HEX_MAX + 1];
+};
+
+// known digests
+TEST_F(HashTests, VectorsTest)
+{
+  const char *million = "12345678901234567890123456789012345678901234567890123456789012345678901234567890";
+  const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  int accel;
+
+  EXPECT_STREQ("d41d8cd98f00b204e9800998ecf8427e", Digest(HashMd5, "", 0));
+  EXPECT_STREQ("900150983cd24fb0d6963f7d28e17f72", Digest(HashMd5, "abc", 3));
+  EXPECT_STREQ("57edf4a22be3c955ac49da2e2107b67a", Digest(HashMd5, million, 80));
+  EXPECT_STREQ("ef46db3751d8e999", Digest(HashXxh64, "", 0));
+  EXPECT_STREQ("44bc2cf5ad770999", Digest(HashXxh64, "abc", 3));
+
+  /* sha256 with and without sha-ni */
+  for(accel = HASH_ACCEL_ALL; accel >= 0; accel -= HASH_ACCEL_ALL)
+  {
+    HashAccel(accel);
+    EXPECT_STREQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+        Digest(HashSha256, "", 0));
+    EXPECT_STREQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+        Digest(HashSha256, "abc", 3));
+    EXPECT_STREQ("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+        Digest(HashSha256, two_blocks, strlen(two_blocks)));
+  }
+
+  EXPECT_EQ(HashSha256, HashByName("sha256"));
+  EXPECT_EQ(HashXxh64, HashByName("xxh64"));
+  EXPECT_EQ(-1, HashByName("crc"));
+}
+
+// sha-ni gives the same as the scalar sha256
+TEST_F(HashTests, Sha256AccelTest)
+{
+  char scalar[HASH_HEX_MAX + 1];
+  size_t size;
+
+  if(!(HashAccel(HASH_ACCEL_ALL) & HASH_ACCEL_SHA)) return;
+  for(size = 0; size < 300; size += 7)
+  {
+    HashAccel(0);
+    strcpy(scalar, Digest(HashSha256, data, size));
+    HashAccel(HASH_ACCEL_ALL);
+    EXPECT_STREQ(scalar, Digest(HashSha256, data, size));
+  }
+}
+
+// streaming in pieces gives the same as one piece
+TEST_F(HashTests, PiecesTest)
+{
+  struct HashCtx ctx;
+  char pieces[HASH_HEX_MAX + 1];
+  int offset, size;
+  int i;
+
+  for(i = HashMd5; i <= HashSha256; ++i)
+  {
+    HashInit(&ctx, (enum HashAlgorithm)i);
+    for(offset = 0, size = 1; offset < 10000; offset += size, size = size * 3 % 97 + 1)
+      HashUpdate(&ctx, data + offset, offset + size > 10000 ? 10000 - offset : size);
+    HashFinalHex(&ctx, pieces);
+    EXPECT_STREQ(Digest((enum HashAlgorithm)i, data, 10000), pieces);
+  }
+}
+
+// return monotonic clock in nanoseconds
+static int64_t Now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// hash BENCH_BYTES with "algorithm", print GB/s
+static void Bench(const char *name, enum HashAlgorithm algorithm, unsigned char *data)
+{
+  struct HashCtx ctx;
+  char hex[HASH_HEX_MAX + 1];
+  int64_t start = Now();
+  int64_t done;
+
+  HashInit(&ctx, algorithm);
+  for(done = 0; done < BENCH_BYTES; done += DATA_SIZE)
+    HashUpdate(&ctx, data, DATA_SIZE);
+  HashFinalHex(&ctx, hex);
+  printf("%s: %.2f GB/s\n", name, (double)BENCH_BYTES / (Now() - start));
+}
+
+TEST_F(HashTests, BenchTest)
+{
+  int accel = HashAccel(HASH_ACCEL_ALL);
+
+  Bench("md5", HashMd5, data);
+  Bench("xxh64", HashXxh64, data);
+  Bench(accel & HASH_ACCEL_SHA ? "sha256 sha-ni" : "sha256", HashSha256, data);
+  if(accel & HASH_ACCEL_SHA)
+  {
+    HashAccel(0);
+    Bench("sha256 scalar", HashSha256, data);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,253 @@
+/*
+ * exit-less channels i/o
+ *
+ *  Created on: Jan 20, 2012
+ *      Author: d'b
+ */
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_sync_checked.h"
+#include "src/platform/nacl_threads.h"
+#include "src/manifest/io_ring.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/trap_stats.h"
+#include "src/service_runtime/sel_mem.h"
+
+#define IO_RING_MAX_ENTRIES (1 << 16)
+#define IO_RING_THREAD_STACK (256 << 10)
+
+/* x86 keeps loads and stores in order, only the compiler must not move them */
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/* the ring. there is only one nexe per zerovm */
+static struct IoRing *ring; /* system address, NULL - no ring */
+static uint32_t mask; /* entries - 1. private copy, the nexe can spoil the ring header */
+static uint32_t spins; /* polls before sleep. on a single cpu polling only delays the nexe */
+static uint32_t sq_tail; /* next request to serve. owned by the i/o thread */
+static volatile uint32_t done; /* completions put. futex of the sleeping nexe */
+static volatile sig_atomic_t stop; /* the i/o thread must exit */
+static volatile sig_atomic_t nexe_sleeping; /* the nexe waits in IoRingWait() */
+static struct NaClThread thread;
+static struct NaClMutex channels_mu;
+static uint64_t served; /* requests served by the i/o thread */
+static int64_t thread_cpu; /* cpu time of the i/o thread, ns */
+
+static int Futex(volatile uint32_t *addr, int op, uint32_t value)
+{
+  return syscall(SYS_futex, addr, op, value, NULL, NULL, 0);
+}
+
+/* serve the request at sq_tail and put its completion */
+static void Serve(struct NaClApp *nap)
+{
+  struct IoRequest request = IO_RING_SQ(ring)[sq_tail & mask];
+  struct IoCompletion *completion;
+  uint64_t start = 0;
+  int64_t result;
+
+  /* the same handlers, limits and counters as the traps */
+  NaClXMutexLock(&channels_mu);
+  if(trap_stats_enabled) start = TrapStatsNow();
+  switch(request.function)
+  {
+    case TrapRead:
+      result = TrapReadHandle(nap, (enum ChannelType)request.desc,
+          (char*)(uintptr_t)(uint32_t)request.buffer, request.size, request.offset);
+      break;
+    case TrapWrite:
+      result = TrapWriteHandle(nap, (enum ChannelType)request.desc,
+          (char*)(uintptr_t)(uint32_t)request.buffer, request.size, request.offset);
+      break;
+    default:
+      result = ERR_CODE;
+      break;
+  }
+  if(trap_stats_enabled)
+    TrapStatsRecord(request.function, start, request.desc, result);
+  NaClXMutexUnlock(&channels_mu);
+
+  /* put the completion, then publish it */
+  completion = &((struct IoCompletion*)(IO_RING_SQ(ring) + mask + 1))[done & mask];
+  completion->tag = request.tag;
+  completion->result = result;
+  COMPILER_BARRIER();
+  ring->sq_tail.value = ++sq_tail;
+  ring->cq_tail.value = ++done;
+  ++served;
+
+  /* wake the nexe if it sleeps in IoRingWait() */
+  __sync_synchronize();
+  if(nexe_sleeping) Futex(&done, FUTEX_WAKE_PRIVATE, 1);
+}
+
+/* the i/o thread. poll the submission queue, sleep when it is idle */
+static void WINAPI IoRingThread(void *state)
+{
+  struct NaClApp *nap = state;
+  struct timespec t;
+  uint32_t pending;
+  uint32_t polls = 0;
+
+  while(!stop)
+  {
+    pending = ring->sq_head.value - sq_tail;
+
+    /* the nexe broke the ring. its requests are not served anymore */
+    if(pending > mask + 1 || (pending && done - ring->cq_head.value > mask))
+    {
+      NaClLog(LOG_ERROR, "i/o ring is broken by the nexe\n");
+      stop = 1;
+      if(nexe_sleeping) Futex(&done, FUTEX_WAKE_PRIVATE, 1);
+      break;
+    }
+
+    if(pending)
+    {
+      COMPILER_BARRIER();
+      Serve(nap);
+      polls = 0;
+      continue;
+    }
+
+    /* poll for a while, then sleep until TrapIoWait */
+    if(polls++ < spins)
+    {
+      __asm__ __volatile__("pause");
+      continue;
+    }
+    ring->host_sleeping = 1;
+    __sync_synchronize();
+    if(!stop && ring->sq_head.value == sq_tail)
+      Futex(&ring->host_sleeping, FUTEX_WAIT_PRIVATE, 1);
+    ring->host_sleeping = 0;
+    polls = 0;
+  }
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  thread_cpu = t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+int IoRingCtor(struct NaClApp *nap, uint32_t entries)
+{
+  size_t size;
+  uintptr_t page;
+  void *p;
+
+  /* the indices wrap around, so the queues are of power of 2 */
+  if(entries == 0 || (entries & (entries - 1)) || entries > IO_RING_MAX_ENTRIES)
+  {
+    NaClLog(LOG_ERROR, "invalid i/o ring size %u\n", entries);
+    return -1;
+  }
+  size = NaClRoundAllocPage(IO_RING_SIZE(entries));
+
+  /* take the highest hole (as mmap does), the heap and the break stay intact */
+  page = NaClVmmapFindMapSpace(&nap->mem_map, size >> NACL_PAGESHIFT);
+  if(page == 0)
+  {
+    NaClLog(LOG_ERROR, "no room for 0x%lx bytes i/o ring\n", size);
+    return -1;
+  }
+  p = mmap((void*)NaClUserToSys(nap, page << NACL_PAGESHIFT), size,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  if(p == MAP_FAILED
+      || !NaClVmmapAdd(&nap->mem_map, page, size >> NACL_PAGESHIFT,
+          PROT_READ | PROT_WRITE, NULL))
+  {
+    NaClLog(LOG_ERROR, "cannot map 0x%lx bytes i/o ring\n", size);
+    return -1;
+  }
+
+  ring = p;
+  ring->self_size = sizeof(*ring);
+  ring->entries = entries;
+  mask = entries - 1;
+  spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? IO_RING_SPINS : 0;
+  ring->spins = spins;
+  sq_tail = done = 0;
+  stop = nexe_sleeping = 0;
+  served = 0;
+  if(!NaClMutexCtor(&channels_mu))
+  {
+    ring = NULL;
+    return -1;
+  }
+
+  /* the nexe signals (CPUMax timer and others) must go to the nexe thread */
+  if(!NaClThreadCreateJoinableNoSignals(&thread, IoRingThread, nap, IO_RING_THREAD_STACK))
+  {
+    NaClLog(LOG_ERROR, "cannot start i/o ring thread\n");
+    NaClMutexDtor(&channels_mu);
+    ring = NULL;
+    return -1;
+  }
+
+  nap->manifest->user_setup->io_ring = page << NACL_PAGESHIFT;
+  NaClLog(2, "i/o ring of %u entries at 0x%lx\n", entries, page << NACL_PAGESHIFT);
+  return 0;
+}
+
+void IoRingDtor(struct NaClApp *nap)
+{
+  UNREFERENCED_PARAMETER(nap);
+  if(!ring) return;
+
+  stop = 1;
+  ring->host_sleeping = 0;
+  Futex(&ring->host_sleeping, FUTEX_WAKE_PRIVATE, 1);
+  NaClThreadJoin(&thread);
+  NaClMutexDtor(&channels_mu);
+  ring = NULL;
+  NaClLog(1, "i/o ring: %lu requests served, thread cpu %ld ns\n", served, thread_cpu);
+}
+
+int IoRingLock(void)
+{
+  if(!ring) return 0;
+  NaClXMutexLock(&channels_mu);
+  return 1;
+}
+
+void IoRingUnlock(void)
+{
+  NaClXMutexUnlock(&channels_mu);
+}
+
+int32_t IoRingWait(struct NaClApp *nap, uint32_t count)
+{
+  uint32_t current;
+
+  UNREFERENCED_PARAMETER(nap);
+  if(!ring) return -INVALID_MODE;
+
+  /* the i/o thread only needs the trap when it sleeps */
+  if(ring->host_sleeping)
+  {
+    ring->host_sleeping = 0;
+    Futex(&ring->host_sleeping, FUTEX_WAKE_PRIVATE, 1);
+  }
+
+  /* the nexe thread is here, so the nexe indices cannot change */
+  for(;;)
+  {
+    current = done;
+    if(current - ring->cq_head.value >= count) break;
+    if(current == ring->sq_head.value) break; /* nothing to wait for */
+    if(stop) return -INTERNAL_ERR;
+    if(GetStopCode()) break; /* Timeout, the nexe is stopped on the return */
+
+    nexe_sleeping = 1;
+    __sync_synchronize();
+    if(done == current && !stop) Futex(&done, FUTEX_WAIT_PRIVATE, current);
+    nexe_sleeping = 0;
+  }
+
+  return current - ring->cq_head.value;
+}
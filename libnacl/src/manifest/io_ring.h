@@ -0,0 +1,48 @@
+/*
+ * exit-less channels i/o. the ring (struct IoRing, see api/zvm.h) is
+ * put to the user space, a zerovm thread polls its submission queue
+ * and serves TrapRead/TrapWrite requests with the same handlers (so the
+ * same channels limits and counters) as the traps. the thread spins
+ * for a while when the queue is empty, then sleeps on a futex until the
+ * nexe wakes it with TrapIoWait. the nexe sleeps the same way when it
+ * waits for a completion
+ *
+ *  Created on: Jan 20, 2012
+ *      Author: d'b
+ */
+
+#ifndef IO_RING_H_
+#define IO_RING_H_
+
+#include "src/service_runtime/sel_ldr.h"
+
+EXTERN_C_BEGIN
+
+/*
+ * put the ring of "entries" (power of 2) requests to the user space,
+ * publish it via io_ring and start the i/o thread. return 0 if
+ * successful. must be called once, before the nexe start
+ */
+int IoRingCtor(struct NaClApp *nap, uint32_t entries);
+
+/* stop the i/o thread after the nexe exit. unserved requests are dropped */
+void IoRingDtor(struct NaClApp *nap);
+
+/*
+ * the channels are shared between the traps and the i/o thread. return
+ * nonzero if the lock is taken (the ring is active), then IoRingUnlock()
+ * must be called
+ */
+int IoRingLock(void);
+void IoRingUnlock(void);
+
+/*
+ * TrapIoWait. wake the i/o thread if it sleeps and wait until "count"
+ * completions are ready or nothing is left to serve. return amount of
+ * ready completions or negative error code
+ */
+int32_t IoRingWait(struct NaClApp *nap, uint32_t count);
+
+EXTERN_C_END
+
+#endif /* IO_RING_H_ */
@@ -0,0 +1,288 @@
+/*
+ * io_ring_test.cc
+ * unit test over google testing framework
+ * checks the exit-less i/o ring: requests served by the i/o thread
+ * with the channels limits, TrapIoWait, the broken ring detection. the
+ * nexe side of the ring (zvm_ring_submit, zvm_ring_reap) is mirrored
+ * here, the ring round trip is measured against the trap
+ *
+ *  Created on: Jan 20, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/service_runtime/sel_mem.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/io_ring.h"
+#include "src/manifest/accounting.h"
+
+#define USER_SPACE_BITS 24
+#define USER_BUFFER 0x100000 /* user address of the nexe buffer */
+#define BUFFER_SIZE 0x10000
+#define CHANNEL_SIZE 4096
+#define RING_ENTRIES 64
+#define BENCH_CALLS 1000000
+
+// Test harness for the ring. the "user space" is a reserved region with
+// the trampoline and the stack in its memory map, the channels are temporary files
+class IoRingTests : public ::testing::Test {
+ protected:
+  IoRingTests()
+  {
+    char name[] = "/tmp/io_ring_testXXXXXX";
+    int i;
+
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    memset(&system, 0, sizeof system);
+    manifest.user_setup = &setup;
+    manifest.system_setup = &system;
+    app.manifest = &manifest;
+    app.addr_bits = USER_SPACE_BITS;
+
+    user_space = (char*)mmap(NULL, 1 << USER_SPACE_BITS, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    app.mem_start = (uintptr_t)user_space;
+    mprotect(user_space + USER_BUFFER, BUFFER_SIZE, PROT_READ | PROT_WRITE);
+    buffer = user_space + USER_BUFFER;
+
+    NaClVmmapCtor(&app.mem_map);
+    NaClVmmapAdd(&app.mem_map, 0, 1, PROT_READ, NULL);
+    NaClVmmapAdd(&app.mem_map, ((1 << USER_SPACE_BITS) >> NACL_PAGESHIFT) - 16,
+        16, PROT_READ | PROT_WRITE, NULL);
+
+    /* input: CHANNEL_SIZE bytes of "i & 0xff", output: empty */
+    for(i = 0; i < CHANNEL_SIZE; ++i) buffer[i] = (char)i;
+    for(i = InputChannel; i <= OutputChannel; ++i)
+    {
+      struct PreOpenedFileDesc *fd = &setup.channels[i];
+      fd->handle = mkstemp(name);
+      unlink(name);
+      strcpy(name, "/tmp/io_ring_testXXXXXX");
+      fd->type = (enum ChannelType)i;
+      fd->mounted = LOADED;
+      fd->fsize = fd->max_size = CHANNEL_SIZE;
+      fd->max_gets = fd->max_puts = 1 << 30;
+      fd->max_get_size = fd->max_put_size = 1LL << 40;
+    }
+    EXPECT_EQ(CHANNEL_SIZE, write(setup.channels[InputChannel].handle, buffer, CHANNEL_SIZE));
+    memset(buffer, 0, CHANNEL_SIZE);
+    AccountingCtor(&app);
+  }
+
+  ~IoRingTests()
+  {
+    IoRingDtor(&app);
+    close(setup.channels[InputChannel].handle);
+    close(setup.channels[OutputChannel].handle);
+    NaClVmmapDtor(&app.mem_map);
+    munmap(user_space, 1 << USER_SPACE_BITS);
+  }
+
+  // create the ring, return it (system address)
+  struct IoRing *Ring()
+  {
+    EXPECT_EQ(0, IoRingCtor(&app, RING_ENTRIES));
+    EXPECT_NE(0u, setup.io_ring);
+    return ring = (struct IoRing*)(user_space + setup.io_ring);
+  }
+
+  // call the trap the way NaClOneRingHook() does
+  int32_t Call(uint64_t function, uint64_t a2)
+  {
+    uint64_t args[] = {function, 0, a2, 0, 0, 0};
+    return TrapHandler(&app, args);
+  }
+
+  // zvm_ring_submit() with the user buffer at "offset"
+  int32_t Submit(uint32_t function, int desc, int32_t size, int64_t offset, uint64_t tag)
+  {
+    uint32_t head = ring->sq_head.value;
+    struct IoRequest *request;
+
+    if(head - ring->cq_head.value >= ring->entries) return ERR_CODE;
+    request = &IO_RING_SQ(ring)[head & (ring->entries - 1)];
+    request->function = function;
+    request->desc = desc;
+    request->buffer = USER_BUFFER + offset;
+    request->size = size;
+    request->offset = offset;
+    request->tag = tag;
+    __sync_synchronize();
+    ring->sq_head.value = head + 1;
+    __sync_synchronize();
+    if(ring->host_sleeping) Call(TrapIoWait, 0);
+    return OK_CODE;
+  }
+
+  // zvm_ring_reap()
+  int32_t Reap(struct IoCompletion *completion)
+  {
+    uint32_t head = ring->cq_head.value;
+    uint32_t i;
+
+    if(head == ring->sq_head.value) return ERR_CODE;
+    for(i = 0; ring->cq_tail.value == head; ++i)
+      if(i >= ring->spins && Call(TrapIoWait, 1) < 0) return ERR_CODE;
+    __sync_synchronize();
+    *completion = IO_RING_CQ(ring)[head & (ring->entries - 1)];
+    ring->cq_head.value = head + 1;
+    return OK_CODE;
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+  struct SystemList system;
+  struct IoRing *ring;
+  char *user_space;
+  char *buffer;
+};
+
+// invalid ring sizes are rejected, TrapIoWait w/o ring fails
+TEST_F(IoRingTests, CtorTest)
+{
+  EXPECT_EQ(-INVALID_MODE, Call(TrapIoWait, 0));
+  EXPECT_EQ(-1, IoRingCtor(&app, 0));
+  EXPECT_EQ(-1, IoRingCtor(&app, 3));
+  EXPECT_EQ(0u, setup.io_ring);
+  Ring();
+  EXPECT_EQ((uint32_t)RING_ENTRIES, ring->entries);
+  EXPECT_EQ(0, Call(TrapIoWait, 0));
+}
+
+// requests are served in order, data and counters are the trap ones
+TEST_F(IoRingTests, ReadWriteTest)
+{
+  struct IoCompletion c;
+  int i;
+
+  Ring();
+  for(i = 0; i < 4; ++i)
+    ASSERT_EQ(OK_CODE, Submit(TrapRead, InputChannel, 1024, i * 1024, i));
+  ASSERT_EQ(OK_CODE, Submit(TrapWrite, OutputChannel, 100, 0, 4));
+  ASSERT_EQ(OK_CODE, Submit(TrapRead, CHANNELS_COUNT, 1, 0, 5));
+
+  for(i = 0; i < 4; ++i)
+  {
+    ASSERT_EQ(OK_CODE, Reap(&c));
+    EXPECT_EQ((uint64_t)i, c.tag);
+    EXPECT_EQ(1024, c.result);
+  }
+  ASSERT_EQ(OK_CODE, Reap(&c));
+  EXPECT_EQ(100, c.result);
+  ASSERT_EQ(OK_CODE, Reap(&c));
+  EXPECT_EQ(-INVALID_DESC, c.result);
+  EXPECT_EQ(ERR_CODE, Reap(&c));
+
+  for(i = 0; i < CHANNEL_SIZE; ++i)
+    ASSERT_EQ((char)i, buffer[i]);
+  AccountingSync(&app);
+  EXPECT_EQ(4, setup.channels[InputChannel].cnt_gets);
+  EXPECT_EQ(4096, setup.channels[InputChannel].cnt_get_size);
+  EXPECT_EQ(1, setup.channels[OutputChannel].cnt_puts);
+}
+
+// the channel limits hold for the ring as for the traps
+TEST_F(IoRingTests, LimitsTest)
+{
+  struct IoCompletion c;
+
+  setup.channels[InputChannel].max_gets = 2;
+  AccountingCtor(&app);
+  Ring();
+  ASSERT_EQ(OK_CODE, Submit(TrapRead, InputChannel, 16, 0, 0));
+  ASSERT_EQ(OK_CODE, Submit(TrapRead, InputChannel, 16, 0, 1));
+  ASSERT_EQ(OK_CODE, Submit(TrapRead, InputChannel, 16, 0, 2));
+  ASSERT_EQ(OK_CODE, Reap(&c));
+  EXPECT_EQ(16, c.result);
+  ASSERT_EQ(OK_CODE, Reap(&c));
+  EXPECT_EQ(16, c.result);
+  ASSERT_EQ(OK_CODE, Reap(&c));
+  EXPECT_EQ(-OUT_OF_LIMITS, c.result);
+  EXPECT_TRUE(accounting.channel_violations[InputChannel] & 1 << LimitGets);
+}
+
+// the ring is full until the completions are taken
+TEST_F(IoRingTests, FullTest)
+{
+  struct IoCompletion c;
+  int i;
+
+  Ring();
+  for(i = 0; i < RING_ENTRIES; ++i)
+    ASSERT_EQ(OK_CODE, Submit(TrapRead, InputChannel, 1, 0, i));
+  EXPECT_EQ(ERR_CODE, Submit(TrapRead, InputChannel, 1, 0, i));
+  EXPECT_EQ(RING_ENTRIES, Call(TrapIoWait, RING_ENTRIES));
+  ASSERT_EQ(OK_CODE, Reap(&c));
+  EXPECT_EQ(OK_CODE, Submit(TrapRead, InputChannel, 1, 0, i));
+}
+
+// the nexe moved the head too far. the thread stops, the nexe is not blocked
+TEST_F(IoRingTests, BrokenRingTest)
+{
+  struct IoCompletion c;
+
+  Ring();
+  ring->sq_head.value = RING_ENTRIES * 2;
+  EXPECT_EQ(ERR_CODE, Reap(&c));
+}
+
+// return monotonic clock in nanoseconds
+static int64_t Now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// round trip of the cheapest request: submit and reap
+TEST_F(IoRingTests, RoundTripBenchTest)
+{
+  struct IoCompletion c;
+  int64_t start;
+  int i;
+
+  Ring();
+  start = Now();
+  for(i = 0; i < BENCH_CALLS; ++i)
+  {
+    ASSERT_EQ(OK_CODE, Submit(TrapRead, CHANNELS_COUNT, 1, 0, i));
+    ASSERT_EQ(OK_CODE, Reap(&c));
+  }
+  printf("ring round trip: %.1f ns per request\n",
+      (double)(Now() - start) / BENCH_CALLS);
+}
+
+// the same requests in batches of the ring size
+TEST_F(IoRingTests, BatchBenchTest)
+{
+  struct IoCompletion c;
+  int64_t start;
+  int i, j;
+
+  Ring();
+  start = Now();
+  for(i = 0; i < BENCH_CALLS; i += RING_ENTRIES)
+  {
+    for(j = 0; j < RING_ENTRIES; ++j)
+      ASSERT_EQ(OK_CODE, Submit(TrapRead, CHANNELS_COUNT, 1, 0, j));
+    for(j = 0; j < RING_ENTRIES; ++j)
+      ASSERT_EQ(OK_CODE, Reap(&c));
+  }
+  printf("ring batch: %.1f ns per request\n", (double)(Now() - start) / BENCH_CALLS);
+}
+
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,149 @@
+/*
+ * live statistics segment and its sampling thread
+ *
+ *  Created on: Jan 25, 2012
+ *      Author: d'b
+ */
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "include/nacl_macros.h"
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_threads.h"
+#include "src/manifest/live_stats.h"
+#include "src/manifest/trap_stats.h"
+
+#define NANOS_PER_SECOND 1000000000LL
+#define NANOS_PER_MILLI 1000000LL
+#define LIVE_STATS_THREAD_STACK (64 << 10)
+
+struct LiveStats *live_stats = NULL;
+
+static size_t size; /* of the mapping */
+static clockid_t main_clock; /* cpu clock of the nexe thread */
+static int statm = -1; /* /proc/self/statm */
+static long page_size;
+static volatile uint32_t stop; /* futex. the thread must exit */
+static struct NaClThread thread;
+
+static int64_t Now(clockid_t clock)
+{
+  struct timespec t;
+  clock_gettime(clock, &t);
+  return t.tv_sec * NANOS_PER_SECOND + t.tv_nsec;
+}
+
+/* resident bytes from the 2nd field of statm. -1 if not available */
+static int64_t Rss()
+{
+  char buf[128];
+  char *p;
+  ssize_t len;
+
+  len = pread(statm, buf, sizeof buf - 1, 0);
+  if(len <= 0) return -1;
+  buf[len] = '\0';
+  p = buf;
+  strtoll(p, &p, 10);
+  return strtoll(p, NULL, 10) * page_size;
+}
+
+static void Sample()
+{
+  LIVE_STATS_SET(cpu, Now(main_clock));
+  LIVE_STATS_SET(rss, Rss());
+  LIVE_STATS_SET(heartbeat, Now(CLOCK_MONOTONIC));
+}
+
+/* sample every LIVE_STATS_PERIOD_MS until stopped */
+static void WINAPI LiveStatsThread(void *state)
+{
+  struct timespec period = {0, LIVE_STATS_PERIOD_MS * NANOS_PER_MILLI};
+
+  UNREFERENCED_PARAMETER(state);
+  while(!stop)
+  {
+    Sample();
+    syscall(SYS_futex, &stop, FUTEX_WAIT_PRIVATE, 0, &period, NULL, 0);
+  }
+}
+
+int LiveStatsCtor(const char *name)
+{
+  struct LiveStats *p;
+  int fd;
+
+  /* the segment layout does not depend on the runtime headers */
+  NACL_COMPILE_TIME_ASSERT(LIVE_STATS_TRAPS == TRAPS_COUNT);
+  NACL_COMPILE_TIME_ASSERT(LIVE_STATS_CHANNELS == CHANNELS_COUNT);
+
+  page_size = sysconf(_SC_PAGESIZE);
+  size = (sizeof *p + page_size - 1) & ~(page_size - 1);
+  if(pthread_getcpuclockid(pthread_self(), &main_clock) != 0)
+    main_clock = CLOCK_THREAD_CPUTIME_ID;
+
+  /* readers only get the read access */
+  unlink(name);
+  fd = open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IRGRP | S_IROTH);
+  if(fd < 0 || ftruncate(fd, size) != 0)
+  {
+    NaClLog(LOG_ERROR, "cannot create stats segment %s\n", name);
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED)
+  {
+    NaClLog(LOG_ERROR, "cannot map stats segment %s\n", name);
+    return -1;
+  }
+  statm = open("/proc/self/statm", O_RDONLY);
+
+  /* the magic goes last, the reader skips a segment w/o it */
+  p->version = LIVE_STATS_VERSION;
+  p->self_size = sizeof *p;
+  p->pid = getpid();
+  p->start = Now(CLOCK_MONOTONIC);
+  live_stats = p;
+  Sample();
+  __atomic_store_n(&p->magic, LIVE_STATS_MAGIC, __ATOMIC_RELEASE);
+
+  /* the nexe signals (CPUMax timer and others) must go to the nexe thread */
+  stop = 0;
+  if(!NaClThreadCreateJoinableNoSignals(&thread, LiveStatsThread, NULL, LIVE_STATS_THREAD_STACK))
+  {
+    NaClLog(LOG_ERROR, "cannot start stats thread\n");
+    stop = 1;
+    LiveStatsDtor();
+    return -1;
+  }
+
+  NaClLog(2, "stats segment %s\n", name);
+  return 0;
+}
+
+void LiveStatsDtor()
+{
+  if(!live_stats) return;
+
+  if(!stop)
+  {
+    stop = 1;
+    syscall(SYS_futex, &stop, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    NaClThreadJoin(&thread);
+  }
+  LIVE_STATS_SET(phase, LIVE_STATS_DONE);
+  Sample();
+
+  munmap(live_stats, size);
+  live_stats = NULL;
+  if(statm >= 0) close(statm);
+  statm = -1;
+}
@@ -0,0 +1,88 @@
+/*
+ * live statistics of the running sandbox ("StatsSegment" manifest key).
+ * zerovm creates the named file (e.g. in /dev/shm), maps it shared and
+ * keeps the counters there while the session runs. the node agent maps
+ * it read only (see src/stat/zvm_stat.c) and can tell slow or stuck
+ * jobs w/o signals or ptrace: a live zerovm moves "heartbeat", a
+ * working nexe moves "traps", channels bytes or "cpu".
+ *
+ * every field has one writer at a time and is stored with relaxed
+ * atomics, so the reader always gets whole values, but not a snapshot
+ * consistent between fields. the mapped (MAPPED) channels are served
+ * w/o traps and their bytes are not counted. the layout only grows:
+ * new fields are appended and "self_size" tells the reader what it has
+ *
+ *  Created on: Jan 25, 2012
+ *      Author: d'b
+ */
+
+#ifndef LIVE_STATS_H_
+#define LIVE_STATS_H_
+
+#include <stdint.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+#define LIVE_STATS_MAGIC 0x534d565a /* "ZVMS" */
+#define LIVE_STATS_VERSION 1
+#define LIVE_STATS_PERIOD_MS 100 /* sampling period of cpu, rss and heartbeat */
+
+/* must answer to TRAPS_COUNT and CHANNELS_COUNT, checked in live_stats.c */
+#define LIVE_STATS_TRAPS 5
+#define LIVE_STATS_CHANNELS 5
+
+/* "phase" after the session end */
+#define LIVE_STATS_DONE -1
+
+struct LiveChannel
+{
+  int64_t gets; /* read calls */
+  int64_t puts; /* write calls */
+  int64_t get_size; /* read bytes */
+  int64_t put_size; /* written bytes */
+};
+
+struct LiveStats
+{
+  uint32_t magic; /* LIVE_STATS_MAGIC when the segment is ready */
+  uint32_t version;
+  uint32_t self_size; /* size of this struct */
+  int32_t pid; /* zerovm */
+  int32_t phase; /* current enum SessionPhase or LIVE_STATS_DONE */
+  int32_t reserved;
+  int64_t start; /* monotonic ns of the segment creation */
+  int64_t heartbeat; /* monotonic ns of the last sample */
+  int64_t cpu; /* cpu ns of the main thread (zerovm and nexe), sampled */
+  int64_t user_cpu; /* nexe cpu ns estimation, updated on traps */
+  int64_t rss; /* resident bytes, sampled */
+  int64_t traps[LIVE_STATS_TRAPS]; /* calls per enum "TrapCalls" */
+  struct LiveChannel channels[LIVE_STATS_CHANNELS]; /* per enum "ChannelType" */
+};
+
+/* the segment. NULL - disabled */
+extern struct LiveStats *live_stats;
+
+/* relaxed store/increment of the segment field. one writer per field */
+#define LIVE_STATS_SET(field, value)\
+  __atomic_store_n(&live_stats->field, (value), __ATOMIC_RELAXED)
+#define LIVE_STATS_ADD(field, value)\
+  LIVE_STATS_SET(field, __atomic_load_n(&live_stats->field, __ATOMIC_RELAXED) + (value))
+#define LIVE_STATS_INC(field) LIVE_STATS_ADD(field, 1)
+
+/*
+ * create the segment file "name" and start the sampling thread. must
+ * be called from the thread which will run the nexe. return 0 if
+ * successful, otherwise -1 (the statistics stay disabled)
+ */
+int LiveStatsCtor(const char *name);
+
+/*
+ * mark the session end, take the last sample, stop the thread and
+ * unmap the segment. the file is left to the reader
+ */
+void LiveStatsDtor();
+
+EXTERN_C_END
+
+#endif /* LIVE_STATS_H_ */
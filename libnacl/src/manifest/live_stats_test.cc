@@ -0,0 +1,139 @@
+/*
+ * live_stats_test.cc
+ * unit test over google testing framework
+ * checks the stats segment as the reader sees it and measures the
+ * counter update put to the traps
+ *
+ *  Created on: Jan 25, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gtest/gtest.h"
+#include "src/platform/nacl_log.h"
+#include "src/manifest/live_stats.h"
+#include "src/manifest/phase_timer.h"
+
+#define BENCH_CALLS 10000000
+
+// Test harness for the segment. the reader maps it read only
+class LiveStatsTests : public ::testing::Test {
+ protected:
+  LiveStatsTests(): reader(NULL)
+  {
+    strcpy(name, "/tmp/live_stats_testXXXXXX");
+    close(mkstemp(name));
+  }
+
+  ~LiveStatsTests()
+  {
+    LiveStatsDtor();
+    if(reader) munmap((void*)reader, sizeof *reader);
+    unlink(name);
+  }
+
+  void Map()
+  {
+    int fd = open(name, O_RDONLY);
+    ASSERT_LE(0, fd);
+    reader = (volatile struct LiveStats*)mmap(NULL, sizeof *reader, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(MAP_FAILED, (void*)reader);
+  }
+
+  char name[32];
+  volatile struct LiveStats *reader;
+};
+
+// return monotonic clock in nanoseconds
+static int64_t Now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// the segment is published ready and read only
+TEST_F(LiveStatsTests, CtorTest)
+{
+  struct stat st;
+
+  ASSERT_EQ(0, LiveStatsCtor(name));
+  Map();
+  EXPECT_EQ(LIVE_STATS_MAGIC, reader->magic);
+  EXPECT_EQ(LIVE_STATS_VERSION, reader->version);
+  EXPECT_EQ(sizeof(struct LiveStats), reader->self_size);
+  EXPECT_EQ(getpid(), reader->pid);
+  EXPECT_LT(0, reader->rss);
+  ASSERT_EQ(0, stat(name, &st));
+  EXPECT_EQ(0, st.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH));
+}
+
+// phases, traps and channels reach the reader, the sampler keeps beating
+TEST_F(LiveStatsTests, UpdateTest)
+{
+  int64_t heartbeat;
+  int64_t cpu;
+  volatile int i;
+
+  ASSERT_EQ(0, LiveStatsCtor(name));
+  Map();
+  heartbeat = reader->heartbeat;
+  cpu = reader->cpu;
+
+  PhaseTimerStart(PhaseRun);
+  EXPECT_EQ(PhaseRun, reader->phase);
+  LIVE_STATS_INC(traps[1]);
+  LIVE_STATS_INC(traps[1]);
+  EXPECT_EQ(2, reader->traps[1]);
+  LIVE_STATS_SET(channels[1].put_size, 12345);
+  EXPECT_EQ(12345, reader->channels[1].put_size);
+
+  /* burn the cpu of this ("nexe") thread over a few sampling periods */
+  while(Now() - heartbeat < 3 * LIVE_STATS_PERIOD_MS * 1000000LL)
+    for(i = 0; i < 1000; ++i);
+  EXPECT_LT(heartbeat, reader->heartbeat);
+  EXPECT_LT(cpu, reader->cpu);
+
+  LiveStatsDtor();
+  EXPECT_EQ(LIVE_STATS_DONE, reader->phase);
+  EXPECT_EQ(12345, reader->channels[1].put_size);
+  EXPECT_EQ(0, access(name, F_OK));
+}
+
+// w/o segment nothing is touched
+TEST_F(LiveStatsTests, DisabledTest)
+{
+  EXPECT_TRUE(live_stats == NULL);
+  PhaseTimerStart(PhaseRun);
+  LiveStatsDtor();
+  EXPECT_EQ(-1, LiveStatsCtor("/nonexistent/segment"));
+  EXPECT_TRUE(live_stats == NULL);
+}
+
+// the cost a trap pays for its counter
+TEST_F(LiveStatsTests, BenchTest)
+{
+  int64_t start;
+  int i;
+
+  ASSERT_EQ(0, LiveStatsCtor(name));
+  start = Now();
+  for(i = 0; i < BENCH_CALLS; ++i)
+    if(live_stats) LIVE_STATS_INC(traps[i & 3]);
+  printf("trap counter: %.2f ns per update\n", (double)(Now() - start) / BENCH_CALLS);
+  EXPECT_EQ(BENCH_CALLS / 4, live_stats->traps[0]);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -11,20 +11,25 @@
 
 /* i/o channels keywords */
 enum IOKeys {
-  Input, /* name of the input channel/file */
+  Input, /* name of the input channel/file. "fd:N" - anonymous channel (inherited memfd) */
   InputMax, /* channel/file length limit */
   InputMaxGet, /* bytes count allowed to get */
   InputMaxGetCnt, /* how many times allowed to invoke "get" syscall. n/a for mounted resiources */
   InputMaxPut, /* n/a */
   InputMaxPutCnt, /* n/a */
   InputMode, /* 0 - premounted channel, 1 - preloaded, 2 - preallocated from network */
-  Output, /* name of the output channel/file */
+  InputCodec, /* preloaded channel is packed, zerovm decodes it: "gzip". see codec.h */
+  InputRoot, /* merkle tree root of the channel data (sha256 hex). see merkle.h */
+  InputChunk, /* bytes per merkle tree leaf */
+  InputTree, /* file of the merkle tree leaves. w/o it the channel is verified whole */
+  Output, /* name of the output channel/file. "fd:N" - anonymous channel (inherited memfd) */
   OutputMax, /* channel/file length limit */
   OutputMaxGet, /* bytes count allowed to get */
   OutputMaxGetCnt, /* how many times allowed to invoke "get" syscall. n/a for mounted resiources */
   OutputMaxPut, /* bytes count allowed to put */
   OutputMaxPutCnt, /* how many times allowed to invoke "put" syscall. n/a for mounted resiources */
   OutputMode, /* 0 - premounted channel, 1 - preloaded, 2 - preallocated from network */
+  OutputCodec, /* preloaded channel is packed by zerovm: "gzip". see codec.h */
   UserLog, /* user log file name. gets/puts/e.t.c. are unlimited */
   UserLogMax, /* file length limit */
   UserMaxLogGet, /* n/a */
@@ -62,7 +67,15 @@ enum ReportKeys {
   ReportEtag, /* checksum of the user output */
   ReportUserRetCode, /* exit code of the user program */
   ReportContentType,
-  ReportXObjectMetaTag /* custom attributes set by user */
+  ReportXObjectMetaTag, /* custom attributes set by user */
+  ReportPhaseTimes, /* "phase:nanoseconds" list of zerovm session phases */
+  ReportTrapLatency, /* latency histograms of "One Ring" calls */
+  ReportChannelLatency, /* latency histograms of channels i/o */
+  ReportChannelSizes, /* calls and bytes per call size of channels i/o */
+  ReportTrapTime, /* calls, total and i/o nanoseconds of "One Ring" calls */
+  ReportUserCpuTime, /* nexe cpu time, nanoseconds */
+  ReportHostCpuTime, /* zerovm cpu time serving the nexe requests, nanoseconds */
+  ReportRuntimeMemory /* bytes held by zerovm runtime objects (vmmap, descriptors) */
 };
 
 /* zerovm control keywords */
@@ -76,12 +89,18 @@ enum Control {
   NexeEtag, /* reserved for "fast validation" */
   Timeout, /* maximum zerovm time to run */
   KillTimeout, /* zerovm time to live */
-  MemMax, /* size of memory available for nexe */
-  CPUMax, /* cpu time allotted to nexe */
+  MemMax, /* size of the nexe heap, reserved before the nexe start */
+  CPUMax, /* cpu time allotted to nexe, milliseconds */
   SyscallsMax, /* syscalls allowed nexe to invoke */
   SetupCallsMax, /* setup calls allowed nexe to invoke */
   Blob, /* blob library if it will retain */
-  CommandLine /* command line for nexe */
+  CommandLine, /* command line for nexe */
+  TrapStats, /* 1 - collect trap/channel histograms for the report */
+  MemCommit, /* 1 - commit whole MemMax before the nexe start, 0 - on demand */
+  IoRing, /* entries (power of 2) of the exit-less i/o ring, 0 - no ring */
+  EtagHash, /* hash of the output etag: md5 (default), sha256, xxh64, none */
+  ReportFormat, /* report to proxy: text (default), json, binary */
+  StatsSegment /* live statistics file (e.g. in /dev/shm) for the node agent */
 };
 
 #endif /* MANIFEST_KEYWORDS_H_ */
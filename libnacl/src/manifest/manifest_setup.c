@@ -20,6 +20,10 @@
 #include <src/manifest/manifest_parser.h>
 #include <src/manifest/manifest_setup.h>
 #include "src/service_runtime/nacl_syscall_common.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/user_heap.h"
+#include "src/manifest/io_ring.h"
+#include "src/manifest/etag.h"
 /*
  * set "prefix" (channel name) by "ch" (channel id)
  * note: prefix must have enough space to hold it
@@ -79,21 +83,14 @@ int32_t ConstructChannel(struct NaClApp *nap, enum ChannelType ch)
 }
 
 /*
- * return md5 hash of mapped _output_ file (or NULL)
+ * return etag of the _output_ file (or NULL). the hash is made while
+ * the nexe writes, the channel must be unmounted already
  */
 char* MakeEtag(struct NaClApp *nap)
 {
-//  uintptr_t addr;
-
   /* check if output file exists */
   if(!nap->manifest->user_setup->channels[OutputChannel].name) return NULL;
-  return "etag disabled";
-
-  /* calculate effective sys address from nexe address space */
-//  //### BUG!!! need additional check no assumtions!
-//  assert(nap->manifest->user_setup->channels[OutputChannel].buffer);
-//  addr = NaClUserToSys(nap, (uint32_t) nap->manifest->user_setup->channels[OutputChannel].buffer);
-//  return MD5((unsigned char*)addr, (uint32_t)nap->manifest->user_setup->channels[OutputChannel].bsize);
+  return (char*)EtagGet();
 }
 
 /*
@@ -115,26 +112,6 @@ void SetupReportSettings(struct NaClApp *nap)
   nap->manifest->report = report;
 }
 
-/*
- * return string containing answer to proxy (or NULL)
- * note: "report" must have enough space to hold a new string
- * "MAX_MANIFEST_LEN" would be enough since report is subset of master manifest
- */
-void AnswerManifestPut(struct NaClApp *nap, char *report)
-{
-  sprintf(report,
-    "ReportRetCode        =%d\n"
-    "ReportEtag           =%s\n"
-    "ReportUserRetCode    =%d\n"
-    "ReportContentType    =%s\n"
-    "ReportXObjectMetaTag =%s\n",
-    nap->manifest->report->ret_code,
-    nap->manifest->report->etag,
-    nap->manifest->report->user_ret_code,
-    nap->manifest->report->content_type,
-    nap->manifest->report->x_object_meta_tag);
-}
-
 #define TRANSET(var, str)\
   do {\
     char *p = GetValueByKey(nap, str);\
@@ -165,6 +142,7 @@ void SetupUserPolicy(struct NaClApp *nap)
   policy->cnt_setup_calls = 0;
   policy->cnt_syscalls = 0;
   policy->heap_ptr = 0; /* set user heap to NULL until it allocated */
+  policy->io_ring = 0; /* set by PreallocateIoRing() */
 
   /* clear syscallback */
   policy->syscallback = 0;
@@ -198,53 +176,42 @@ void SetupSystemPolicy(struct NaClApp *nap)
   policy->cmd_line = GetValueByKey(nap, "CommandLine");
   policy->blob = GetValueByKey(nap, "Blob");
   policy->nexe_etag = GetValueByKey(nap, "NexeEtag");
+  policy->etag_hash = GetValueByKey(nap, "EtagHash");
+  policy->report_format = GetValueByKey(nap, "ReportFormat");
+  policy->stats_segment = GetValueByKey(nap, "StatsSegment");
 
   TRANSET(policy->nexe_max, "NexeMax");
   TRANSET(policy->timeout, "Timeout");
   TRANSET(policy->kill_timeout, "KillTimeout");
+  TRANSET(policy->trap_stats, "TrapStats");
+  TRANSET(policy->mem_commit, "MemCommit");
+  TRANSET(policy->io_ring, "IoRing");
 
   nap->manifest->system_setup = policy;
 }
 
-/* ### temporary disabled
- * preallocate memory area of given size. abort if fail
+/*
+ * reserve max_mem bytes of the user heap and publish it via heap_ptr.
+ * abort if fail. w/o manifest or MemMax the break is served as before
  */
 void PreallocateUserMemory(struct NaClApp *nap)
 {
-  return; // ###
+  struct SetupList *policy;
+
+  if(nap->manifest == NULL) return;
+  policy = nap->manifest->user_setup;
+  if(policy->max_mem <= 0) return;
 
-//  struct SetupList *policy = nap->manifest->user_setup;
-//  policy->heap_ptr = NaClCommonSysMmapIntern(nap, 0, policy->max_mem, 3, 0x22, -1, 0);
-//
-//  /* why 0xfffff000? 1. 0x1000 reserved for error codes 2. it is still larger then 4gb - stack */
-//  COND_ABORT(policy->heap_ptr > 0xfffff000, "cannot preallocate memory for user\n");
+  policy->heap_ptr = UserHeapCtor(nap, policy->max_mem,
+      nap->manifest->system_setup->mem_commit ? HeapCommitEager : HeapCommitLazy);
+  COND_ABORT(policy->heap_ptr == 0, "cannot preallocate memory for user\n");
 }
 
-/*
- * user accounting. SetupList object counters
- * all accounting procedures return 0 if succes and -1 if fail
- */
+void PreallocateIoRing(struct NaClApp *nap)
+{
+  if(nap->manifest == NULL) return;
+  if(nap->manifest->system_setup->io_ring <= 0) return;
 
-/* system counters */
-#define INCNT(cnt) if(nap->manifest) {++nap->manifest->user_setup->cnt; return 0;} return -1
-#define DECNT(cnt) if(nap->manifest) {--nap->manifest->user_setup->cnt; return 0;} return -1
-
-int32_t AccountingSyscallsInc(struct NaClApp *nap) { INCNT(cnt_syscalls); }
-int32_t AccountingSyscallsDec(struct NaClApp *nap) { INCNT(cnt_syscalls); }
-int32_t AccountingMemInc(struct NaClApp *nap) { INCNT(cnt_mem); }
-int32_t AccountingMemDec(struct NaClApp *nap) { INCNT(cnt_mem); }
-int32_t AccountingSetupcallsInc(struct NaClApp *nap) { INCNT(cnt_setup_calls); }
-int32_t AccountingSetupcallsDec(struct NaClApp *nap) { INCNT(cnt_setup_calls); }
-
-/* channel counters */
-#define INCHCNT(ch, cnt) if(nap->manifest) {++nap->manifest->user_setup->channels[ch].cnt; return 0;} return -1
-#define DECHCNT(ch, cnt) if(nap->manifest) {--nap->manifest->user_setup->channels[ch].cnt; return 0;} return -1
-
-int32_t AccountingGetsInc(struct NaClApp *nap, enum ChannelType ch) { INCHCNT(ch, cnt_gets); }
-int32_t AccountingGetsDec(struct NaClApp *nap, enum ChannelType ch) { DECHCNT(ch, cnt_gets); }
-int32_t AccountingPutsInc(struct NaClApp *nap, enum ChannelType ch) { INCHCNT(ch, cnt_puts); }
-int32_t AccountingPutsDec(struct NaClApp *nap, enum ChannelType ch) { DECHCNT(ch, cnt_puts); }
-int32_t AccountingGetSizeInc(struct NaClApp *nap, enum ChannelType ch) { INCHCNT(ch, cnt_get_size); }
-int32_t AccountingGetSizeDec(struct NaClApp *nap, enum ChannelType ch) { DECHCNT(ch, cnt_get_size); }
-int32_t AccountingPutSizeInc(struct NaClApp *nap, enum ChannelType ch) { INCHCNT(ch, cnt_put_size); }
-int32_t AccountingPutSizeDec(struct NaClApp *nap, enum ChannelType ch) { DECHCNT(ch, cnt_put_size); }
+  COND_ABORT(IoRingCtor(nap, nap->manifest->system_setup->io_ring) != 0,
+      "cannot create i/o ring\n");
+}
@@ -38,11 +38,29 @@ struct SystemList
   char *nexe_etag; /* digital signature. reserved for a future "short" nexe validation */
   int32_t timeout;
   int32_t kill_timeout;
+  int32_t trap_stats; /* collect trap/channel histograms, 0 - disabled */
+  int32_t mem_commit; /* 1 - commit whole MemMax at start, 0 - as the heap grows */
+  int32_t io_ring; /* entries of the exit-less i/o ring, 0 - disabled */
+  char *etag_hash; /* hash of the output etag, NULL - default (md5) */
+  char *report_format; /* text, json or binary, NULL - default (text) */
+  char *stats_segment; /* live statistics file name, NULL - disabled */
 };
 
+/* zerovm return codes put to the report */
+enum ReportRetCodes {
+  RetCodeOk,
+  RetCodeCpuLimit, /* nexe stopped by CPUMax */
+  RetCodeTimeout, /* nexe stopped by Timeout */
+  RetCodeSyscallsLimit, /* nexe stopped by SyscallsMax */
+  RetCodeChannelError /* a channel could not be finished (e.g. the codec failed) */
+};
+
+/* exit reasons put to the report. must answer to enum "ReportRetCodes" */
+#define RET_CODE_NAMES {"ok", "cpu_limit", "timeout", "syscalls_limit", "channel_error"}
+
 struct Report
 {
-  int32_t ret_code; /* zerovm return code */
+  int32_t ret_code; /* zerovm return code, see "ReportRetCodes" */
   char *etag; /* user output memory digital signature */
   int32_t user_ret_code; /* nexe return code */
   char *content_type; /* custom user attribute */
@@ -77,11 +95,6 @@ struct Manifest
  */
 void SetupReportSettings(struct NaClApp *nap);
 
-/*
- * prepare string containing proxi requested tags
- */
-void AnswerManifestPut(struct NaClApp *nap, char *report);
-
 /*
  * construct SetupList (policy) part of manifest structure
  * note: malloc(). must be called only once
@@ -94,9 +107,6 @@ void SetupUserPolicy(struct NaClApp *nap);
  */
 void SetupSystemPolicy(struct NaClApp *nap);
 
-/* declaration: md5 digest calculation */
-char* MD5(unsigned char *buf, unsigned size);
-
 /*
  * construct i/o channel. the function contain "hardcoded" manifest keywords
  * if successful return initialized, but not mounted object, otherwise - NULL
@@ -105,27 +115,15 @@ char* MD5(unsigned char *buf, unsigned size);
 int32_t ConstructChannel(struct NaClApp *nap, enum ChannelType ch);
 
 /*
- * preallocate memory area of given size. abort if fail
+ * reserve MemMax for the user heap, set heap_ptr. abort if fail
  */
 void PreallocateUserMemory(struct NaClApp *nap);
 
-/* system counters */
-int32_t AccountingSyscallsInc(struct NaClApp *nap);
-int32_t AccountingSyscallsDec(struct NaClApp *nap);
-int32_t AccountingMemInc(struct NaClApp *nap);
-int32_t AccountingMemDec(struct NaClApp *nap);
-int32_t AccountingSetupcallsInc(struct NaClApp *nap);
-int32_t AccountingSetupcallsDec(struct NaClApp *nap);
-
-/* channel counters */
-int32_t AccountingGetsInc(struct NaClApp *nap, enum ChannelType ch);
-int32_t AccountingGetsDec(struct NaClApp *nap, enum ChannelType ch);
-int32_t AccountingPutsInc(struct NaClApp *nap, enum ChannelType ch);
-int32_t AccountingPutsDec(struct NaClApp *nap, enum ChannelType ch);
-int32_t AccountingGetSizeInc(struct NaClApp *nap, enum ChannelType ch);
-int32_t AccountingGetSizeDec(struct NaClApp *nap, enum ChannelType ch);
-int32_t AccountingPutSizeInc(struct NaClApp *nap, enum ChannelType ch);
-int32_t AccountingPutSizeDec(struct NaClApp *nap, enum ChannelType ch);
+/*
+ * create the exit-less i/o ring and start its thread. abort if fail.
+ * w/o manifest or IoRing the channels are only served by the traps
+ */
+void PreallocateIoRing(struct NaClApp *nap);
 
 EXTERN_C_END
 
@@ -0,0 +1,380 @@
+/*
+ * chunked merkle tree verification of the input channel
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_threads.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_parser.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/hash.h"
+#include "src/manifest/merkle.h"
+
+#define MERKLE_THREADS 16 /* the most cores verifying the channel */
+#define MERKLE_THREAD_STACK (64 << 10)
+
+struct Merkle
+{
+  struct PreOpenedFileDesc *channel;
+  int handle;
+  int64_t size; /* channel bytes covered by the tree */
+  int64_t chunk; /* bytes per leaf */
+  int64_t chunks;
+  unsigned char *leaves; /* the chunks digests */
+  uint64_t *verified; /* bit per chunk */
+  char *scratch; /* the chunk partly read by the nexe */
+};
+
+/* the whole channel hashing, shared by the threads */
+struct MerkleJob
+{
+  struct Merkle *m;
+  const char *buffer; /* the premapped channel, NULL - read the handle */
+  unsigned char *leaves;
+  int64_t next; /* the chunk to take */
+  volatile int error;
+};
+
+struct Merkle *merkles[CHANNELS_COUNT];
+static struct Merkle slots[CHANNELS_COUNT];
+
+/* read "size" bytes at "offset". return 0 if successful */
+static int GetAll(int handle, char *buffer, size_t size, int64_t offset)
+{
+  ssize_t n;
+
+  while(size > 0)
+  {
+    n = pread(handle, buffer, size, offset);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return -1;
+    buffer += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+/* size of the chunk "i" */
+static int64_t ChunkSize(struct Merkle *m, int64_t i)
+{
+  int64_t size = m->size - i * m->chunk;
+  return size < m->chunk ? size : m->chunk;
+}
+
+/* put the leaf of "size" bytes of "data" to "digest" */
+static void Leaf(const char *data, size_t size, unsigned char *digest)
+{
+  struct HashCtx ctx;
+
+  HashInit(&ctx, HashSha256);
+  HashUpdate(&ctx, "\0", 1);
+  HashUpdate(&ctx, data, size);
+  HashFinal(&ctx, digest);
+}
+
+void MerkleRoot(unsigned char *leaves, int64_t n, unsigned char *root)
+{
+  struct HashCtx ctx;
+  int64_t i;
+
+  if(n < 1)
+  {
+    Leaf("", 0, root);
+    return;
+  }
+
+  /* a level is put in place of the previous one */
+  for(; n > 1; n = (n + 1) / 2)
+  {
+    for(i = 0; i < n / 2; ++i)
+    {
+      HashInit(&ctx, HashSha256);
+      HashUpdate(&ctx, "\1", 1);
+      HashUpdate(&ctx, leaves + 2 * i * MERKLE_DIGEST, 2 * MERKLE_DIGEST);
+      HashFinal(&ctx, leaves + i * MERKLE_DIGEST);
+    }
+    if(n & 1)
+      memmove(leaves + i * MERKLE_DIGEST, leaves + (n - 1) * MERKLE_DIGEST, MERKLE_DIGEST);
+  }
+  memcpy(root, leaves, MERKLE_DIGEST);
+}
+
+/* the worker. hash the chunks until there are no more */
+static void WINAPI HashChunks(void *state)
+{
+  struct MerkleJob *job = state;
+  struct Merkle *m = job->m;
+  char *scratch = NULL;
+  const char *data;
+  int64_t i;
+
+  if(job->buffer == NULL)
+  {
+    scratch = malloc(m->chunk);
+    if(scratch == NULL) job->error = 1;
+  }
+
+  while(!job->error)
+  {
+    i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if(i >= m->chunks) break;
+
+    if(scratch == NULL)
+      data = job->buffer + i * m->chunk;
+    else if(GetAll(m->handle, scratch, ChunkSize(m, i), i * m->chunk) == 0)
+      data = scratch;
+    else
+    {
+      job->error = 1;
+      break;
+    }
+    Leaf(data, ChunkSize(m, i), job->leaves + i * MERKLE_DIGEST);
+  }
+  free(scratch);
+}
+
+/*
+ * put the leaves of the whole channel to "leaves". the chunks are hashed
+ * by the cores available, the caller is one of them. return 0 if successful
+ */
+static int HashChannel(struct Merkle *m, const char *buffer, unsigned char *leaves)
+{
+  struct NaClThread threads[MERKLE_THREADS - 1];
+  struct MerkleJob job;
+  int64_t n;
+  int i;
+
+  job.m = m;
+  job.buffer = buffer;
+  job.leaves = leaves;
+  job.next = 0;
+  job.error = 0;
+
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+  if(n > MERKLE_THREADS) n = MERKLE_THREADS;
+  if(n > m->chunks) n = m->chunks;
+
+  /* the nexe signals must not go to the helpers */
+  for(i = 0; i < n - 1; ++i)
+    if(!NaClThreadCreateJoinableNoSignals(&threads[i], HashChunks, &job, MERKLE_THREAD_STACK))
+      break;
+
+  HashChunks(&job);
+  while(i-- > 0)
+    NaClThreadJoin(&threads[i]);
+  return job.error ? -1 : 0;
+}
+
+/* put "hex" of MERKLE_DIGEST bytes to "digest". return 0 if successful */
+static int Unhex(const char *hex, unsigned char *digest)
+{
+  unsigned int byte;
+  int i;
+
+  if(strlen(hex) != 2 * MERKLE_DIGEST) return -1;
+  for(i = 0; i < MERKLE_DIGEST; ++i)
+  {
+    if(!isxdigit(hex[2 * i]) || !isxdigit(hex[2 * i + 1])) return -1;
+    sscanf(hex + 2 * i, "%2x", &byte);
+    digest[i] = byte;
+  }
+  return 0;
+}
+
+/* read "n" leaves from the tree file "name". return 0 if successful */
+static int LoadTree(const char *name, unsigned char *leaves, int64_t n)
+{
+  int handle = open(name, O_RDONLY);
+  int code;
+
+  if(handle < 0) return -1;
+  code = lseek(handle, 0, SEEK_END) != n * MERKLE_DIGEST
+      || GetAll(handle, (char*)leaves, n * MERKLE_DIGEST, 0) != 0;
+  close(handle);
+  return code ? -1 : 0;
+}
+
+/* return the key of the channel manifest "suffix" */
+static char *GetChannelKey(struct NaClApp *nap,
+    struct PreOpenedFileDesc *channel, const char *suffix)
+{
+  static const char *prefixes[] = CHANNEL_PREFIXES;
+  char key[64];
+
+  snprintf(key, sizeof key, "%s%s", prefixes[channel->type], suffix);
+  return GetValueByKey(nap, key);
+}
+
+int MerkleCtor(struct NaClApp *nap, struct PreOpenedFileDesc *channel)
+{
+  struct Merkle *m;
+  unsigned char root[MERKLE_DIGEST];
+  unsigned char digest[MERKLE_DIGEST];
+  unsigned char *leaves = NULL;
+  unsigned char *tree = NULL;
+  char *name = (char*)(uintptr_t)channel->name;
+  char *value;
+  char *codec;
+  int64_t i;
+  int lazy;
+  int code = -1;
+
+  /* the verification is asked by the manifest */
+  value = GetChannelKey(nap, channel, "Root");
+  if(value == NULL) return 0;
+  if(channel->type != InputChannel)
+  {
+    NaClLog(LOG_ERROR, "%s: only the input can be verified\n", name);
+    return -1;
+  }
+  if(Unhex(value, root) != 0)
+  {
+    NaClLog(LOG_ERROR, "%s: the root must be sha256 hex\n", name);
+    return -1;
+  }
+
+  m = &slots[channel->type];
+  memset(m, 0, sizeof *m);
+  m->channel = channel;
+  m->handle = channel->handle;
+  m->size = channel->fsize;
+  value = GetChannelKey(nap, channel, "Chunk");
+  m->chunk = value == NULL ? 0 : atoll(value);
+  if(m->chunk < 1)
+  {
+    NaClLog(LOG_ERROR, "%s: the chunk size is not set\n", name);
+    return -1;
+  }
+  m->chunks = m->size > 0 ? (m->size - 1) / m->chunk + 1 : 1;
+
+  /* w/o the leaves or with codec (the nexe reads the plain stream) the channel is hashed whole */
+  value = GetChannelKey(nap, channel, "Tree");
+  codec = GetChannelKey(nap, channel, "Codec");
+  lazy = value != NULL && channel->mounted == LOADED
+      && (codec == NULL || strcmp(codec, "none") == 0);
+
+  leaves = malloc(m->chunks * MERKLE_DIGEST);
+  if(value != NULL) tree = malloc(m->chunks * MERKLE_DIGEST);
+  if(leaves == NULL || (value != NULL && tree == NULL)) goto end;
+  if(value != NULL && LoadTree(value, tree, m->chunks) != 0)
+  {
+    NaClLog(LOG_ERROR, "%s: cannot load %ld leaves from %s\n", name, m->chunks, value);
+    goto end;
+  }
+
+  if(lazy)
+    memcpy(leaves, tree, m->chunks * MERKLE_DIGEST);
+  else
+  {
+    if(HashChannel(m, channel->mounted == MAPPED
+        ? (char*)NaClUserToSys(nap, (uint32_t)channel->buffer) : NULL, leaves) != 0)
+    {
+      NaClLog(LOG_ERROR, "%s: cannot hash the channel\n", name);
+      goto end;
+    }
+    for(i = 0; tree != NULL && i < m->chunks; ++i)
+      if(memcmp(leaves + i * MERKLE_DIGEST, tree + i * MERKLE_DIGEST, MERKLE_DIGEST) != 0)
+      {
+        NaClLog(LOG_ERROR, "%s: chunk %ld is corrupted\n", name, i);
+        goto end;
+      }
+  }
+
+  MerkleRoot(leaves, m->chunks, digest);
+  if(memcmp(digest, root, MERKLE_DIGEST) != 0)
+  {
+    NaClLog(LOG_ERROR, "%s: the merkle root does not match\n", name);
+    goto end;
+  }
+
+  if(lazy)
+  {
+    m->verified = calloc((m->chunks + 63) / 64, sizeof *m->verified);
+    m->scratch = malloc(m->chunk);
+    if(m->verified == NULL || m->scratch == NULL)
+    {
+      free(m->verified);
+      free(m->scratch);
+      goto end;
+    }
+    m->leaves = tree;
+    tree = NULL;
+    merkles[channel->type] = m;
+  }
+  NaClLog(2, "%s: %ld chunks %s\n", name, m->chunks, lazy ? "to verify" : "verified");
+  code = 0;
+
+end:
+  free(leaves);
+  free(tree);
+  return code;
+}
+
+void MerkleDtor(struct PreOpenedFileDesc *channel)
+{
+  struct Merkle *m = merkles[channel->type];
+
+  if(m == NULL) return;
+  merkles[channel->type] = NULL;
+  free(m->leaves);
+  free(m->verified);
+  free(m->scratch);
+}
+
+int32_t MerkleRead(struct Merkle *m, char *buffer, int32_t size, int64_t offset)
+{
+  unsigned char digest[MERKLE_DIGEST];
+  const char *data;
+  int64_t i, start, end, from, to;
+  ssize_t n;
+
+  /* the tree covers the channel as it was mounted */
+  if(offset >= m->size) return 0;
+  if(size > m->size - offset) size = m->size - offset;
+  n = pread(m->handle, buffer, (size_t)size, (off_t)offset);
+  if(n <= 0) return n;
+
+  for(i = offset / m->chunk; i <= (offset + n - 1) / m->chunk; ++i)
+  {
+    if(m->verified[i / 64] & 1ULL << i % 64) continue;
+
+    /* the chunk read whole is checked in place */
+    start = i * m->chunk;
+    end = start + ChunkSize(m, i);
+    data = buffer + (start - offset);
+    if(start < offset || end > offset + n)
+    {
+      if(GetAll(m->handle, m->scratch, end - start, start) != 0) return -CORRUPTED_DATA;
+      data = m->scratch;
+    }
+
+    Leaf(data, end - start, digest);
+    if(memcmp(digest, m->leaves + i * MERKLE_DIGEST, MERKLE_DIGEST) != 0)
+    {
+      NaClLog(LOG_ERROR, "%s: chunk %ld is corrupted\n",
+          (char*)(uintptr_t)m->channel->name, i);
+      return -CORRUPTED_DATA;
+    }
+    m->verified[i / 64] |= 1ULL << i % 64;
+
+    /* the nexe gets the bytes verified */
+    if(data == m->scratch)
+    {
+      from = start > offset ? start : offset;
+      to = end < offset + n ? end : offset + n;
+      memcpy(buffer + (from - offset), m->scratch + (from - start), to - from);
+    }
+  }
+  return n;
+}
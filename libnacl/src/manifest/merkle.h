@@ -0,0 +1,60 @@
+/*
+ * integrity of the input channel: chunked merkle tree over sha256. the
+ * manifest gives the tree root ("InputRoot", hex) and the chunk size
+ * ("InputChunk"), optionally the file of the leaves ("InputTree": the
+ * digests of the chunks, 32 bytes each, in order):
+ *
+ *   leaf = sha256(0x00 | chunk), node = sha256(0x01 | left | right)
+ *
+ * the odd node of a level goes up as is. the leaves are checked against
+ * the root when the channel is mounted. then the preloaded channel is
+ * verified lazily: a chunk is checked when TrapRead first touches it,
+ * the verified bitmap makes the following reads free. the premapped
+ * channel (and the preloaded one w/o the leaves or with codec) is
+ * verified whole before the nexe starts, by all cores
+ *
+ * note: the verified chunk is supposed to stay intact (cached object)
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+
+#ifndef MERKLE_H_
+#define MERKLE_H_
+
+#include "api/zvm.h"
+#include "src/service_runtime/sel_ldr.h"
+
+EXTERN_C_BEGIN
+
+#define MERKLE_DIGEST 32 /* sha256 */
+
+/* the lazy verification state, NULL - nothing to verify */
+struct Merkle;
+extern struct Merkle *merkles[CHANNELS_COUNT];
+
+/*
+ * check the mounted (opened, measured, premapped) "channel" against the
+ * root if the manifest gives it. return 0 if successful or there is no
+ * root, otherwise -1
+ */
+int MerkleCtor(struct NaClApp *nap, struct PreOpenedFileDesc *channel);
+
+/* drop the verification state of the channel. no-op w/o it */
+void MerkleDtor(struct PreOpenedFileDesc *channel);
+
+/*
+ * TrapRead of the channel with lazy verification. return as pread or
+ * -CORRUPTED_DATA if a chunk fails the check
+ */
+int32_t MerkleRead(struct Merkle *merkle, char *buffer, int32_t size, int64_t offset);
+
+/*
+ * put to "root" the root of the tree of "n" leaves (MERKLE_DIGEST bytes
+ * each, destroyed)
+ */
+void MerkleRoot(unsigned char *leaves, int64_t n, unsigned char *root);
+
+EXTERN_C_END
+
+#endif /* MERKLE_H_ */
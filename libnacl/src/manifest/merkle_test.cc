@@ -0,0 +1,280 @@
+/*
+ * merkle_test.cc
+ * unit test over google testing framework
+ * checks the input channel integrity verification: the root of the
+ * leaves, the lazy check of the chunks the nexe reads, the whole
+ * channel check. measures the parallel hashing of the channel
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string>
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/hash.h"
+#include "src/manifest/merkle.h"
+
+#define CHUNK 4096
+#define DATA_SIZE (10 * CHUNK + 100) /* the last chunk is short */
+#define BENCH_SIZE (256 << 20)
+
+// Test harness for the verification. the channel and tree files are temporary
+class MerkleTests : public ::testing::Test {
+ protected:
+  MerkleTests()
+  {
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    manifest.user_setup = &setup;
+    manifest.master = records;
+    app.manifest = &manifest;
+    records[0].key = (char*)"InputRoot";
+    records[0].value = root;
+    records[1].key = (char*)"InputChunk";
+    records[1].value = (char*)"4096";
+    records[2].key = (char*)"InputTree";
+    records[2].value = tree;
+    records[3].key = (char*)"InputCodec";
+    records[3].value = (char*)"none";
+    manifest.master_records = 4;
+    strcpy(name, "/tmp/merkle_testXXXXXX");
+    close(mkstemp(name));
+    strcpy(tree, "/tmp/merkle_treeXXXXXX");
+    close(mkstemp(tree));
+  }
+
+  ~MerkleTests()
+  {
+    MerkleDtor(&setup.channels[InputChannel]);
+    unlink(name);
+    unlink(tree);
+  }
+
+  // the preloaded input over the test file with "data" in it, the tree of "data"
+  struct PreOpenedFileDesc *Channel(const std::string &data, int64_t chunk)
+  {
+    struct PreOpenedFileDesc *channel = &setup.channels[InputChannel];
+    std::string leaves = Leaves(data, chunk);
+    std::string level = leaves;
+    unsigned char digest[MERKLE_DIGEST];
+    FILE *f;
+    int i;
+
+    f = fopen(name, "w");
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+    f = fopen(tree, "w");
+    fwrite(leaves.data(), 1, leaves.size(), f);
+    fclose(f);
+
+    MerkleRoot((unsigned char*)&level[0], leaves.size() / MERKLE_DIGEST, digest);
+    for(i = 0; i < MERKLE_DIGEST; ++i)
+      sprintf(root + 2 * i, "%02x", digest[i]);
+
+    channel->name = (uint64_t)(uintptr_t)name;
+    channel->type = InputChannel;
+    channel->mounted = LOADED;
+    channel->handle = open(name, O_RDWR);
+    channel->fsize = data.size();
+    channel->max_size = 1LL << 40;
+    return channel;
+  }
+
+  // sha256 of 0x00 | chunk per chunk of "data"
+  static std::string Leaves(const std::string &data, int64_t chunk)
+  {
+    std::string leaves;
+    unsigned char digest[MERKLE_DIGEST];
+    struct HashCtx ctx;
+    size_t i = 0;
+
+    do
+    {
+      HashInit(&ctx, HashSha256);
+      HashUpdate(&ctx, "\0", 1);
+      HashUpdate(&ctx, data.data() + i, std::min<size_t>(chunk, data.size() - i));
+      HashFinal(&ctx, digest);
+      leaves.append((char*)digest, MERKLE_DIGEST);
+      i += chunk;
+    } while(i < data.size());
+    return leaves;
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+  struct MasterManifestRecord records[4];
+  char name[32];
+  char tree[32];
+  char root[2 * MERKLE_DIGEST + 1];
+};
+
+// "size" bytes of the channel data
+static std::string Data(int size)
+{
+  std::string data(size, '\0');
+  uint32_t x = 1;
+  int i;
+
+  for(i = 0; i < size; ++i)
+  {
+    x = x * 1103515245 + 12345;
+    data[i] = x >> 24;
+  }
+  return data;
+}
+
+// the odd node goes up as is, the nodes are sha256(0x01 | left | right)
+TEST_F(MerkleTests, RootTest)
+{
+  std::string leaves = Leaves(Data(3 * CHUNK), CHUNK);
+  unsigned char expected[MERKLE_DIGEST];
+  unsigned char digest[MERKLE_DIGEST];
+  struct HashCtx ctx;
+
+  HashInit(&ctx, HashSha256);
+  HashUpdate(&ctx, "\1", 1);
+  HashUpdate(&ctx, leaves.data(), 2 * MERKLE_DIGEST);
+  HashFinal(&ctx, expected);
+  HashInit(&ctx, HashSha256);
+  HashUpdate(&ctx, "\1", 1);
+  HashUpdate(&ctx, expected, MERKLE_DIGEST);
+  HashUpdate(&ctx, leaves.data() + 2 * MERKLE_DIGEST, MERKLE_DIGEST);
+  HashFinal(&ctx, expected);
+
+  MerkleRoot((unsigned char*)&leaves[0], 3, digest);
+  EXPECT_EQ(0, memcmp(expected, digest, MERKLE_DIGEST));
+
+  /* one leaf is the root */
+  leaves = Leaves(Data(100), CHUNK);
+  memcpy(expected, leaves.data(), MERKLE_DIGEST);
+  MerkleRoot((unsigned char*)&leaves[0], 1, digest);
+  EXPECT_EQ(0, memcmp(expected, digest, MERKLE_DIGEST));
+}
+
+// w/o root the channel is not touched, bad root or leaves fail
+TEST_F(MerkleTests, CtorTest)
+{
+  std::string data = Data(DATA_SIZE);
+  struct PreOpenedFileDesc *channel = Channel(data, CHUNK);
+
+  manifest.master_records = 0;
+  EXPECT_EQ(0, MerkleCtor(&app, channel));
+  EXPECT_TRUE(merkles[InputChannel] == NULL);
+  manifest.master_records = 4;
+
+  /* the chunk size the tree was not made with */
+  records[1].value = (char*)"8192";
+  EXPECT_EQ(-1, MerkleCtor(&app, channel));
+  records[1].value = (char*)"0";
+  EXPECT_EQ(-1, MerkleCtor(&app, channel));
+  records[1].value = (char*)"4096";
+
+  /* the root of other data */
+  root[0] = root[0] == '0' ? '1' : '0';
+  EXPECT_EQ(-1, MerkleCtor(&app, channel));
+  root[10] = 'x';
+  EXPECT_EQ(-1, MerkleCtor(&app, channel));
+  EXPECT_TRUE(merkles[InputChannel] == NULL);
+  close(channel->handle);
+}
+
+// the chunks are checked as the nexe reads them, once
+TEST_F(MerkleTests, LazyTest)
+{
+  std::string data = Data(DATA_SIZE);
+  struct PreOpenedFileDesc *channel = Channel(data, CHUNK);
+  char buffer[3 * CHUNK];
+  int handle;
+
+  ASSERT_EQ(0, MerkleCtor(&app, channel));
+  ASSERT_TRUE(merkles[InputChannel] != NULL);
+
+  /* parts of the chunks 0 and 1, the whole chunk 2 */
+  ASSERT_EQ(2 * CHUNK, MerkleRead(merkles[InputChannel], buffer, 2 * CHUNK, CHUNK / 2));
+  EXPECT_EQ(0, memcmp(buffer, data.data() + CHUNK / 2, 2 * CHUNK));
+  ASSERT_EQ(CHUNK, MerkleRead(merkles[InputChannel], buffer, CHUNK, 2 * CHUNK));
+  EXPECT_EQ(0, memcmp(buffer, data.data() + 2 * CHUNK, CHUNK));
+
+  /* the short last chunk, the read is cut at the end */
+  ASSERT_EQ(100, MerkleRead(merkles[InputChannel], buffer, CHUNK, 10 * CHUNK));
+  EXPECT_EQ(0, memcmp(buffer, data.data() + 10 * CHUNK, 100));
+  EXPECT_EQ(0, MerkleRead(merkles[InputChannel], buffer, CHUNK, DATA_SIZE));
+
+  /* the verified chunks are not checked again, the others fail */
+  handle = open(name, O_RDWR);
+  ASSERT_EQ(1, pwrite(handle, "#", 1, CHUNK));
+  ASSERT_EQ(1, pwrite(handle, "#", 1, 5 * CHUNK + 7));
+  close(handle);
+  EXPECT_EQ(CHUNK, MerkleRead(merkles[InputChannel], buffer, CHUNK, CHUNK));
+  EXPECT_EQ(-CORRUPTED_DATA, MerkleRead(merkles[InputChannel], buffer, 10, 5 * CHUNK));
+  EXPECT_EQ(-CORRUPTED_DATA, MerkleRead(merkles[InputChannel], buffer, 3 * CHUNK, 4 * CHUNK));
+  EXPECT_EQ(CHUNK, MerkleRead(merkles[InputChannel], buffer, CHUNK, 6 * CHUNK));
+
+  MerkleDtor(channel);
+  EXPECT_TRUE(merkles[InputChannel] == NULL);
+  close(channel->handle);
+}
+
+// w/o the leaves the channel is checked whole, nothing is left to verify
+TEST_F(MerkleTests, WholeTest)
+{
+  std::string data = Data(DATA_SIZE);
+  struct PreOpenedFileDesc *channel = Channel(data, CHUNK);
+  int handle;
+
+  manifest.master_records = 2;
+  EXPECT_EQ(0, MerkleCtor(&app, channel));
+  EXPECT_TRUE(merkles[InputChannel] == NULL);
+
+  /* with codec the leaves given are checked against the data */
+  manifest.master_records = 4;
+  records[3].value = (char*)"gzip";
+  EXPECT_EQ(0, MerkleCtor(&app, channel));
+  EXPECT_TRUE(merkles[InputChannel] == NULL);
+
+  handle = open(name, O_RDWR);
+  ASSERT_EQ(1, pwrite(handle, "#", 1, 9 * CHUNK));
+  close(handle);
+  EXPECT_EQ(-1, MerkleCtor(&app, channel));
+  manifest.master_records = 2;
+  EXPECT_EQ(-1, MerkleCtor(&app, channel));
+  close(channel->handle);
+}
+
+// return monotonic clock in nanoseconds
+static int64_t Now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// the whole channel is hashed by all cores
+TEST_F(MerkleTests, WholeBenchTest)
+{
+  struct PreOpenedFileDesc *channel = Channel(Data(BENCH_SIZE), 1 << 20);
+  int64_t start;
+
+  records[1].value = (char*)"1048576";
+  manifest.master_records = 2;
+  start = Now();
+  ASSERT_EQ(0, MerkleCtor(&app, channel));
+  printf("merkle whole channel: %.1f MB/s\n", BENCH_SIZE / 1e6 / ((Now() - start) / 1e9));
+  close(channel->handle);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -6,7 +6,11 @@
  *      Author: d'b
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 /* ### remove the junk */
 #include "src/service_runtime/include/bits/mman.h"
@@ -21,6 +25,9 @@
 /**/
 
 #include "src/manifest/mount_channel.h"
+#include "src/manifest/etag.h"
+#include "src/manifest/codec.h"
+#include "src/manifest/merkle.h"
 
 /*
  * mount given channel (must be constructed) with a given mode/attributes
@@ -54,6 +61,25 @@ int MountChannel(struct NaClApp *nap, enum ChannelType ch)
   return 0;
 }
 
+/*
+ * finalize given channel mounted with MountChannel()
+ */
+int UnmountChannel(struct NaClApp *nap, enum ChannelType ch)
+{
+  struct PreOpenedFileDesc *channel = &nap->manifest->user_setup->channels[ch];
+  int code = CodecDtor(channel);
+
+  MerkleDtor(channel);
+  if(channel->mounted == MAPPED) UnmapChannel(nap, channel);
+  else if(channel->mounted == LOADED && channel->name
+      && (channel->type == OutputChannel || channel->type == LogChannel))
+  {
+    if(channel->type == OutputChannel) EtagUnload(channel->handle);
+    SealChannel(channel);
+  }
+  return code;
+}
+
 /*
  * return size of given file or -1 (max_size) if fail
  */
@@ -70,3 +96,71 @@ uint64_t GetFileSize(const char *name)
   close(handle);
   return i < 0 ? -1 : fs.st_size;
 }
+
+/*
+ * return descriptor of the anonymous channel ("fd:N" name) or -1 if
+ * the channel is a file
+ */
+int GetChannelFd(const struct PreOpenedFileDesc *channel)
+{
+  const char *name = (const char*)(uintptr_t)channel->name;
+  char *end;
+  long fd;
+
+  if(!name || strncmp(name, CHANNEL_FD_PREFIX, sizeof CHANNEL_FD_PREFIX - 1)) return -1;
+  name += sizeof CHANNEL_FD_PREFIX - 1;
+  fd = strtol(name, &end, 10);
+  if(end == name || *end || fd < 0 || fd > INT_MAX) return -1;
+  return fd;
+}
+
+/*
+ * open the channel file with "flags" or duplicate the inherited descriptor
+ * of the anonymous channel. return the handle or -1 if fail
+ */
+int OpenChannel(const struct PreOpenedFileDesc *channel, int flags)
+{
+  int fd = GetChannelFd(channel);
+  int mode;
+
+  if(fd < 0) return open((char*)(uintptr_t)channel->name, flags, S_IRWXU);
+
+  /* the launcher must give the access the channel needs */
+  mode = fcntl(fd, F_GETFL);
+  if(mode < 0) return -1;
+  if((flags & O_ACCMODE) != O_RDONLY && (mode & O_ACCMODE) != O_RDWR) return -1;
+
+#ifdef F_GET_SEALS
+  /* the producer seals the finished channel */
+  if(channel->type == InputChannel && !(fcntl(fd, F_GET_SEALS) & F_SEAL_WRITE))
+    NaClLog(LOG_WARNING, "channel %s is not sealed\n", (char*)(uintptr_t)channel->name);
+#endif
+
+  return dup(fd);
+}
+
+/*
+ * return size of the opened channel or -1 (max_size) if fail
+ */
+uint64_t GetChannelSize(const struct PreOpenedFileDesc *channel)
+{
+  struct stat fs;
+  return fstat(channel->handle, &fs) < 0 ? -1 : fs.st_size;
+}
+
+/*
+ * seal the finished anonymous channel: neither data nor size can be
+ * changed anymore. files are not touched. the launcher must create the
+ * channel with MFD_ALLOW_SEALING, writable shared maps must be gone
+ */
+void SealChannel(const struct PreOpenedFileDesc *channel)
+{
+  int fd = GetChannelFd(channel);
+
+  if(fd < 0) return;
+#ifdef F_ADD_SEALS
+  if(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0)
+    return;
+#endif
+  NaClLog(LOG_ERROR, "cannot seal channel %s\n", (char*)(uintptr_t)channel->name);
+}
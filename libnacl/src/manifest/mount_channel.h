@@ -12,6 +12,14 @@
 #include "src/service_runtime/sel_ldr.h"
 
 EXTERN_C_BEGIN
+
+/*
+ * anonymous channel name: "fd:N", where N is the descriptor inherited from
+ * the launcher (a memfd shared by the chained sandboxes). the producer maps
+ * it as any output and seals it at exit, the consumer maps it read only
+ */
+#define CHANNEL_FD_PREFIX "fd:"
+
 /*
  * return zvm preopened file descriptor by channel number
  */
@@ -29,6 +37,29 @@ int MountChannel(struct NaClApp *nap, enum ChannelType ch);
  */
 uint64_t GetFileSize(const char *name);
 
+/*
+ * return descriptor of the anonymous channel ("fd:N" name) or -1 if
+ * the channel is a file
+ */
+int GetChannelFd(const struct PreOpenedFileDesc *channel);
+
+/*
+ * open the channel file with "flags" or duplicate the inherited descriptor
+ * of the anonymous channel. return the handle or -1 if fail
+ */
+int OpenChannel(const struct PreOpenedFileDesc *channel, int flags);
+
+/*
+ * return size of the opened channel or -1 (max_size) if fail
+ */
+uint64_t GetChannelSize(const struct PreOpenedFileDesc *channel);
+
+/*
+ * seal the finished anonymous output channel: neither data nor size can
+ * be changed anymore. no-op for files
+ */
+void SealChannel(const struct PreOpenedFileDesc *channel);
+
 /*
  * preload given file (channel). return 0 if success, otherwise negative errcode
  */
@@ -39,6 +70,20 @@ int PreloadChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
  */
 int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
 
+/*
+ * unmap output/log channel. only pages written by nexe are synced,
+ * the file is trimmed to the data produced
+ */
+void UnmapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
+
+/*
+ * finalize given channel mounted with MountChannel(). for now only
+ * premapped output channels, anonymous output channels and channels
+ * with codec need it. return 0 if successful, -1 if the channel is
+ * broken (the codec failed)
+ */
+int UnmountChannel(struct NaClApp *nap, enum ChannelType ch);
+
 /*
  * preallocate given network channel. return 0 if success, otherwise negative errcode
  */
@@ -0,0 +1,123 @@
+/*
+ * mount_channel_test.cc
+ * unit test over google testing framework
+ * checks the anonymous ("fd:N") channels: name parsing, the access the
+ * inherited memfd gives, size and the seal put to the finished output
+ *
+ *  Created on: Jan 21, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/mount_channel.h"
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+// Test harness for anonymous channels. the memfd is what the launcher gives
+class MountChannelTests : public ::testing::Test {
+ protected:
+  MountChannelTests()
+  {
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    manifest.user_setup = &setup;
+    app.manifest = &manifest;
+    memfd = syscall(SYS_memfd_create, "mount_channel_test", MFD_ALLOW_SEALING);
+    snprintf(name, sizeof name, "fd:%d", memfd);
+  }
+
+  ~MountChannelTests()
+  {
+    close(memfd);
+  }
+
+  // construct the channel of "type" named "channel_name"
+  struct PreOpenedFileDesc *Channel(enum ChannelType type, const char *channel_name)
+  {
+    struct PreOpenedFileDesc *channel = &setup.channels[type];
+    channel->name = (uint64_t)(uintptr_t)channel_name;
+    channel->type = type;
+    channel->mounted = LOADED;
+    channel->handle = -1;
+    return channel;
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+  char name[32];
+  int memfd;
+};
+
+// only "fd:" followed by a number is the anonymous channel
+TEST_F(MountChannelTests, GetChannelFdTest)
+{
+  ASSERT_LE(0, memfd);
+  EXPECT_EQ(memfd, GetChannelFd(Channel(InputChannel, name)));
+  EXPECT_EQ(5, GetChannelFd(Channel(InputChannel, "fd:5")));
+  EXPECT_EQ(-1, GetChannelFd(Channel(InputChannel, "fd:")));
+  EXPECT_EQ(-1, GetChannelFd(Channel(InputChannel, "fd:5x")));
+  EXPECT_EQ(-1, GetChannelFd(Channel(InputChannel, "fd:-5")));
+  EXPECT_EQ(-1, GetChannelFd(Channel(InputChannel, "/tmp/fd:5")));
+  EXPECT_EQ(-1, GetChannelFd(Channel(InputChannel, NULL)));
+}
+
+// the channel is opened as a duplicate, read only descriptor cannot be output
+TEST_F(MountChannelTests, OpenChannelTest)
+{
+  struct PreOpenedFileDesc *channel = Channel(OutputChannel, name);
+  char ro_name[32];
+  int ro;
+
+  ASSERT_EQ(0, ftruncate(memfd, 100));
+  channel->handle = OpenChannel(channel, O_RDWR | O_CREAT);
+  ASSERT_LE(0, channel->handle);
+  EXPECT_NE(memfd, channel->handle);
+  EXPECT_EQ(100u, GetChannelSize(channel));
+  close(channel->handle);
+
+  snprintf(ro_name, sizeof ro_name, "/proc/self/fd/%d", memfd);
+  ro = open(ro_name, O_RDONLY);
+  ASSERT_LE(0, ro);
+  snprintf(ro_name, sizeof ro_name, "fd:%d", ro);
+  EXPECT_EQ(-1, OpenChannel(Channel(OutputChannel, ro_name), O_RDWR | O_CREAT));
+  channel = Channel(InputChannel, ro_name);
+  channel->handle = OpenChannel(channel, O_RDONLY);
+  EXPECT_LE(0, channel->handle);
+  close(channel->handle);
+  close(ro);
+}
+
+// the finished output is sealed: cannot be written, resized or mapped for write
+TEST_F(MountChannelTests, SealChannelTest)
+{
+  struct PreOpenedFileDesc *channel = Channel(OutputChannel, name);
+
+  channel->handle = OpenChannel(channel, O_RDWR | O_CREAT);
+  ASSERT_EQ(5, pwrite(channel->handle, "hello", 5, 0));
+  UnmountChannel(&app, OutputChannel);
+  close(channel->handle);
+
+  EXPECT_EQ(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL,
+      fcntl(memfd, F_GET_SEALS));
+  EXPECT_EQ(-1, pwrite(memfd, "x", 1, 0));
+  EXPECT_EQ(-1, ftruncate(memfd, 0));
+  EXPECT_EQ(MAP_FAILED, mmap(NULL, 5, PROT_WRITE, MAP_SHARED, memfd, 0));
+  EXPECT_NE(MAP_FAILED, mmap(NULL, 5, PROT_READ, MAP_PRIVATE, memfd, 0));
+}
+
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
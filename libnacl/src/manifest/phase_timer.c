@@ -0,0 +1,61 @@
+/*
+ * startup/teardown phase profiler
+ *
+ *  Created on: Jan 12, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/manifest/phase_timer.h"
+#include "src/manifest/live_stats.h"
+
+#define NANOS_PER_SECOND 1000000000LL
+
+static int64_t phase_start[PHASES_COUNT];
+static int64_t phase_total[PHASES_COUNT];
+
+/* return monotonic time in nanoseconds */
+static int64_t MonotonicNow()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * NANOS_PER_SECOND + t.tv_nsec;
+}
+
+void PhaseTimerStart(enum SessionPhase phase)
+{
+  if(phase >= PHASES_COUNT) return;
+  phase_start[phase] = MonotonicNow();
+  if(live_stats) LIVE_STATS_SET(phase, phase);
+}
+
+void PhaseTimerStop(enum SessionPhase phase)
+{
+  if(phase >= PHASES_COUNT || !phase_start[phase]) return;
+  phase_total[phase] += MonotonicNow() - phase_start[phase];
+  phase_start[phase] = 0;
+  NaClLog(3, "phase %d took %ld ns\n", phase, phase_total[phase]);
+}
+
+int64_t PhaseTimerGet(enum SessionPhase phase)
+{
+  return phase < PHASES_COUNT ? phase_total[phase] : 0;
+}
+
+int PhaseTimerToString(char *buf, int size)
+{
+  char *names[] = PHASE_NAMES;
+  int len = 0;
+  int i;
+
+  if(size < 1) return 0;
+  *buf = '\0';
+
+  for(i = 0; i < PHASES_COUNT && len < size; ++i)
+    len += snprintf(buf + len, size - len, "%s%s:%ld",
+        i ? "," : "", names[i], phase_total[i]);
+
+  return len < size ? len : size - 1;
+}
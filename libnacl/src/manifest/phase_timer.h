@@ -0,0 +1,55 @@
+/*
+ * startup/teardown phase profiler. every phase of zerovm session is
+ * measured with monotonic clock (nanoseconds) and the result is put to
+ * the report, so the proxy can attribute latency w/o debug logging
+ *
+ *  Created on: Jan 12, 2012
+ *      Author: d'b
+ */
+
+#ifndef PHASE_TIMER_H_
+#define PHASE_TIMER_H_
+
+#include <stdint.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* zerovm session phases in order of appearance */
+enum SessionPhase {
+  PhaseInit, /* modules initialization, command line */
+  PhaseManifest, /* manifest parsing, policies setup */
+  PhaseQualify, /* platform qualification */
+  PhaseLoad, /* nexe snapshot and load (validation included) */
+  PhaseValidate, /* nexe validation only */
+  PhaseChannels, /* channels construction and mounting */
+  PhasePreallocate, /* user memory preallocation */
+  PhaseRun, /* nexe run time */
+  PhaseUnmount, /* channels unmount (sync, trim, etag), report settings */
+  PhaseTeardown /* report writing and finalization. only logged */
+};
+
+#define PHASES_COUNT (PhaseTeardown + 1)
+
+/* names must answer to enum "SessionPhase" */
+#define PHASE_NAMES {"init", "manifest", "qualify", "load", "validate",\
+  "channels", "preallocate", "run", "unmount", "teardown"}
+
+/* start (or resume) given phase */
+void PhaseTimerStart(enum SessionPhase phase);
+
+/* stop given phase and add elapsed time to its total */
+void PhaseTimerStop(enum SessionPhase phase);
+
+/* return total time of given phase in nanoseconds */
+int64_t PhaseTimerGet(enum SessionPhase phase);
+
+/*
+ * put "name:nanoseconds" pairs separated with comma to the buffer
+ * return number of written characters (w/o ending zero)
+ */
+int PhaseTimerToString(char *buf, int size);
+
+EXTERN_C_END
+
+#endif /* PHASE_TIMER_H_ */
@@ -27,6 +27,9 @@
 #include "src/platform/nacl_log.h"
 #include <src/manifest/preload.h>
 #include "src/manifest/mount_channel.h"
+#include "src/manifest/etag.h"
+#include "src/manifest/codec.h"
+#include "src/manifest/merkle.h"
 
 /* ### remove code doubling
  * infere file open flags by channel prefix
@@ -64,15 +67,23 @@ int PreloadChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
 
   /* open file */
   // ### add O_DIRECT needs #define _GNU_SOURCE
-  channel->handle = open((char*)channel->name, GetChannelOpenFlags(channel), S_IRWXU);
+  channel->handle = OpenChannel(channel, GetChannelOpenFlags(channel));
   COND_ABORT(channel->handle < 0, "channel open error\n");
 
   /* check if given file in bounds of manifest limits */
-  channel->fsize = GetFileSize((char*)channel->name);
+  channel->fsize = GetChannelSize(channel);
+  if(channel->type == OutputChannel)
+    COND_ABORT(EtagCtor(nap, channel), "cannot start output etag\n");
   PreallocateChannel(channel);
   COND_ABORT(channel->max_size < channel->fsize,
              "channel legnth exceeded policy limit\n");
 
+  /* the input is checked against the manifest merkle root */
+  COND_ABORT(MerkleCtor(nap, channel), "channel integrity check failed\n");
+
+  /* the nexe gets the plain stream of the packed channel */
+  COND_ABORT(CodecCtor(nap, channel), "cannot start channel codec\n");
+
   /* mounting finalization */
   channel->bsize = -1; /* will be provided by user */
   return 0;
@@ -9,6 +9,9 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "src/service_runtime/include/bits/mman.h"
 #include "src/service_runtime/sel_ldr.h"
@@ -22,6 +25,8 @@
 #include "src/desc/nacl_desc_io.h"
 #include "src/service_runtime/nacl_syscall_common.h"
 #include "src/manifest/mount_channel.h"
+#include "src/manifest/etag.h"
+#include "src/manifest/merkle.h"
 
 /* ### remove code doubling
  * infere file open flags by channel prefix
@@ -70,14 +75,129 @@ static void PreallocateChannel(struct PreOpenedFileDesc* channel)
   }
 }
 
+/*
+ * dirty pages tracking for the output channels. pages written by nexe
+ * are told by the soft-dirty bit of /proc/self/pagemap, cleared after
+ * the channel is mapped. w/o soft-dirty support the present bit is used
+ * (pages nexe touched), w/o pagemap - the page cache residency (mincore).
+ * the dirty pages only choose what to sync: a page written back and
+ * reclaimed (or swapped out) has no pte and looks clean, so the end of
+ * the data is taken from the file itself
+ */
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_SOFT_DIRTY (1ULL << 55)
+#define PAGEMAP_BATCH 512
+
+static int soft_dirty; /* soft-dirty bits are cleared and valid */
+static volatile char soft_dirty_probe;
+
+/*
+ * forget all written pages. nonzero if soft-dirty tracking is available.
+ * kernels w/o soft-dirty accept the clear, so a written probe is checked
+ * note: the clear resets the soft-dirty bits of the whole process, not
+ * only of the channel. nothing else here uses them, and all the output
+ * channels are mapped (and cleared) before the nexe starts
+ */
+static int ClearSoftDirty()
+{
+  int handle = open("/proc/self/clear_refs", O_WRONLY);
+  uint64_t entry = 0;
+  int ok;
+
+  if(handle < 0) return 0;
+  ok = write(handle, "4", 1) == 1;
+  close(handle);
+  if(!ok) return 0;
+
+  soft_dirty_probe = 1;
+  handle = open("/proc/self/pagemap", O_RDONLY);
+  if(handle < 0) return 0;
+  ok = pread(handle, &entry, sizeof entry,
+      (uintptr_t)&soft_dirty_probe / NACL_PAGESIZE * sizeof entry) == sizeof entry;
+  close(handle);
+  return ok && (entry & PAGEMAP_SOFT_DIRTY) != 0;
+}
+
+/*
+ * mark pages of [addr, addr + size) written since the channel was mapped
+ * in "dirty" (one byte per page). addr must be page aligned
+ */
+static void GetDirtyPages(uintptr_t addr, size_t size, unsigned char *dirty)
+{
+  uint64_t entries[PAGEMAP_BATCH];
+  uint64_t mask = soft_dirty ? PAGEMAP_SOFT_DIRTY : PAGEMAP_PRESENT;
+  size_t npages = (size + NACL_PAGESIZE - 1) / NACL_PAGESIZE;
+  size_t i, j, n;
+  int handle;
+
+  handle = open("/proc/self/pagemap", O_RDONLY);
+  if(handle < 0)
+  {
+    if(mincore((void*)addr, size, dirty) != 0) memset(dirty, 1, npages);
+    for(i = 0; i < npages; ++i) dirty[i] &= 1;
+    return;
+  }
+
+  for(i = 0; i < npages; i += n)
+  {
+    n = npages - i < PAGEMAP_BATCH ? npages - i : PAGEMAP_BATCH;
+    if(pread(handle, entries, n * sizeof *entries,
+        (addr / NACL_PAGESIZE + i) * sizeof *entries) != (ssize_t)(n * sizeof *entries))
+    {
+      /* cannot tell, everything is dirty */
+      memset(dirty + i, 1, npages - i);
+      break;
+    }
+    for(j = 0; j < n; ++j)
+      dirty[i + j] = (entries[j] & mask) != 0;
+  }
+  close(handle);
+}
+
+/*
+ * mark pages of the first "size" bytes of the channel file holding data
+ * in "data" (one byte per page) and return the end of the last data
+ * extent, not above "size". the extents are told by SEEK_DATA/SEEK_HOLE,
+ * so the page written back and reclaimed is found. the file system w/o
+ * holes support gives the whole file as data, if the extents cannot be
+ * read at all the whole channel is data too. the end is block granular
+ */
+static size_t GetDataPages(int handle, size_t size, unsigned char *data)
+{
+  size_t npages = (size + NACL_PAGESIZE - 1) / NACL_PAGESIZE;
+  off_t start, end = 0;
+  size_t last = 0;
+  size_t page;
+
+  memset(data, 0, npages);
+  while((size_t)end < size)
+  {
+    start = lseek(handle, end, SEEK_DATA);
+    if(start < 0 && errno == ENXIO) break;
+    if(start < 0) goto whole;
+    if((size_t)start >= size) break;
+    end = lseek(handle, start, SEEK_HOLE);
+    if(end < 0) goto whole;
+    if((size_t)end > size) end = size;
+    for(page = start / NACL_PAGESIZE; page * NACL_PAGESIZE < (size_t)end; ++page)
+      data[page] = 1;
+    last = end;
+  }
+  return last;
+
+whole:
+  memset(data, 1, npages);
+  return size;
+}
+
 /*
  * premap given file (channel). return 0 if success, otherwise negative errcode
- * note: malloc()
+ * note: host descriptor is taken from nap->host_descs
  */
 int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
 {
   int desc;
-  struct NaClHostDesc *hd = malloc(sizeof(*hd));
+  struct NaClHostDesc *hd = NaClSlabAlloc(&nap->host_descs, sizeof(*hd));
 
   /* debug checks */
   COND_ABORT(!hd, "cannot allocate memory to hold channel descriptor\n");
@@ -86,23 +206,32 @@ int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
   COND_ABORT(!channel->name, "cannot resolve channel name\n");
 
   /* open file */
-  channel->handle = open((char*)channel->name, GetChannelOpenFlags(channel), S_IRWXU);
+  channel->handle = OpenChannel(channel, GetChannelOpenFlags(channel));
   COND_ABORT(channel->handle < 0, "channel open error\n");
 
   /* check if given file in bounds of manifest limits */
-  channel->fsize = GetFileSize((char*)channel->name);
+  channel->fsize = GetChannelSize(channel);
+  if(channel->type == OutputChannel)
+    COND_ABORT(EtagCtor(nap, channel), "cannot start output etag\n");
   PreallocateChannel(channel);
   COND_ABORT(channel->max_size < channel->fsize, "channel legnth exceeded policy limit\n");
 
   /* construct nacl descriptor */
   hd->d = channel->handle;
-  desc = NaClSetAvail(nap, ((struct NaClDesc *) NaClDescIoDescMake(hd)));
+  desc = NaClSetAvail(nap, ((struct NaClDesc *) NaClDescIoDescMakeSlab(hd, &nap->host_descs)));
 
   /* map whole file into the memory. address cannot be higher than stack */
   channel->buffer = NaClCommonSysMmapIntern(nap, NULL, channel->fsize,
       GetChannelMapProt(channel), GetChannelMapFlags(channel), desc, 0);
   COND_ABORT((uint32_t)channel->buffer > 0xFF000000, "channel map error\n");
 
+  /* the input is checked against the manifest merkle root by all cores */
+  COND_ABORT(MerkleCtor(nap, channel), "channel integrity check failed\n");
+
+  /* start tracking pages nexe writes */
+  if(channel->type == OutputChannel || channel->type == LogChannel)
+    soft_dirty = ClearSoftDirty();
+
 
   /* mounting finalization */
   close(channel->handle);
@@ -111,3 +240,73 @@ int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
 
   return 0;
 }
+
+/*
+ * unmap output or log channel. only the pages nexe has written are
+ * synced and the file is trimmed to the data produced: asciiz string
+ * for the log, up to the end of the last data extent of the file for
+ * the output (the output is page granular, the tail of the last page is
+ * kept as is). the file is never cut below a page which may have been
+ * written: the preexisting data nexe did not touch is kept too, only
+ * the holes of the preallocated tail go. anonymous channel is sealed
+ */
+void UnmapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
+{
+  char *buf;
+  unsigned char *dirty;
+  unsigned char *data;
+  size_t size, npages, i, j;
+  int fd, handle;
+
+  if(channel->mounted != MAPPED || !channel->buffer || channel->bsize <= 0) return;
+  if(channel->type != OutputChannel && channel->type != LogChannel) return;
+
+  buf = (char*)NaClUserToSys(nap, (uint32_t)channel->buffer);
+  npages = ((size_t)channel->bsize + NACL_PAGESIZE - 1) / NACL_PAGESIZE;
+  dirty = malloc(2 * npages);
+  COND_ABORT(!dirty, "cannot allocate channel dirty map\n");
+  data = dirty + npages;
+  GetDirtyPages((uintptr_t)buf, channel->bsize, dirty);
+
+  /* write back the dirty ranges, so the file has all the data. anonymous channel has no storage */
+  fd = GetChannelFd(channel);
+  for(i = 0; fd < 0 && i < npages; i = j)
+  {
+    for(; i < npages && !dirty[i]; ++i);
+    for(j = i; j < npages && dirty[j]; ++j);
+    if(i < j && msync(buf + i * NACL_PAGESIZE, (j - i) * NACL_PAGESIZE, MS_SYNC))
+      NaClLog(LOG_ERROR, "cannot sync channel %s\n", (char*)channel->name);
+  }
+
+  /* find the data. dirty page is the data even if the file does not tell it yet */
+  handle = fd < 0 ? open((char*)channel->name, O_RDONLY) : fd;
+  if(handle < 0)
+  {
+    NaClLog(LOG_ERROR, "cannot read extents of channel %s\n", (char*)channel->name);
+    memset(data, 1, npages);
+    size = channel->bsize;
+  }
+  else
+    size = GetDataPages(handle, channel->bsize, data);
+  for(i = 0; i < npages; ++i)
+  {
+    data[i] |= dirty[i];
+    if(data[i] && (i + 1) * NACL_PAGESIZE > size) size = (i + 1) * NACL_PAGESIZE;
+  }
+  if(size > (size_t)channel->bsize) size = channel->bsize;
+  if(channel->type == LogChannel) size = strnlen(buf, channel->bsize);
+
+  /* trim the file. pages above the data will not be written back */
+  if(fd < 0 ? truncate((char*)channel->name, size) : ftruncate(fd, size))
+    NaClLog(LOG_ERROR, "cannot trim channel %s\n", (char*)channel->name);
+  if(handle >= 0 && handle != fd) close(handle);
+
+  NaClLog(3, "channel %s trimmed to %lu bytes\n", (char*)channel->name, size);
+  if(channel->type == OutputChannel) EtagUnmap(buf, size, data);
+  free(dirty);
+  munmap(buf, channel->bsize);
+  SealChannel(channel); /* the map is gone, write seal is allowed */
+  channel->fsize = size;
+  channel->bsize = 0;
+  channel->buffer = 0;
+}
@@ -10,6 +10,8 @@
 #include "src/service_runtime/sel_ldr.h"
 #include "api/zvm.h"
 
+EXTERN_C_BEGIN
+
 /* open/map flags/modes. must contain "channel types" number of elements -1 means absense of value */
 #define CHANNEL_OPEN_FLAGS {O_RDONLY, O_RDWR | O_CREAT , O_RDWR | O_CREAT , -1, -1}
 #define CHANNEL_MAP_FLAGS {NACL_ABI_MAP_PRIVATE, NACL_ABI_MAP_SHARED, NACL_ABI_MAP_SHARED, -1, -1}
@@ -20,4 +22,12 @@
  */
 int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
 
+/*
+ * unmap output/log channel. only pages written by nexe are synced,
+ * the file is trimmed to the data produced
+ */
+void UnmapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
+
+EXTERN_C_END
+
 #endif /* PREMAP_H_ */
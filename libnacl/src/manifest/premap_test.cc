@@ -0,0 +1,181 @@
+/*
+ * premap_test.cc
+ * unit test over google testing framework
+ * checks the unmap of the mapped output and log channels: the file is
+ * trimmed to the end of its last data (whatever nexe wrote, evicted
+ * pages included), the log to its asciiz string
+ *
+ *  Created on: Dec 5, 2011
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/premap.h"
+
+#define PAGES 8
+
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+// Test harness for the unmap. the channel file is temporary
+class PremapTests : public ::testing::Test {
+ protected:
+  PremapTests()
+  {
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    manifest.user_setup = &setup;
+    app.manifest = &manifest;
+    app.addr_bits = 32;
+    strcpy(name, "/tmp/premap_testXXXXXX");
+    close(mkstemp(name));
+  }
+
+  ~PremapTests()
+  {
+    unlink(name);
+  }
+
+  // the mapped channel of "type" over the file of "size" bytes. "buffer" is the map
+  struct PreOpenedFileDesc *Channel(enum ChannelType type, int32_t size)
+  {
+    struct PreOpenedFileDesc *channel = &setup.channels[type];
+    int handle = open(name, O_RDWR);
+
+    EXPECT_EQ(0, ftruncate(handle, size));
+    buffer = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+    close(handle);
+    EXPECT_NE(MAP_FAILED, buffer);
+
+    /* the map is at the nexe address of one page */
+    app.mem_start = (uintptr_t)buffer - NACL_PAGESIZE;
+    channel->name = (uint64_t)(uintptr_t)name;
+    channel->type = type;
+    channel->mounted = MAPPED;
+    channel->handle = -1;
+    channel->buffer = NACL_PAGESIZE;
+    channel->bsize = size;
+    channel->fsize = size;
+    channel->max_size = size;
+    return channel;
+  }
+
+  // return the size of the channel file
+  int64_t FileSize()
+  {
+    struct stat fs;
+    return stat(name, &fs) ? -1 : fs.st_size;
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+  char name[32];
+  char *buffer;
+};
+
+// the output nexe did not write is trimmed to nothing
+TEST_F(PremapTests, UntouchedTest)
+{
+  struct PreOpenedFileDesc *channel = Channel(OutputChannel, PAGES * NACL_PAGESIZE);
+
+  UnmapChannel(&app, channel);
+  EXPECT_EQ(0, FileSize());
+  EXPECT_EQ(0, channel->fsize);
+  EXPECT_EQ(0, channel->buffer);
+}
+
+// the output ends with the last written page, zeroes written are the data
+TEST_F(PremapTests, DirtyTest)
+{
+  struct PreOpenedFileDesc *channel = Channel(OutputChannel, PAGES * NACL_PAGESIZE);
+  char data[NACL_PAGESIZE];
+  int handle;
+
+  memset(buffer + NACL_PAGESIZE, 'x', 10);
+  buffer[4 * NACL_PAGESIZE + 100] = '\0';
+  UnmapChannel(&app, channel);
+  ASSERT_EQ(5 * NACL_PAGESIZE, FileSize());
+  EXPECT_EQ(5 * NACL_PAGESIZE, channel->fsize);
+
+  handle = open(name, O_RDONLY);
+  ASSERT_EQ(NACL_PAGESIZE, pread(handle, data, NACL_PAGESIZE, NACL_PAGESIZE));
+  close(handle);
+  EXPECT_EQ(0, memcmp(data, "xxxxxxxxxx", 10));
+  EXPECT_EQ(0, data[10]);
+}
+
+// the short last page is not rounded up past the channel
+TEST_F(PremapTests, ShortPageTest)
+{
+  struct PreOpenedFileDesc *channel = Channel(OutputChannel, 3 * NACL_PAGESIZE + 100);
+
+  buffer[3 * NACL_PAGESIZE] = 'x';
+  UnmapChannel(&app, channel);
+  EXPECT_EQ(3 * NACL_PAGESIZE + 100, FileSize());
+}
+
+// the page written back and evicted is not in the page tables, still it is the data
+TEST_F(PremapTests, EvictedTest)
+{
+  struct PreOpenedFileDesc *channel = Channel(OutputChannel, PAGES * NACL_PAGESIZE);
+  unsigned char vec[PAGES];
+  char data[NACL_PAGESIZE];
+  int handle;
+
+  buffer[NACL_PAGESIZE] = 'x';
+  buffer[5 * NACL_PAGESIZE + 1] = 'y';
+  ASSERT_EQ(0, msync(buffer, PAGES * NACL_PAGESIZE, MS_SYNC));
+  if(madvise(buffer, PAGES * NACL_PAGESIZE, MADV_PAGEOUT) == 0
+      && mincore(buffer, PAGES * NACL_PAGESIZE, vec) == 0 && (vec[5] & 1))
+    printf("the page is still resident, eviction is not checked\n");
+
+  UnmapChannel(&app, channel);
+  ASSERT_EQ(6 * NACL_PAGESIZE, FileSize());
+  handle = open(name, O_RDONLY);
+  ASSERT_EQ(NACL_PAGESIZE, pread(handle, data, NACL_PAGESIZE, 5 * NACL_PAGESIZE));
+  close(handle);
+  EXPECT_EQ('y', data[1]);
+}
+
+// the data in the channel before nexe is kept even if nexe did not touch it
+TEST_F(PremapTests, PreexistingTest)
+{
+  struct PreOpenedFileDesc *channel;
+  int handle = open(name, O_RDWR);
+
+  ASSERT_EQ(3, pwrite(handle, "old", 3, 2 * NACL_PAGESIZE));
+  close(handle);
+  channel = Channel(OutputChannel, PAGES * NACL_PAGESIZE);
+  buffer[0] = 'x';
+  UnmapChannel(&app, channel);
+  EXPECT_EQ(3 * NACL_PAGESIZE, FileSize());
+}
+
+// the log is trimmed to its asciiz string
+TEST_F(PremapTests, LogTest)
+{
+  struct PreOpenedFileDesc *channel = Channel(LogChannel, PAGES * NACL_PAGESIZE);
+
+  strcpy(buffer, "nexe log");
+  buffer[2 * NACL_PAGESIZE] = 'x';
+  UnmapChannel(&app, channel);
+  EXPECT_EQ(8, FileSize());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,411 @@
+/*
+ * zerovm report to proxy: text, json and binary writers
+ *
+ *  Created on: Jan 24, 2012
+ *      Author: d'b
+ */
+#include <string.h>
+#include <sys/resource.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/phase_timer.h"
+#include "src/manifest/trap_stats.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/accounting.h"
+#include "src/manifest/report.h"
+
+/* bounded writer over the caller buffer */
+struct Writer
+{
+  enum ReportFormats format;
+  char *buf;
+  int size;
+  int len;
+  int overflow; /* something did not fit. nothing is put after it */
+  int comma; /* json: the next member needs a comma */
+};
+
+/* the "ToString" functions of the runtime statistics */
+typedef int (*ToString)(char *buf, int size);
+
+/* put "size" bytes of "data" or mark the overflow */
+static void Put(struct Writer *w, const void *data, int size)
+{
+  if(w->overflow || size > w->size - w->len)
+  {
+    w->overflow = 1;
+    return;
+  }
+  memcpy(w->buf + w->len, data, size);
+  w->len += size;
+}
+
+static void PutString(struct Writer *w, const char *s)
+{
+  Put(w, s, strlen(s));
+}
+
+/* decimal w/o snprintf */
+static void PutDecimal(struct Writer *w, int64_t value)
+{
+  char digits[24];
+  char *p = digits + sizeof digits;
+  uint64_t u = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+  do *--p = '0' + u % 10; while(u /= 10);
+  if(value < 0) *--p = '-';
+  Put(w, p, digits + sizeof digits - p);
+}
+
+/* little endian integer of "bytes" bytes */
+static void PutBinary(struct Writer *w, uint64_t value, int bytes)
+{
+  char le[8];
+  int i;
+
+  for(i = 0; i < bytes; ++i, value >>= 8)
+    le[i] = value & 0xff;
+  Put(w, le, bytes);
+}
+
+/* put the output of "fn" to the rest of the buffer. return its length */
+static int PutToString(struct Writer *w, ToString fn)
+{
+  int room = w->size - w->len;
+  int len;
+
+  if(w->overflow || room < 2)
+  {
+    w->overflow = 1;
+    return 0;
+  }
+
+  /* truncated output is "room - 1" long */
+  len = fn(w->buf + w->len, room);
+  if(len >= room - 1)
+  {
+    w->overflow = 1;
+    return 0;
+  }
+  w->len += len;
+  return len;
+}
+
+/* json string with quotes. the spans of plain characters are put at once */
+static void PutJsonString(struct Writer *w, const char *s)
+{
+  static const char hex[] = "0123456789abcdef";
+  const char *span;
+  char escape[6] = {'\\', 'u', '0', '0'};
+
+  Put(w, "\"", 1);
+  for(;;)
+  {
+    for(span = s; (unsigned char)*s >= 0x20 && *s != '"' && *s != '\\'; ++s);
+    Put(w, span, s - span);
+    if(*s == '\0') break;
+
+    if(*s == '"' || *s == '\\')
+    {
+      escape[1] = *s;
+      Put(w, escape, 2);
+    }
+    else
+    {
+      escape[1] = 'u';
+      escape[4] = hex[(*s >> 4) & 0xf];
+      escape[5] = hex[*s & 0xf];
+      Put(w, escape, 6);
+    }
+    ++s;
+  }
+  Put(w, "\"", 1);
+}
+
+/* json member name */
+static void Key(struct Writer *w, const char *name)
+{
+  if(w->comma) Put(w, ",", 1);
+  Put(w, "\"", 1);
+  PutString(w, name);
+  Put(w, "\":", 2);
+  w->comma = 1;
+}
+
+/* binary record header */
+static void Record(struct Writer *w, int id, int size)
+{
+  PutBinary(w, id, 2);
+  PutBinary(w, size, 2);
+}
+
+/* integer field */
+static void Int(struct Writer *w, int id, const char *name, int64_t value)
+{
+  if(w->format == ReportJson)
+  {
+    Key(w, name);
+    PutDecimal(w, value);
+    return;
+  }
+  Record(w, id, sizeof value);
+  PutBinary(w, value, sizeof value);
+}
+
+/* string field. NULL - json null, empty binary record */
+static void Str(struct Writer *w, int id, const char *name, const char *value)
+{
+  int size;
+
+  if(w->format == ReportJson)
+  {
+    Key(w, name);
+    if(value == NULL) PutString(w, "null");
+    else PutJsonString(w, value);
+    return;
+  }
+
+  size = value == NULL ? 0 : strlen(value);
+  if(size > 0xffff) size = 0xffff;
+  Record(w, id, size);
+  Put(w, value, size);
+}
+
+/* names of the exceeded limits in "bits", comma separated */
+static void Violations(struct Writer *w, int id, const char *name, uint32_t bits)
+{
+  static const char *limits[] = LIMIT_NAMES;
+  char list[64] = "";
+  int i;
+
+  for(i = 0; i < LIMITS_COUNT; ++i)
+  {
+    if(!(bits & 1 << i)) continue;
+    if(*list) strcat(list, ",");
+    strcat(list, limits[i]);
+  }
+  Str(w, id, name, list);
+}
+
+/* statistics string field. its characters need no json escaping */
+static void Stats(struct Writer *w, int id, const char *name, ToString fn)
+{
+  int header = w->len;
+  int size;
+
+  if(w->format == ReportJson)
+  {
+    Key(w, name);
+    Put(w, "\"", 1);
+    PutToString(w, fn);
+    Put(w, "\"", 1);
+    return;
+  }
+
+  /* the size is known after the string is put */
+  Record(w, id, 0);
+  size = PutToString(w, fn);
+  if(w->overflow) return;
+  if(size > 0xffff)
+  {
+    w->len -= size - 0xffff;
+    size = 0xffff;
+  }
+  w->buf[header + 2] = size & 0xff;
+  w->buf[header + 3] = size >> 8;
+}
+
+/* json object or array. the binary report is flat */
+static void Open(struct Writer *w, const char *name, char bracket)
+{
+  if(w->format != ReportJson) return;
+  if(name != NULL) Key(w, name);
+  else if(w->comma) Put(w, ",", 1);
+  Put(w, &bracket, 1);
+  w->comma = 0;
+}
+
+static void Close(struct Writer *w, char bracket)
+{
+  if(w->format != ReportJson) return;
+  Put(w, &bracket, 1);
+  w->comma = 1;
+}
+
+/* bytes held by zerovm runtime objects */
+static int64_t RuntimeMemory(struct NaClApp *nap)
+{
+  return nap->mem_map.entries.bytes + nap->mem_map.mem_objs.bytes
+      + nap->host_descs.bytes;
+}
+
+/* legacy "key=value" report. NULL strings are put as sprintf did */
+static void Text(struct Writer *w, struct NaClApp *nap)
+{
+  struct Report *report = nap->manifest->report;
+
+#define TEXT_INT(key, value) PutString(w, key), PutDecimal(w, value), Put(w, "\n", 1)
+#define TEXT_STR(key, value)\
+  PutString(w, key), PutString(w, (value) ? (value) : "(null)"), Put(w, "\n", 1)
+#define TEXT_STATS(key, fn) PutString(w, key), PutToString(w, fn), Put(w, "\n", 1)
+
+  TEXT_INT("ReportRetCode        =", report->ret_code);
+  TEXT_STR("ReportEtag           =", report->etag);
+  TEXT_INT("ReportUserRetCode    =", report->user_ret_code);
+  TEXT_STR("ReportContentType    =", report->content_type);
+  TEXT_STR("ReportXObjectMetaTag =", report->x_object_meta_tag);
+
+  /* per phase timings in nanoseconds */
+  TEXT_STATS("ReportPhaseTimes     =", PhaseTimerToString);
+
+  /* trap and channel histograms, trap time totals. empty if not enabled */
+  TEXT_STATS("ReportTrapLatency    =", TrapStatsLatencyToString);
+  TEXT_STATS("ReportChannelLatency =", TrapStatsChannelsToString);
+  TEXT_STATS("ReportChannelSizes   =", TrapStatsSizesToString);
+  TEXT_STATS("ReportTrapTime       =", TrapStatsTimeToString);
+
+  /* cpu time in nanoseconds */
+  TEXT_INT("ReportUserCpuTime    =", GetUserCpuTime());
+  TEXT_INT("ReportHostCpuTime    =", GetHostCpuTime());
+
+  /* runtime objects slabs */
+  TEXT_INT("ReportRuntimeMemory  =", RuntimeMemory(nap));
+
+#undef TEXT_INT
+#undef TEXT_STR
+#undef TEXT_STATS
+}
+
+/* json and binary report. the same fields in the same order */
+static void Structured(struct Writer *w, struct NaClApp *nap)
+{
+  static const char *reasons[] = RET_CODE_NAMES;
+  static const char *phases[] = PHASE_NAMES;
+  struct Report *report = nap->manifest->report;
+  struct SetupList *policy = nap->manifest->user_setup;
+  struct rusage usage;
+  enum SessionPhase phase;
+  enum ChannelType ch;
+
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+    memset(&usage, 0, sizeof usage);
+
+  Open(w, NULL, '{');
+
+  /* exit */
+  Int(w, ReportFieldRetCode, "ret_code", report->ret_code);
+  Str(w, ReportFieldExitReason, "exit_reason",
+      (uint32_t)report->ret_code < sizeof reasons / sizeof *reasons
+      ? reasons[report->ret_code] : "unknown");
+  Int(w, ReportFieldUserRetCode, "user_ret_code", report->user_ret_code);
+  Str(w, ReportFieldEtag, "etag", report->etag);
+  Str(w, ReportFieldContentType, "content_type", report->content_type);
+  Str(w, ReportFieldXObjectMetaTag, "x_object_meta_tag", report->x_object_meta_tag);
+
+  /* resources. cpu in nanoseconds, memory in bytes */
+  Int(w, ReportFieldUserCpu, "user_cpu", GetUserCpuTime());
+  Int(w, ReportFieldHostCpu, "host_cpu", GetHostCpuTime());
+  Int(w, ReportFieldRuntimeMemory, "runtime_memory", RuntimeMemory(nap));
+  Int(w, ReportFieldPeakRss, "peak_rss", (int64_t)usage.ru_maxrss << 10);
+  Int(w, ReportFieldMinorFaults, "minor_faults", usage.ru_minflt);
+  Int(w, ReportFieldMajorFaults, "major_faults", usage.ru_majflt);
+
+  /* session phases in nanoseconds. teardown is not measured yet */
+  Open(w, "phases", '{');
+  for(phase = PhaseInit; phase < PhaseTeardown; ++phase)
+    Int(w, ReportFieldPhase + phase, phases[phase], PhaseTimerGet(phase));
+  Close(w, '}');
+
+  /* user policy limits and counters */
+  Open(w, "limits", '{');
+  Int(w, ReportFieldMaxMem, "mem", policy->max_mem);
+  Int(w, ReportFieldMaxCpu, "cpu", policy->max_cpu);
+  Int(w, ReportFieldMaxSyscalls, "syscalls", policy->max_syscalls);
+  Int(w, ReportFieldMaxSetupCalls, "setup_calls", policy->max_setup_calls);
+  Close(w, '}');
+  Open(w, "counters", '{');
+  Int(w, ReportFieldMem, "mem", policy->cnt_mem);
+  Int(w, ReportFieldCpu, "cpu", policy->cnt_cpu);
+  Int(w, ReportFieldSyscalls, "syscalls", policy->cnt_syscalls);
+  Int(w, ReportFieldSetupCalls, "setup_calls", policy->cnt_setup_calls);
+  Close(w, '}');
+  Violations(w, ReportFieldViolations, "violations", accounting.violations);
+
+  /* constructed channels */
+  Open(w, "channels", '[');
+  for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+  {
+    struct PreOpenedFileDesc *channel = &policy->channels[ch];
+    if(!channel->name) continue;
+
+    Open(w, NULL, '{');
+    Int(w, ReportFieldChannel, "type", ch);
+    Str(w, ReportFieldChannelName, "name", (char*)(uintptr_t)channel->name);
+    Int(w, ReportFieldChannelMode, "mode", channel->mounted);
+    Int(w, ReportFieldChannelSize, "size", channel->fsize);
+    Int(w, ReportFieldChannelMaxSize, "max_size", channel->max_size);
+    Int(w, ReportFieldChannelMaxGets, "max_gets", channel->max_gets);
+    Int(w, ReportFieldChannelMaxPuts, "max_puts", channel->max_puts);
+    Int(w, ReportFieldChannelMaxGetSize, "max_get_size", channel->max_get_size);
+    Int(w, ReportFieldChannelMaxPutSize, "max_put_size", channel->max_put_size);
+    Int(w, ReportFieldChannelGets, "gets", channel->cnt_gets);
+    Int(w, ReportFieldChannelPuts, "puts", channel->cnt_puts);
+    Int(w, ReportFieldChannelGetSize, "get_size", channel->cnt_get_size);
+    Int(w, ReportFieldChannelPutSize, "put_size", channel->cnt_put_size);
+    Violations(w, ReportFieldChannelViolations, "violations",
+        accounting.channel_violations[ch]);
+    Close(w, '}');
+  }
+  Close(w, ']');
+
+  /* trap and channel histograms, trap time totals. empty if not enabled */
+  Stats(w, ReportFieldTrapLatency, "trap_latency", TrapStatsLatencyToString);
+  Stats(w, ReportFieldChannelLatency, "channel_latency", TrapStatsChannelsToString);
+  Stats(w, ReportFieldChannelSizes, "channel_sizes", TrapStatsSizesToString);
+  Stats(w, ReportFieldTrapTime, "trap_time", TrapStatsTimeToString);
+
+  Close(w, '}');
+}
+
+enum ReportFormats ReportFormatByName(const char *name)
+{
+  static const char *names[] = REPORT_FORMAT_NAMES;
+  size_t i;
+
+  if(name == NULL) return ReportText;
+  for(i = 0; i < sizeof names / sizeof *names; ++i)
+    if(strcmp(name, names[i]) == 0) return (enum ReportFormats)i;
+
+  NaClLog(LOG_WARNING, "unknown report format %s, text is used\n", name);
+  return ReportText;
+}
+
+int ReportPut(struct NaClApp *nap, enum ReportFormats format, char *buf, int size)
+{
+  struct Writer w = {format, buf, size, 0, 0, 0};
+
+  switch(format)
+  {
+    case ReportJson:
+      Structured(&w, nap);
+      break;
+    case ReportBinary:
+      Put(&w, REPORT_MAGIC, sizeof REPORT_MAGIC - 1);
+      PutBinary(&w, REPORT_VERSION, 2);
+      Structured(&w, nap);
+      break;
+    case ReportText:
+    default:
+      Text(&w, nap);
+      break;
+  }
+
+  if(format != ReportBinary)
+  {
+    Put(&w, "", 1);
+    --w.len;
+  }
+  return w.overflow ? -1 : w.len;
+}
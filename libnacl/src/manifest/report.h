@@ -0,0 +1,102 @@
+/*
+ * zerovm report to proxy. the legacy "key=value" text, json or the
+ * compact binary form ("ReportFormat" manifest key). besides the
+ * legacy fields the json and binary reports carry the SetupList and
+ * channels limits, counters and violations, peak rss, page faults,
+ * validation time and the exit reason. the writer is bounded and does not
+ * allocate, so the report can be made when the memory is exhausted
+ *
+ * binary form: "ZVMR" magic, 16-bit version, then the records of
+ * 16-bit field id, 16-bit payload size and the payload. all numbers
+ * are little endian. the integers are 64-bit, the strings are w/o
+ * ending zero. the channel fields belong to the last ReportFieldChannel
+ * record (its payload is the channel type). the phase times have ids
+ * ReportFieldPhase + enum SessionPhase. unknown ids must be skipped
+ *
+ *  Created on: Jan 24, 2012
+ *      Author: d'b
+ */
+
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <stdint.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+struct NaClApp;
+
+/* big enough for any report. the strings all come from the manifest */
+#define REPORT_MAX_SIZE 0x10000
+
+#define REPORT_MAGIC "ZVMR"
+#define REPORT_VERSION 1
+
+enum ReportFormats {
+  ReportText, /* legacy "key=value" lines (default) */
+  ReportJson,
+  ReportBinary
+};
+
+/* names must answer to enum "ReportFormats" */
+#define REPORT_FORMAT_NAMES {"text", "json", "binary"}
+
+/* binary report field ids. never renumber, only append */
+enum ReportFields {
+  ReportFieldRetCode = 1,
+  ReportFieldExitReason,
+  ReportFieldUserRetCode,
+  ReportFieldEtag,
+  ReportFieldContentType,
+  ReportFieldXObjectMetaTag,
+  ReportFieldUserCpu, /* nanoseconds */
+  ReportFieldHostCpu, /* nanoseconds */
+  ReportFieldRuntimeMemory, /* bytes */
+  ReportFieldPeakRss, /* bytes */
+  ReportFieldMinorFaults,
+  ReportFieldMajorFaults,
+  ReportFieldMaxMem, /* SetupList limits */
+  ReportFieldMaxCpu,
+  ReportFieldMaxSyscalls,
+  ReportFieldMaxSetupCalls,
+  ReportFieldMem, /* SetupList counters */
+  ReportFieldCpu,
+  ReportFieldSyscalls,
+  ReportFieldSetupCalls,
+  ReportFieldTrapLatency, /* trap stats strings, see "trap_stats.h" */
+  ReportFieldChannelLatency,
+  ReportFieldChannelSizes,
+  ReportFieldTrapTime,
+  ReportFieldChannel, /* starts the channel fields. payload: channel type */
+  ReportFieldChannelName,
+  ReportFieldChannelMode,
+  ReportFieldChannelSize,
+  ReportFieldChannelMaxSize,
+  ReportFieldChannelMaxGets,
+  ReportFieldChannelMaxPuts,
+  ReportFieldChannelMaxGetSize,
+  ReportFieldChannelMaxPutSize,
+  ReportFieldChannelGets,
+  ReportFieldChannelPuts,
+  ReportFieldChannelGetSize,
+  ReportFieldChannelPutSize,
+  ReportFieldViolations, /* exceeded limits names, see "accounting.h" */
+  ReportFieldChannelViolations,
+  ReportFieldPhase = 0x100 /* + enum SessionPhase. nanoseconds */
+};
+
+/* return the format by the manifest value. NULL or unknown - text */
+enum ReportFormats ReportFormatByName(const char *name);
+
+/*
+ * put the report in the given format to "buf" of "size" bytes. the
+ * report fields must be set (SetupReportSettings). never writes beyond
+ * "size" and does not allocate. return the report length or -1 if the
+ * report does not fit. the text and json reports are zero ended
+ */
+int ReportPut(struct NaClApp *nap, enum ReportFormats format, char *buf, int size);
+
+EXTERN_C_END
+
+#endif /* REPORT_H_ */
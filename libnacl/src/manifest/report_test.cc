@@ -0,0 +1,256 @@
+/*
+ * report_test.cc
+ * unit test over google testing framework
+ * checks the text, json and binary reports and the writer bounds,
+ * measures the report generation
+ *
+ *  Created on: Jan 24, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/phase_timer.h"
+#include "src/manifest/report.h"
+#include "src/manifest/accounting.h"
+
+#define BENCH_CALLS 100000
+
+// Test harness for the report. two channels are constructed
+class ReportTests : public ::testing::Test {
+ protected:
+  ReportTests()
+  {
+    struct PreOpenedFileDesc *channel;
+
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    memset(&report, 0, sizeof report);
+    manifest.user_setup = &setup;
+    manifest.report = &report;
+    app.manifest = &manifest;
+
+    report.ret_code = RetCodeCpuLimit;
+    report.user_ret_code = -3;
+    report.etag = (char*)"d41d8cd98f00b204e9800998ecf8427e";
+    report.content_type = (char*)"application/octet-stream";
+    report.x_object_meta_tag = (char*)"Format:Pickle";
+    setup.max_syscalls = 1000;
+    setup.cnt_syscalls = 17;
+    memset(&accounting, 0, sizeof accounting);
+    accounting.violations = 1 << LimitSyscalls | 1 << LimitGets;
+    accounting.channel_violations[InputChannel] = 1 << LimitGets;
+
+    channel = &setup.channels[InputChannel];
+    channel->name = (uintptr_t)"/tmp/in";
+    channel->type = InputChannel;
+    channel->fsize = 4096;
+    channel->max_get_size = 1LL << 40;
+    channel->cnt_gets = 5;
+    channel->cnt_get_size = 4096;
+
+    channel = &setup.channels[OutputChannel];
+    channel->name = (uintptr_t)"/tmp/\"out\"\\\n";
+    channel->type = OutputChannel;
+    channel->mounted = LOADED;
+    channel->cnt_puts = 2;
+    channel->cnt_put_size = 100;
+  }
+
+  std::string Put(enum ReportFormats format)
+  {
+    int len = ReportPut(&app, format, buffer, sizeof buffer);
+    EXPECT_LT(0, len);
+    return std::string(buffer, len < 0 ? 0 : len);
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+  struct Report report;
+  char buffer[REPORT_MAX_SIZE];
+};
+
+// the report format manifest values
+TEST_F(ReportTests, FormatByNameTest)
+{
+  EXPECT_EQ(ReportText, ReportFormatByName(NULL));
+  EXPECT_EQ(ReportText, ReportFormatByName("text"));
+  EXPECT_EQ(ReportJson, ReportFormatByName("json"));
+  EXPECT_EQ(ReportBinary, ReportFormatByName("binary"));
+  EXPECT_EQ(ReportText, ReportFormatByName("xml"));
+}
+
+// the legacy report keeps its lines
+TEST_F(ReportTests, TextTest)
+{
+  std::string text = Put(ReportText);
+
+  EXPECT_EQ(0, text.find("ReportRetCode        =1\n"
+      "ReportEtag           =d41d8cd98f00b204e9800998ecf8427e\n"
+      "ReportUserRetCode    =-3\n"
+      "ReportContentType    =application/octet-stream\n"
+      "ReportXObjectMetaTag =Format:Pickle\n"
+      "ReportPhaseTimes     =init:"));
+  EXPECT_NE(std::string::npos, text.find("\nReportRuntimeMemory  =0\n"));
+  EXPECT_EQ('\n', text[text.size() - 1]);
+  EXPECT_EQ('\0', buffer[text.size()]);
+}
+
+// json carries the counters and escapes the strings
+TEST_F(ReportTests, JsonTest)
+{
+  std::string json = Put(ReportJson);
+
+  EXPECT_EQ(0, json.find("{\"ret_code\":1,\"exit_reason\":\"cpu_limit\","
+      "\"user_ret_code\":-3,\"etag\":\"d41d8cd98f00b204e9800998ecf8427e\","));
+  EXPECT_NE(std::string::npos, json.find("\"phases\":{\"init\":"));
+  EXPECT_NE(std::string::npos, json.find("\"validate\":"));
+  EXPECT_NE(std::string::npos, json.find("\"peak_rss\":"));
+  EXPECT_NE(std::string::npos, json.find("\"major_faults\":"));
+  EXPECT_NE(std::string::npos, json.find(
+      "\"limits\":{\"mem\":0,\"cpu\":0,\"syscalls\":1000,\"setup_calls\":0}"));
+  EXPECT_NE(std::string::npos, json.find(
+      "\"counters\":{\"mem\":0,\"cpu\":0,\"syscalls\":17,\"setup_calls\":0},"
+      "\"violations\":\"syscalls,gets\","));
+  EXPECT_NE(std::string::npos, json.find(
+      "\"channels\":[{\"type\":0,\"name\":\"/tmp/in\",\"mode\":0,\"size\":4096,"
+      "\"max_size\":0,\"max_gets\":0,\"max_puts\":0,\"max_get_size\":1099511627776,"
+      "\"max_put_size\":0,\"gets\":5,\"puts\":0,\"get_size\":4096,\"put_size\":0,"
+      "\"violations\":\"gets\"},"
+      "{\"type\":1,\"name\":\"/tmp/\\\"out\\\"\\\\\\u000a\",\"mode\":1,"));
+  EXPECT_NE(std::string::npos, json.find("\"put_size\":100,\"violations\":\"\"}],\"trap_latency\":\"\","));
+  EXPECT_EQ(json.size() - 1, json.rfind("\"trap_time\":\"\"}") + 14);
+  EXPECT_EQ('\0', buffer[json.size()]);
+}
+
+// read little endian integer of "bytes" bytes
+static int64_t Get(const char *p, int bytes)
+{
+  uint64_t value = 0;
+  while(bytes--) value = value << 8 | (uint8_t)p[bytes];
+  return value;
+}
+
+// binary records walk to the very end and hold the same values
+TEST_F(ReportTests, BinaryTest)
+{
+  std::string binary = Put(ReportBinary);
+  const char *p = binary.data();
+  const char *end = p + binary.size();
+  int channel = -1;
+  int records = 0;
+  int id;
+  int size;
+
+  ASSERT_EQ(0, memcmp(p, REPORT_MAGIC, 4));
+  EXPECT_EQ(REPORT_VERSION, Get(p + 4, 2));
+
+  for(p += 6; p + 4 <= end; p += 4 + size, ++records)
+  {
+    id = Get(p, 2);
+    size = Get(p + 2, 2);
+    ASSERT_LE(p + 4 + size, end);
+
+    switch(id)
+    {
+      case ReportFieldRetCode:
+        EXPECT_EQ(RetCodeCpuLimit, Get(p + 4, size));
+        break;
+      case ReportFieldUserRetCode:
+        EXPECT_EQ(-3, Get(p + 4, size));
+        break;
+      case ReportFieldExitReason:
+        EXPECT_EQ("cpu_limit", std::string(p + 4, size));
+        break;
+      case ReportFieldSyscalls:
+        EXPECT_EQ(17, Get(p + 4, size));
+        break;
+      case ReportFieldChannel:
+        channel = Get(p + 4, size);
+        break;
+      case ReportFieldChannelName:
+        EXPECT_EQ((char*)(uintptr_t)setup.channels[channel].name, std::string(p + 4, size));
+        break;
+      case ReportFieldChannelGetSize:
+        EXPECT_EQ(setup.channels[channel].cnt_get_size, Get(p + 4, size));
+        break;
+      case ReportFieldChannelPuts:
+        EXPECT_EQ(setup.channels[channel].cnt_puts, Get(p + 4, size));
+        break;
+      case ReportFieldViolations:
+        EXPECT_EQ("syscalls,gets", std::string(p + 4, size));
+        break;
+      case ReportFieldChannelViolations:
+        EXPECT_EQ(channel == InputChannel ? "gets" : "", std::string(p + 4, size));
+        break;
+      case ReportFieldTrapTime:
+        EXPECT_EQ(0, size);
+        break;
+    }
+  }
+  EXPECT_EQ(end, p);
+  EXPECT_EQ(OutputChannel, channel);
+  EXPECT_EQ(25 + PhaseTeardown + 2 * 14, records);
+}
+
+// any buffer too small fails and is never overrun
+TEST_F(ReportTests, OverflowTest)
+{
+  enum ReportFormats format;
+  int len;
+  int size;
+
+  for(format = ReportText; format <= ReportBinary; format = (enum ReportFormats)(format + 1))
+  {
+    len = ReportPut(&app, format, buffer, sizeof buffer);
+    ASSERT_LT(0, len);
+
+    /* the text and json need room for the ending zero */
+    for(size = 0; size <= len - (format == ReportBinary); ++size)
+    {
+      memset(buffer, 'x', sizeof buffer);
+      EXPECT_EQ(-1, ReportPut(&app, format, buffer, size)) << format << ":" << size;
+      EXPECT_EQ('x', buffer[size]);
+    }
+  }
+}
+
+// return monotonic clock in nanoseconds
+static int64_t Now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// report generation per format
+TEST_F(ReportTests, BenchTest)
+{
+  const char *names[] = REPORT_FORMAT_NAMES;
+  enum ReportFormats format;
+  int64_t start;
+  int len = 0;
+  int i;
+
+  for(format = ReportText; format <= ReportBinary; format = (enum ReportFormats)(format + 1))
+  {
+    start = Now();
+    for(i = 0; i < BENCH_CALLS; ++i)
+      len = ReportPut(&app, format, buffer, sizeof buffer);
+    printf("%s report: %d bytes, %.1f ns per report\n", names[format], len,
+        (double)(Now() - start) / BENCH_CALLS);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -11,36 +11,238 @@
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/time.h>
+#include <sys/syscall.h>
 
 #include "src/manifest/trap.h"
 #include "src/manifest/manifest_setup.h"
 #include "src/manifest/mount_channel.h"
 #include "src/platform/nacl_log.h"
+#include "src/perf_counter/nacl_perf_counter.h"
+#include "src/manifest/trap_stats.h"
+#include "src/manifest/io_ring.h"
+#include "src/manifest/etag.h"
+#include "src/manifest/live_stats.h"
+#include "src/manifest/accounting.h"
+#include "src/manifest/codec.h"
+#include "src/manifest/merkle.h"
 #include "api/zvm.h"
 #include "src/service_runtime/sel_ldr.h"
 #include "src/service_runtime/nacl_globals.h"
 #include "src/service_runtime/nacl_syscall_common.h"
+#include "src/service_runtime/nacl_signal.h"
+
+#define NANOS_PER_SECOND 1000000000LL
+#define NANOS_PER_MILLI 1000000LL
+#define CPU_LIMIT_SIGNAL SIGXCPU
+
+/*
+ * cpu time accounting. there is only one nexe per zerovm. the switches
+ * between the nexe and zerovm are counted with tsc (no syscall per
+ * trap), the thread cpu clock is only read at the start and at the stop
+ * and its total is split between user and host in tsc proportion. the
+ * tsc is supposed to be invariant (constant_tsc, nonstop_tsc)
+ */
+static int64_t cpu_user; /* nexe time, ns. set by StopCpuClock() */
+static int64_t cpu_host; /* zerovm time spent on nexe requests, ns. set by StopCpuClock() */
+static int64_t cpu_start; /* thread cpu clock at the start, 0 - not started */
+static uint64_t tsc_last; /* tsc at the last switch */
+static uint64_t ticks_user; /* nexe tsc ticks */
+static uint64_t ticks_host; /* zerovm tsc ticks */
+static uint64_t tsc_start; /* tsc calibration point */
+static int64_t ns_start; /* monotonic clock calibration point */
+static volatile sig_atomic_t in_user; /* nexe code is running */
+static volatile sig_atomic_t stop_code; /* the nexe must be stopped with it, RetCodeOk - not */
+static timer_t cpu_timer;
+static int cpu_timer_armed;
+static int cpu_handler_id; /* in the nacl signal handlers list */
+
+/* return cpu time of the calling thread in nanoseconds */
+static int64_t ThreadCpuNow()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec * NANOS_PER_SECOND + t.tv_nsec;
+}
+
+/* return monotonic time in nanoseconds. vdso, no syscall */
+static int64_t MonotonicNow()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * NANOS_PER_SECOND + t.tv_nsec;
+}
+
+/*
+ * stop the nexe. the session ends as if the nexe called exit. called
+ * from the signal handlers too, so no logging (StopCpuClock() does it)
+ */
+static void NexeExit()
+{
+  gnap->exit_status = -1;
+  gnap->running = 0;
+  longjmp(user_exit, -1);
+}
+
+void StopNexe(int32_t code, int untrusted)
+{
+  if(!cpu_start) return; /* the nexe is over already */
+  if(stop_code == RetCodeOk) stop_code = code;
+  if(untrusted) NexeExit();
+}
+
+/*
+ * CPUMax timer handler. the trusted code is left alone, it exits on
+ * the trap return (ResumeCpuClock). the nexe code never gets there by
+ * itself, it is left with longjmp as by the watchdog
+ */
+static enum NaClSignalResult CpuLimitHandler(int signo, void *ctx)
+{
+  struct NaClSignalContext context;
+  sigset_t set;
+
+  if(signo != CPU_LIMIT_SIGNAL) return NACL_SIGNAL_SEARCH;
+  NaClSignalContextFromHandler(&context, ctx);
+  if(NaClSignalContextIsUntrusted(&context))
+  {
+    /* setjmp does not keep the mask, the signal must not stay blocked */
+    sigemptyset(&set);
+    sigaddset(&set, CPU_LIMIT_SIGNAL);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+  }
+  StopNexe(RetCodeCpuLimit, NaClSignalContextIsUntrusted(&context));
+  return NACL_SIGNAL_RETURN;
+}
 
 /* pause cpu time counting. update cnt_cpu */
 void PauseCpuClock(struct NaClApp *nap)
 {
-  if(nap->manifest)
+  uint64_t current;
+  uint64_t ticks;
+  int64_t ns;
+  int64_t user;
+
+  if(!nap->manifest || !cpu_start) return;
+  current = TrapStatsNow();
+  if(in_user)
   {
-    clock_t current = clock();
-    struct SetupList *policy = nap->manifest->user_setup;
-    policy->cnt_cpu += current - policy->cnt_cpu_last;
-    policy->cnt_cpu_last = current;
+    in_user = 0;
+    ticks_user += current - tsc_last;
+
+    /* estimation, StopCpuClock() gives the exact time */
+    ticks = current - tsc_start;
+    ns = MonotonicNow() - ns_start;
+    if(ticks && ns > 0)
+    {
+      user = (double)ns / ticks * ticks_user;
+      nap->manifest->user_setup->cnt_cpu = user / NANOS_PER_MILLI;
+      if(live_stats) LIVE_STATS_SET(user_cpu, user);
+    }
   }
+  else
+    ticks_host += current - tsc_last;
+  tsc_last = current;
 }
 
 /* resume cpu time counting */
 void ResumeCpuClock(struct NaClApp *nap)
 {
-  if(nap->manifest)
+  uint64_t current;
+
+  if(!nap->manifest || !cpu_start) return;
+  current = TrapStatsNow();
+  if(!in_user) ticks_host += current - tsc_last;
+  tsc_last = current;
+  if(stop_code) NexeExit();
+  in_user = 1;
+}
+
+void StartCpuClock(struct NaClApp *nap)
+{
+  struct sigevent sev;
+  struct itimerspec its;
+  int32_t max_cpu;
+
+  if(!nap->manifest) return;
+  max_cpu = nap->manifest->user_setup->max_cpu;
+  cpu_user = cpu_host = 0;
+  ticks_user = ticks_host = 0;
+  stop_code = RetCodeOk;
+  ns_start = MonotonicNow();
+  tsc_start = tsc_last = TrapStatsNow();
+  cpu_start = ThreadCpuNow();
+
+  /* arm the timer on the nexe thread cpu clock, the signal goes to that thread */
+  if(max_cpu > 0)
+  {
+    cpu_handler_id = NaClSignalHandlerAdd(CpuLimitHandler);
+    COND_ABORT(!cpu_handler_id, "cannot add cpu limit signal handler");
+    NaClSignalTimerInit(CPU_LIMIT_SIGNAL);
+
+    memset(&sev, 0, sizeof sev);
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = CPU_LIMIT_SIGNAL;
+    sev.sigev_notify_thread_id = syscall(SYS_gettid);
+    COND_ABORT(timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &cpu_timer) != 0,
+        "cannot create cpu limit timer");
+
+    memset(&its, 0, sizeof its);
+    its.it_value.tv_sec = max_cpu / 1000;
+    its.it_value.tv_nsec = (max_cpu % 1000) * NANOS_PER_MILLI;
+    COND_ABORT(timer_settime(cpu_timer, 0, &its, NULL) != 0,
+        "cannot arm cpu limit timer");
+    cpu_timer_armed = 1;
+  }
+
+  in_user = 1;
+}
+
+void StopCpuClock(struct NaClApp *nap)
+{
+  if(cpu_timer_armed)
+  {
+    timer_delete(cpu_timer);
+    cpu_timer_armed = 0;
+    NaClSignalTimerFini(CPU_LIMIT_SIGNAL);
+    NaClSignalHandlerRemove(cpu_handler_id);
+  }
+  if(stop_code) NaClLog(1, "nexe stopped with code %d\n", (int)stop_code);
+
+  /* account the last interval (user or host) and split the cpu time */
+  PauseCpuClock(nap);
+  in_user = 0;
+  if(cpu_start)
   {
-    nap->manifest->user_setup->cnt_cpu_last = clock();
+    int64_t total = ThreadCpuNow() - cpu_start;
+    uint64_t ticks = ticks_user + ticks_host;
+
+    cpu_user = ticks ? (double)total * ticks_user / ticks : total;
+    cpu_host = total - cpu_user;
+    if(nap->manifest)
+      nap->manifest->user_setup->cnt_cpu = cpu_user / NANOS_PER_MILLI;
+    if(live_stats) LIVE_STATS_SET(user_cpu, cpu_user);
   }
+  cpu_start = 0;
+  NaClLog(1, "cpu time: user %ld ns, host %ld ns\n", cpu_user, cpu_host);
+}
+
+int64_t GetUserCpuTime()
+{
+  return cpu_user;
+}
+
+int64_t GetHostCpuTime()
+{
+  return cpu_host;
+}
+
+int32_t GetStopCode()
+{
+  return stop_code;
 }
 
 /*
@@ -102,8 +304,9 @@ int32_t TrapReadHandle(struct NaClApp *nap,
     enum ChannelType desc, char *buffer, int32_t size, int64_t offset)
 {
   struct PreOpenedFileDesc *fd;
-  int64_t tail;
+  struct ChannelBudget *budget;
   char *sys_buffer;
+  uint64_t start = 0;
   int32_t retcode;
 
   // ### make it function with editable list of available channels
@@ -113,7 +316,7 @@ int32_t TrapReadHandle(struct NaClApp *nap,
   /* convert address and check buffer */
   sys_buffer = (char*)NaClUserToSys(nap, (uintptr_t) buffer);
 
-  NaClLog(4, "%s() invoked: desc=%d, buffer=0x%lx, size=%d, offset=%ld\n",
+  NaClLogTrace(4, "%s() invoked: desc=%d, buffer=0x%lx, size=%d, offset=%ld\n",
       __func__, desc, (intptr_t)buffer, size, offset);
 
   /* take fd from nap with given desc */
@@ -128,18 +331,29 @@ int32_t TrapReadHandle(struct NaClApp *nap,
 
   /* check/update limits/counters */
   if(offset >= fd->fsize) return -OUT_OF_BOUNDS;
-  if(fd->cnt_gets >= fd->max_gets) return -OUT_OF_LIMITS;
-
-  tail = fd->max_get_size - fd->cnt_get_size;
-  if(size > tail) size = tail;
-  if(size < 1) return -OUT_OF_LIMITS;
+  budget = &accounting.channels[desc];
+  if(size > budget->get_size) size = budget->get_size;
+  if(((budget->gets - 1) | (size - 1)) < 0)
+    return AccountingViolation(desc, budget->gets < 1 ? LimitGets : LimitGetSize);
 
   /* update counters (even if syscall failed) */
-  ++fd->cnt_gets;
-  fd->cnt_get_size += size;
+  --budget->gets;
+  budget->get_size -= size;
+  if(live_stats)
+  {
+    LIVE_STATS_INC(channels[desc].gets);
+    LIVE_STATS_ADD(channels[desc].get_size, size);
+  }
 
   /* read data */
-  retcode = pread(fd->handle, sys_buffer, (size_t)size, (off_t)offset);
+  if(trap_stats_enabled) start = TrapStatsNow();
+  if(codecs[desc])
+    retcode = CodecRead(codecs[desc], sys_buffer, size, offset);
+  else if(merkles[desc])
+    retcode = MerkleRead(merkles[desc], sys_buffer, size, offset);
+  else
+    retcode = pread(fd->handle, sys_buffer, (size_t)size, (off_t)offset);
+  if(trap_stats_enabled) TrapStatsRecordIo(TrapRead, start);
 
   return retcode;
 }
@@ -152,8 +366,9 @@ int32_t TrapWriteHandle(struct NaClApp *nap,
     enum ChannelType desc, char *buffer, int32_t size, int64_t offset)
 {
   struct PreOpenedFileDesc *fd;
-  int64_t tail;
+  struct ChannelBudget *budget;
   char *sys_buffer;
+  uint64_t start = 0;
   int32_t retcode;
 
   /* only allow this call for OutputChannel */
@@ -162,7 +377,7 @@ int32_t TrapWriteHandle(struct NaClApp *nap,
   /* convert address and check buffer */
   sys_buffer = (char*)NaClUserToSys(nap, (uintptr_t) buffer);
 
-  NaClLog(4, "%s() invoked: desc=%d, buffer=0x%lx, size=%d, offset=%ld\n",
+  NaClLogTrace(4, "%s() invoked: desc=%d, buffer=0x%lx, size=%d, offset=%ld\n",
         __func__, desc, (intptr_t)buffer, size, offset);
 
   /* take fd from nap with given desc */
@@ -177,18 +392,30 @@ int32_t TrapWriteHandle(struct NaClApp *nap,
 
   /* check/update limits/counters */
   if(offset >= fd->fsize) return -OUT_OF_BOUNDS;
-  if(fd->cnt_puts >= fd->max_puts) return -OUT_OF_LIMITS;
-
-  tail = fd->max_put_size - fd->cnt_put_size;
-  if(size > tail) size = tail;
-  if(size < 1) return -OUT_OF_LIMITS;
+  budget = &accounting.channels[desc];
+  if(size > budget->put_size) size = budget->put_size;
+  if(((budget->puts - 1) | (size - 1)) < 0)
+    return AccountingViolation(desc, budget->puts < 1 ? LimitPuts : LimitPutSize);
 
   /* update counters (even if syscall failed) */
-  ++fd->cnt_puts;
-  fd->cnt_put_size += size;
+  --budget->puts;
+  budget->put_size -= size;
+  if(live_stats)
+  {
+    LIVE_STATS_INC(channels[desc].puts);
+    LIVE_STATS_ADD(channels[desc].put_size, size);
+  }
 
   /* read data */
-  retcode = pwrite(fd->handle, sys_buffer, (size_t)size, (off_t)offset);
+  if(trap_stats_enabled) start = TrapStatsNow();
+  if(codecs[desc])
+    retcode = CodecWrite(codecs[desc], sys_buffer, size, offset);
+  else
+  {
+    retcode = pwrite(fd->handle, sys_buffer, (size_t)size, (off_t)offset);
+    EtagWrite(sys_buffer, offset, retcode);
+  }
+  if(trap_stats_enabled) TrapStatsRecordIo(TrapWrite, start);
 
   return retcode;
 }
@@ -208,13 +435,16 @@ static int32_t TrapUserSetupHandle(struct NaClApp *nap, struct SetupList *h)
   enum ChannelType ch;
 
   /*
-   * check/count this call. decrease number of syscalls
+   * check/count this call. return the syscall budget
    * since this call is not really "system"
    */
-  --nap->manifest->user_setup->cnt_syscalls;
+  ++accounting.syscalls;
   if(policy->max_setup_calls < ++policy->cnt_setup_calls)
     return -OUT_OF_LIMITS;
 
+  /* the limits are compared with the counters, then the budgets are remade */
+  AccountingSync(nap);
+
   /* check i/o limits */
   for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
   {
@@ -254,6 +484,7 @@ static int32_t TrapUserSetupHandle(struct NaClApp *nap, struct SetupList *h)
   /* set system fields n/a to change */
   hint->self_size = policy->self_size; /* set self size */
   hint->heap_ptr = policy->heap_ptr; /* set self size */
+  hint->io_ring = policy->io_ring;
   STRNCPY_NULL(hint->content_type, policy->content_type, CONTENT_TYPE_LEN);
   STRNCPY_NULL(hint->timestamp, policy->timestamp, TIMESTAMP_LEN);
   STRNCPY_NULL(hint->user_etag, policy->user_etag, USER_TAG_LEN);
@@ -264,57 +495,103 @@ static int32_t TrapUserSetupHandle(struct NaClApp *nap, struct SetupList *h)
 
 #undef STRNCPY_NULL
 #undef TRY_UPDATE
+  AccountingCtor(nap);
   return retcode;
 }
 
+/*
+ * trap entries. each one unpacks the arguments vector ([0] - function,
+ * [1] - not used, [2].. - arguments) for its own handler
+ */
+static int32_t TrapUserSetupEntry(struct NaClApp *nap, uint64_t *args)
+{
+  return TrapUserSetupHandle(nap, (struct SetupList*) args[2]);
+}
+
+static int32_t TrapReadEntry(struct NaClApp *nap, uint64_t *args)
+{
+  return TrapReadHandle(nap,
+      (enum ChannelType)args[2], (char*)args[3], (int32_t)args[4], args[5]);
+}
+
+static int32_t TrapWriteEntry(struct NaClApp *nap, uint64_t *args)
+{
+  return TrapWriteHandle(nap,
+      (enum ChannelType)args[2], (char*)args[3], (int32_t)args[4], args[5]);
+}
+
+static int32_t TrapExitEntry(struct NaClApp *nap, uint64_t *args)
+{
+  return TrapExitHandle(nap, (int32_t) args[2]);
+}
+
+static int32_t TrapIoWaitEntry(struct NaClApp *nap, uint64_t *args)
+{
+  return IoRingWait(nap, (uint32_t) args[2]);
+}
+
+/* jump table indexed with "function - TrapUserSetup". must answer to enum "TrapCalls" */
+static const struct TrapEntry {
+  int32_t (*handle)(struct NaClApp *nap, uint64_t *args);
+  const char *name; /* for the profiler */
+  int channels; /* touches the channels, shared with the i/o ring thread */
+} traps[TRAPS_COUNT] = {
+  [TrapUserSetup - TrapUserSetup] = {TrapUserSetupEntry, "TrapUserSetup", 1},
+  [TrapRead - TrapUserSetup] = {TrapReadEntry, "TrapRead", 1},
+  [TrapWrite - TrapUserSetup] = {TrapWriteEntry, "TrapWrite", 1},
+  [TrapExit - TrapUserSetup] = {TrapExitEntry, "TrapExit", 0},
+  [TrapIoWait - TrapUserSetup] = {TrapIoWaitEntry, "TrapIoWait", 0}
+};
+
 /*
  * "One Ring" syscall main routine
  *
- * 1st parameter is a pointer to the command (function, arg1, reserved, argv3,..)
+ * "args" is an array of the function and its arguments:
+ * TrapUserSetup(struct SetupList *hint)
+ * TrapRead(int desc, char *buffer, int32_t size, int64_t offset)
+ * TrapWrite(int desc, char *buffer, int32_t size, int64_t offset)
+ * TrapExit(int32_t code)
+ * TrapIoWait(uint32_t count)
+ * args[1] is not used (once spoiled by nacl), the arguments start at [2]
  * return int32_t, value depends on invoked function
  */
-/* ### move to documentation or rewrite
- * supported three functions:
- * ZVMSetup(char *hint, char answer[])
- * TrapRead(int32_t buffer, int32_t size, int64_t offset)
- * TrapWrite(int32_t buffer, int32_t size, int64_t offset)
- *
- * "args" is an array of syscall name and its arguments:
- * FunctionName(arg1,arg2,..) where arg1/2/3 are values/pointers
- * note: since nacl spoils 1st two arguments if they are pointers, arg[1] are not used
- */
-int32_t TrapHandler(struct NaClApp *nap, uint32_t args)
+int32_t TrapHandler(struct NaClApp *nap, uint64_t *args)
 {
-  uint64_t *sys_args;
+  uint64_t index; /* of the traps table. unsigned: lesser functions wrap around */
+  uint64_t start = 0;
   int retcode = 0;
+  int locked;
+  int profiled = 0; /* the trap scope is open */
 
-  /* translate address from user space to system. note: cannot set "trap error" */
   if(!nap->manifest) return -1; /* return error if not manifest found */
-  sys_args = (uint64_t*)NaClUserToSys(nap, (uintptr_t) args);
-  NaClLog(4, "NaClSysNanosleep received in = 0x%lx\n", (intptr_t)sys_args);
+  index = *args - TrapUserSetup;
+  locked = index < TRAPS_COUNT && traps[index].channels && IoRingLock();
 
-  switch(*sys_args)
+  if(trap_stats_enabled) start = TrapStatsNow();
+
+  /* TrapExit never returns, so it is not profiled */
+  if(nap->perf && *args != TrapExit)
+    profiled = NaClPerfCounterEnter(nap->perf,
+        index < TRAPS_COUNT ? traps[index].name : "TrapUnknown") > 0;
+
+  /* SyscallsMax. the nexe is stopped, but its exit is served */
+  if(--accounting.syscalls < 0 && *args != TrapExit)
+    retcode = AccountingViolation(CHANNELS_COUNT, LimitSyscalls);
+  else if(index < TRAPS_COUNT)
+  {
+    if(live_stats) LIVE_STATS_INC(traps[index]);
+    retcode = traps[index].handle(nap, args);
+  }
+  else
   {
-    case TrapExit:
-      retcode = TrapExitHandle(nap, (int32_t) sys_args[2]);
-      break;
-    case TrapUserSetup:
-      retcode = TrapUserSetupHandle(nap, (struct SetupList*) sys_args[2]);
-      break;
-    case TrapRead:
-      retcode = TrapReadHandle(nap,
-          (enum ChannelType)sys_args[2], (char*)sys_args[3], (int32_t)sys_args[4], sys_args[5]);
-      break;
-    case TrapWrite:
-      retcode = TrapWriteHandle(nap,
-          (enum ChannelType)sys_args[2], (char*)sys_args[3], (int32_t)sys_args[4], sys_args[5]);
-      break;
-    default:
-      retcode = ERR_CODE;
-      NaClLog(LOG_ERROR, "function %ld is not supported\n", *sys_args);
-      break;
+    retcode = ERR_CODE;
+    NaClLog(LOG_ERROR, "function %ld is not supported\n", *args);
   }
 
+  if(profiled) NaClPerfCounterLeave(nap->perf);
+  if(trap_stats_enabled)
+    TrapStatsRecord(*args, start, args[2], (int64_t)retcode);
+  if(locked) IoRingUnlock();
   return retcode;
 }
 
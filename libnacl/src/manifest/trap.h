@@ -14,22 +14,58 @@
 EXTERN_C_BEGIN
 
 /*
- * our "One Ring" syscall main routine
- * call given syscall with the given parameteres supposed to be invoked from NaClSysNanosleep()
- *
- * 1st parameter is a pointer to the command (function, arg1, argv2,..)
- * 2nd parameter is a pointer to return value(s)
- * return 0 if successful, otherwise - 1 (nanosleep restriction)
- * note: in a future will be moved to "nacl_syscall_handler.c" to be only syscall
+ * our "One Ring" syscall main routine. invoked by NaClOneRingHook() with
+ * the trap registers put to the host array (function, n/a, arg2,.. arg5)
+ * return int32_t, value depends on invoked function
+ */
+int32_t TrapHandler(struct NaClApp *nap, uint64_t *args);
+
+/*
+ * TrapRead/TrapWrite handlers. also serve the exit-less i/o ring
+ * return amount of transferred bytes or negative error code
  */
-int32_t TrapHandler(struct NaClApp *nap, uint32_t args);
+int32_t TrapReadHandle(struct NaClApp *nap,
+    enum ChannelType desc, char *buffer, int32_t size, int64_t offset);
+int32_t TrapWriteHandle(struct NaClApp *nap,
+    enum ChannelType desc, char *buffer, int32_t size, int64_t offset);
 
-/* pause cpu time counting. update cnt_cpu */
+/*
+ * cpu time accounting. the nexe thread cpu clock is split to the user
+ * time (nexe code) and host time (zerovm serving traps and syscalls).
+ * both are 64-bit nanoseconds. the switches are counted with tsc, the
+ * split is done by StopCpuClock(). cnt_cpu gets user time in milliseconds
+ */
+
+/* pause user cpu time counting, start host time counting. update cnt_cpu (estimation) */
 void PauseCpuClock(struct NaClApp *nap);
 
-/* resume cpu time counting */
+/* resume user cpu time counting. exit nexe if it must be stopped (StopNexe) */
 void ResumeCpuClock(struct NaClApp *nap);
 
+/*
+ * start cpu time counting before the nexe start. if max_cpu is set arm
+ * the timer (milliseconds of the thread cpu time) which stops the nexe
+ */
+void StartCpuClock(struct NaClApp *nap);
+
+/* stop cpu time counting and disarm the timer after the nexe exit */
+void StopCpuClock(struct NaClApp *nap);
+
+/* return user/host cpu time in nanoseconds. valid after StopCpuClock() */
+int64_t GetUserCpuTime();
+int64_t GetHostCpuTime();
+
+/*
+ * stop the nexe with "code" of enum ReportRetCodes. called from a
+ * signal handler. if the signal came to the nexe code ("untrusted") it
+ * is stopped at once via user_exit, otherwise zerovm finishes the
+ * current request and the nexe is stopped in ResumeCpuClock()
+ */
+void StopNexe(int32_t code, int untrusted);
+
+/* return the code the nexe was stopped with, RetCodeOk - not stopped */
+int32_t GetStopCode();
+
 EXTERN_C_END
 
 #endif /* TRAP_H_ */
@@ -0,0 +1,184 @@
+/*
+ * per trap and per channel latency histograms
+ *
+ *  Created on: Jan 16, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/manifest/trap_stats.h"
+
+#define NANOS_PER_SECOND 1000000000LL
+
+struct Histogram
+{
+  uint64_t calls[TRAP_STATS_BUCKETS];
+};
+
+struct SizeHistogram
+{
+  uint64_t calls[TRAP_STATS_BUCKETS];
+  uint64_t bytes[TRAP_STATS_BUCKETS];
+};
+
+int trap_stats_enabled = 0;
+
+static struct Histogram trap_latency[TRAPS_COUNT];
+static struct Histogram channel_latency[CHANNELS_COUNT];
+static struct SizeHistogram channel_sizes[CHANNELS_COUNT];
+
+/* exact totals per trap: calls, tsc ticks in TrapHandler and in i/o */
+struct TrapTime
+{
+  uint64_t calls;
+  uint64_t ticks;
+  uint64_t io_ticks;
+};
+
+static struct TrapTime trap_time[TRAPS_COUNT];
+
+/* tsc calibration points */
+static uint64_t tsc_start;
+static int64_t ns_start;
+
+/* return monotonic time in nanoseconds */
+static int64_t MonotonicNow()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * NANOS_PER_SECOND + t.tv_nsec;
+}
+
+/* return log2 bucket of the value */
+static INLINE int Bucket(uint64_t value)
+{
+  int i = value ? 64 - __builtin_clzll(value) : 0;
+  return i < TRAP_STATS_BUCKETS ? i : TRAP_STATS_BUCKETS - 1;
+}
+
+void TrapStatsEnable(void)
+{
+  tsc_start = TrapStatsNow();
+  ns_start = MonotonicNow();
+  trap_stats_enabled = 1;
+}
+
+void TrapStatsRecord(uint64_t function, uint64_t start,
+    uint64_t channel, int64_t size)
+{
+  uint64_t ticks = TrapStatsNow() - start;
+  int bucket = Bucket(ticks);
+
+  if(function - TrapUserSetup >= TRAPS_COUNT) return;
+  ++trap_latency[function - TrapUserSetup].calls[bucket];
+  ++trap_time[function - TrapUserSetup].calls;
+  trap_time[function - TrapUserSetup].ticks += ticks;
+
+  if(function != TrapRead && function != TrapWrite) return;
+  if(channel >= CHANNELS_COUNT) return;
+  ++channel_latency[channel].calls[bucket];
+
+  /* failed calls have no size */
+  if(size < 0) return;
+
+  bucket = Bucket(size);
+  ++channel_sizes[channel].calls[bucket];
+  channel_sizes[channel].bytes[bucket] += size;
+}
+
+void TrapStatsRecordIo(uint64_t function, uint64_t start)
+{
+  if(function - TrapUserSetup >= TRAPS_COUNT) return;
+  trap_time[function - TrapUserSetup].io_ticks += TrapStatsNow() - start;
+}
+
+/*
+ * return nanoseconds per tsc tick measured since TrapStatsEnable().
+ * if the session was too short to calibrate return 1
+ */
+static double NanosPerTick()
+{
+  uint64_t ticks = TrapStatsNow() - tsc_start;
+  int64_t ns = MonotonicNow() - ns_start;
+  return ticks && ns > 0 ? (double)ns / ticks : 1.0;
+}
+
+/* print histograms of given names to the buffer. return written length */
+static int HistogramsToString(char *buf, int size, char **names,
+    struct Histogram *h, int count)
+{
+  double factor = NanosPerTick();
+  int len = 0;
+  int i, j;
+
+  if(size < 1) return 0;
+  *buf = '\0';
+  if(!trap_stats_enabled) return 0;
+
+  for(i = 0; i < count && len < size; ++i)
+  {
+    len += snprintf(buf + len, size - len, "%s%s", i ? ";" : "", names[i]);
+    for(j = 0; j < TRAP_STATS_BUCKETS && len < size; ++j)
+      if(h[i].calls[j])
+        len += snprintf(buf + len, size - len, "/%lu:%lu",
+            (uint64_t)(((uint64_t)1 << j) * factor), h[i].calls[j]);
+  }
+
+  return len < size ? len : size - 1;
+}
+
+int TrapStatsLatencyToString(char *buf, int size)
+{
+  char *names[] = TRAP_NAMES;
+  return HistogramsToString(buf, size, names, trap_latency, TRAPS_COUNT);
+}
+
+int TrapStatsChannelsToString(char *buf, int size)
+{
+  char *names[] = CHANNEL_PREFIXES;
+  return HistogramsToString(buf, size, names, channel_latency, CHANNELS_COUNT);
+}
+
+int TrapStatsSizesToString(char *buf, int size)
+{
+  char *names[] = CHANNEL_PREFIXES;
+  int len = 0;
+  int i, j;
+
+  if(size < 1) return 0;
+  *buf = '\0';
+  if(!trap_stats_enabled) return 0;
+
+  for(i = 0; i < CHANNELS_COUNT && len < size; ++i)
+  {
+    len += snprintf(buf + len, size - len, "%s%s", i ? ";" : "", names[i]);
+    for(j = 0; j < TRAP_STATS_BUCKETS && len < size; ++j)
+      if(channel_sizes[i].calls[j])
+        len += snprintf(buf + len, size - len, "/%lu:%lu:%lu",
+            (uint64_t)1 << j, channel_sizes[i].calls[j],
+            channel_sizes[i].bytes[j]);
+  }
+
+  return len < size ? len : size - 1;
+}
+
+int TrapStatsTimeToString(char *buf, int size)
+{
+  char *names[] = TRAP_NAMES;
+  double factor = NanosPerTick();
+  int len = 0;
+  int i;
+
+  if(size < 1) return 0;
+  *buf = '\0';
+  if(!trap_stats_enabled) return 0;
+
+  for(i = 0; i < TRAPS_COUNT && len < size; ++i)
+    len += snprintf(buf + len, size - len, "%s%s:%lu:%lu:%lu", i ? ";" : "",
+        names[i], trap_time[i].calls, (uint64_t)(trap_time[i].ticks * factor),
+        (uint64_t)(trap_time[i].io_ticks * factor));
+
+  return len < size ? len : size - 1;
+}
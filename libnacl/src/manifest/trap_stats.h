@@ -0,0 +1,84 @@
+/*
+ * per trap and per channel latency histograms. when enabled, every
+ * "One Ring" call is timed with tsc and put into log2 buckets. channels
+ * also count calls and bytes per call size bucket. results are put to
+ * the report, so the proxy can tell i/o bound jobs from trap/compute
+ * bound ones. exact time totals per trap split the trap time from its
+ * i/o. when disabled the cost is one predictable branch per trap
+ *
+ *  Created on: Jan 16, 2012
+ *      Author: d'b
+ */
+
+#ifndef TRAP_STATS_H_
+#define TRAP_STATS_H_
+
+#include <stdint.h>
+#include "include/nacl_base.h"
+#include "include/nacl_compiler_annotations.h"
+#include "api/zvm.h"
+
+EXTERN_C_BEGIN
+
+/* log2 buckets. the last bucket also takes everything bigger */
+#define TRAP_STATS_BUCKETS 40
+
+/* amount of TrapCalls functions */
+#define TRAPS_COUNT (TrapIoWait - TrapUserSetup + 1)
+
+/* names must answer to enum "TrapCalls" */
+#define TRAP_NAMES {"TrapUserSetup", "TrapRead", "TrapWrite", "TrapExit", "TrapIoWait"}
+
+/* nonzero if histograms are collected. do not change, use TrapStatsEnable() */
+extern int trap_stats_enabled;
+
+/* start histograms collection and tsc calibration */
+void TrapStatsEnable(void);
+
+/* return current tsc value */
+static INLINE uint64_t TrapStatsNow(void)
+{
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+/*
+ * account trap call started at "start" (tsc). channel and size (bytes
+ * transferred, negative on error) are only used for TrapRead/TrapWrite
+ */
+void TrapStatsRecord(uint64_t function, uint64_t start,
+    uint64_t channel, int64_t size);
+
+/*
+ * account i/o (pread/pwrite) of TrapRead/TrapWrite started at "start"
+ * (tsc). the time is also a part of the trap time
+ */
+void TrapStatsRecordIo(uint64_t function, uint64_t start);
+
+/*
+ * put "name:bucket_ns:calls/..." records separated with ';' to the
+ * buffer. bucket_ns is the upper bound of the bucket in nanoseconds,
+ * empty buckets are omitted. return number of written characters
+ */
+int TrapStatsLatencyToString(char *buf, int size);
+
+/* the same as above, but for channels */
+int TrapStatsChannelsToString(char *buf, int size);
+
+/*
+ * put "channel:bucket_bytes:calls:bytes/..." records separated with ';'
+ * to the buffer. bucket_bytes is the upper bound of the call size bucket
+ */
+int TrapStatsSizesToString(char *buf, int size);
+
+/*
+ * put "name:calls:ns:io_ns" records separated with ';' to the buffer.
+ * ns is the exact total time spent in TrapHandler, io_ns is its part
+ * spent in pread/pwrite. return number of written characters
+ */
+int TrapStatsTimeToString(char *buf, int size);
+
+EXTERN_C_END
+
+#endif /* TRAP_STATS_H_ */
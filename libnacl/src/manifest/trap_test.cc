@@ -0,0 +1,180 @@
+/*
+ * trap_test.cc
+ * unit test over google testing framework
+ * checks the "One Ring" dispatch and measures the host side of the
+ * trampoline round trip: TrapHandler -> trap table -> trap entry, and
+ * the per call costs every round trip pays: cpu clock pause/resume,
+ * accounting counters, suppressed logging. the nexe side (trampoline,
+ * context switch, NaClOneRingHook) is measured by src/bench
+ *
+ *  Created on: Jan 19, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "gtest/gtest.h"
+#include "src/platform/nacl_log.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/trap_stats.h"
+#include "src/manifest/accounting.h"
+#include "src/perf_counter/nacl_perf_counter.h"
+
+#define USER_SPACE_BITS 16
+#define USER_ARGS 0x100 /* user address of the buffer */
+#define BENCH_CALLS 1000000
+
+// Test harness for the trap dispatch. the "user space" is a local buffer
+class TrapTests : public ::testing::Test {
+ protected:
+  TrapTests()
+  {
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    manifest.user_setup = &setup;
+    app.manifest = &manifest;
+    app.mem_start = (uintptr_t)user_space;
+    app.addr_bits = USER_SPACE_BITS;
+    AccountingCtor(&app);
+  }
+
+  // call the trap the way NaClOneRingHook() does
+  int32_t Call(uint64_t function, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5)
+  {
+    uint64_t args[] = {function, 0, a2, a3, a4, a5};
+    return TrapHandler(&app, args);
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+  char user_space[1 << USER_SPACE_BITS];
+};
+
+// functions outside of enum "TrapCalls" must be rejected
+TEST_F(TrapTests, UnknownTrapTest)
+{
+  EXPECT_EQ(ERR_CODE, Call(TrapUserSetup - 1, 0, 0, 0, 0));
+  EXPECT_EQ(ERR_CODE, Call(TrapUserSetup + TRAPS_COUNT, 0, 0, 0, 0));
+  EXPECT_EQ(ERR_CODE, Call(0, 0, 0, 0, 0));
+}
+
+// arguments must reach the handler in their places
+TEST_F(TrapTests, ArgumentsTest)
+{
+  EXPECT_EQ(-INVALID_DESC, Call(TrapRead, CHANNELS_COUNT, USER_ARGS, 1, 0));
+  EXPECT_EQ(-INVALID_DESC, Call(TrapWrite, InputChannel, USER_ARGS, 1, 0));
+  EXPECT_EQ(-INVALID_MODE, Call(TrapWrite, OutputChannel, USER_ARGS, 1, 0));
+}
+
+// the trap is a profiler scope. the scope which cannot be opened is not closed
+TEST_F(TrapTests, ProfiledTest)
+{
+  struct NaClPerfCounter perf;
+  int i;
+
+  NaClPerfCounterCtor(&perf, "trap_test");
+  app.perf = &perf;
+  EXPECT_EQ(1, NaClPerfCounterEnter(&perf, "session"));
+  EXPECT_EQ(-INVALID_DESC, Call(TrapRead, CHANNELS_COUNT, USER_ARGS, 1, 0));
+  EXPECT_EQ(1u, perf.depth);
+  EXPECT_EQ(2u, perf.scopes);
+
+  /* the full stack refuses the trap scope, the session scope stays open */
+  for(i = 1; i < NACL_MAX_PERF_COUNTER_DEPTH; ++i)
+    EXPECT_EQ(i + 1, NaClPerfCounterEnter(&perf, "nested"));
+  EXPECT_EQ(-INVALID_DESC, Call(TrapRead, CHANNELS_COUNT, USER_ARGS, 1, 0));
+  EXPECT_EQ((uint32_t)NACL_MAX_PERF_COUNTER_DEPTH, perf.depth);
+
+  app.perf = NULL;
+  NaClPerfCounterDtor(&perf);
+}
+
+// return monotonic clock in nanoseconds
+static int64_t Now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// print nanoseconds per call of the benchmark started at "start"
+static void Report(const char *name, int64_t start)
+{
+  printf("%s: %.1f ns per call\n", name, (double)(Now() - start) / BENCH_CALLS);
+}
+
+// round trip of the cheapest trap
+TEST_F(TrapTests, DispatchBenchTest)
+{
+  int64_t start = Now();
+  int i;
+
+  for(i = 0; i < BENCH_CALLS; ++i)
+    ASSERT_EQ(-INVALID_DESC, Call(TrapRead, CHANNELS_COUNT, USER_ARGS, 1, 0));
+  Report("trap dispatch", start);
+}
+
+// the syscall hook pauses the nexe cpu clock on exit and resumes it on return
+TEST_F(TrapTests, CpuClockBenchTest)
+{
+  int64_t start;
+  int i;
+
+  StartCpuClock(&app);
+  start = Now();
+  for(i = 0; i < BENCH_CALLS; ++i)
+  {
+    PauseCpuClock(&app);
+    ResumeCpuClock(&app);
+  }
+  Report("cpu clock pause/resume", start);
+  StopCpuClock(&app);
+  EXPECT_LE(0, GetHostCpuTime());
+}
+
+// every trap pays the syscall budget. the exceeding one stops the nexe
+TEST_F(TrapTests, SyscallsLimitTest)
+{
+  int64_t start;
+  int i;
+
+  setup.max_syscalls = BENCH_CALLS;
+  AccountingCtor(&app);
+  StartCpuClock(&app);
+  PauseCpuClock(&app); /* as the syscall hook does */
+
+  start = Now();
+  for(i = 0; i < BENCH_CALLS; ++i)
+    ASSERT_EQ(-INVALID_DESC, Call(TrapRead, CHANNELS_COUNT, USER_ARGS, 1, 0));
+  Report("trap dispatch with syscalls limit", start);
+  EXPECT_EQ(RetCodeOk, GetStopCode());
+
+  EXPECT_EQ(-OUT_OF_LIMITS, Call(TrapRead, CHANNELS_COUNT, USER_ARGS, 1, 0));
+  EXPECT_EQ(RetCodeSyscallsLimit, GetStopCode());
+  EXPECT_TRUE(accounting.violations & 1 << LimitSyscalls);
+  StopCpuClock(&app);
+
+  AccountingSync(&app);
+  EXPECT_EQ(BENCH_CALLS + 1, setup.cnt_syscalls);
+}
+
+// level 4 message below the verbosity. NaClLogTrace does not cost even this
+TEST_F(TrapTests, LogBenchTest)
+{
+  int64_t start = Now();
+  int i;
+
+  for(i = 0; i < BENCH_CALLS; ++i)
+    NaClLog(4, "suppressed message %d\n", i);
+  Report("suppressed log", start);
+}
+
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
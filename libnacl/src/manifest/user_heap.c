@@ -0,0 +1,101 @@
+/*
+ * sandbox local heap engine
+ *
+ *  Created on: Jan 18, 2012
+ *      Author: d'b
+ */
+#include <sys/mman.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/manifest/user_heap.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/service_runtime/sel_memory.h"
+
+/* the heap (user addresses). there is only one nexe per zerovm */
+static uintptr_t heap_start; /* heap_ptr, 0 - heap is not reserved */
+static uintptr_t heap_end; /* end of the reserved region */
+static uintptr_t heap_open; /* pages below are accessible */
+
+uintptr_t UserHeapCtor(struct NaClApp *nap, uint32_t size, enum HeapCommit mode)
+{
+  uintptr_t start = NaClRoundAllocPage(nap->break_addr);
+  size_t npages;
+
+  size = NaClRoundAllocPage(size);
+  npages = size >> NACL_PAGESHIFT;
+
+  /* the region must be free: channels and stack are already mapped */
+  if(start + size < start || start + size > ((uintptr_t)1U << nap->addr_bits)
+      || NaClVmmapFindMapSpaceAboveHint(&nap->mem_map, start, npages)
+          != start >> NACL_PAGESHIFT)
+  {
+    NaClLog(LOG_ERROR, "no room for 0x%x bytes heap at 0x%lx\n", size, start);
+    return 0;
+  }
+
+  /* eager commit takes the memory now, so a job either gets MemMax or fails at start */
+  if(mode == HeapCommitEager)
+  {
+    void *p = mmap((void*)NaClUserToSys(nap, start), size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_POPULATE, -1, 0);
+    if(p == MAP_FAILED)
+    {
+      NaClLog(LOG_ERROR, "cannot commit 0x%x bytes heap\n", size);
+      return 0;
+    }
+  }
+
+  /* the map tells the pages protection: the lazy heap is closed yet */
+  heap_open = mode == HeapCommitEager ? start + size : start;
+  if(!NaClVmmapAdd(&nap->mem_map, start >> NACL_PAGESHIFT, npages,
+      mode == HeapCommitEager ? PROT_READ | PROT_WRITE : PROT_NONE, NULL))
+  {
+    NaClLog(LOG_ERROR, "cannot add heap to the memory map\n");
+    return 0;
+  }
+
+  heap_start = start;
+  heap_end = start + size;
+  NaClLog(2, "heap 0x%lx..0x%lx reserved, %s commit\n", heap_start, heap_end,
+      mode == HeapCommitEager ? "eager" : "lazy");
+  return heap_start;
+}
+
+int UserHeapActive(void)
+{
+  return heap_start != 0;
+}
+
+uintptr_t UserHeapSetBreak(struct NaClApp *nap, uintptr_t new_break)
+{
+  struct SetupList *policy = nap->manifest->user_setup;
+  uintptr_t limit = heap_start + policy->max_mem;
+
+  /* nexe may lower max_mem with the setup call, but never raise the reservation */
+  if(limit > heap_end || policy->max_mem < 0) limit = heap_end;
+  if(new_break > limit)
+  {
+    NaClLog(3, "break 0x%lx is above MemMax\n", new_break);
+    return nap->break_addr;
+  }
+
+  /* open the pages up to the new break. shrinking keeps them open */
+  if(new_break > heap_open)
+  {
+    uintptr_t open = NaClRoundAllocPage(new_break);
+    if(0 != NaCl_mprotect((void*)NaClUserToSys(nap, heap_open),
+        open - heap_open, PROT_READ | PROT_WRITE))
+    {
+      NaClLog(LOG_ERROR, "cannot open heap 0x%lx..0x%lx\n", heap_open, open);
+      return nap->break_addr;
+    }
+    /* the open part is one entry, the map does not grow with the break */
+    NaClVmmapUpdate(&nap->mem_map, heap_start >> NACL_PAGESHIFT,
+        (open - heap_start) >> NACL_PAGESHIFT, PROT_READ | PROT_WRITE, NULL, 0);
+    heap_open = open;
+  }
+
+  nap->break_addr = new_break;
+  policy->cnt_mem = new_break > heap_start ? new_break - heap_start : 0;
+  return new_break;
+}
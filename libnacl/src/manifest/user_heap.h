@@ -0,0 +1,45 @@
+/*
+ * sandbox local heap engine. MemMax bytes of the user space right after
+ * the nexe data are reserved before the nexe start and published to the
+ * nexe as heap_ptr. the break only moves inside the reserved region:
+ * growth opens the pages and updates their protection in the memory
+ * map (the open part is kept as one entry), shrinking keeps them open.
+ * cnt_mem follows the break, the break cannot go above heap_ptr + max_mem
+ *
+ *  Created on: Jan 18, 2012
+ *      Author: d'b
+ */
+
+#ifndef USER_HEAP_H_
+#define USER_HEAP_H_
+
+#include "src/service_runtime/sel_ldr.h"
+
+EXTERN_C_BEGIN
+
+/* how the heap pages get host memory. "MemCommit" manifest key */
+enum HeapCommit {
+  HeapCommitLazy, /* pages opened by the break growth, memory taken on touch */
+  HeapCommitEager /* whole heap opened and populated before the nexe start */
+};
+
+/*
+ * reserve "size" bytes of the user space after the nexe data. return
+ * the heap start (user address) or 0 if the space is taken or cannot be
+ * committed. must be called once, after the nexe is loaded
+ */
+uintptr_t UserHeapCtor(struct NaClApp *nap, uint32_t size, enum HeapCommit mode);
+
+/* nonzero if the heap is reserved and serves the break */
+int UserHeapActive(void);
+
+/*
+ * move the break inside the heap. return the new break if successful,
+ * otherwise the current one (sysbrk semantics). update cnt_mem
+ * note: must be called with nap->mu held
+ */
+uintptr_t UserHeapSetBreak(struct NaClApp *nap, uintptr_t new_break);
+
+EXTERN_C_END
+
+#endif /* USER_HEAP_H_ */
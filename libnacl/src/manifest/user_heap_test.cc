@@ -0,0 +1,159 @@
+/*
+ * user_heap_test.cc
+ * unit test over google testing framework
+ * checks the heap engine: the reservation after the nexe data, the
+ * break moves with MemMax, the commit modes and the memory map telling
+ * the heap pages protection
+ *
+ *  Created on: Jan 18, 2012
+ *      Author: d'b
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/service_runtime/sel_mem.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/user_heap.h"
+
+#define ADDR_BITS 24
+#define SPACE ((uintptr_t)1 << ADDR_BITS)
+#define DATA_END 0x100000 /* the nexe break */
+#define STACK_SIZE 0x100000
+#define HEAP_SIZE 0x400000
+
+// Test harness for the heap. the user space is reserved as the loader does
+class UserHeapTests : public ::testing::Test {
+ protected:
+  UserHeapTests()
+  {
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    manifest.user_setup = &setup;
+    app.manifest = &manifest;
+    app.addr_bits = ADDR_BITS;
+    app.break_addr = DATA_END;
+    app.mem_start = (uintptr_t)mmap(NULL, SPACE, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    setup.max_mem = HEAP_SIZE;
+
+    /* the nexe and the stack are in the map */
+    EXPECT_TRUE(NaClVmmapCtor(&app.mem_map));
+    EXPECT_TRUE(NaClVmmapAdd(&app.mem_map, 0, DATA_END >> NACL_PAGESHIFT,
+        PROT_READ | PROT_WRITE, NULL));
+    EXPECT_TRUE(NaClVmmapAdd(&app.mem_map, (SPACE - STACK_SIZE) >> NACL_PAGESHIFT,
+        STACK_SIZE >> NACL_PAGESHIFT, PROT_READ | PROT_WRITE, NULL));
+  }
+
+  ~UserHeapTests()
+  {
+    NaClVmmapDtor(&app.mem_map);
+    munmap((void*)app.mem_start, SPACE);
+  }
+
+  // return the protection the memory map gives to the user address
+  int Prot(uintptr_t addr)
+  {
+    struct NaClVmmapEntry const *entry =
+        NaClVmmapFindPage(&app.mem_map, addr >> NACL_PAGESHIFT);
+    return entry ? entry->prot : -1;
+  }
+
+  // return the number of pages of the map entry of the user address
+  size_t Pages(uintptr_t addr)
+  {
+    struct NaClVmmapEntry const *entry =
+        NaClVmmapFindPage(&app.mem_map, addr >> NACL_PAGESHIFT);
+    return entry ? entry->npages : 0;
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+};
+
+// the lazy heap is closed, the break opens it and the map follows
+TEST_F(UserHeapTests, LazyTest)
+{
+  uintptr_t heap = UserHeapCtor(&app, HEAP_SIZE, HeapCommitLazy);
+
+  ASSERT_EQ(DATA_END, heap);
+  EXPECT_TRUE(UserHeapActive());
+  EXPECT_EQ(PROT_NONE, Prot(heap));
+  EXPECT_EQ(PROT_NONE, Prot(heap + HEAP_SIZE - 1));
+
+  /* the growth opens the pages up to the break */
+  EXPECT_EQ(heap + 100000, UserHeapSetBreak(&app, heap + 100000));
+  EXPECT_EQ(100000, setup.cnt_mem);
+  EXPECT_EQ(PROT_READ | PROT_WRITE, Prot(heap));
+  EXPECT_EQ(PROT_READ | PROT_WRITE, Prot(heap + 100000 - 1));
+  EXPECT_EQ(PROT_NONE, Prot(NaClRoundAllocPage(heap + 100000)));
+  memset((void*)(app.mem_start + heap), 1, 100000);
+
+  /* the open part stays one entry */
+  EXPECT_EQ(heap + 300000, UserHeapSetBreak(&app, heap + 300000));
+  EXPECT_EQ(NaClRoundAllocPage(300000) >> NACL_PAGESHIFT, Pages(heap));
+  EXPECT_EQ(PROT_READ | PROT_WRITE, Prot(heap + 300000 - 1));
+
+  /* shrinking keeps the pages open */
+  EXPECT_EQ(heap + 10, UserHeapSetBreak(&app, heap + 10));
+  EXPECT_EQ(10, setup.cnt_mem);
+  EXPECT_EQ(PROT_READ | PROT_WRITE, Prot(heap + 300000 - 1));
+  memset((void*)(app.mem_start + heap + 200000), 1, 100000);
+}
+
+// the break cannot go above MemMax, lowered by the nexe or not
+TEST_F(UserHeapTests, MemMaxTest)
+{
+  uintptr_t heap = UserHeapCtor(&app, HEAP_SIZE, HeapCommitLazy);
+
+  ASSERT_EQ(DATA_END, heap);
+  EXPECT_EQ(heap + HEAP_SIZE, UserHeapSetBreak(&app, heap + HEAP_SIZE));
+  EXPECT_EQ(heap + HEAP_SIZE, UserHeapSetBreak(&app, heap + HEAP_SIZE + 1));
+  EXPECT_EQ(HEAP_SIZE, setup.cnt_mem);
+
+  /* lowered max_mem takes effect at once */
+  setup.max_mem = 0x1000;
+  EXPECT_EQ(heap + HEAP_SIZE, UserHeapSetBreak(&app, heap + 0x2000));
+  EXPECT_EQ(heap + 0x1000, UserHeapSetBreak(&app, heap + 0x1000));
+  EXPECT_EQ(0x1000, setup.cnt_mem);
+
+  /* raised max_mem does not raise the reservation */
+  setup.max_mem = 2 * HEAP_SIZE;
+  EXPECT_EQ(heap + 0x1000, UserHeapSetBreak(&app, heap + HEAP_SIZE + 1));
+}
+
+// the eager heap is open and populated before the nexe start
+TEST_F(UserHeapTests, EagerTest)
+{
+  uintptr_t heap = UserHeapCtor(&app, HEAP_SIZE, HeapCommitEager);
+  unsigned char vec;
+
+  ASSERT_EQ(DATA_END, heap);
+  EXPECT_EQ(PROT_READ | PROT_WRITE, Prot(heap));
+  EXPECT_EQ(HEAP_SIZE >> NACL_PAGESHIFT, Pages(heap));
+  EXPECT_EQ(0, mincore((void*)(app.mem_start + heap + HEAP_SIZE - NACL_PAGESIZE),
+      NACL_PAGESIZE, &vec));
+  EXPECT_EQ(1, vec & 1);
+  memset((void*)(app.mem_start + heap), 1, HEAP_SIZE);
+
+  /* the break moves w/o the map updates */
+  EXPECT_EQ(heap + 100000, UserHeapSetBreak(&app, heap + 100000));
+  EXPECT_EQ(HEAP_SIZE >> NACL_PAGESHIFT, Pages(heap));
+}
+
+// the heap which does not fit below the stack is not reserved
+TEST_F(UserHeapTests, NoRoomTest)
+{
+  EXPECT_EQ(0, UserHeapCtor(&app, SPACE - STACK_SIZE - DATA_END + 1, HeapCommitLazy));
+  EXPECT_EQ(0, UserHeapCtor(&app, SPACE, HeapCommitLazy));
+  EXPECT_EQ(DATA_END, UserHeapCtor(&app, SPACE - STACK_SIZE - DATA_END, HeapCommitLazy));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+/*
+ * Timeout/KillTimeout watchdog. posix timer on the monotonic clock,
+ * its signal is sent to the nexe thread
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "src/platform/nacl_exit.h"
+#include "src/platform/nacl_log.h"
+#include "src/service_runtime/nacl_signal.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/watchdog.h"
+
+#define WATCHDOG_SIGNAL SIGALRM
+
+static timer_t timer;
+static int armed;
+static int handler_id; /* in the nacl signal handlers list */
+static int32_t kill_timeout;
+static volatile sig_atomic_t expired; /* Timeout is over */
+
+/* (re)arm the timer for "seconds", 0 - disarm. async signal safe */
+static void Arm(int32_t seconds)
+{
+  struct itimerspec its;
+
+  memset(&its, 0, sizeof its);
+  its.it_value.tv_sec = seconds;
+  timer_settime(timer, 0, &its, NULL);
+}
+
+static enum NaClSignalResult WatchdogHandler(int signo, void *ctx)
+{
+  struct NaClSignalContext context;
+  sigset_t set;
+
+  if(signo != WATCHDOG_SIGNAL) return NACL_SIGNAL_SEARCH;
+
+  /* zerovm could not finish the session in KillTimeout */
+  if(expired)
+  {
+    NaClSignalErrorMessage("kill timeout expired, zerovm exits w/o report\n");
+    NaClExit((-signo) & 0xff);
+  }
+
+  /* stop the nexe and give zerovm KillTimeout to finish the session */
+  expired = 1;
+  Arm(kill_timeout > 0 ? kill_timeout : 0);
+
+  /* the nexe stop leaves the handler with longjmp, the kill must get through */
+  sigemptyset(&set);
+  sigaddset(&set, WATCHDOG_SIGNAL);
+  pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+  NaClSignalContextFromHandler(&context, ctx);
+  StopNexe(RetCodeTimeout, NaClSignalContextIsUntrusted(&context));
+  return NACL_SIGNAL_RETURN;
+}
+
+void WatchdogCtor(struct NaClApp *nap)
+{
+  struct sigevent sev;
+  int32_t timeout;
+
+  if(!nap->manifest) return;
+  timeout = nap->manifest->system_setup->timeout;
+  if(timeout <= 0) return;
+  kill_timeout = nap->manifest->system_setup->kill_timeout;
+  expired = 0;
+
+  handler_id = NaClSignalHandlerAdd(WatchdogHandler);
+  COND_ABORT(!handler_id, "cannot add watchdog signal handler");
+  NaClSignalTimerInit(WATCHDOG_SIGNAL);
+
+  /* the helper threads block all signals, but the nexe one must get it */
+  memset(&sev, 0, sizeof sev);
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = WATCHDOG_SIGNAL;
+  sev.sigev_notify_thread_id = syscall(SYS_gettid);
+  COND_ABORT(timer_create(CLOCK_MONOTONIC, &sev, &timer) != 0,
+      "cannot create watchdog timer");
+  armed = 1;
+  Arm(timeout);
+  NaClLog(2, "watchdog: timeout %d s, kill timeout %d s\n", timeout, kill_timeout);
+}
+
+void WatchdogDtor()
+{
+  if(!armed) return;
+  timer_delete(timer);
+  armed = 0;
+  NaClSignalTimerFini(WATCHDOG_SIGNAL);
+  NaClSignalHandlerRemove(handler_id);
+}
@@ -0,0 +1,33 @@
+/*
+ * wall clock limits of the session. "Timeout" (seconds) is counted
+ * from the nexe start. when it expires the nexe is stopped as if it
+ * called exit and the report gets RetCodeTimeout. "KillTimeout"
+ * (seconds) is given to zerovm after that to finish the report, then
+ * the process exits w/o it. the timer signal goes through the nacl
+ * signal handlers list, the traps do not pay for the watchdog
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+
+#ifndef WATCHDOG_H_
+#define WATCHDOG_H_
+
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+struct NaClApp;
+
+/*
+ * arm the watchdog. must be called from the nexe thread right before
+ * the nexe start. w/o manifest or Timeout does nothing. abort if fail
+ */
+void WatchdogCtor(struct NaClApp *nap);
+
+/* disarm the watchdog after the report is written */
+void WatchdogDtor();
+
+EXTERN_C_END
+
+#endif /* WATCHDOG_H_ */
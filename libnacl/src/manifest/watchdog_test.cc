@@ -0,0 +1,161 @@
+/*
+ * watchdog_test.cc
+ * unit test over google testing framework
+ * checks the nexe stop by Timeout in the nexe code and in zerovm, the
+ * exit after KillTimeout and the nexe stop by CPUMax
+ *
+ *  Created on: Jan 26, 2012
+ *      Author: d'b
+ */
+
+#include <setjmp.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "gtest/gtest.h"
+#include "src/platform/nacl_log.h"
+#include "src/service_runtime/nacl_globals.h"
+#include "src/service_runtime/nacl_signal.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/trap.h"
+#include "src/manifest/watchdog.h"
+
+#define TIMEOUT 1 /* seconds */
+#define NANOS_PER_SECOND 1000000000LL
+
+// Test harness for the watchdog. the "nexe" runs in this thread
+class WatchdogTests : public ::testing::Test {
+ protected:
+  WatchdogTests()
+  {
+    memset(&app, 0, sizeof app);
+    memset(&manifest, 0, sizeof manifest);
+    memset(&setup, 0, sizeof setup);
+    memset(&system, 0, sizeof system);
+    manifest.user_setup = &setup;
+    manifest.system_setup = &system;
+    app.manifest = &manifest;
+    gnap = &app;
+    system.timeout = TIMEOUT;
+  }
+
+  ~WatchdogTests()
+  {
+    WatchdogDtor();
+  }
+
+  struct NaClApp app;
+  struct Manifest manifest;
+  struct SetupList setup;
+  struct SystemList system;
+};
+
+// return monotonic clock in nanoseconds
+static int64_t Now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * NANOS_PER_SECOND + t.tv_nsec;
+}
+
+// the "nexe" here is trusted code, it is stopped on the next trap
+TEST_F(WatchdogTests, UserTimeoutTest)
+{
+  volatile int64_t start = Now();
+
+  if(setjmp(user_exit) == 0)
+  {
+    WatchdogCtor(&app);
+    StartCpuClock(&app);
+    while(Now() - start < 3 * TIMEOUT * NANOS_PER_SECOND)
+    {
+      PauseCpuClock(&app);
+      ResumeCpuClock(&app);
+    }
+    FAIL() << "the nexe is not stopped";
+  }
+  StopCpuClock(&app);
+  EXPECT_EQ(RetCodeTimeout, GetStopCode());
+  EXPECT_NEAR(TIMEOUT * NANOS_PER_SECOND, Now() - start, NANOS_PER_SECOND / 10);
+}
+
+// zerovm finishes the request, the nexe is stopped on the return
+TEST_F(WatchdogTests, HostTimeoutTest)
+{
+  volatile int served = 0;
+
+  if(setjmp(user_exit) == 0)
+  {
+    WatchdogCtor(&app);
+    StartCpuClock(&app);
+    PauseCpuClock(&app);
+    sleep(3 * TIMEOUT); /* a blocked host call is interrupted */
+    served = 1;
+    ResumeCpuClock(&app);
+    FAIL() << "the nexe is not stopped";
+  }
+  StopCpuClock(&app);
+  EXPECT_EQ(1, served);
+  EXPECT_EQ(RetCodeTimeout, GetStopCode());
+}
+
+// CPUMax: the nexe thread cpu timer stops the nexe on the next trap
+TEST_F(WatchdogTests, CpuLimitTest)
+{
+  volatile int traps = 0;
+
+  setup.max_cpu = 200; /* milliseconds */
+  if(setjmp(user_exit) == 0)
+  {
+    StartCpuClock(&app);
+    for(;;)
+    {
+      PauseCpuClock(&app);
+      ++traps;
+      ResumeCpuClock(&app);
+    }
+  }
+  StopCpuClock(&app);
+  EXPECT_LT(0, traps);
+  EXPECT_EQ(RetCodeCpuLimit, GetStopCode());
+  EXPECT_NEAR(200, GetUserCpuTime() / 1000000 + GetHostCpuTime() / 1000000, 50);
+}
+
+// the nexe which finishes in time is not touched
+TEST_F(WatchdogTests, NoTimeoutTest)
+{
+  if(setjmp(user_exit) == 0)
+  {
+    WatchdogCtor(&app);
+    StartCpuClock(&app);
+  }
+  StopCpuClock(&app);
+  WatchdogDtor();
+  sleep(TIMEOUT + 1);
+  EXPECT_EQ(RetCodeOk, GetStopCode());
+}
+
+// zerovm which cannot finish the session in KillTimeout exits
+TEST_F(WatchdogTests, KillTimeoutTest)
+{
+  system.kill_timeout = TIMEOUT;
+  EXPECT_EXIT({
+    if(setjmp(user_exit) == 0)
+    {
+      WatchdogCtor(&app);
+      StartCpuClock(&app);
+      for(;;);
+    }
+    for(;;) pause(); /* the report hangs */
+  }, ::testing::ExitedWithCode((-SIGALRM) & 0xff), "kill timeout expired");
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  testing::FLAGS_gtest_death_test_style = "threadsafe";
+  NaClSignalHandlerInit();
+  NaClSignalHandlerFini(); /* as w/o -S, only the handlers list is kept */
+  return RUN_ALL_TESTS();
+}
@@ -69,7 +69,7 @@ int32_t ZMQSysOpen(struct NaClAppThread *natp, char *name, int flags, int mode)
 	 * just open the local file w/o "http://" prefix to test this function
 	 * example of file name: "http://dummy_zmq.dat" (will open "dummy_zmq.dat")
 	 */
-	hd = malloc(sizeof *hd);
+	hd = NaClSlabAlloc(&natp->nap->host_descs, sizeof *hd);
 	if (NULL == hd)
 	{
 		return -NACL_ABI_ENOMEM;
@@ -83,7 +83,7 @@ int32_t ZMQSysOpen(struct NaClAppThread *natp, char *name, int flags, int mode)
 	/* add a new record to the file descriptors table */
 	if (0 == retval)
 	{
-		retval = NaClSetAvail(natp->nap, ((struct NaClDesc *) NaClDescIoDescMake(hd)));
+		retval = NaClSetAvail(natp->nap, ((struct NaClDesc *) NaClDescIoDescMakeSlab(hd, &natp->nap->host_descs)));
 		NaClLog(1, "Entered url into open file table at %d\n", retval);
 	}
 
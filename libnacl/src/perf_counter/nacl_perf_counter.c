@@ -9,8 +9,14 @@
  * Simple Perf Counter Layer to be used by the rest of the service run time
  */
 
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "src/gio/gio.h"
 #include "src/platform/nacl_log.h"
-#include "src/platform/nacl_time.h"
 #include "include/portability.h"
 #include "include/portability_string.h"
 #include "include/nacl_assert.h"
@@ -18,6 +24,104 @@
 #include "src/perf_counter/nacl_perf_counter.h"
 
 #define LAST_IDX(X) (NACL_ARRAY_SIZE(X)-1)
+#define NANOS_PER_MICRO (1000)
+#define NANOS_PER_UNIT  (1000 * 1000 * 1000)
+
+static char const *const kHwCounterNames[NACL_PERF_HW_COUNTERS] = {
+  "instructions", "cycles", "cache_misses", "page_faults"
+};
+
+/*
+ * perf_event_open() descriptors, shared by all the counters of the
+ * process.  -2 means "not initialized yet", -1 means "not available".
+ */
+static int hw_fd[NACL_PERF_HW_COUNTERS] = { -2, -2, -2, -2 };
+
+static void NaClPerfHwInit(void) {
+  static const struct {
+    uint32_t type;
+    uint64_t config;
+  } kEvents[NACL_PERF_HW_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+  };
+  struct perf_event_attr attr;
+  int i;
+
+  if (-2 != hw_fd[0]) {
+    return;
+  }
+
+  for (i = 0; i < NACL_PERF_HW_COUNTERS; ++i) {
+    hw_fd[i] = -1;
+  }
+  if (NULL == getenv("NACL_PERF_HW")) {
+    return;
+  }
+
+  for (i = 0; i < NACL_PERF_HW_COUNTERS; ++i) {
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = kEvents[i].type;
+    attr.config = kEvents[i].config;
+    attr.exclude_hv = 1;
+    hw_fd[i] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (hw_fd[i] < 0) {
+      NaClLog(1, "NaClPerfHwInit: %s counter is not available\n",
+              kHwCounterNames[i]);
+      hw_fd[i] = -1;
+    }
+  }
+}
+
+static void NaClPerfHwRead(uint64_t *hw) {
+  int i;
+
+  for (i = 0; i < NACL_PERF_HW_COUNTERS; ++i) {
+    hw[i] = 0;
+    if (hw_fd[i] >= 0 &&
+        sizeof hw[i] != read(hw_fd[i], &hw[i], sizeof hw[i])) {
+      hw[i] = 0;
+    }
+  }
+}
+
+static int64_t NaClPerfNow(void) {
+  struct timespec ts;
+
+  /* busy loop until we succeed, damn it */
+  while (0 != clock_gettime(CLOCK_MONOTONIC_RAW, &ts));
+  return (int64_t) ts.tv_sec * NANOS_PER_UNIT + ts.tv_nsec;
+}
+
+/*
+ * Make room for one more sample.  Returns 0 if the buffer cannot grow.
+ */
+static int NaClPerfCounterReserve(struct NaClPerfCounter *sv) {
+  struct NaClPerfCounterSample *list;
+  uint32_t capacity;
+
+  if (sv->samples < sv->capacity) {
+    return 1;
+  }
+  capacity = 2 * sv->capacity;
+  if (sv->sample_list == sv->inline_samples) {
+    list = malloc(capacity * sizeof *list);
+    if (NULL != list) {
+      memcpy(list, sv->inline_samples, sizeof sv->inline_samples);
+    }
+  } else {
+    list = realloc(sv->sample_list, capacity * sizeof *list);
+  }
+  if (NULL == list) {
+    return 0;
+  }
+  sv->sample_list = list;
+  sv->capacity = capacity;
+  return 1;
+}
 
 void NaClPerfCounterCtor(struct NaClPerfCounter *sv,
                          const char *app_name) {
@@ -27,6 +131,9 @@ void NaClPerfCounterCtor(struct NaClPerfCounter *sv,
   };
 
   memset(sv, 0, sizeof(struct NaClPerfCounter));
+  sv->sample_list = sv->inline_samples;
+  sv->capacity = NACL_ARRAY_SIZE(sv->inline_samples);
+  NaClPerfHwInit();
 
   if (NULL == app_name) {
     app_name = "__unknown_app__";
@@ -38,14 +145,19 @@ void NaClPerfCounterCtor(struct NaClPerfCounter *sv,
   /* Being explicit about string termination */
   sv->app_name[LAST_IDX(sv->app_name)] = '\0';
 
-  strncpy(sv->sample_names[0], "__start__", LAST_IDX(sv->sample_names[0]));
-
+  NaClPerfCounterMark(sv, "__start__");
+}
 
-  while (0 != NaClGetTimeOfDay(&sv->sample_list[sv->samples])) {
-    /* repeat until we get a sample */
+void NaClPerfCounterDtor(struct NaClPerfCounter *sv) {
+  if (NULL == sv) {
+    return;
   }
-
-  sv->samples++;
+  if (sv->sample_list != sv->inline_samples) {
+    free(sv->sample_list);
+  }
+  sv->sample_list = sv->inline_samples;
+  sv->capacity = NACL_ARRAY_SIZE(sv->inline_samples);
+  sv->samples = 0;
 }
 
 
@@ -56,49 +168,114 @@ void NaClPerfCounterCtor(struct NaClPerfCounter *sv,
  * is actually the SECOND sample.
  */
 int NaClPerfCounterMark(struct NaClPerfCounter *sv, const char *ev_name) {
+  struct NaClPerfCounterSample *sample;
+
   if ((NULL == sv) || (NULL == ev_name)) {
     NaClLog(LOG_ERROR, "NaClPerfCounterMark received null args\n");
     return -1;
   }
-  if (sv->samples >= NACL_MAX_PERF_COUNTER_SAMPLES) {
-    NaClLog(LOG_ERROR, "NaClPerfCounterMark going beyond buffer size\n");
+  if (!NaClPerfCounterReserve(sv)) {
+    NaClLog(LOG_ERROR, "NaClPerfCounterMark cannot grow sample buffer\n");
     return -1;
   }
-  /* busy loop until we succeed, damn it */
-  while (0 != NaClGetTimeOfDay(&(sv->sample_list[sv->samples])));
-
-  /*
-   * This relies upon memset() inside NaClPerfCounterCtor() for
-   * correctness
-   */
 
-  NACL_ASSERT_IS_ARRAY(sv->sample_names[sv->samples]);
+  sample = &sv->sample_list[sv->samples];
+  sample->time_ns = NaClPerfNow();
+  sample->depth = sv->depth;
+  NaClPerfHwRead(sample->hw);
 
-  strncpy(sv->sample_names[sv->samples], ev_name,
-          LAST_IDX(sv->sample_names[sv->samples]));
+  NACL_ASSERT_IS_ARRAY(sample->name);
+  strncpy(sample->name, ev_name, LAST_IDX(sample->name));
   /* Being explicit about string termination */
-  sv->sample_names[sv->samples][LAST_IDX(sv->sample_names[sv->samples])] =
-    '\0';
+  sample->name[LAST_IDX(sample->name)] = '\0';
 
   return (sv->samples)++;
 }
 
+int NaClPerfCounterEnter(struct NaClPerfCounter *sv, const char *scope_name) {
+  struct NaClPerfCounterFrame *frame;
+  struct NaClPerfCounterScope *scope = NULL;
+  uint32_t i;
+
+  if ((NULL == sv) || (NULL == scope_name)) {
+    NaClLog(LOG_ERROR, "NaClPerfCounterEnter received null args\n");
+    return -1;
+  }
+  if (sv->depth >= NACL_MAX_PERF_COUNTER_DEPTH) {
+    NaClLog(LOG_ERROR, "NaClPerfCounterEnter nesting is too deep\n");
+    return -1;
+  }
+
+  /* scopes are few, linear search is cheaper than hashing */
+  for (i = 0; i < sv->scopes; ++i) {
+    if (sv->scope_list[i].depth == sv->depth &&
+        0 == strncmp(sv->scope_list[i].name, scope_name,
+                     LAST_IDX(sv->scope_list[i].name))) {
+      scope = &sv->scope_list[i];
+      break;
+    }
+  }
+  if (NULL == scope) {
+    if (sv->scopes >= NACL_MAX_PERF_COUNTER_SCOPES) {
+      NaClLog(LOG_ERROR, "NaClPerfCounterEnter going beyond scope table\n");
+      return -1;
+    }
+    scope = &sv->scope_list[sv->scopes++];
+    scope->depth = sv->depth;
+    scope->min_ns = INT64_MAX;
+    strncpy(scope->name, scope_name, LAST_IDX(scope->name));
+    scope->name[LAST_IDX(scope->name)] = '\0';
+  }
+
+  frame = &sv->stack[sv->depth++];
+  frame->scope = (uint32_t) (scope - sv->scope_list);
+  NaClPerfHwRead(frame->hw);
+  frame->start_ns = NaClPerfNow();
+
+  return sv->depth;
+}
+
+int64_t NaClPerfCounterLeave(struct NaClPerfCounter *sv) {
+  struct NaClPerfCounterFrame *frame;
+  struct NaClPerfCounterScope *scope;
+  uint64_t hw[NACL_PERF_HW_COUNTERS];
+  int64_t elapsed;
+  int i;
+
+  if ((NULL == sv) || (0 == sv->depth)) {
+    NaClLog(LOG_ERROR, "NaClPerfCounterLeave without open scope\n");
+    return -1;
+  }
+
+  frame = &sv->stack[--sv->depth];
+  elapsed = NaClPerfNow() - frame->start_ns;
+  NaClPerfHwRead(hw);
+
+  scope = &sv->scope_list[frame->scope];
+  ++scope->count;
+  scope->total_ns += elapsed;
+  if (elapsed < scope->min_ns) scope->min_ns = elapsed;
+  if (elapsed > scope->max_ns) scope->max_ns = elapsed;
+  for (i = 0; i < NACL_PERF_HW_COUNTERS; ++i) {
+    scope->hw[i] += hw[i] - frame->hw[i];
+  }
+
+  return elapsed;
+}
+
 
 int64_t NaClPerfCounterInterval(struct NaClPerfCounter *sv,
                                 uint32_t a, uint32_t b) {
   if ((NULL != sv) && (a < ((unsigned)sv->samples)) &&
-      (b < ((unsigned)sv->samples)) &&
-      (sv->samples <= NACL_MAX_PERF_COUNTER_SAMPLES)) {
+      (b < ((unsigned)sv->samples))) {
     uint32_t lo = (a < b)? a : b;
     uint32_t hi = (b < a)? a : b;
-    int64_t seconds = (sv->sample_list[hi].nacl_abi_tv_sec -
-                       sv->sample_list[lo].nacl_abi_tv_sec);
-    int64_t usec = (sv->sample_list[hi].nacl_abi_tv_usec -
-                    sv->sample_list[lo].nacl_abi_tv_usec);
-    int64_t rtn = seconds * NACL_MICROS_PER_UNIT + usec;
+    int64_t rtn = (sv->sample_list[hi].time_ns -
+                   sv->sample_list[lo].time_ns) / NANOS_PER_MICRO;
 
     NaClLog(1, "NaClPerfCounterInterval(%s %s:%s): %"NACL_PRId64" microsecs\n",
-            sv->app_name, sv->sample_names[lo], sv->sample_names[hi], rtn);
+            sv->app_name, sv->sample_list[lo].name, sv->sample_list[hi].name,
+            rtn);
 
     return rtn;
   }
@@ -118,3 +295,99 @@ int64_t NaClPerfCounterIntervalTotal(struct NaClPerfCounter *sv) {
   }
   return -1;
 }
+
+enum NaClPerfDumpFormat NaClPerfCounterDumpFormat(void) {
+  char const *env = getenv("NACL_PERF_COUNTER");
+
+  if (NULL == env) {
+    return NACL_PERF_DUMP_NONE;
+  }
+  if (0 == strcmp(env, "json")) {
+    return NACL_PERF_DUMP_JSON;
+  }
+  return NACL_PERF_DUMP_TEXT;
+}
+
+static void NaClPerfDumpHw(struct Gio *gp,
+                           enum NaClPerfDumpFormat format,
+                           uint64_t const *hw) {
+  int i;
+
+  for (i = 0; i < NACL_PERF_HW_COUNTERS; ++i) {
+    if (NACL_PERF_DUMP_JSON == format) {
+      gprintf(gp, ",\"%s\":%"NACL_PRIu64, kHwCounterNames[i], hw[i]);
+    } else {
+      gprintf(gp, " %s=%"NACL_PRIu64, kHwCounterNames[i], hw[i]);
+    }
+  }
+}
+
+void NaClPerfCounterDump(struct NaClPerfCounter *sv,
+                         struct Gio *gp,
+                         enum NaClPerfDumpFormat format) {
+  int json = (NACL_PERF_DUMP_JSON == format);
+  uint64_t hw[NACL_PERF_HW_COUNTERS];
+  uint32_t i;
+  int j;
+
+  if ((NULL == sv) || (NULL == gp) || (NACL_PERF_DUMP_NONE == format)) {
+    return;
+  }
+
+  if (json) {
+    gprintf(gp, "{\"app\":\"%s\",\"samples\":[", sv->app_name);
+  } else {
+    gprintf(gp, "perf app=%s samples=%u scopes=%u\n",
+            sv->app_name, sv->samples, sv->scopes);
+  }
+
+  for (i = 0; i < sv->samples; ++i) {
+    struct NaClPerfCounterSample *s = &sv->sample_list[i];
+    struct NaClPerfCounterSample *prev = &sv->sample_list[i ? i - 1 : 0];
+
+    for (j = 0; j < NACL_PERF_HW_COUNTERS; ++j) {
+      hw[j] = s->hw[j] - prev->hw[j];
+    }
+    if (json) {
+      gprintf(gp, "%s{\"name\":\"%s\",\"depth\":%u,\"t_ns\":%"NACL_PRId64
+              ",\"delta_ns\":%"NACL_PRId64, i ? "," : "", s->name, s->depth,
+              s->time_ns - sv->sample_list[0].time_ns,
+              s->time_ns - prev->time_ns);
+      NaClPerfDumpHw(gp, format, hw);
+      gprintf(gp, "}");
+    } else {
+      gprintf(gp, "mark %u %s depth=%u t_ns=%"NACL_PRId64
+              " delta_ns=%"NACL_PRId64, i, s->name, s->depth,
+              s->time_ns - sv->sample_list[0].time_ns,
+              s->time_ns - prev->time_ns);
+      NaClPerfDumpHw(gp, format, hw);
+      gprintf(gp, "\n");
+    }
+  }
+
+  if (json) {
+    gprintf(gp, "],\"scopes\":[");
+  }
+  for (i = 0; i < sv->scopes; ++i) {
+    struct NaClPerfCounterScope *s = &sv->scope_list[i];
+    int64_t min_ns = s->count ? s->min_ns : 0;
+
+    if (json) {
+      gprintf(gp, "%s{\"name\":\"%s\",\"depth\":%u,\"count\":%"NACL_PRIu64
+              ",\"total_ns\":%"NACL_PRId64",\"min_ns\":%"NACL_PRId64
+              ",\"max_ns\":%"NACL_PRId64, i ? "," : "", s->name, s->depth,
+              s->count, s->total_ns, min_ns, s->max_ns);
+      NaClPerfDumpHw(gp, format, s->hw);
+      gprintf(gp, "}");
+    } else {
+      gprintf(gp, "scope %s depth=%u count=%"NACL_PRIu64" total_ns=%"
+              NACL_PRId64" min_ns=%"NACL_PRId64" max_ns=%"NACL_PRId64,
+              s->name, s->depth, s->count, s->total_ns, min_ns, s->max_ns);
+      NaClPerfDumpHw(gp, format, s->hw);
+      gprintf(gp, "\n");
+    }
+  }
+  if (json) {
+    gprintf(gp, "]}\n");
+  }
+}
@@ -11,36 +11,95 @@
  */
 
 #include "include/nacl_base.h"
-#include "src/service_runtime/include/sys/time.h"
+#include "include/portability.h"
 
 EXTERN_C_BEGIN
 
+struct Gio;
+
+/*
+ * Samples are kept inline until NACL_MAX_PERF_COUNTER_SAMPLES is
+ * exceeded, then the buffer moves to the heap and grows as needed.
+ */
 #define NACL_MAX_PERF_COUNTER_SAMPLES  (16)
-#define NACL_MAX_PERF_COUNTER_NAME     (20)
+#define NACL_MAX_PERF_COUNTER_NAME     (40)
+#define NACL_MAX_PERF_COUNTER_DEPTH    (16)
+#define NACL_MAX_PERF_COUNTER_SCOPES   (32)
+
+/*
+ * Optional hardware/software counters read through perf_event_open()
+ * at every sample.  They are enabled process wide by setting the
+ * NACL_PERF_HW environment variable; when not available the values
+ * stay zero.
+ */
+enum NaClPerfHwCounter {
+  NACL_PERF_HW_INSTRUCTIONS,
+  NACL_PERF_HW_CYCLES,
+  NACL_PERF_HW_CACHE_MISSES,
+  NACL_PERF_HW_PAGE_FAULTS,
+  NACL_PERF_HW_COUNTERS
+};
+
+struct NaClPerfCounterSample {
+  int64_t   time_ns;  /* CLOCK_MONOTONIC_RAW */
+  uint32_t  depth;    /* scope nesting level when the mark was taken */
+  uint64_t  hw[NACL_PERF_HW_COUNTERS];
+  char      name[NACL_MAX_PERF_COUNTER_NAME];
+};
+
+/*
+ * Scopes are aggregated by name rather than recorded sample by sample,
+ * so they can be used on hot paths (e.g. every trap) without growing
+ * the sample buffer.
+ */
+struct NaClPerfCounterScope {
+  uint32_t  depth;
+  uint64_t  count;
+  int64_t   total_ns;
+  int64_t   min_ns;
+  int64_t   max_ns;
+  uint64_t  hw[NACL_PERF_HW_COUNTERS];
+  char      name[NACL_MAX_PERF_COUNTER_NAME];
+};
+
+struct NaClPerfCounterFrame {
+  uint32_t  scope;  /* index in scope_list */
+  int64_t   start_ns;
+  uint64_t  hw[NACL_PERF_HW_COUNTERS];
+};
+
 struct NaClPerfCounter {
   char app_name[128]; /* name of the app being run */
 
-  /*
-   * It's a basic NaClGetTimeOfDay() based measurement.
-   */
-
   uint32_t samples;
-  struct nacl_abi_timeval sample_list[NACL_MAX_PERF_COUNTER_SAMPLES];
-  char sample_names[NACL_MAX_PERF_COUNTER_SAMPLES][NACL_MAX_PERF_COUNTER_NAME];
+  uint32_t capacity;
+  struct NaClPerfCounterSample *sample_list;  /* inline_samples or heap */
+  struct NaClPerfCounterSample inline_samples[NACL_MAX_PERF_COUNTER_SAMPLES];
 
-  /*
-   * This struct may be extended in the future to include more
-   * architecture-specific perf measurements.
-   */
+  uint32_t depth;
+  struct NaClPerfCounterFrame stack[NACL_MAX_PERF_COUNTER_DEPTH];
+
+  uint32_t scopes;
+  struct NaClPerfCounterScope scope_list[NACL_MAX_PERF_COUNTER_SCOPES];
+};
+
+enum NaClPerfDumpFormat {
+  NACL_PERF_DUMP_NONE = -1,
+  NACL_PERF_DUMP_TEXT,
+  NACL_PERF_DUMP_JSON
 };
 
 /*
  * Requires a non-null app name.
  * Starts the measurement count by taking the first time measurement.
+ * Note: the object must not be copied, sample_list may point inside it.
  */
 extern void NaClPerfCounterCtor(struct NaClPerfCounter *sv,
                                 const char *app_name);
 
+/* Releases the sample buffer if it was moved to the heap. */
+extern void NaClPerfCounterDtor(struct NaClPerfCounter *sv);
+
 /*
  * Adds one more time measurement sample.
  * Returns the index of the time sample being made.
@@ -49,6 +108,20 @@ extern void NaClPerfCounterCtor(struct NaClPerfCounter *sv,
 extern int NaClPerfCounterMark(struct NaClPerfCounter *sv,
                                const char *ev_name);
 
+/*
+ * Opens a nested scope.  Scopes with the same name and depth are
+ * aggregated (count, total, min, max and hardware counter deltas).
+ * Returns the scope depth or -1 on error.
+ */
+extern int NaClPerfCounterEnter(struct NaClPerfCounter *sv,
+                                const char *scope_name);
+
+/*
+ * Closes the innermost scope.  Returns the time spent in it, in
+ * nanoseconds, or -1 if no scope is open.
+ */
+extern int64_t NaClPerfCounterLeave(struct NaClPerfCounter *sv);
+
 /* Returns the time spent between two sampling points, in microseconds */
 extern int64_t NaClPerfCounterInterval(struct NaClPerfCounter *sv,
                                        uint32_t sample1,
@@ -60,6 +133,22 @@ extern int64_t NaClPerfCounterIntervalLast(struct NaClPerfCounter *sv);
 /* Returns the time spent between all sampling points, in microseconds */
 extern int64_t NaClPerfCounterIntervalTotal(struct NaClPerfCounter *sv);
 
+/*
+ * Returns the dump format requested with the NACL_PERF_COUNTER
+ * environment variable ("text" or "json"), or NACL_PERF_DUMP_NONE.
+ */
+extern enum NaClPerfDumpFormat NaClPerfCounterDumpFormat(void);
+
+/*
+ * Writes all samples and aggregated scopes to gp.  The text format is
+ * one record per line ("mark ..." / "scope ..." followed by key=value
+ * pairs), the JSON format is a single object.  Both are stable: new
+ * fields are only ever appended.
+ */
+extern void NaClPerfCounterDump(struct NaClPerfCounter *sv,
+                                struct Gio *gp,
+                                enum NaClPerfDumpFormat format);
+
 /* Prefix for important events and app_names */
 #define NACL_PERF_IMPORTANT_PREFIX "*"
 
@@ -10,8 +10,10 @@
 #include <unistd.h>
 
 #include "src/platform/nacl_exit.h"
+#include "src/platform/nacl_log_ring.h"
 
 void NaClAbort(void) {
+  NaClLogRingFlush();
 #ifdef COVERAGE
   /* Give coverage runs a chance to flush coverage data */
   exit(-SIGABRT);
@@ -21,6 +23,8 @@ void NaClAbort(void) {
 }
 
 void NaClExit(int err_code) {
+  /* the queued log records, the exit may come from a signal handler */
+  NaClLogRingFlush();
 #ifdef COVERAGE
   /* Give coverage runs a chance to flush coverage data */
   exit(err_code);
@@ -109,6 +109,23 @@ int NaClThreadCreateJoinable(struct NaClThread  *ntp,
                           /* is_detached= */ 0);
 }
 
+int NaClThreadCreateJoinableNoSignals(struct NaClThread  *ntp,
+                                      void               (*start_fn)(void *),
+                                      void               *state,
+                                      size_t             stack_size) {
+  sigset_t  all;
+  sigset_t  old;
+  int       rv;
+
+  /* the new thread inherits the mask of the creator */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  rv = NaClThreadCreate(ntp, start_fn, state, stack_size,
+                        /* is_detached= */ 0);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return rv;
+}
+
 void NaClThreadDtor(struct NaClThread *ntp) {
   /*
    * The threads that we create are not joinable, and we cannot tell
@@ -33,11 +33,16 @@
 
 #include "src/gio/gio.h"
 #include "src/platform/nacl_exit.h"
+#include "src/platform/nacl_log_ring.h"
 #include "src/platform/nacl_sync.h"
 #include "src/platform/nacl_sync_checked.h"
 #include "src/platform/nacl_threads.h"
 #include "src/platform/nacl_timestamp.h"
 
+/* the functions behind the NaClLog and NaClLog2 macros */
+#undef NaClLog
+#undef NaClLog2
+
 /*
  * Three implementation strategies for module-specific logging:
  *
@@ -77,6 +82,7 @@ static int              abort_on_unlock = 0;
 #define NACL_VERBOSITY_UNSET INT_MAX
 
 static int              verbosity = NACL_VERBOSITY_UNSET;
+int                     gNaClLogMaxVerbosity = NACL_VERBOSITY_UNSET;
 static struct Gio       *log_stream = NULL;
 static struct GioFile   log_file_stream;
 static int              timestamp_enabled = 1;
@@ -101,6 +107,23 @@ struct NaClLogModuleVerbosity {
 
 static struct NaClLogModuleVerbosity *gNaClLogModuleVerbosity = NULL;
 
+/*
+ * The NaClLog macro checks the detail level against the highest of
+ * the verbosity levels before the call.  Must follow every change of
+ * them.
+ */
+static void NaClLogUpdateMaxVerbosity_mu(void) {
+  struct NaClLogModuleVerbosity *p;
+  int                           max = verbosity;
+
+  for (p = gNaClLogModuleVerbosity; NULL != p; p = p->next) {
+    if (p->verbosity > max) {
+      max = p->verbosity;
+    }
+  }
+  gNaClLogMaxVerbosity = max;
+}
+
 static FILE *NaClLogFileIoBufferFromFile(char const *log_file) {
   int   log_desc;
   FILE  *log_iob;
@@ -254,6 +277,7 @@ void NaClLogParseAndSetModuleVerbosityMap(char const *module_verbosity_map) {
     assign = strchr(entry_buf, '=');
     if (NULL == assign && !seen_global) {
       verbosity = strtol(entry_buf, (char **) 0, 0);
+      NaClLogUpdateMaxVerbosity_mu();
       seen_global = 1;
     } else {
       *assign = '\0';
@@ -315,6 +339,7 @@ void NaClLogModuleFini(void) {
   struct NaClLogModuleVerbosity *entry;
   struct NaClLogModuleVerbosity *next;
 
+  NaClLogRingStop();
   entry = gNaClLogModuleVerbosity;
   while (entry != NULL) {
     next = entry->next;
@@ -322,6 +347,7 @@ void NaClLogModuleFini(void) {
     entry = next;
   }
   gNaClLogModuleVerbosity = NULL;
+  NaClLogUpdateMaxVerbosity_mu();
   NaClMutexDtor(&log_mu);
 }
 
@@ -330,6 +356,8 @@ void NaClLogTagNext_mu(void) {
 }
 
 void NaClLogLock(void) {
+  /* the queued records go first */
+  NaClLogRingDrain();
   NaClXMutexLock(&log_mu);
   NaClLogTagNext_mu();
 }
@@ -359,6 +387,7 @@ static INLINE struct Gio *NaClLogGetGio_mu() {
 
 static void NaClLogSetVerbosity_mu(int verb) {
   verbosity = verb;
+  NaClLogUpdateMaxVerbosity_mu();
 }
 
 void NaClLogPreInitSetVerbosity(int verb) {
@@ -385,6 +414,7 @@ void  NaClLogIncrVerbosity(void) {
     verbosity = 0;
   }
   ++verbosity;
+  NaClLogUpdateMaxVerbosity_mu();
   NaClLogUnlock();
 }
 
@@ -394,6 +424,7 @@ int NaClLogGetVerbosity(void) {
   NaClLogLock();
   if (NACL_VERBOSITY_UNSET == verbosity) {
     verbosity = 0;
+    NaClLogUpdateMaxVerbosity_mu();
   }
   v = verbosity;
   NaClLogUnlock();
@@ -439,6 +470,47 @@ void NaClLogDisableTimestamp(void) {
   timestamp_enabled = 0;
 }
 
+int NaClLogTimestampEnabled(void) {
+  return timestamp_enabled;
+}
+
+/*
+ * Write out a batch of records formatted by the ring logger.  The
+ * dying process does not take the lock (the lock owner may be the
+ * one dying) and bypasses stdio for the file streams.
+ */
+void NaClLogRingOutput(char const *text, size_t size, int crash) {
+  struct Gio  *s;
+  ssize_t     written;
+
+  if (crash) {
+    s = log_stream;
+    if (NULL == s) {
+      return;
+    }
+    if (GioFileWrite == s->vtbl->Write) {
+      while (size > 0) {
+        written = write(fileno(((struct GioFile *) s)->iop), text, size);
+        if (written <= 0) {
+          break;
+        }
+        text += written;
+        size -= written;
+      }
+    } else {
+      (void) (*s->vtbl->Write)(s, text, size);
+      (void) (*s->vtbl->Flush)(s);
+    }
+    return;
+  }
+
+  NaClXMutexLock(&log_mu);
+  s = NaClLogGetGio_mu();
+  (void) (*s->vtbl->Write)(s, text, size);
+  (void) (*s->vtbl->Flush)(s);
+  NaClXMutexUnlock(&log_mu);
+}
+
 static void NaClLogOutputTag_mu(struct Gio *s) {
   char timestamp[128];
   int  pid;
@@ -493,6 +565,7 @@ void NaClLogV_mu(int        detail_level,
                  va_list    ap) {
   if (NACL_VERBOSITY_UNSET == verbosity) {
     verbosity = NaClLogDefaultLogVerbosity();
+    NaClLogUpdateMaxVerbosity_mu();
   }
 
   if (detail_level <= verbosity) {
@@ -507,6 +580,9 @@ void NaClLogV(int         detail_level,
   if (detail_level > verbosity) {
     return;
   }
+  if (NACL_VERBOSITY_UNSET != verbosity && NaClLogRingPut(detail_level, fmt, ap)) {
+    return;
+  }
 #endif
   NaClLogLock();
   NaClLogV_mu(detail_level, fmt, ap);
@@ -534,6 +610,7 @@ void NaClLogSetModuleVerbosity_mu(char const  *module_name,
   entry->verbosity = verbosity;
   entry->next = gNaClLogModuleVerbosity;
   gNaClLogModuleVerbosity = entry;
+  NaClLogUpdateMaxVerbosity_mu();
 }
 
 void NaClLogSetModuleVerbosity(char const *module_name,
@@ -580,7 +657,8 @@ static void NaClLogDoLogAndUnsetModuleV(int        detail_level,
   int module_verbosity;
 
   module_verbosity = NaClLogGetModuleVerbosity_mu(gTls_ModuleName);
-  if (detail_level <= module_verbosity) {
+  if (detail_level <= module_verbosity
+      && !NaClLogRingPut(detail_level, fmt, ap)) {
     NaClLogLock();
     NaClLogDoLogV_mu(detail_level, fmt, ap);
     NaClLogUnlock();
@@ -601,7 +679,8 @@ static void NaClLogDoLogAndUnsetModuleV(int        detail_level,
   int         module_verbosity;
 
   module_verbosity = NaClLogGetModuleVerbosity_mu(module_name);
-  if (detail_level <= module_verbosity) {
+  if (detail_level <= module_verbosity
+      && !NaClLogRingPut(detail_level, fmt, ap)) {
     NaClLogLock();
     NaClLogDoLogV_mu(detail_level, fmt, ap);
     NaClLogUnlock();
@@ -651,6 +730,16 @@ void NaClLog(int         detail_level,
   if (detail_level > verbosity) {
     return;
   }
+  if (NACL_VERBOSITY_UNSET != verbosity) {
+    int queued;
+
+    va_start(ap, fmt);
+    queued = NaClLogRingPut(detail_level, fmt, ap);
+    va_end(ap);
+    if (queued) {
+      return;
+    }
+  }
 #endif
 
   NaClLogLock();
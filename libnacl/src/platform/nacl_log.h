@@ -21,7 +21,8 @@
  * the NACL_LOG_MODULE_NAME preprocessor symbol is not defined, then a
  * global verbosity level is used for the logging statements' outputs.
  * NB: the definition of NACL_LOG_MODULE_NAME *must* precede the
- * include.
+ * include.  So must NACL_LOG_MODULE_MAX_LEVEL, the highest detail
+ * level compiled in for the file (see NaClLogIsOn below).
  *
  * Then
  *
@@ -80,6 +81,7 @@
 #ifndef NATIVE_CLIENT_SRC_TRUSTED_PLATFORM_NACL_LOG_H__
 #define NATIVE_CLIENT_SRC_TRUSTED_PLATFORM_NACL_LOG_H__
 
+#include <limits.h>
 #include <stdarg.h>
 
 #ifdef __native_client__
@@ -274,57 +276,104 @@ void NaClLog2(char const *module_name,
 
 /*
  * "Internal" functions.  NaClLogSetModule and
- * NaClLogDoLogAndUnsetModule should only be used by the syntactic
- * macro below.
- *
- * NaClLogSetModule always return 0.  This means in the macro, its
- * continuation is the else clause.  NaClLogDoLogAndUnsetModule is a
- * "naked" identifier in the macro definition, and so will take on the
- * argument list from the apparent argument list of NaClLog.
+ * NaClLogDoLogAndUnsetModule should only be used by the NaClLog
+ * macro below.  NaClLogSetModule always return 0.
  */
 int NaClLogSetModule(char const *module_name);
 void NaClLogDoLogAndUnsetModule(int        detail_level,
                                 char const *fmt,
                                 ...) ATTRIBUTE_FORMAT_PRINTF(2, 3);
 
-#ifdef NACL_LOG_MODULE_NAME
-# define NaClLog                              \
-  if (NaClLogSetModule(NACL_LOG_MODULE_NAME)) \
-    ;                                         \
-  else                                        \
-    NaClLogDoLogAndUnsetModule
+/*
+ * Compile-time and inline elimination of the log statements.
+ *
+ * NACL_LOG_MAX_LEVEL is the highest detail level compiled in for the
+ * whole build (the release build in libnacl/Makefile sets it to 0),
+ * NACL_LOG_MODULE_MAX_LEVEL is the same for one source file.  A
+ * statement above either of them is dead code: the format is still
+ * checked, nothing is compiled.  The statements compiled in compare
+ * the detail level with gNaClLogMaxVerbosity, the highest of the
+ * default and the module verbosity levels, before the arguments are
+ * evaluated.  So a suppressed
+ *
+ * NaClLog(8, "read result: %.*s\n", size, (char *) buffer);
+ *
+ * costs a load and a compare, not a varargs call.  The exact check
+ * (module verbosity, unset verbosity) is still done by the function.
+ * The negative levels (LOG_INFO .. LOG_FATAL) are never eliminated.
+ */
+#ifndef NACL_LOG_MAX_LEVEL
+# define NACL_LOG_MAX_LEVEL INT_MAX
+#endif
+
+#ifndef NACL_LOG_MODULE_MAX_LEVEL
+# define NACL_LOG_MODULE_MAX_LEVEL NACL_LOG_MAX_LEVEL
+#endif
+
+extern int gNaClLogMaxVerbosity;
+
+#define NaClLogIsOn(detail_level)                     \
+  ((detail_level) < 0                                 \
+   || ((detail_level) <= NACL_LOG_MAX_LEVEL           \
+       && (detail_level) <= NACL_LOG_MODULE_MAX_LEVEL \
+       && (detail_level) <= gNaClLogMaxVerbosity))
 
 /*
  * User code has lines of the form
  *
  * NaClLog(detail_level, format_string, ...);
  *
- * We need to be usable without variadic macros.  So, when
- * NACL_LOG_MODULE_NAME is not defined, the NaClLog statement would
- * just invoke the NaClLog function.  When NACL_LOG_MODULE_NAME *is*
- * defined, however, it expands to:
- *
- * if (NaClLogSetModule(NACL_LOG_MODULE_NAME))
- *   ;
- * else
- *   NaClLogDoLogAndUnsetModule(detail_level, format_string, ...);
+ * which expand to
  *
- * Note that this is a syntactic macro, so that if the original code had
+ * do {
+ *   if (NaClLogIsOn(detail_level))
+ *     (NaClLog)(detail_level, format_string, ...);
+ * } while (0)
  *
- * if (foo)
- *   if (bar)
- *     NaClLog(LOG_WARNING, "EEeeep!\n");
- *   else
- *     printf("!bar\n");
- *
- * the macro expansion for NaClLog would not cause the "else" clauses
- * to mis-bind.
- *
- * Also note that the compiler may generate a warning/suggestion to
- * use braces.  This doesn't occur in the NaCl code base (esp w/
- * -Werror), but may have an impact on untrusted code that use this
- * module.
+ * calling the function (the parenthesized name is not expanded again).
+ * When NACL_LOG_MODULE_NAME is defined, NaClLogSetModule and
+ * NaClLogDoLogAndUnsetModule are called instead.  Note that the
+ * detail level is evaluated twice.
+ */
+#ifdef NACL_LOG_MODULE_NAME
+# define NaClLog(detail_level, ...)                               \
+  do {                                                            \
+    if (NaClLogIsOn(detail_level)) {                              \
+      NaClLogSetModule(NACL_LOG_MODULE_NAME);                     \
+      NaClLogDoLogAndUnsetModule((detail_level), __VA_ARGS__);    \
+    }                                                             \
+  } while (0)
+#else
+# define NaClLog(detail_level, ...)                               \
+  do {                                                            \
+    if (NaClLogIsOn(detail_level)) {                              \
+      (NaClLog)((detail_level), __VA_ARGS__);                     \
+    }                                                             \
+  } while (0)
+#endif
+
+#define NaClLog2(module_name, detail_level, ...)                  \
+  do {                                                            \
+    if (NaClLogIsOn(detail_level)) {                              \
+      (NaClLog2)((module_name), (detail_level), __VA_ARGS__);     \
+    }                                                             \
+  } while (0)
+
+/*
+ * NaClLogTrace is NaClLog for the syscall/trap hot paths.  In the
+ * release build (NDEBUG) it is a syntactic macro with a constant
+ * condition: the format is still checked, but the compiler drops the
+ * call and its arguments are never evaluated, whatever the
+ * NACL_LOG_MAX_LEVEL is.
  */
+#ifdef NDEBUG
+# define NaClLogTrace \
+  if (1)              \
+    ;                 \
+  else                \
+    NaClLog
+#else
+# define NaClLogTrace NaClLog
 #endif
 
 #define LOG_INFO    (-1)
@@ -11,6 +11,9 @@
 #ifndef NATIVE_CLIENT_SRC_TRUSTED_PLATFORM_NACL_LOG_INTERN_H__
 #define NATIVE_CLIENT_SRC_TRUSTED_PLATFORM_NACL_LOG_INTERN_H__
 
+#include <stdarg.h>
+#include <stddef.h>
+
 #include "include/nacl_base.h"
 
 EXTERN_C_BEGIN
@@ -35,6 +38,24 @@ EXTERN_C_BEGIN
  */
 extern void (*gNaClLogAbortBehavior)(void);
 
+/*
+ * Between nacl_log.c and nacl_log_ring.c.
+ *
+ * NaClLogRingPut queues the message if the ring logger runs and the
+ * message can be captured.  Returns nonzero if queued, otherwise the
+ * message must be written synchronously.
+ *
+ * NaClLogRingDrain writes out the queued records.  It is called
+ * before any synchronous output, so the log order is kept.
+ *
+ * NaClLogRingOutput writes the formatted records to the log stream.
+ * The dying process ("crash" set) writes them without locking.
+ */
+int NaClLogRingPut(int detail_level, char const *fmt, va_list ap);
+void NaClLogRingDrain(void);
+void NaClLogRingOutput(char const *text, size_t size, int crash);
+int NaClLogTimestampEnabled(void);
+
 EXTERN_C_END
 
 #endif  /* NATIVE_CLIENT_SRC_TRUSTED_PLATFORM_NACL_LOG_INTERN_H__ */
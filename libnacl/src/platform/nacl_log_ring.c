@@ -0,0 +1,630 @@
+/*
+ * Copyright (c) 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Asynchronous NaClLog output, see nacl_log_ring.h.
+ *
+ * Every thread which logs gets its own single producer, single
+ * consumer ring of fixed size records.  The rings are put to a global
+ * list and never freed, there are only a few threads in zerovm.  The
+ * records of all rings are stamped with a global sequence number, the
+ * writer merges the rings by it.
+ *
+ * The records are written out by whoever owns the "drain": the writer
+ * thread, a thread which is about to log synchronously, a producer
+ * whose ring is full or the dying process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_log_intern.h"
+#include "src/platform/nacl_log_ring.h"
+#include "src/platform/nacl_threads.h"
+
+#define NACL_LOG_RING_RECORDS     256  /* power of 2 */
+#define NACL_LOG_RING_ARGS        16
+#define NACL_LOG_RING_STRINGS     240
+#define NACL_LOG_RING_BATCH       (64 << 10)
+#define NACL_LOG_RING_SPEC_MAX    32
+#define NACL_LOG_RING_SPEC_OUTPUT 1024
+#define NACL_LOG_RING_PERIOD_NS   (50 * 1000 * 1000)
+#define NACL_LOG_RING_STACK       (64 << 10)
+#define NACL_LOG_RING_CRASH_SPINS (1 << 20)
+
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+struct NaClLogRecord {
+  uint64_t    seq;
+  char const  *fmt;
+  int64_t     time_us;  /* wall clock */
+  uint32_t    tid;
+  uint32_t    nargs;
+  uint64_t    args[NACL_LOG_RING_ARGS];  /* stars, integers, doubles bits */
+  char        strings[NACL_LOG_RING_STRINGS];  /* %s copies */
+};
+
+struct NaClLogRing {
+  struct NaClLogRing    *next;
+  volatile uint32_t     head;  /* next record to put. moved by the owner */
+  volatile int          busy;  /* the owner is putting a record */
+  char                  pad[48];
+  volatile uint32_t     tail;  /* next record to write. moved by the drain */
+  struct NaClLogRecord  records[NACL_LOG_RING_RECORDS];
+};
+
+/* what a conversion takes from the arguments */
+enum NaClLogArg {
+  kNaClLogArgNone,  /* %% */
+  kNaClLogArgInt,
+  kNaClLogArgLong,
+  kNaClLogArgDouble,
+  kNaClLogArgPointer,
+  kNaClLogArgString
+};
+
+struct NaClLogSpec {
+  char const      *start;
+  size_t          len;
+  int             stars;  /* "*" width and precision */
+  int             precision;  /* -1 if none, -2 if "*" */
+  enum NaClLogArg arg;
+};
+
+static struct NaClLogRing * volatile  rings = NULL;
+static THREAD struct NaClLogRing      *my_ring = NULL;
+static volatile uint64_t              seq = 0;
+static volatile int                   started = 0;
+static volatile int                   stop = 0;
+static volatile uint32_t              writer_sleeping = 0;
+static volatile uint32_t              drain_owner = 0;  /* thread id + 1 */
+static struct NaClThread              writer;
+static int                            pid;
+static long                           utc_offset;  /* seconds */
+
+/* the drain owner's buffers */
+static char                           batch[NACL_LOG_RING_BATCH];
+static size_t                         batch_size;
+static int                            batch_crash;
+
+static int Futex(volatile uint32_t *addr, int op, uint32_t value,
+                 struct timespec const *timeout) {
+  return syscall(SYS_futex, addr, op, value, timeout, NULL, 0);
+}
+
+/*
+ * Parse the conversion at "p" (past the '%').  Returns the position
+ * after it, or NULL if the conversion cannot be queued.
+ */
+static char const *NaClLogParseSpec(char const *p, struct NaClLogSpec *spec) {
+  int length = 0;  /* 'h' or 'l' */
+
+  spec->start = p - 1;
+  spec->stars = 0;
+  spec->precision = -1;
+
+  while ('\0' != *p && NULL != strchr("-+ #0'", *p)) {
+    ++p;
+  }
+  if ('*' == *p) {
+    ++spec->stars;
+    ++p;
+  } else {
+    while (*p >= '0' && *p <= '9') ++p;
+  }
+  if ('.' == *p) {
+    ++p;
+    if ('*' == *p) {
+      ++spec->stars;
+      spec->precision = -2;
+      ++p;
+    } else {
+      spec->precision = 0;
+      while (*p >= '0' && *p <= '9') {
+        spec->precision = spec->precision * 10 + *p++ - '0';
+      }
+    }
+  }
+  while ('\0' != *p && NULL != strchr("hlqjzt", *p)) {
+    length = 'h' == *p ? 'h' : 'l';
+    ++p;
+  }
+
+  switch (*p) {
+    case '%':
+      spec->arg = kNaClLogArgNone;
+      break;
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+      spec->arg = 'l' == length ? kNaClLogArgLong : kNaClLogArgInt;
+      break;
+    case 'c':
+      if ('l' == length) return NULL;
+      spec->arg = kNaClLogArgInt;
+      break;
+    case 'e': case 'E': case 'f': case 'F':
+    case 'g': case 'G': case 'a': case 'A':
+      spec->arg = kNaClLogArgDouble;
+      break;
+    case 'p':
+      spec->arg = kNaClLogArgPointer;
+      break;
+    case 's':
+      if ('l' == length) return NULL;
+      spec->arg = kNaClLogArgString;
+      break;
+    default:  /* %n, %m, long double, wide and unknown conversions */
+      return NULL;
+  }
+  ++p;
+
+  spec->len = p - spec->start;
+  if (spec->len >= NACL_LOG_RING_SPEC_MAX) {
+    return NULL;
+  }
+  return p;
+}
+
+/* take the arguments of the message into the record. 0 if they do not fit */
+static int NaClLogCapture(struct NaClLogRecord *r, char const *fmt, va_list ap) {
+  struct NaClLogSpec  spec;
+  size_t              strings = 0;
+  size_t              len;
+  char const          *s;
+  int                 precision;
+  int                 i;
+  union {
+    double    d;
+    uint64_t  u;
+  } bits;
+
+  r->nargs = 0;
+  for (fmt = strchr(fmt, '%'); NULL != fmt; fmt = strchr(fmt, '%')) {
+    fmt = NaClLogParseSpec(fmt + 1, &spec);
+    if (NULL == fmt
+        || r->nargs + spec.stars + (kNaClLogArgNone != spec.arg)
+            > NACL_LOG_RING_ARGS) {
+      return 0;
+    }
+
+    for (i = 0; i < spec.stars; ++i) {
+      r->args[r->nargs++] = (int64_t) va_arg(ap, int);
+    }
+    precision = -2 == spec.precision
+        ? (int) r->args[r->nargs - 1] : spec.precision;
+
+    switch (spec.arg) {
+      case kNaClLogArgNone:
+        break;
+      case kNaClLogArgInt:
+        r->args[r->nargs++] = (int64_t) va_arg(ap, int);
+        break;
+      case kNaClLogArgLong:
+        r->args[r->nargs++] = (int64_t) va_arg(ap, long);
+        break;
+      case kNaClLogArgDouble:
+        bits.d = va_arg(ap, double);
+        r->args[r->nargs++] = bits.u;
+        break;
+      case kNaClLogArgPointer:
+        r->args[r->nargs++] = (uintptr_t) va_arg(ap, void *);
+        break;
+      case kNaClLogArgString:
+        s = va_arg(ap, char const *);
+        if (NULL == s) {
+          s = "(null)";
+        }
+        len = precision < 0 ? strlen(s) : strnlen(s, precision);
+        if (strings + len + 1 > sizeof r->strings) {
+          return 0;
+        }
+        memcpy(r->strings + strings, s, len);
+        r->strings[strings + len] = '\0';
+        r->args[r->nargs++] = strings;
+        strings += len + 1;
+        break;
+    }
+  }
+  return 1;
+}
+
+static struct NaClLogRing *NaClLogRingOfThread(void) {
+  struct NaClLogRing *ring;
+
+  if (NULL != my_ring) {
+    return my_ring;
+  }
+  ring = calloc(1, sizeof *ring);
+  if (NULL == ring) {
+    return NULL;
+  }
+  do {
+    ring->next = rings;
+  } while (!__sync_bool_compare_and_swap(&rings, ring->next, ring));
+  return my_ring = ring;
+}
+
+/*
+ * Take the drain.  Returns 0 if the calling thread already owns it (a
+ * signal handler logs in the middle of the drain).  The dying process
+ * takes it from a stuck owner.
+ */
+static int NaClLogDrainLock(int crash) {
+  uint32_t self = NaClThreadId() + 1;
+  uint32_t spins;
+
+  for (spins = 0;
+       !__sync_bool_compare_and_swap(&drain_owner, 0, self);
+       ++spins) {
+    if (self == drain_owner) {
+      return 0;
+    }
+    if (crash && spins > NACL_LOG_RING_CRASH_SPINS) {
+      drain_owner = self;
+      break;
+    }
+    if (crash) {
+      __asm__ __volatile__("pause");
+    } else {
+      sched_yield();
+    }
+  }
+  return 1;
+}
+
+static void NaClLogDrainUnlock(void) {
+  __sync_lock_release(&drain_owner);
+}
+
+static void NaClLogBatchWrite(void) {
+  if (batch_size > 0) {
+    NaClLogRingOutput(batch, batch_size, batch_crash);
+    batch_size = 0;
+  }
+}
+
+static void NaClLogBatchAppend(char const *text, size_t size) {
+  size_t part;
+
+  while (size > 0) {
+    if (batch_size == sizeof batch) {
+      NaClLogBatchWrite();
+    }
+    part = sizeof batch - batch_size;
+    if (part > size) {
+      part = size;
+    }
+    memcpy(batch + batch_size, text, part);
+    batch_size += part;
+    text += part;
+    size -= part;
+  }
+}
+
+/* append "value" of at least "digits" digits. snprintf costs much more */
+static void NaClLogBatchNumber(uint64_t value, unsigned base, int digits,
+                               char const *alphabet) {
+  char  out[24];
+  char  *p = out + sizeof out;
+
+  do {
+    *--p = alphabet[value % base];
+    value /= base;
+  } while (0 != value || --digits > 0);
+  NaClLogBatchAppend(p, out + sizeof out - p);
+}
+
+/* the NaClLog tag. hh:mm:ss w/o localtime_r, it is not async-signal-safe */
+static void NaClLogBatchTag(struct NaClLogRecord const *r) {
+  static char const decimal[] = "0123456789";
+  int64_t           day_us;
+
+  day_us = (r->time_us + utc_offset * 1000000LL) % (86400 * 1000000LL);
+  if (day_us < 0) {
+    day_us += 86400 * 1000000LL;
+  }
+  NaClLogBatchAppend("[", 1);
+  NaClLogBatchNumber(pid, 10, 1, decimal);
+  NaClLogBatchAppend(",", 1);
+  NaClLogBatchNumber(r->tid, 10, 1, decimal);
+  NaClLogBatchAppend(":", 1);
+  NaClLogBatchNumber(day_us / 3600000000LL, 10, 2, decimal);
+  NaClLogBatchAppend(":", 1);
+  NaClLogBatchNumber(day_us / 60000000LL % 60, 10, 2, decimal);
+  NaClLogBatchAppend(":", 1);
+  NaClLogBatchNumber(day_us / 1000000 % 60, 10, 2, decimal);
+  NaClLogBatchAppend(".", 1);
+  NaClLogBatchNumber(day_us % 1000000, 10, 6, decimal);
+  NaClLogBatchAppend("] ", 2);
+}
+
+/*
+ * Format %d, %u, %x, %X, %s and their "l" forms w/o flags, width and
+ * precision -- almost all the log conversions.  Returns 0 for others.
+ */
+static int NaClLogBatchPlain(struct NaClLogRecord const *r,
+                             struct NaClLogSpec const *spec,
+                             uint32_t *arg) {
+  char      conversion = spec->start[spec->len - 1];
+  uint64_t  value = r->args[*arg];
+
+  if (!(2 == spec->len || (3 == spec->len && 'l' == spec->start[1]))) {
+    return 0;
+  }
+  if (kNaClLogArgInt == spec->arg && 'd' != conversion && 'i' != conversion) {
+    value = (uint32_t) value;
+  }
+
+  switch (conversion) {
+    case 'd':
+    case 'i':
+      if ((int64_t) value < 0) {
+        NaClLogBatchAppend("-", 1);
+        value = -value;
+      }
+      /* fall through */
+    case 'u':
+      NaClLogBatchNumber(value, 10, 1, "0123456789");
+      break;
+    case 'x':
+      NaClLogBatchNumber(value, 16, 1, "0123456789abcdef");
+      break;
+    case 'X':
+      NaClLogBatchNumber(value, 16, 1, "0123456789ABCDEF");
+      break;
+    case 's':
+      NaClLogBatchAppend(r->strings + value, strlen(r->strings + value));
+      break;
+    default:
+      return 0;
+  }
+  ++*arg;
+  return 1;
+}
+
+/* format one conversion the way vsnprintf would do it */
+static void NaClLogBatchSpec(struct NaClLogRecord const *r,
+                             struct NaClLogSpec const *spec,
+                             uint32_t *arg) {
+  char    format[NACL_LOG_RING_SPEC_MAX];
+  char    out[NACL_LOG_RING_SPEC_OUTPUT];
+  int     star[2] = {0, 0};
+  int     i;
+  int     len;
+  union {
+    double    d;
+    uint64_t  u;
+  } bits;
+
+  if (NaClLogBatchPlain(r, spec, arg)) {
+    return;
+  }
+  memcpy(format, spec->start, spec->len);
+  format[spec->len] = '\0';
+  for (i = 0; i < spec->stars; ++i) {
+    star[i] = (int) r->args[(*arg)++];
+  }
+
+#define NACL_LOG_FORMAT(value)                                          \
+  (0 == spec->stars ? snprintf(out, sizeof out, format, value)          \
+   : 1 == spec->stars ? snprintf(out, sizeof out, format, star[0], value) \
+   : snprintf(out, sizeof out, format, star[0], star[1], value))
+
+  switch (spec->arg) {
+    case kNaClLogArgNone:
+      len = snprintf(out, sizeof out, "%%");
+      break;
+    case kNaClLogArgInt:
+      len = NACL_LOG_FORMAT((int) r->args[(*arg)++]);
+      break;
+    case kNaClLogArgLong:
+      len = NACL_LOG_FORMAT((long) r->args[(*arg)++]);
+      break;
+    case kNaClLogArgDouble:
+      bits.u = r->args[(*arg)++];
+      len = NACL_LOG_FORMAT(bits.d);
+      break;
+    case kNaClLogArgPointer:
+      len = NACL_LOG_FORMAT((void *) (uintptr_t) r->args[(*arg)++]);
+      break;
+    case kNaClLogArgString:
+      len = NACL_LOG_FORMAT(r->strings + r->args[(*arg)++]);
+      break;
+    default:
+      len = 0;
+      break;
+  }
+#undef NACL_LOG_FORMAT
+
+  if (len < 0) {
+    return;
+  }
+  if ((size_t) len >= sizeof out) {
+    len = sizeof out - 1;
+  }
+  NaClLogBatchAppend(out, len);
+}
+
+static void NaClLogBatchRecord(struct NaClLogRecord const *r) {
+  struct NaClLogSpec  spec;
+  char const          *fmt = r->fmt;
+  char const          *p;
+  uint32_t            arg = 0;
+
+  if (NaClLogTimestampEnabled()) {
+    NaClLogBatchTag(r);
+  }
+  for (p = strchr(fmt, '%'); NULL != p; p = strchr(fmt, '%')) {
+    NaClLogBatchAppend(fmt, p - fmt);
+    fmt = NaClLogParseSpec(p + 1, &spec);
+    NaClLogBatchSpec(r, &spec, &arg);
+  }
+  NaClLogBatchAppend(fmt, strlen(fmt));
+}
+
+/* write out all queued records in order. the caller owns the drain */
+static void NaClLogDrain_mu(int crash) {
+  struct NaClLogRing    *ring;
+  struct NaClLogRing    *first;
+  struct NaClLogRecord  *r;
+  struct NaClLogRecord  *next;
+
+  batch_crash = crash;
+  for (;;) {
+    first = NULL;
+    r = NULL;
+    for (ring = rings; NULL != ring; ring = ring->next) {
+      if (ring->tail == ring->head) {
+        continue;
+      }
+      COMPILER_BARRIER();
+      next = &ring->records[ring->tail & (NACL_LOG_RING_RECORDS - 1)];
+      if (NULL == r || next->seq < r->seq) {
+        first = ring;
+        r = next;
+      }
+    }
+    if (NULL == first) {
+      break;
+    }
+    NaClLogBatchRecord(r);
+    COMPILER_BARRIER();
+    ++first->tail;
+  }
+  NaClLogBatchWrite();
+}
+
+void NaClLogRingDrain(void) {
+  if (NULL == rings || !NaClLogDrainLock(0)) {
+    return;
+  }
+  NaClLogDrain_mu(0);
+  NaClLogDrainUnlock();
+}
+
+void NaClLogRingFlush(void) {
+  if (NULL == rings || !NaClLogDrainLock(1)) {
+    return;
+  }
+  NaClLogDrain_mu(1);
+  NaClLogDrainUnlock();
+}
+
+int NaClLogRingPut(int detail_level, char const *fmt, va_list ap) {
+  struct NaClLogRing    *ring;
+  struct NaClLogRecord  *r;
+  struct timespec       t;
+  va_list               aq;
+  int                   captured;
+
+  if (!started || LOG_FATAL == detail_level) {
+    return 0;
+  }
+  ring = NaClLogRingOfThread();
+  if (NULL == ring || ring->busy) {
+    return 0;
+  }
+  ring->busy = 1;
+  COMPILER_BARRIER();
+
+  /* full ring: write it out here, the log does not lose records */
+  if (ring->head - ring->tail == NACL_LOG_RING_RECORDS) {
+    NaClLogRingDrain();
+    if (ring->head - ring->tail == NACL_LOG_RING_RECORDS) {
+      ring->busy = 0;
+      return 0;
+    }
+  }
+
+  r = &ring->records[ring->head & (NACL_LOG_RING_RECORDS - 1)];
+  va_copy(aq, ap);
+  captured = NaClLogCapture(r, fmt, aq);
+  va_end(aq);
+  if (captured) {
+    clock_gettime(CLOCK_REALTIME, &t);
+    r->fmt = fmt;
+    r->time_us = t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+    r->tid = NaClThreadId();
+    r->seq = __sync_fetch_and_add(&seq, 1);
+    COMPILER_BARRIER();
+    ++ring->head;
+
+    /* a half full ring does not wait for the period */
+    if (ring->head - ring->tail >= NACL_LOG_RING_RECORDS / 2
+        && writer_sleeping) {
+      writer_sleeping = 0;
+      Futex(&writer_sleeping, FUTEX_WAKE_PRIVATE, 1, NULL);
+    }
+  }
+
+  COMPILER_BARRIER();
+  ring->busy = 0;
+  return captured;
+}
+
+/* the writer thread. wakes up every period or when a ring is half full */
+static void WINAPI NaClLogRingThread(void *state) {
+  struct timespec period = {0, NACL_LOG_RING_PERIOD_NS};
+
+  UNREFERENCED_PARAMETER(state);
+  while (!stop) {
+    writer_sleeping = 1;
+    __sync_synchronize();
+    if (!stop) {
+      Futex(&writer_sleeping, FUTEX_WAIT_PRIVATE, 1, &period);
+    }
+    writer_sleeping = 0;
+    NaClLogRingDrain();
+  }
+}
+
+int NaClLogRingStart(void) {
+  struct tm tm;
+  time_t    now;
+
+  if (started) {
+    return 1;
+  }
+  pid = getpid();
+  now = time(NULL);
+  localtime_r(&now, &tm);
+  utc_offset = tm.tm_gmtoff;
+
+  /* the calling thread logs the most, its ring is ready */
+  if (NULL == NaClLogRingOfThread()) {
+    return 0;
+  }
+
+  /* signals must go to the threads which log, not to the writer */
+  stop = 0;
+  if (!NaClThreadCreateJoinableNoSignals(&writer, NaClLogRingThread, NULL,
+                                         NACL_LOG_RING_STACK)) {
+    return 0;
+  }
+  __sync_synchronize();
+  started = 1;
+  return 1;
+}
+
+void NaClLogRingStop(void) {
+  if (!started) {
+    return;
+  }
+  started = 0;
+  stop = 1;
+  writer_sleeping = 0;
+  Futex(&writer_sleeping, FUTEX_WAKE_PRIVATE, 1, NULL);
+  NaClThreadJoin(&writer);
+  NaClLogRingDrain();
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Asynchronous NaClLog output.
+ *
+ * Once started, NaClLog does not format and flush the message in the
+ * calling thread.  It puts a binary record (format pointer, raw
+ * arguments, copies of the %s strings, time and thread id) into a
+ * lock-free ring owned by the calling thread and returns.  A writer
+ * thread merges the rings in the order the records were put, formats
+ * them and writes them out in batches, one Write and one Flush per
+ * batch.
+ *
+ * The format string must be a literal (or otherwise outlive the
+ * record).  Messages which cannot be captured -- LOG_FATAL, %n,
+ * long double, too many arguments or too long strings -- are written
+ * synchronously after the queued ones, so the log order is kept.
+ */
+
+#ifndef NATIVE_CLIENT_SRC_TRUSTED_PLATFORM_NACL_LOG_RING_H__
+#define NATIVE_CLIENT_SRC_TRUSTED_PLATFORM_NACL_LOG_RING_H__
+
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/*
+ * Start the writer thread.  Must be called after the log stream is
+ * set.  Returns nonzero if successful; otherwise the log stays
+ * synchronous.
+ */
+int NaClLogRingStart(void);
+
+/*
+ * Write out the queued records and stop the writer thread.  The log
+ * is synchronous again.
+ */
+void NaClLogRingStop(void);
+
+/*
+ * Write out the queued records from a dying process: does not take
+ * the log lock, does not allocate and does not wait for a stuck
+ * writer for long.  Called by NaClExit and NaClAbort, so the records
+ * reach the log when zerovm exits from a signal handler.
+ */
+void NaClLogRingFlush(void);
+
+EXTERN_C_END
+
+#endif  /* NATIVE_CLIENT_SRC_TRUSTED_PLATFORM_NACL_LOG_RING_H__ */
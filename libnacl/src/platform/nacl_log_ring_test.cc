@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Checks the asynchronous NaClLog output against the synchronous one
+ * and measures both on level 4 messages, the trap trace level.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <string>
+
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_log_intern.h"
+#include "src/platform/nacl_log_ring.h"
+#include "gtest/gtest.h"
+
+#define BENCH_CALLS 1000000
+#define THREADS 4
+#define THREAD_LINES 10000
+#define BURST 100  /* messages put between the writer wake ups */
+
+class NaClLogRingTest : public testing::Test {
+ protected:
+  virtual void SetUp();
+  virtual void TearDown();
+
+  // all the log file
+  std::string Log();
+
+  char name_[32];
+};
+
+void NaClLogRingTest::SetUp() {
+  int fd;
+
+  NaClLogModuleInit();
+  strcpy(name_, "/tmp/log_ring_testXXXXXX");
+  fd = mkstemp(name_);
+  close(fd);
+  NaClLogSetFile(name_);
+  NaClLogSetVerbosity(4);
+  NaClLogDisableTimestamp();
+}
+
+void NaClLogRingTest::TearDown() {
+  NaClLogModuleFini();
+  unlink(name_);
+}
+
+std::string NaClLogRingTest::Log() {
+  std::string log;
+  char buffer[4096];
+  size_t size;
+  FILE *f = fopen(name_, "r");
+
+  while ((size = fread(buffer, 1, sizeof buffer, f)) > 0) {
+    log.append(buffer, size);
+  }
+  fclose(f);
+  return log;
+}
+
+// the queued messages are formatted as vsnprintf would format them
+TEST_F(NaClLogRingTest, FormatTest) {
+  char expected[1024];
+  const char *null = NULL;
+
+  snprintf(expected, sizeof expected,
+           "%d %5u %-5x| %lx %ld %hd %hhu %c %p %s %.3s %*d %.*s %-*.*f "
+           "%e %g %% %s %zu\n",
+           -1, 7u, 0xab, 0xdeadbeefcafeUL, -1L, (short) 70000,
+           (unsigned char) 300, 'z', (void *) &expected, "string", "trimmed",
+           6, 42, 2, "precision", 9, 2, 3.14159, 1e-10, 0.5, null,
+           (size_t) 12345);
+
+  ASSERT_NE(0, NaClLogRingStart());
+  NaClLog(4, "%d %5u %-5x| %lx %ld %hd %hhu %c %p %s %.3s %*d %.*s %-*.*f "
+          "%e %g %% %s %zu\n",
+          -1, 7u, 0xab, 0xdeadbeefcafeUL, -1L, (short) 70000,
+          (unsigned char) 300, 'z', (void *) &expected, "string", "trimmed",
+          6, 42, 2, "precision", 9, 2, 3.14159, 1e-10, 0.5, null,
+          (size_t) 12345);
+  NaClLog(5, "above the verbosity\n");
+  NaClLogRingStop();
+  EXPECT_EQ(std::string(expected), Log());
+}
+
+// the messages which cannot be queued keep their place in the log
+TEST_F(NaClLogRingTest, OrderTest) {
+  std::string big(1000, 'x');
+  int n;
+
+  ASSERT_NE(0, NaClLogRingStart());
+  NaClLog(4, "queued 1\n");
+  NaClLog(4, "long string %s\n", big.c_str());
+  NaClLog(4, "conversion n%n\n", &n);
+  NaClLog(4, "queued 2\n");
+  NaClLog(LOG_WARNING, "too many %d %d %d %d %d %d %d %d %d %d %d %d %d %d "
+          "%d %d %d\n", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+          16, 17);
+  NaClLogRingStop();
+  EXPECT_EQ("queued 1\nlong string " + big + "\nconversion n\nqueued 2\n"
+            "too many 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17\n", Log());
+}
+
+static void *LogLines(void *arg) {
+  int thread = (int) (intptr_t) arg;
+  int i;
+
+  for (i = 0; i < THREAD_LINES; ++i) {
+    NaClLog(4, "%d %d\n", thread, i);
+  }
+  return NULL;
+}
+
+// every thread has its own ring, nothing is lost, the order of a thread kept
+TEST_F(NaClLogRingTest, ThreadsTest) {
+  pthread_t threads[THREADS];
+  int next[THREADS] = {0};
+  std::string log;
+  const char *p;
+  int thread;
+  int line;
+  int i;
+
+  ASSERT_NE(0, NaClLogRingStart());
+  for (i = 0; i < THREADS; ++i) {
+    pthread_create(&threads[i], NULL, LogLines, (void *) (intptr_t) i);
+  }
+  for (i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  NaClLogRingStop();
+
+  log = Log();
+  for (p = log.c_str(); 2 == sscanf(p, "%d %d\n", &thread, &line);
+       p = strchr(p, '\n') + 1) {
+    ASSERT_LE(0, thread);
+    ASSERT_GT(THREADS, thread);
+    ASSERT_EQ(next[thread], line);
+    ++next[thread];
+  }
+  for (i = 0; i < THREADS; ++i) {
+    EXPECT_EQ(THREAD_LINES, next[i]);
+  }
+}
+
+// the dying process writes out the queued records itself
+TEST_F(NaClLogRingTest, FlushTest) {
+  ASSERT_NE(0, NaClLogRingStart());
+  NaClLog(4, "before the crash %d\n", 1);
+  NaClLogRingFlush();
+  EXPECT_EQ("before the crash 1\n", Log());
+  NaClLogRingStop();
+  EXPECT_EQ("before the crash 1\n", Log());
+}
+
+// return monotonic clock in nanoseconds
+static int64_t Now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// the trap trace message written at level 4, synchronous vs queued. the
+// queued messages come in bursts, the cost of the caller is measured
+// apart from the cost of the writer
+TEST_F(NaClLogRingTest, BenchTest) {
+  int64_t start;
+  int64_t put = 0;
+  int64_t written = 0;
+  int i;
+  int j;
+
+  NaClLogSetFile("/dev/null");
+  NaClLogEnableTimestamp();
+  start = Now();
+  for (i = 0; i < BENCH_CALLS; ++i) {
+    NaClLog(4, "%s() invoked: desc=%d, buffer=0x%lx, size=%d, offset=%ld\n",
+            "TrapReadHandle", 0, 0x10000UL + i, 4096, (long) i << 12);
+  }
+  printf("synchronous log: %.1f ns per message\n",
+         (double) (Now() - start) / BENCH_CALLS);
+
+  ASSERT_NE(0, NaClLogRingStart());
+  for (i = 0; i < BENCH_CALLS; i += BURST) {
+    start = Now();
+    for (j = i; j < i + BURST; ++j) {
+      NaClLog(4, "%s() invoked: desc=%d, buffer=0x%lx, size=%d, offset=%ld\n",
+              "TrapReadHandle", 0, 0x10000UL + j, 4096, (long) j << 12);
+    }
+    put += Now() - start;
+    start = Now();
+    NaClLogRingDrain();
+    written += Now() - start;
+  }
+  NaClLogRingStop();
+  printf("queued log: %.1f ns per message, %.1f ns in the writer\n",
+         (double) put / BENCH_CALLS, (double) written / BENCH_CALLS);
+}
+
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -63,6 +63,16 @@ int NaClThreadCreateJoinable(struct NaClThread  *ntp,
                              size_t stack_size) NACL_WUR;
 void NaClThreadJoin(struct NaClThread *ntp);
 
+/*
+ * d'b: NaClThreadCreateJoinable() for the zerovm service threads. the
+ * thread starts with all signals blocked, so the signals meant for the
+ * nexe (timers, faults) never land on it. the caller mask is kept
+ */
+int NaClThreadCreateJoinableNoSignals(struct NaClThread  *ntp,
+                                      void (WINAPI *start_fn)(void *),
+                                      void *state,
+                                      size_t stack_size) NACL_WUR;
+
 /*
  * NaClThreadExit is invoked by the thread itself, and exit_code is the
  * value returned by the thread.
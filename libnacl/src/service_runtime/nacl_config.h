@@ -185,6 +185,11 @@
 #  define NACL_USERRET_FIX        (0x8)
 #  define NACL_SYSARGS_FIX        (-0x18)
 #  define NACL_SYSCALLRET_FIX     (0x10)
+/*
+ * d'b: the low 32 bits of the return address to the "One Ring" slot
+ * (One_ring == 0): movabs $NaClSyscallSeg, %rax (10 bytes) + call *%rax
+ */
+#  define NACL_ONE_RING_RET       (NACL_SYSCALL_START_ADDR + 0xc)
 /*
  * System V Application Binary Interface, AMD64 Architecture Processor
  * Supplement, at http://www.x86-64.org/documentation/abi.pdf, section
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * NaCl I/O descriptor table.
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/desc/nacl_desc_base.h"
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_threads.h"
+#include "src/service_runtime/nacl_desc_table.h"
+
+#define BITS_PER_WORD 64
+#define ALL_USED      (~(uint64_t) 0)
+
+
+static INLINE size_t WordsFor(size_t nbits) {
+  return (nbits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+
+
+static struct NaClDescTableArray *NaClDescTableArrayMake(size_t size) {
+  struct NaClDescTableArray *array;
+
+  array = malloc(sizeof *array + (size - 1) * sizeof array->slots[0]);
+  if (NULL == array) {
+    return NULL;
+  }
+  array->size = size;
+  memset(array->slots, 0, size * sizeof array->slots[0]);
+  return array;
+}
+
+
+/* Readers of one thread always use the same stripe. */
+static INLINE uint32_t NaClDescTableStripe(void) {
+  return (NaClThreadId() * 0x9e3779b1u) >> (32 - NACL_DESC_TABLE_STRIPE_BITS);
+}
+
+
+static void NaClDescTableWaitCount(struct NaClDescTable *self,
+                                   uint32_t             parity) {
+  uint32_t  i;
+
+  for (i = 0; i < NACL_DESC_TABLE_STRIPES; ++i) {
+    while (0 != __atomic_load_n(&self->readers[i].count[parity],
+                                __ATOMIC_ACQUIRE)) {
+      sched_yield();
+    }
+  }
+}
+
+
+/*
+ * Grace period: returns when no reader which could have seen the old
+ * array or the old slot contents is left.  The readers which took the
+ * parity before the previous flip but were counted after it are waited
+ * for first (there is at most one such lookup per thread), then the
+ * epoch is flipped and the readers of the old parity are waited for.
+ * New lookups go to the new parity and are never waited for.
+ */
+static void NaClDescTableWaitReaders(struct NaClDescTable *self) {
+  uint32_t  epoch = self->epoch;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  NaClDescTableWaitCount(self, (epoch + 1) & 1);
+  __atomic_store_n(&self->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+  NaClDescTableWaitCount(self, epoch & 1);
+}
+
+
+static int NaClDescTableGrow(struct NaClDescTable *self, size_t min_size) {
+  struct NaClDescTableArray *old = self->array;
+  struct NaClDescTableArray *array;
+  size_t                    nwords = self->nwords * 2;
+  size_t                    old_full = WordsFor(self->nwords);
+  uint64_t                  *used;
+  uint64_t                  *full;
+
+  if (nwords < WordsFor(min_size)) {
+    nwords = WordsFor(min_size);
+  }
+  array = NaClDescTableArrayMake(nwords * BITS_PER_WORD);
+  used = realloc(self->used, nwords * sizeof *used);
+  if (NULL != used) {
+    self->used = used;
+  }
+  full = realloc(self->full, WordsFor(nwords) * sizeof *full);
+  if (NULL != full) {
+    self->full = full;
+  }
+  if (NULL == array || NULL == used || NULL == full) {
+    free(array);
+    return 0;
+  }
+  memset(used + self->nwords, 0, (nwords - self->nwords) * sizeof *used);
+  memset(full + old_full, 0, (WordsFor(nwords) - old_full) * sizeof *full);
+  memcpy(array->slots, old->slots, old->size * sizeof old->slots[0]);
+  self->nwords = nwords;
+
+  __atomic_store_n(&self->array, array, __ATOMIC_RELEASE);
+  NaClDescTableWaitReaders(self);
+  free(old);
+  return 1;
+}
+
+
+int NaClDescTableCtor(struct NaClDescTable  *self,
+                      size_t                initial_size) {
+  self->nwords = WordsFor(0 == initial_size ? 1 : initial_size);
+  self->epoch = 0;
+  memset(self->readers, 0, sizeof self->readers);
+  self->array = NaClDescTableArrayMake(self->nwords * BITS_PER_WORD);
+  self->used = calloc(self->nwords, sizeof *self->used);
+  self->full = calloc(WordsFor(self->nwords), sizeof *self->full);
+  if (NULL == self->array || NULL == self->used || NULL == self->full) {
+    NaClDescTableDtor(self);
+    return 0;
+  }
+  return 1;
+}
+
+
+void NaClDescTableDtor(struct NaClDescTable *self) {
+  free(self->array);
+  free(self->used);
+  free(self->full);
+  self->array = NULL;
+  self->used = NULL;
+  self->full = NULL;
+  self->nwords = 0;
+}
+
+
+struct NaClDesc *NaClDescTableGet(struct NaClDescTable  *self,
+                                  int                   d) {
+  struct NaClDescTableArray *array;
+  struct NaClDescTableSlot  *slot;
+  struct NaClDesc           *ndp = NULL;
+  uint32_t                  seq;
+  uint32_t                  *count;
+
+  count = &self->readers[NaClDescTableStripe()].count[
+      __atomic_load_n(&self->epoch, __ATOMIC_RELAXED) & 1];
+  __atomic_fetch_add(count, 1, __ATOMIC_SEQ_CST);
+  array = __atomic_load_n(&self->array, __ATOMIC_ACQUIRE);
+  if (d >= 0 && (size_t) d < array->size) {
+    slot = &array->slots[d];
+    for (;;) {
+      seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+      if (0 != (seq & 1)) {
+        continue;
+      }
+      ndp = __atomic_load_n(&slot->desc, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (seq == __atomic_load_n(&slot->seq, __ATOMIC_RELAXED)) {
+        break;
+      }
+    }
+    if (NULL != ndp) {
+      NaClDescRef(ndp);
+    }
+  }
+  __atomic_fetch_sub(count, 1, __ATOMIC_RELEASE);
+  return ndp;
+}
+
+
+int NaClDescTableSet(struct NaClDescTable *self,
+                     int                  d,
+                     struct NaClDesc      *ndp) {
+  struct NaClDescTableSlot  *slot;
+  struct NaClDesc           *old;
+  size_t                    word;
+  uint64_t                  bit;
+
+  if (d < 0) {
+    return 0;
+  }
+  if ((size_t) d >= self->array->size
+      && !NaClDescTableGrow(self, (size_t) d + 1)) {
+    return 0;
+  }
+
+  slot = &self->array->slots[d];
+  old = slot->desc;
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&slot->desc, ndp, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+
+  word = (size_t) d / BITS_PER_WORD;
+  bit = (uint64_t) 1 << ((size_t) d % BITS_PER_WORD);
+  if (NULL != ndp) {
+    self->used[word] |= bit;
+  } else {
+    self->used[word] &= ~bit;
+  }
+  bit = (uint64_t) 1 << (word % BITS_PER_WORD);
+  if (ALL_USED == self->used[word]) {
+    self->full[word / BITS_PER_WORD] |= bit;
+  } else {
+    self->full[word / BITS_PER_WORD] &= ~bit;
+  }
+
+  if (NULL != old) {
+    NaClDescTableWaitReaders(self);
+    NaClDescUnref(old);
+  }
+  return 1;
+}
+
+
+int32_t NaClDescTableSetAvail(struct NaClDescTable  *self,
+                              struct NaClDesc       *ndp) {
+  size_t  nfull = WordsFor(self->nwords);
+  size_t  pos = self->nwords * BITS_PER_WORD;
+  size_t  word;
+  size_t  i;
+
+  for (i = 0; i < nfull; ++i) {
+    if (ALL_USED != self->full[i]) {
+      word = i * BITS_PER_WORD + __builtin_ctzll(~self->full[i]);
+      if (word < self->nwords) {
+        pos = word * BITS_PER_WORD + __builtin_ctzll(~self->used[word]);
+      }
+      break;
+    }
+  }
+
+  if (pos > INT32_MAX) {
+    NaClLog(LOG_ERROR, "NaClDescTableSetAvail: table is full\n");
+    return -1;
+  }
+  if (!NaClDescTableSet(self, (int) pos, ndp)) {
+    return -1;
+  }
+  return (int32_t) pos;
+}
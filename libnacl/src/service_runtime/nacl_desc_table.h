@@ -0,0 +1,102 @@
+/*
+ * Copyright 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+
+/* @file
+ *
+ * NaCl I/O descriptor table.  Replaces the DynArray based table: the
+ * lowest free descriptor number is found through a two level bitmap
+ * index (a summary word per 64 words of the slot bitmap) instead of a
+ * linear scan, and lookups do not take any lock.
+ *
+ * Readers load the slot array with acquire semantics and read the slot
+ * under its sequence counter, which is odd while a writer updates the
+ * slot.  When the table grows a new array is published and the old one
+ * is freed after a grace period; a replaced descriptor is unreferenced
+ * after the same grace period, so a reader never takes a reference on a
+ * destroyed object.
+ *
+ * The grace period is epoch based.  A reader is counted in the counter
+ * of the current epoch parity, in the stripe of its thread (a cache
+ * line per stripe, so the lookups of different threads do not share
+ * one).  The writer flips the epoch and waits only for the readers
+ * counted in the old parity, i.e. the readers which started before the
+ * flip: the lookups which keep coming do not hold the writer up.
+ *
+ * Writers (Set, SetAvail) are not serialized by the table, the caller
+ * holds a lock (nap->desc_mu).  As with DynArray, NaClDescTableDtor
+ * only releases the table memory, the descriptors are not unreferenced.
+ */
+
+#ifndef SERVICE_RUNTIME_NACL_DESC_TABLE_H__
+#define SERVICE_RUNTIME_NACL_DESC_TABLE_H__ 1
+
+#include "include/portability.h"
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+struct NaClDesc;
+
+struct NaClDescTableSlot {
+  uint32_t          seq;    /* odd while the slot is updated */
+  struct NaClDesc   *desc;
+};
+
+struct NaClDescTableArray {
+  size_t                    size;
+  struct NaClDescTableSlot  slots[1];
+};
+
+#define NACL_DESC_TABLE_STRIPE_BITS 3
+#define NACL_DESC_TABLE_STRIPES     (1 << NACL_DESC_TABLE_STRIPE_BITS)
+
+struct NaClDescTableReaders {
+  uint32_t  count[2];   /* lookups in progress, by the epoch parity */
+} __attribute__((aligned(64)));
+
+struct NaClDescTable {
+  /* protected, readers */
+  struct NaClDescTableArray   *array;
+  uint32_t                    epoch;  /* moved by the writers only */
+  struct NaClDescTableReaders readers[NACL_DESC_TABLE_STRIPES];
+
+  /* protected, writers */
+  uint64_t                  *used;    /* bit per slot */
+  uint64_t                  *full;    /* bit per "used" word that is ~0 */
+  size_t                    nwords;   /* of used, size is nwords * 64 */
+};
+
+int NaClDescTableCtor(struct NaClDescTable  *self,
+                      size_t                initial_size) NACL_WUR;
+
+void NaClDescTableDtor(struct NaClDescTable *self);
+
+/*
+ * Returns the descriptor with a reference taken, or NULL.  Lock free,
+ * may be called concurrently with the writers.
+ */
+struct NaClDesc *NaClDescTableGet(struct NaClDescTable  *self,
+                                  int                   d);
+
+/*
+ * Takes ownership of ndp (may be NULL to free the slot), the previous
+ * descriptor is unreferenced.  Returns 0 if out of memory.
+ */
+int NaClDescTableSet(struct NaClDescTable *self,
+                     int                  d,
+                     struct NaClDesc      *ndp) NACL_WUR;
+
+/*
+ * Puts ndp to the lowest free slot.  Returns the descriptor number or
+ * -1 if out of memory.
+ */
+int32_t NaClDescTableSetAvail(struct NaClDescTable  *self,
+                              struct NaClDesc       *ndp);
+
+EXTERN_C_END
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can
+ * be found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/desc/nacl_desc_base.h"
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_sync_checked.h"
+#include "src/platform/nacl_threads.h"
+#include "src/service_runtime/nacl_desc_table.h"
+#include "gtest/gtest.h"
+
+#define kLive     0x4c495645u
+#define kReaders  4
+#define kCycles   100000
+#define kSlots    200
+
+/*
+ * A descriptor which tells whether it was destroyed.  Only the ref
+ * count part of the NaClDesc is used by the table.
+ */
+struct TestDesc {
+  struct NaClDesc base;
+  uint32_t        magic;
+};
+
+static uint32_t destroyed;
+
+static void TestDescDtor(struct NaClRefCount *vself) {
+  struct TestDesc *self = (struct TestDesc *) vself;
+
+  self->magic = 0;
+  __atomic_fetch_add(&destroyed, 1, __ATOMIC_RELAXED);
+  vself->vtbl = &kNaClRefCountVtbl;
+  (*vself->vtbl->Dtor)(vself);
+}
+
+static struct NaClRefCountVtbl const kTestDescVtbl = {
+  TestDescDtor,
+};
+
+static struct NaClDesc *TestDescMake() {
+  struct TestDesc *self = (struct TestDesc *) malloc(sizeof *self);
+
+  if (NULL == self || !NaClDescCtor(&self->base)) {
+    abort();
+  }
+  self->base.base.vtbl = &kTestDescVtbl;
+  self->magic = kLive;
+  return &self->base;
+}
+
+class NaClDescTableTest : public testing::Test {
+ protected:
+  virtual void SetUp();
+  virtual void TearDown();
+
+  struct NaClDescTable table;
+};
+
+void NaClDescTableTest::SetUp() {
+  NaClLogModuleInit();
+  destroyed = 0;
+  EXPECT_EQ(1, NaClDescTableCtor(&table, 8));
+}
+
+void NaClDescTableTest::TearDown() {
+  NaClDescTableDtor(&table);
+  NaClLogModuleFini();
+}
+
+// the lowest free number is given, holes are filled first
+TEST_F(NaClDescTableTest, LowestFreeTest) {
+  struct NaClDesc *ndp;
+  int i;
+
+  for (i = 0; i < kSlots; ++i) {
+    EXPECT_EQ(i, NaClDescTableSetAvail(&table, TestDescMake()));
+  }
+
+  EXPECT_EQ(1, NaClDescTableSet(&table, 130, NULL));
+  EXPECT_EQ(1, NaClDescTableSet(&table, 5, NULL));
+  EXPECT_EQ(2u, destroyed);
+  EXPECT_EQ(5, NaClDescTableSetAvail(&table, TestDescMake()));
+  EXPECT_EQ(130, NaClDescTableSetAvail(&table, TestDescMake()));
+  EXPECT_EQ(kSlots, NaClDescTableSetAvail(&table, TestDescMake()));
+
+  ndp = NaClDescTableGet(&table, 130);
+  ASSERT_TRUE(NULL != ndp);
+  EXPECT_EQ(kLive, ((struct TestDesc *) ndp)->magic);
+  NaClDescUnref(ndp);
+
+  for (i = 0; i <= kSlots; ++i) {
+    EXPECT_EQ(1, NaClDescTableSet(&table, i, NULL));
+  }
+  EXPECT_EQ(kSlots + 3u, destroyed);
+  EXPECT_EQ(0, NaClDescTableSetAvail(&table, TestDescMake()));
+  EXPECT_EQ(1, NaClDescTableSet(&table, 0, NULL));
+}
+
+// a set far above the table grows it, the numbers below stay free
+TEST_F(NaClDescTableTest, SparseTest) {
+  struct NaClDesc *ndp = TestDescMake();
+  struct NaClDesc *got;
+
+  EXPECT_EQ(1, NaClDescTableSet(&table, 5000, ndp));
+  got = NaClDescTableGet(&table, 5000);
+  EXPECT_EQ(ndp, got);
+  NaClDescUnref(got);
+  EXPECT_TRUE(NULL == NaClDescTableGet(&table, 4999));
+  EXPECT_TRUE(NULL == NaClDescTableGet(&table, 1 << 20));
+  EXPECT_TRUE(NULL == NaClDescTableGet(&table, -1));
+
+  EXPECT_EQ(0, NaClDescTableSetAvail(&table, TestDescMake()));
+  EXPECT_EQ(1, NaClDescTableSetAvail(&table, TestDescMake()));
+
+  /* replaced descriptor is released */
+  EXPECT_EQ(1, NaClDescTableSet(&table, 5000, TestDescMake()));
+  EXPECT_EQ(1u, destroyed);
+
+  EXPECT_EQ(1, NaClDescTableSet(&table, 0, NULL));
+  EXPECT_EQ(1, NaClDescTableSet(&table, 1, NULL));
+  EXPECT_EQ(1, NaClDescTableSet(&table, 5000, NULL));
+  EXPECT_EQ(4u, destroyed);
+}
+
+struct ReaderState {
+  struct NaClDescTable  *table;
+  volatile int          stop;
+  int                   errors;
+  uint64_t              found;
+};
+
+static void WINAPI Reader(void *state) {
+  struct ReaderState  *rs = (struct ReaderState *) state;
+  struct NaClDesc     *ndp;
+  int                 d = 0;
+
+  while (!rs->stop) {
+    d = (d * 7 + 1) % (kSlots + 10);
+    ndp = NaClDescTableGet(rs->table, d);
+    if (NULL != ndp) {
+      if (kLive != ((struct TestDesc *) ndp)->magic) {
+        __atomic_fetch_add(&rs->errors, 1, __ATOMIC_RELAXED);
+      }
+      __atomic_fetch_add(&rs->found, 1, __ATOMIC_RELAXED);
+      NaClDescUnref(ndp);
+    }
+  }
+}
+
+// lock free readers never get a destroyed descriptor while the table
+// is written and grows (one writer, as serialized by desc_mu)
+TEST_F(NaClDescTableTest, StressTest) {
+  struct NaClThread   threads[kReaders];
+  struct ReaderState  rs;
+  uint32_t            made = 0;
+  int                 i;
+
+  rs.table = &table;
+  rs.stop = 0;
+  rs.errors = 0;
+  rs.found = 0;
+  for (i = 0; i < kReaders; ++i) {
+    ASSERT_EQ(1, NaClThreadCreateJoinable(&threads[i], Reader, &rs, 1 << 16));
+  }
+
+  for (i = 0; i < kCycles; ++i) {
+    int d = (i * 13) % kSlots;
+    if (0 == i % 3) {
+      EXPECT_EQ(1, NaClDescTableSet(&table, d, NULL));
+    } else if (1 == i % 3) {
+      EXPECT_EQ(1, NaClDescTableSet(&table, d, TestDescMake()));
+      ++made;
+    } else {
+      EXPECT_LE(0, NaClDescTableSetAvail(&table, TestDescMake()));
+      ++made;
+    }
+  }
+
+  rs.stop = 1;
+  for (i = 0; i < kReaders; ++i) {
+    NaClThreadJoin(&threads[i]);
+  }
+  EXPECT_EQ(0, rs.errors);
+  EXPECT_LT(0u, rs.found);
+
+  for (i = 0; i < (int) table.array->size; ++i) {
+    EXPECT_EQ(1, NaClDescTableSet(&table, i, NULL));
+  }
+  EXPECT_EQ(made, destroyed);
+}
+
+
+struct WriterState {
+  struct NaClDescTable  *table;
+  volatile int          done;
+};
+
+static void WINAPI Writer(void *state) {
+  struct WriterState  *ws = (struct WriterState *) state;
+
+  if (!NaClDescTableSet(ws->table, 0, NULL)) {
+    abort();
+  }
+  ws->done = 1;
+}
+
+// the writer waits for the reader which started before it, the readers
+// which come after do not hold it up
+TEST_F(NaClDescTableTest, GracePeriodTest) {
+  struct NaClThread   thread;
+  struct WriterState  ws;
+  uint32_t            *before;
+  uint32_t            *after;
+
+  EXPECT_EQ(0, NaClDescTableSetAvail(&table, TestDescMake()));
+
+  /* a lookup in progress in the current epoch */
+  before = &table.readers[0].count[table.epoch & 1];
+  after = &table.readers[NACL_DESC_TABLE_STRIPES - 1].count[
+      (table.epoch + 1) & 1];
+  __atomic_fetch_add(before, 1, __ATOMIC_SEQ_CST);
+
+  ws.table = &table;
+  ws.done = 0;
+  ASSERT_EQ(1, NaClThreadCreateJoinable(&thread, Writer, &ws, 1 << 16));
+  usleep(50000);
+  EXPECT_EQ(0, ws.done);
+  EXPECT_EQ(0u, destroyed);
+
+  /* the lookup started after the flip stays, the old one is over */
+  __atomic_fetch_add(after, 1, __ATOMIC_SEQ_CST);
+  __atomic_fetch_sub(before, 1, __ATOMIC_SEQ_CST);
+  NaClThreadJoin(&thread);
+  EXPECT_EQ(1, ws.done);
+  EXPECT_EQ(1u, destroyed);
+  __atomic_fetch_sub(after, 1, __ATOMIC_SEQ_CST);
+}
@@ -13,6 +13,7 @@
 #include "src/platform/nacl_log.h"
 #include "src/platform/nacl_sync_checked.h"
 #include "src/service_runtime/nacl_memory_object.h"
+#include "src/service_runtime/nacl_slab.h"
 
 
 /*
@@ -62,7 +63,8 @@ void NaClMemObjSafeDtor(struct NaClMemObj *nmop) {
 }
 
 
-struct NaClMemObj *NaClMemObjMake(struct NaClDesc *ndp,
+struct NaClMemObj *NaClMemObjMake(struct NaClSlab *slab,
+                                  struct NaClDesc *ndp,
                                   nacl_off64_t    nbytes,
                                   nacl_off64_t    offset) {
   struct NaClMemObj *nmop;
@@ -71,7 +73,7 @@ struct NaClMemObj *NaClMemObjMake(struct NaClDesc *ndp,
     NaClLog(4, "NaClMemObjMake: invoked with NULL ndp\n");
     return NULL;  /* anonymous paging file backed memory */
   }
-  if (NULL == (nmop = malloc(sizeof *nmop))) {
+  if (NULL == (nmop = NaClSlabAlloc(slab, sizeof *nmop))) {
     NaClLog(LOG_FATAL, ("NaClMemObjMake: out of memory creating object "
                         "(NaClDesc = 0x%08"NACL_PRIxPTR", "
                         "offset = 0x%"NACL_PRIx64")\n"),
@@ -84,14 +86,15 @@ struct NaClMemObj *NaClMemObjMake(struct NaClDesc *ndp,
 }
 
 
-struct NaClMemObj *NaClMemObjSplit(struct NaClMemObj *orig,
+struct NaClMemObj *NaClMemObjSplit(struct NaClSlab   *slab,
+                                   struct NaClMemObj *orig,
                                    nacl_off64_t      additional) {
   struct NaClMemObj *nmop;
 
   if (NULL == orig)
     return NULL;
 
-  if (NULL == (nmop = malloc(sizeof *nmop))) {
+  if (NULL == (nmop = NaClSlabAlloc(slab, sizeof *nmop))) {
     NaClLog(LOG_FATAL, ("NaClMemObjSplit: out of memory creating object"
                         " (NaClMemObj = 0x%08"NACL_PRIxPTR","
                         " additional = 0x%"NACL_PRIx64")\n"),
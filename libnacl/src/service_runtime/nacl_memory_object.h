@@ -20,6 +20,8 @@
 
 EXTERN_C_BEGIN
 
+struct NaClSlab;
+
 /*
  * Memory object for the virtual memory map.  We map in 64KB chunks,
  * and we need this so that we can recreate the memory from the
@@ -92,12 +94,16 @@ void NaClMemObjSafeDtor(struct NaClMemObj *nmop);
 
 /*
  * Allocating Ctor.  Increments refcount on ndp, which must not be NULL.
+ * The object is allocated from slab, normally the mem_objs slab of the
+ * memory map it will be added to, or malloc'ed if slab is NULL.
  */
-struct NaClMemObj *NaClMemObjMake(struct NaClDesc *ndp,
+struct NaClMemObj *NaClMemObjMake(struct NaClSlab *slab,
+                                  struct NaClDesc *ndp,
                                   nacl_off64_t    nbytes,
                                   nacl_off64_t    offset) NACL_WUR;
 
-struct NaClMemObj *NaClMemObjSplit(struct NaClMemObj  *nmop,
+struct NaClMemObj *NaClMemObjSplit(struct NaClSlab    *slab,
+                                   struct NaClMemObj  *nmop,
                                    nacl_off64_t       additional) NACL_WUR;
 
 void NaClMemObjIncOffset(struct NaClMemObj  *nmop,
@@ -104,6 +104,20 @@ void NaClSignalHandlerFini(void);
  */
 void NaClSignalAssertNoHandlers(void);
 
+/*
+ * d'b: catch a timer signal (zerovm watchdog) and pass it to the
+ * handler list, with or without the fault handlers above.  The signal
+ * is not restarting, so a blocked host call returns EINTR.
+ * NaClSignalTimerFini() restores the default action.
+ */
+void NaClSignalTimerInit(int signal_number);
+void NaClSignalTimerFini(int signal_number);
+
+/* d'b: the timers signal the nexe thread (SIGEV_THREAD_ID). older glibc only has the union member */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 /*
  * Provides a signal safe method to write to stderr.
  */
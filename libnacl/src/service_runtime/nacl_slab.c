@@ -0,0 +1,129 @@
+/*
+ * Copyright 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * NaCl slab allocator for fixed size runtime objects.
+ */
+
+#include <stdlib.h>
+
+#include "src/platform/nacl_check.h"
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_sync_checked.h"
+#include "src/service_runtime/nacl_slab.h"
+
+/* objects follow the header, pointer aligned */
+struct NaClSlabChunk {
+  struct NaClSlabChunk  *next;
+};
+
+
+static int NaClSlabGrow(struct NaClSlab *self, size_t count) {
+  struct NaClSlabChunk  *chunk;
+  char                  *obj;
+  size_t                i;
+
+  if ((SIZE_T_MAX - sizeof *chunk) / self->obj_size < count) {
+    return 0;
+  }
+  chunk = malloc(sizeof *chunk + count * self->obj_size);
+  if (NULL == chunk) {
+    return 0;
+  }
+  chunk->next = self->chunks;
+  self->chunks = chunk;
+
+  /* the first object of the chunk goes to the head of the free list */
+  obj = (char *) (chunk + 1) + count * self->obj_size;
+  for (i = 0; i < count; ++i) {
+    obj -= self->obj_size;
+    *(void **) obj = self->free_list;
+    self->free_list = obj;
+  }
+  self->capacity += count;
+  self->bytes += sizeof *chunk + count * self->obj_size;
+  return 1;
+}
+
+
+int NaClSlabCtor(struct NaClSlab  *self,
+                 size_t           obj_size,
+                 size_t           initial_objs) {
+  if (obj_size < sizeof(void *)) {
+    obj_size = sizeof(void *);
+  }
+  self->obj_size = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  self->capacity = 0;
+  self->in_use = 0;
+  self->peak = 0;
+  self->bytes = 0;
+  self->free_list = NULL;
+  self->chunks = NULL;
+  if (!NaClMutexCtor(&self->mu)) {
+    return 0;
+  }
+  if (!NaClSlabGrow(self, 0 == initial_objs ? 1 : initial_objs)) {
+    NaClMutexDtor(&self->mu);
+    return 0;
+  }
+  return 1;
+}
+
+
+void NaClSlabDtor(struct NaClSlab *self) {
+  struct NaClSlabChunk *chunk;
+
+  NaClLog(3, "NaClSlabDtor: %"NACL_PRIuS" of %"NACL_PRIuS" objects of "
+          "%"NACL_PRIuS" bytes in use, peak %"NACL_PRIuS"\n",
+          self->in_use, self->capacity, self->obj_size, self->peak);
+  while (NULL != (chunk = self->chunks)) {
+    self->chunks = chunk->next;
+    free(chunk);
+  }
+  self->free_list = NULL;
+  self->capacity = 0;
+  self->in_use = 0;
+  self->bytes = 0;
+  NaClMutexDtor(&self->mu);
+}
+
+
+void *NaClSlabAlloc(struct NaClSlab *self, size_t obj_size) {
+  void *obj;
+
+  if (NULL == self) {
+    return malloc(obj_size);
+  }
+  CHECK(obj_size <= self->obj_size);
+  NaClXMutexLock(&self->mu);
+  if (NULL == self->free_list && !NaClSlabGrow(self, self->capacity)) {
+    NaClXMutexUnlock(&self->mu);
+    return NULL;
+  }
+  obj = self->free_list;
+  self->free_list = *(void **) obj;
+  if (++self->in_use > self->peak) {
+    self->peak = self->in_use;
+  }
+  NaClXMutexUnlock(&self->mu);
+  return obj;
+}
+
+
+void NaClSlabFree(struct NaClSlab *self, void *obj) {
+  if (NULL == self) {
+    free(obj);
+    return;
+  }
+  if (NULL == obj) {
+    return;
+  }
+  NaClXMutexLock(&self->mu);
+  *(void **) obj = self->free_list;
+  self->free_list = obj;
+  --self->in_use;
+  NaClXMutexUnlock(&self->mu);
+}
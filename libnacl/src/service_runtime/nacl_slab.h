@@ -0,0 +1,74 @@
+/*
+ * Copyright 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+
+/* @file
+ *
+ * NaCl slab allocator for fixed size runtime objects (vmmap entries,
+ * memory objects, host descriptors).  Objects are carved from chunks
+ * owned by the slab and recycled through a free list, so the hot paths
+ * do not go to malloc and all the memory of a sandbox is released at
+ * once by NaClSlabDtor, whether or not the objects were freed.
+ *
+ * A slab is constructed with NaClSlabCtor in a placement-new manner
+ * with the object size and the initial number of objects.  Every new
+ * chunk doubles the capacity.  Chunks are never moved, so pointers to
+ * the objects stay valid until NaClSlabDtor.
+ *
+ * A NULL slab may be given to NaClSlabAlloc/NaClSlabFree, then the
+ * objects come from malloc/free.  This keeps the code which has no
+ * NaClApp (unit tests) working.
+ *
+ * Alloc and Free take the slab mutex: the host descriptors are released
+ * by the last NaClDescUnref, which may run on any thread (the service
+ * threads included), not only under nap->mu.
+ */
+
+#ifndef SERVICE_RUNTIME_NACL_SLAB_H__
+#define SERVICE_RUNTIME_NACL_SLAB_H__ 1
+
+#include "include/portability.h"
+#include "include/nacl_base.h"
+#include "src/platform/nacl_sync.h"
+
+EXTERN_C_BEGIN
+
+struct NaClSlabChunk;
+
+struct NaClSlab {
+  /* public, read only */
+  size_t                obj_size;   /* rounded up to pointer alignment */
+  size_t                capacity;   /* objects in all chunks */
+  size_t                in_use;     /* allocated objects */
+  size_t                peak;       /* max of in_use */
+  size_t                bytes;      /* memory held by the chunks */
+
+  /* private */
+  struct NaClMutex      mu;
+  void                  *free_list;
+  struct NaClSlabChunk  *chunks;
+};
+
+int NaClSlabCtor(struct NaClSlab  *self,
+                 size_t           obj_size,
+                 size_t           initial_objs) NACL_WUR;
+
+/* Releases all the chunks.  Objects still in use become invalid. */
+void NaClSlabDtor(struct NaClSlab *self);
+
+/*
+ * Returns an uninitialized object or NULL if out of memory.  If self
+ * is NULL the object of obj_size bytes is malloc'ed, otherwise obj_size
+ * must not exceed the object size of the slab.
+ */
+void *NaClSlabAlloc(struct NaClSlab *self, size_t obj_size);
+
+/* Returns the object to the free list.  If self is NULL calls free() */
+void NaClSlabFree(struct NaClSlab *self, void *obj);
+
+EXTERN_C_END
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can
+ * be found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/platform/nacl_log.h"
+#include "src/platform/nacl_threads.h"
+#include "src/service_runtime/nacl_slab.h"
+#include "gtest/gtest.h"
+
+#define kThreads  4
+#define kRounds   100000
+
+class NaClSlabTest : public testing::Test {
+ protected:
+  virtual void SetUp();
+  virtual void TearDown();
+};
+
+void NaClSlabTest::SetUp() {
+  NaClLogModuleInit();
+}
+
+void NaClSlabTest::TearDown() {
+  NaClLogModuleFini();
+}
+
+// the object size is pointer aligned, freed objects are reused
+TEST_F(NaClSlabTest, AllocFreeTest) {
+  struct NaClSlab slab;
+  void            *a;
+  void            *b;
+
+  ASSERT_EQ(1, NaClSlabCtor(&slab, 13, 4));
+  EXPECT_EQ(16u, slab.obj_size);
+  EXPECT_EQ(4u, slab.capacity);
+
+  a = NaClSlabAlloc(&slab, 13);
+  b = NaClSlabAlloc(&slab, 13);
+  ASSERT_TRUE(NULL != a && NULL != b);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(0u, (uintptr_t) a % sizeof(void *));
+  EXPECT_EQ(2u, slab.in_use);
+
+  NaClSlabFree(&slab, a);
+  EXPECT_EQ(1u, slab.in_use);
+  EXPECT_EQ(a, NaClSlabAlloc(&slab, 13));
+  NaClSlabFree(&slab, NULL);
+  EXPECT_EQ(2u, slab.in_use);
+  EXPECT_EQ(2u, slab.peak);
+  NaClSlabDtor(&slab);
+  EXPECT_EQ(0u, slab.capacity);
+  EXPECT_EQ(0u, slab.bytes);
+}
+
+// every new chunk doubles the capacity, the objects do not move
+TEST_F(NaClSlabTest, GrowTest) {
+  struct NaClSlab slab;
+  uint64_t        *objs[100];
+  int             i;
+
+  ASSERT_EQ(1, NaClSlabCtor(&slab, sizeof(uint64_t), 1));
+  for (i = 0; i < 100; ++i) {
+    objs[i] = (uint64_t *) NaClSlabAlloc(&slab, sizeof(uint64_t));
+    ASSERT_TRUE(NULL != objs[i]);
+    *objs[i] = i;
+  }
+  EXPECT_EQ(128u, slab.capacity);
+  EXPECT_EQ(100u, slab.in_use);
+  EXPECT_LE(128 * sizeof(uint64_t), slab.bytes);
+  for (i = 0; i < 100; ++i) {
+    EXPECT_EQ((uint64_t) i, *objs[i]);
+  }
+
+  /* the capacity is kept for the reuse */
+  for (i = 0; i < 100; ++i) {
+    NaClSlabFree(&slab, objs[i]);
+  }
+  EXPECT_EQ(0u, slab.in_use);
+  EXPECT_EQ(100u, slab.peak);
+  EXPECT_EQ(128u, slab.capacity);
+  NaClSlabDtor(&slab);
+}
+
+// w/o the slab the objects come from malloc
+TEST_F(NaClSlabTest, NullSlabTest) {
+  void *obj = NaClSlabAlloc(NULL, 1000);
+
+  ASSERT_TRUE(NULL != obj);
+  memset(obj, 0, 1000);
+  NaClSlabFree(NULL, obj);
+}
+
+// the object bigger than the slab one is refused
+TEST_F(NaClSlabTest, ObjSizeDeathTest) {
+  struct NaClSlab slab;
+
+  ASSERT_EQ(1, NaClSlabCtor(&slab, 16, 1));
+  EXPECT_DEATH(NaClSlabAlloc(&slab, 17), "");
+  NaClSlabDtor(&slab);
+}
+
+static void WINAPI Churn(void *state) {
+  struct NaClSlab *slab = (struct NaClSlab *) state;
+  void            *objs[8];
+  int             i;
+  int             j;
+
+  for (i = 0; i < kRounds; ++i) {
+    for (j = 0; j < 8; ++j) {
+      objs[j] = NaClSlabAlloc(slab, sizeof(uint64_t));
+      *(uint64_t *) objs[j] = (uintptr_t) objs[j];
+    }
+    for (j = 0; j < 8; ++j) {
+      if (*(uint64_t *) objs[j] != (uintptr_t) objs[j]) {
+        abort();
+      }
+      NaClSlabFree(slab, objs[j]);
+    }
+  }
+}
+
+// objects are allocated and freed from several threads at once
+TEST_F(NaClSlabTest, ThreadsTest) {
+  struct NaClSlab   slab;
+  struct NaClThread threads[kThreads];
+  int               i;
+
+  ASSERT_EQ(1, NaClSlabCtor(&slab, sizeof(uint64_t), 1));
+  for (i = 0; i < kThreads; ++i) {
+    ASSERT_EQ(1, NaClThreadCreateJoinable(&threads[i], Churn, &slab, 1 << 16));
+  }
+  for (i = 0; i < kThreads; ++i) {
+    NaClThreadJoin(&threads[i]);
+  }
+  EXPECT_EQ(0u, slab.in_use);
+  EXPECT_GE(8u * kThreads, slab.peak);
+  NaClSlabDtor(&slab);
+}
@@ -43,6 +43,7 @@
 #include "src/service_runtime/nacl_tls.h"
 #include "src/service_runtime/sel_ldr.h"
 #include "src/service_runtime/sel_memory.h"
+#include "src/manifest/user_heap.h" /* d'b */
 
 #include "src/service_runtime/include/sys/errno.h"
 #include "src/service_runtime/include/sys/fcntl.h"
@@ -128,6 +129,11 @@ int32_t NaClSetBreak(struct NaClApp *nap, uintptr_t new_break)
             nap->data_end);
     goto cleanup;
   }
+  /* d'b: MemMax is reserved, the break is served by the heap engine */
+  if (UserHeapActive()) {
+    break_addr = UserHeapSetBreak(nap, new_break);
+    goto cleanup;
+  }
   if (new_break <= nap->break_addr) {
     /* freeing memory */
     NaClLog(4, "new_break before break (0x%"NACL_PRIxPTR"); freeing\n",
@@ -1034,7 +1040,8 @@ void NaClCommonUtilUpdateAddrMap(struct NaClApp       *nap,
               ("invariant of delete_mem implies backing_desc NULL"
                " violated.\n"));
     }
-    nmop = NaClMemObjMake(backing_desc, backing_bytes, offset_bytes);
+    nmop = NaClMemObjMake(&nap->mem_map.mem_objs, backing_desc,
+                          backing_bytes, offset_bytes);
   }
 
   NaClVmmapUpdate(&nap->mem_map,
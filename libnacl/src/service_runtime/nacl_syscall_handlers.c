@@ -55,24 +55,11 @@
 #include "src/service_runtime/include/sys/unistd.h"
 
 #include "src/service_runtime/linux/nacl_syscall_inl.h"
-#include "src/manifest/trap.h"
 #include "src/manifest/manifest_setup.h"
 #include "api/zvm.h"
 
-struct NaClSyscallTableEntry nacl_syscall[NACL_MAX_SYSCALLS] = {{0}};
-
-
-static int32_t NotImplementedDecoder(struct NaClAppThread *natp) {
-  UNREFERENCED_PARAMETER(natp);
-  return -NACL_ABI_ENOSYS;
-}
-
-static void NaClAddSyscall(int num, int32_t (*fn)(struct NaClAppThread *)) {
-  if (nacl_syscall[num].handler != &NotImplementedDecoder) {
-    NaClLog(LOG_FATAL, "Duplicate syscall number %d\n", num);
-  }
-  nacl_syscall[num].handler = fn;
-}
+/* selected by NaClSyscallTableInit*() before the NaClApp construction */
+struct NaClSyscallTableEntry const *nacl_syscall;
 
 /* ====================================================================== */
 
@@ -1180,25 +1167,6 @@ static int32_t NaClSysTest_InfoLeakDecoder(struct NaClAppThread *natp) {
   return NaClSysTest_InfoLeak(natp);
 }
 
-/*
- * d'b: "One Ring" syscall hook. tonneling syscall. all system calls go trough it
- * will be the only syscall in the future.
- * accepts 2 parameters:
- *   1st (input) - pointer to uint64_t (from user side it is array of uint64_t's)
- *   2nd (output)- pointer to uint64_t (from user side it is array of uint64_t's)
- * returns int32_t
- * note: [0] element from input is always syscall id; [1].. are syscalls parameters
- */
-static int32_t OneRingDecoder(struct NaClApp *nap)
-{
-  struct OneRingDecoderArgs
-  {
-    uint32_t args;
-  } p = *(struct OneRingDecoderArgs*) nap->syscall_args;
-
-  return TrapHandler(nap, p.args);
-}
-
 /* d'b: put to the log restricted syscall detection */
 static int32_t NaClSysRestricted()
 {
@@ -1207,69 +1175,68 @@ static int32_t NaClSysRestricted()
   return -NACL_ABI_ENOSYS;
 }
 
+/*
+ * the syscall tables are built at compile time and never change. entries
+ * not listed are NULL, the syscall hook answers them with ENOSYS
+ */
 /* auto generated */
-void NaClSyscallTableInit() {
-  int i;
-  for (i = 0; i < NACL_MAX_SYSCALLS; ++i) {
-    nacl_syscall[i].handler = &NotImplementedDecoder;
-  }
-
-  NaClAddSyscall(One_ring, &OneRingDecoder); /* d'b: 0. added onering call */
-  NaClAddSyscall(NACL_sys_null, &NaClSysNullDecoder);
-  NaClAddSyscall(NACL_sys_nameservice, &NaClSysNameServiceDecoder);
-  NaClAddSyscall(NACL_sys_dup, &NaClSysDupDecoder);
-  NaClAddSyscall(NACL_sys_dup2, &NaClSysDup2Decoder);
-  NaClAddSyscall(NACL_sys_open, &NaClSysOpenDecoder);
-  NaClAddSyscall(NACL_sys_close, &NaClSysCloseDecoder);
-  NaClAddSyscall(NACL_sys_read, &NaClSysReadDecoder);
-  NaClAddSyscall(NACL_sys_write, &NaClSysWriteDecoder);
-  NaClAddSyscall(NACL_sys_lseek, &NaClSysLseekDecoder);
-  NaClAddSyscall(NACL_sys_ioctl, &NaClSysIoctlDecoder);
-  NaClAddSyscall(NACL_sys_fstat, &NaClSysFstatDecoder);
-  NaClAddSyscall(NACL_sys_stat, &NaClSysStatDecoder);
-  NaClAddSyscall(NACL_sys_getdents, &NaClSysGetdentsDecoder);
-  NaClAddSyscall(NACL_sys_sysbrk, &NaClSysSysbrkDecoder);
-  NaClAddSyscall(NACL_sys_mmap, &NaClSysMmapDecoder);
-  NaClAddSyscall(NACL_sys_munmap, &NaClSysMunmapDecoder);
-  NaClAddSyscall(NACL_sys_exit, &NaClSysExitDecoder);
-  NaClAddSyscall(NACL_sys_getpid, &NaClSysGetpidDecoder);
-  NaClAddSyscall(NACL_sys_thread_exit, &NaClSysThread_ExitDecoder);
-  NaClAddSyscall(NACL_sys_gettimeofday, &NaClSysGetTimeOfDayDecoder);
-  NaClAddSyscall(NACL_sys_clock, &NaClSysClockDecoder);
-  NaClAddSyscall(NACL_sys_nanosleep, &NaClSysNanosleepDecoder);
-  NaClAddSyscall(NACL_sys_imc_makeboundsock, &NaClSysImc_MakeBoundSockDecoder);
-  NaClAddSyscall(NACL_sys_imc_accept, &NaClSysImc_AcceptDecoder);
-  NaClAddSyscall(NACL_sys_imc_connect, &NaClSysImc_ConnectDecoder);
-  NaClAddSyscall(NACL_sys_imc_sendmsg, &NaClSysImc_SendmsgDecoder);
-  NaClAddSyscall(NACL_sys_imc_recvmsg, &NaClSysImc_RecvmsgDecoder);
-  NaClAddSyscall(NACL_sys_imc_mem_obj_create, &NaClSysImc_Mem_Obj_CreateDecoder);
-  NaClAddSyscall(NACL_sys_tls_init, &NaClSysTls_InitDecoder);
-  NaClAddSyscall(NACL_sys_thread_create, &NaClSysThread_CreateDecoder);
-  NaClAddSyscall(NACL_sys_tls_get, &NaClSysTls_GetDecoder);
-  NaClAddSyscall(NACL_sys_thread_nice, &NaClSysThread_NiceDecoder);
-  NaClAddSyscall(NACL_sys_mutex_create, &NaClSysMutex_CreateDecoder);
-  NaClAddSyscall(NACL_sys_mutex_lock, &NaClSysMutex_LockDecoder);
-  NaClAddSyscall(NACL_sys_mutex_unlock, &NaClSysMutex_UnlockDecoder);
-  NaClAddSyscall(NACL_sys_mutex_trylock, &NaClSysMutex_TrylockDecoder);
-  NaClAddSyscall(NACL_sys_cond_create, &NaClSysCond_CreateDecoder);
-  NaClAddSyscall(NACL_sys_cond_wait, &NaClSysCond_WaitDecoder);
-  NaClAddSyscall(NACL_sys_cond_signal, &NaClSysCond_SignalDecoder);
-  NaClAddSyscall(NACL_sys_cond_broadcast, &NaClSysCond_BroadcastDecoder);
-  NaClAddSyscall(NACL_sys_cond_timed_wait_abs, &NaClSysCond_Timed_Wait_AbsDecoder);
-  NaClAddSyscall(NACL_sys_imc_socketpair, &NaClSysImc_SocketPairDecoder);
-  NaClAddSyscall(NACL_sys_sem_create, &NaClSysSem_CreateDecoder);
-  NaClAddSyscall(NACL_sys_sem_wait, &NaClSysSem_WaitDecoder);
-  NaClAddSyscall(NACL_sys_sem_post, &NaClSysSem_PostDecoder);
-  NaClAddSyscall(NACL_sys_sem_get_value, &NaClSysSem_Get_ValueDecoder);
-  NaClAddSyscall(NACL_sys_sched_yield, &NaClSysSched_YieldDecoder);
-  NaClAddSyscall(NACL_sys_sysconf, &NaClSysSysconfDecoder);
-  NaClAddSyscall(NACL_sys_dyncode_create, &NaClSysDyncode_CreateDecoder);
-  NaClAddSyscall(NACL_sys_dyncode_modify, &NaClSysDyncode_ModifyDecoder);
-  NaClAddSyscall(NACL_sys_dyncode_delete, &NaClSysDyncode_DeleteDecoder);
-  NaClAddSyscall(NACL_sys_second_tls_set, &NaClSysSecond_Tls_SetDecoder);
-  NaClAddSyscall(NACL_sys_second_tls_get, &NaClSysSecond_Tls_GetDecoder);
-  NaClAddSyscall(NACL_sys_test_infoleak, &NaClSysTest_InfoLeakDecoder);
-}
+static const struct NaClSyscallTableEntry nacl_syscall_enabled[NACL_MAX_SYSCALLS] = {
+  /* d'b: One_ring (0) never gets here, NaClSyscallSeg() passes it to NaClOneRingHook() */
+  [NACL_sys_null]                = {&NaClSysNullDecoder},
+  [NACL_sys_nameservice]         = {&NaClSysNameServiceDecoder},
+  [NACL_sys_dup]                 = {&NaClSysDupDecoder},
+  [NACL_sys_dup2]                = {&NaClSysDup2Decoder},
+  [NACL_sys_open]                = {&NaClSysOpenDecoder},
+  [NACL_sys_close]               = {&NaClSysCloseDecoder},
+  [NACL_sys_read]                = {&NaClSysReadDecoder},
+  [NACL_sys_write]               = {&NaClSysWriteDecoder},
+  [NACL_sys_lseek]               = {&NaClSysLseekDecoder},
+  [NACL_sys_ioctl]               = {&NaClSysIoctlDecoder},
+  [NACL_sys_fstat]               = {&NaClSysFstatDecoder},
+  [NACL_sys_stat]                = {&NaClSysStatDecoder},
+  [NACL_sys_getdents]            = {&NaClSysGetdentsDecoder},
+  [NACL_sys_sysbrk]              = {&NaClSysSysbrkDecoder},
+  [NACL_sys_mmap]                = {&NaClSysMmapDecoder},
+  [NACL_sys_munmap]              = {&NaClSysMunmapDecoder},
+  [NACL_sys_exit]                = {&NaClSysExitDecoder},
+  [NACL_sys_getpid]              = {&NaClSysGetpidDecoder},
+  [NACL_sys_thread_exit]         = {&NaClSysThread_ExitDecoder},
+  [NACL_sys_gettimeofday]        = {&NaClSysGetTimeOfDayDecoder},
+  [NACL_sys_clock]               = {&NaClSysClockDecoder},
+  [NACL_sys_nanosleep]           = {&NaClSysNanosleepDecoder},
+  [NACL_sys_imc_makeboundsock]   = {&NaClSysImc_MakeBoundSockDecoder},
+  [NACL_sys_imc_accept]          = {&NaClSysImc_AcceptDecoder},
+  [NACL_sys_imc_connect]         = {&NaClSysImc_ConnectDecoder},
+  [NACL_sys_imc_sendmsg]         = {&NaClSysImc_SendmsgDecoder},
+  [NACL_sys_imc_recvmsg]         = {&NaClSysImc_RecvmsgDecoder},
+  [NACL_sys_imc_mem_obj_create]  = {&NaClSysImc_Mem_Obj_CreateDecoder},
+  [NACL_sys_tls_init]            = {&NaClSysTls_InitDecoder},
+  [NACL_sys_thread_create]       = {&NaClSysThread_CreateDecoder},
+  [NACL_sys_tls_get]             = {&NaClSysTls_GetDecoder},
+  [NACL_sys_thread_nice]         = {&NaClSysThread_NiceDecoder},
+  [NACL_sys_mutex_create]        = {&NaClSysMutex_CreateDecoder},
+  [NACL_sys_mutex_lock]          = {&NaClSysMutex_LockDecoder},
+  [NACL_sys_mutex_unlock]        = {&NaClSysMutex_UnlockDecoder},
+  [NACL_sys_mutex_trylock]       = {&NaClSysMutex_TrylockDecoder},
+  [NACL_sys_cond_create]         = {&NaClSysCond_CreateDecoder},
+  [NACL_sys_cond_wait]           = {&NaClSysCond_WaitDecoder},
+  [NACL_sys_cond_signal]         = {&NaClSysCond_SignalDecoder},
+  [NACL_sys_cond_broadcast]      = {&NaClSysCond_BroadcastDecoder},
+  [NACL_sys_cond_timed_wait_abs] = {&NaClSysCond_Timed_Wait_AbsDecoder},
+  [NACL_sys_imc_socketpair]      = {&NaClSysImc_SocketPairDecoder},
+  [NACL_sys_sem_create]          = {&NaClSysSem_CreateDecoder},
+  [NACL_sys_sem_wait]            = {&NaClSysSem_WaitDecoder},
+  [NACL_sys_sem_post]            = {&NaClSysSem_PostDecoder},
+  [NACL_sys_sem_get_value]       = {&NaClSysSem_Get_ValueDecoder},
+  [NACL_sys_sched_yield]         = {&NaClSysSched_YieldDecoder},
+  [NACL_sys_sysconf]             = {&NaClSysSysconfDecoder},
+  [NACL_sys_dyncode_create]      = {&NaClSysDyncode_CreateDecoder},
+  [NACL_sys_dyncode_modify]      = {&NaClSysDyncode_ModifyDecoder},
+  [NACL_sys_dyncode_delete]      = {&NaClSysDyncode_DeleteDecoder},
+  [NACL_sys_second_tls_set]      = {&NaClSysSecond_Tls_SetDecoder},
+  [NACL_sys_second_tls_get]      = {&NaClSysSecond_Tls_GetDecoder},
+  [NACL_sys_test_infoleak]       = {&NaClSysTest_InfoLeakDecoder},
+};
 
 /*
   d'b:
@@ -1284,71 +1251,74 @@ void NaClSyscallTableInit() {
   +  84 -- NACL_sys_tls_get (NaClSysTls_GetDecoder) -- dummy
 
   special case, tonneling call:
-  0 -- artificially added "One Ring" single syscall
+  0 -- artificially added "One Ring" single syscall (NaClOneRingHook)
 
   note: to restore syscalls to the original version just delete everything
   until "d'b end" and uncomment commented code
 */
-void NaClSyscallTableInitDisable() {
-  int i;
-  for (i = 0; i < NACL_MAX_SYSCALLS; ++i) {
-     nacl_syscall[i].handler = &NotImplementedDecoder;
-  }
+static const struct NaClSyscallTableEntry nacl_syscall_disabled[NACL_MAX_SYSCALLS] = {
+  /* One_ring (0) is served by NaClOneRingHook() */
+  [NACL_sys_null]                = {&NaClSysRestricted},
+  [NACL_sys_nameservice]         = {&NaClSysRestricted},
+  [NACL_sys_dup]                 = {&NaClSysRestricted},
+  [NACL_sys_dup2]                = {&NaClSysRestricted},
+  [NACL_sys_open]                = {&NaClSysRestricted},
+  [NACL_sys_close]               = {&NaClSysRestricted},
+  [NACL_sys_read]                = {&NaClSysRestricted},
+  [NACL_sys_write]               = {&NaClSysRestricted},
+  [NACL_sys_lseek]               = {&NaClSysRestricted},
+  [NACL_sys_ioctl]               = {&NaClSysRestricted},
+  [NACL_sys_fstat]               = {&NaClSysRestricted},
+  [NACL_sys_stat]                = {&NaClSysRestricted},
+  [NACL_sys_getdents]            = {&NaClSysRestricted},
+  [NACL_sys_sysbrk]              = {&NaClSysSysbrkDecoder}, /* 20 */
+  [NACL_sys_mmap]                = {&NaClSysRestricted},
+  [NACL_sys_munmap]              = {&NaClSysRestricted},
+  [NACL_sys_exit]                = {&NaClSysExitDecoder}, /* 30 */
+  [NACL_sys_getpid]              = {&NaClSysRestricted},
+  [NACL_sys_thread_exit]         = {&NaClSysRestricted},
+  [NACL_sys_gettimeofday]        = {&NaClSysRestricted},
+  [NACL_sys_clock]               = {&NaClSysRestricted},
+  [NACL_sys_nanosleep]           = {&NaClSysRestricted},
+  [NACL_sys_imc_makeboundsock]   = {&NaClSysRestricted},
+  [NACL_sys_imc_accept]          = {&NaClSysRestricted},
+  [NACL_sys_imc_connect]         = {&NaClSysRestricted},
+  [NACL_sys_imc_sendmsg]         = {&NaClSysRestricted},
+  [NACL_sys_imc_recvmsg]         = {&NaClSysRestricted},
+  [NACL_sys_imc_mem_obj_create]  = {&NaClSysRestricted},
+  [NACL_sys_tls_init]            = {&NaClSysTls_InitDecoder}, /* 82 */
+  [NACL_sys_thread_create]       = {&NaClSysRestricted},
+  [NACL_sys_tls_get]             = {&NaClSysTls_GetDecoder}, /* 84 */
+  [NACL_sys_thread_nice]         = {&NaClSysRestricted},
+  [NACL_sys_mutex_create]        = {&NaClSysMutex_CreateDecoder}, /* 70 */
+  [NACL_sys_mutex_lock]          = {&NaClSysRestricted},
+  [NACL_sys_mutex_unlock]        = {&NaClSysRestricted},
+  [NACL_sys_mutex_trylock]       = {&NaClSysRestricted},
+  [NACL_sys_cond_create]         = {&NaClSysRestricted},
+  [NACL_sys_cond_wait]           = {&NaClSysRestricted},
+  [NACL_sys_cond_signal]         = {&NaClSysRestricted},
+  [NACL_sys_cond_broadcast]      = {&NaClSysRestricted},
+  [NACL_sys_cond_timed_wait_abs] = {&NaClSysRestricted},
+  [NACL_sys_imc_socketpair]      = {&NaClSysRestricted},
+  [NACL_sys_sem_create]          = {&NaClSysRestricted},
+  [NACL_sys_sem_wait]            = {&NaClSysRestricted},
+  [NACL_sys_sem_post]            = {&NaClSysRestricted},
+  [NACL_sys_sem_get_value]       = {&NaClSysRestricted},
+  [NACL_sys_sched_yield]         = {&NaClSysRestricted},
+  [NACL_sys_sysconf]             = {&NaClSysRestricted},
+  [NACL_sys_dyncode_create]      = {&NaClSysRestricted},
+  [NACL_sys_dyncode_modify]      = {&NaClSysRestricted},
+  [NACL_sys_dyncode_delete]      = {&NaClSysRestricted},
+  [NACL_sys_second_tls_set]      = {&NaClSysRestricted},
+  [NACL_sys_second_tls_get]      = {&NaClSysRestricted},
+  [NACL_sys_test_infoleak]       = {&NaClSysRestricted},
+};
+
+void NaClSyscallTableInit() {
+  nacl_syscall = nacl_syscall_enabled;
+}
 
-  NaClAddSyscall(One_ring, &OneRingDecoder); /* 0. added onering call */
-  NaClAddSyscall(NACL_sys_null, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_nameservice, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_dup, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_dup2, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_open, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_close, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_read, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_write, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_lseek, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_ioctl, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_fstat, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_stat, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_getdents, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_sysbrk, &NaClSysSysbrkDecoder); /* 20 */
-  NaClAddSyscall(NACL_sys_mmap, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_munmap, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_exit, &NaClSysExitDecoder); /* 30 */
-  NaClAddSyscall(NACL_sys_getpid, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_thread_exit, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_gettimeofday, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_clock, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_nanosleep, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_imc_makeboundsock, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_imc_accept, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_imc_connect, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_imc_sendmsg, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_imc_recvmsg, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_imc_mem_obj_create, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_tls_init, &NaClSysTls_InitDecoder); /* 82 */
-  NaClAddSyscall(NACL_sys_thread_create, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_tls_get, &NaClSysTls_GetDecoder); /* 84 */
-  NaClAddSyscall(NACL_sys_thread_nice, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_mutex_create, &NaClSysMutex_CreateDecoder); /* 70 */
-  NaClAddSyscall(NACL_sys_mutex_lock, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_mutex_unlock, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_mutex_trylock, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_cond_create, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_cond_wait, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_cond_signal, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_cond_broadcast, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_cond_timed_wait_abs, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_imc_socketpair, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_sem_create, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_sem_wait, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_sem_post, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_sem_get_value, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_sched_yield, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_sysconf, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_dyncode_create, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_dyncode_modify, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_dyncode_delete, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_second_tls_set, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_second_tls_get, &NaClSysRestricted);
-  NaClAddSyscall(NACL_sys_test_infoleak, &NaClSysRestricted);
+void NaClSyscallTableInitDisable() {
+  nacl_syscall = nacl_syscall_disabled;
 }
 /* d'b end */
@@ -10,15 +10,21 @@
 
 #include "include/nacl_base.h"
 
+EXTERN_C_BEGIN
+
 struct NaClAppThread;
 
 struct NaClSyscallTableEntry {
   int32_t (*handler)(struct NaClAppThread *natp);
 };
 
-/* these are defined in the platform specific code */
-extern struct NaClSyscallTableEntry nacl_syscall[];
+/*
+ * these are defined in the platform specific code. the tables are
+ * const and NACL_MAX_SYSCALLS long, a NULL handler is not implemented
+ */
+extern struct NaClSyscallTableEntry const *nacl_syscall;
 
+/* select the full (or the restricted) table. call before NaClAppCtor() */
 void NaClSyscallTableInit();
 void NaClSyscallTableInitDisable(); /* d'b */
 
@@ -31,6 +31,7 @@
 #include "src/service_runtime/nacl_globals.h" /* d'b */
 #include "src/manifest/trap.h" /* d'b: ResumeCpuClock(), PauseCpuClock() */
 #include "src/manifest/manifest_setup.h" /* d'b: ResumeCpuClock(), PauseCpuClock() */
+#include "src/manifest/accounting.h" /* d'b */
 
 int NaClArtificialDelay = -1;
 
@@ -82,21 +83,20 @@ NORETURN void NaClSyscallCSegHook()
 
   /*
    * d'b: nexe just invoked some syscall. stop cpu time counting
-   * increase syscalls counter (correction for setup call will be
-   * corrected later). small mallocs and other calls which are
-   * not really "system" will be accounted anyway!
+   * and take the syscall from the budget. small mallocs and other
+   * calls which are not really "system" will be accounted anyway!
+   * if SyscallsMax is exceeded the nexe is stopped on the return
    */
   nap = gnap; /* restore NaClApp object */
   PauseCpuClock(nap);
-  AccountingSyscallsInc(nap);
+  if(--accounting.syscalls < 0)
+    AccountingViolation(CHANNELS_COUNT, LimitSyscalls);
   user = nacl_user; /* restore from global */
   sp_user = NaClGetThreadCtxSp(user);
 
   /* sp must be okay for control to have gotten here */
-#if !BENCHMARK
-  NaClLog(4, "Entered NaClSyscallCSegHook\n");
-  NaClLog(4, "user sp %"NACL_PRIxPTR"\n", sp_user);
-#endif
+  NaClLogTrace(4, "Entered NaClSyscallCSegHook\n");
+  NaClLogTrace(4, "user sp %"NACL_PRIxPTR"\n", sp_user);
 
   /*
    * on x86_32 user stack:
@@ -123,9 +123,7 @@ NORETURN void NaClSyscallCSegHook()
   sysnum = (tramp_ret - (nap->mem_start + NACL_SYSCALL_START_ADDR))
       >> NACL_SYSCALL_BLOCK_SHIFT;
 
-#if !BENCHMARK
-  NaClLog(4, "system call %"NACL_PRIuS"\n", sysnum);
-#endif
+  NaClLogTrace(4, "system call %"NACL_PRIuS"\n", sysnum);
 
   /*
    * getting user return address (the address where we need to return after
@@ -144,12 +142,13 @@ NORETURN void NaClSyscallCSegHook()
   if (sysnum >= NACL_MAX_SYSCALLS) {
     NaClLog(2, "INVALID system call %"NACL_PRIdS"\n", sysnum);
     nap->sysret = -NACL_ABI_EINVAL;
+  } else if (NULL == nap->syscall_table[sysnum].handler) {
+    NaClLog(2, "system call %"NACL_PRIdS" is not implemented\n", sysnum);
+    nap->sysret = -NACL_ABI_ENOSYS;
   } else {
-#if !BENCHMARK
-    NaClLog(4, "making system call %"NACL_PRIdS", "
-            "handler 0x%08"NACL_PRIxPTR"\n",
-            sysnum, (uintptr_t) nap->syscall_table[sysnum].handler);
-#endif
+    NaClLogTrace(4, "making system call %"NACL_PRIdS", "
+                 "handler 0x%08"NACL_PRIxPTR"\n",
+                 sysnum, (uintptr_t) nap->syscall_table[sysnum].handler);
     /*
      * syscall_args is used by Decoder functions in
      * nacl_syscall_handlers.c which is automatically generated file
@@ -162,15 +161,13 @@ NORETURN void NaClSyscallCSegHook()
     nap->syscall_args = (uintptr_t *) sp_sys;
     nap->sysret = (*(nap->syscall_table[sysnum].handler))(nap); //###
   }
-#if !BENCHMARK
-  NaClLog(4,
-          ("returning from system call %"NACL_PRIdS", return value %"NACL_PRId32
-           " (0x%"NACL_PRIx32")\n"),
-          sysnum, nap->sysret, nap->sysret);
-
-  NaClLog(4, "return target 0x%08"NACL_PRIxNACL_REG"\n", user_ret);
-  NaClLog(4, "user sp %"NACL_PRIxPTR"\n", sp_user);
-#endif
+  NaClLogTrace(4,
+               ("returning from system call %"NACL_PRIdS", return value "
+                "%"NACL_PRId32" (0x%"NACL_PRIx32")\n"),
+               sysnum, nap->sysret, nap->sysret);
+
+  NaClLogTrace(4, "return target 0x%08"NACL_PRIxNACL_REG"\n", user_ret);
+  NaClLogTrace(4, "user sp %"NACL_PRIxPTR"\n", sp_user);
   if (-1 == NaClArtificialDelay) {
     char *delay = getenv("NACLDELAY");
     if (NULL != delay) {
@@ -199,3 +196,39 @@ NORETURN void NaClSyscallCSegHook()
   fprintf(stderr, "NORETURN NaClSwitchToApp returned!?!\n");
   NaClAbort();
 }
+
+/*
+ * d'b: "One Ring" hook. NaClSyscallSeg() passes the trap registers as
+ * they are: function and 4 arguments. unlike NaClSyscallCSegHook() the
+ * untrusted stack is only read to get the return address
+ */
+NORETURN void NaClOneRingHook(nacl_reg_t function, nacl_reg_t arg2,
+                              nacl_reg_t arg3, nacl_reg_t arg4,
+                              nacl_reg_t arg5) {
+  struct NaClApp  *nap;
+  nacl_reg_t      user_ret;
+  uintptr_t       sp_user;
+  uint64_t        args[] = {function, 0, arg2, arg3, arg4, arg5};
+
+  nap = gnap;
+  PauseCpuClock(nap); /* the syscall is accounted by TrapHandler() */
+
+  /* see NaClSyscallCSegHook() for the user stack layout */
+  sp_user = NaClGetThreadCtxSp(nacl_user);
+  user_ret = *(uintptr_t *) (NaClUserToSysStackAddr(nap, sp_user)
+                             + NACL_USERRET_FIX);
+  NaClSetThreadCtxSp(nacl_user, sp_user + NACL_SYSCALLRET_FIX);
+
+  nap->sysret = TrapHandler(nap, args);
+  NaClLogTrace(4, "One Ring %"NACL_PRIu64" returned %"NACL_PRId32"\n",
+               args[0], nap->sysret);
+
+  user_ret = (nacl_reg_t) NaClSandboxCodeAddr(nap, (uintptr_t)user_ret);
+  NaClStackSafetyNowOnUntrustedStack();
+  ResumeCpuClock(nap);
+  NaClSwitchToApp(nap, user_ret);
+  /* NOTREACHED */
+
+  fprintf(stderr, "NORETURN NaClSwitchToApp returned!?!\n");
+  NaClAbort();
+}
@@ -775,6 +775,7 @@ int32_t NaClTextDyncodeCreate(struct NaClApp *nap,
 
  cleanup_unlock:
   NaClXMutexUnlock(&nap->dynamic_load_mutex);
+  NaClPerfCounterDtor(&time_dyncode_create);
   return retval;
 }
 
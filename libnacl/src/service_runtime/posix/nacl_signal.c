@@ -264,6 +264,36 @@ void NaClSignalHandlerFiniPlatform() {
   }
 }
 
+/*
+ * d'b: the timer signals are not faults.  They are not in s_Signals,
+ * so they do not go to the old handlers and are not removed with the
+ * fault handlers.
+ */
+void NaClSignalTimerInit(int signal_number) {
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_sigaction = SignalCatch;
+  sa.sa_flags = SA_ONSTACK | SA_SIGINFO;
+  if (sigaction(signal_number, &sa, NULL) != 0) {
+    NaClLog(LOG_FATAL, "Failed to install handler for %d.\n\tERR:%s\n",
+            signal_number, strerror(errno));
+  }
+}
+
+void NaClSignalTimerFini(int signal_number) {
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_handler = SIG_DFL;
+  if (sigaction(signal_number, &sa, NULL) != 0) {
+    NaClLog(LOG_FATAL, "Failed to unregister handler for %d.\n\tERR:%s\n",
+            signal_number, strerror(errno));
+  }
+}
+
 /*
  * Check that signal handlers are not registered.  We want to
  * discourage Chrome or libraries from registering signal handlers
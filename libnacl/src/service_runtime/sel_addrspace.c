@@ -170,7 +170,8 @@ NaClErrorCode NaClMemoryProtection(struct NaClApp *nap) {
                       NaClSysToUser(nap, start_addr) >> NACL_PAGESHIFT,
                       region_size >> NACL_PAGESHIFT,
                       PROT_READ | PROT_EXEC,
-                      NaClMemObjMake(nap->text_shm,
+                      NaClMemObjMake(&nap->mem_map.mem_objs,
+                                     nap->text_shm,
                                      region_size,
                                      0))) {
       NaClLog(LOG_ERROR, ("NaClMemoryProtection: NaClVmmapAdd failed"
@@ -51,6 +51,9 @@
 
 #include "src/threading/nacl_thread_interface.h"
 
+/* enough host descriptors for all the channels of a session */
+#define START_HOST_DESCS 8
+
 static int IsEnvironmentVariableSet(char const *env_name) {
   return NULL != getenv(env_name);
 }
@@ -59,8 +62,8 @@ static int ShouldEnableDynamicLoading() {
   return !IsEnvironmentVariableSet("NACL_DISABLE_DYNAMIC_LOADING");
 }
 
-int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
-                                struct NaClSyscallTableEntry *table) {
+int NaClAppWithSyscallTableCtor(struct NaClApp                     *nap,
+                                struct NaClSyscallTableEntry const *table) {
   struct NaClDescEffectorLdr  *effp;
 
   nap->addr_bits = NACL_MAX_ADDR_BITS;
@@ -91,16 +94,20 @@ int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
   if (!DynArrayCtor(&nap->threads, 2)) {
     goto cleanup_none;
   }
-  if (!DynArrayCtor(&nap->desc_tbl, 2)) {
+  if (!NaClDescTableCtor(&nap->desc_tbl, 2)) {
     goto cleanup_threads;
   }
   if (!NaClVmmapCtor(&nap->mem_map)) {
     goto cleanup_desc_tbl;
   }
+  if (!NaClSlabCtor(&nap->host_descs, sizeof(struct NaClHostDesc),
+                    START_HOST_DESCS)) {
+    goto cleanup_mem_map;
+  }
 
   effp = (struct NaClDescEffectorLdr *) malloc(sizeof *effp);
   if (NULL == effp) {
-    goto cleanup_mem_map;
+    goto cleanup_host_descs;
   }
   if (!NaClDescEffectorLdrCtor(effp, nap)) {
     goto cleanup_effp_free;
@@ -163,6 +170,7 @@ int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
 
   nap->enable_debug_stub = 0;
   nap->debug_stub_callbacks = NULL;
+  nap->perf = NULL;
 
   return 1;
 
@@ -184,10 +192,12 @@ int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
   (*nap->effp->vtbl->Dtor)(nap->effp);
  cleanup_effp_free:
   free(nap->effp);
+ cleanup_host_descs:
+  NaClSlabDtor(&nap->host_descs);
  cleanup_mem_map:
   NaClVmmapDtor(&nap->mem_map);
  cleanup_desc_tbl:
-  DynArrayDtor(&nap->desc_tbl);
+  NaClDescTableDtor(&nap->desc_tbl);
  cleanup_threads:
   DynArrayDtor(&nap->threads);
  cleanup_none:
@@ -442,25 +452,13 @@ void  NaClAppPrintDetails(struct NaClApp  *nap,
 
 struct NaClDesc *NaClGetDescMu(struct NaClApp *nap,
                                int            d) {
-  struct NaClDesc *result;
-
-  result = (struct NaClDesc *) DynArrayGet(&nap->desc_tbl, d);
-  if (NULL != result) {
-    NaClDescRef(result);
-  }
-
-  return result;
+  return NaClDescTableGet(&nap->desc_tbl, d);
 }
 
 void NaClSetDescMu(struct NaClApp   *nap,
                    int              d,
                    struct NaClDesc  *ndp) {
-  struct NaClDesc *result;
-
-  result = (struct NaClDesc *) DynArrayGet(&nap->desc_tbl, d);
-  NaClDescSafeUnref(result);
-
-  if (!DynArraySet(&nap->desc_tbl, d, ndp)) {
+  if (!NaClDescTableSet(&nap->desc_tbl, d, ndp)) {
     NaClLog(LOG_FATAL,
             "NaClSetDesc: could not set descriptor %d to 0x%08"
             NACL_PRIxPTR"\n",
@@ -471,29 +469,23 @@ void NaClSetDescMu(struct NaClApp   *nap,
 
 int32_t NaClSetAvailMu(struct NaClApp  *nap,
                        struct NaClDesc *ndp) {
-  size_t pos;
+  int32_t pos;
 
-  pos = DynArrayFirstAvail(&nap->desc_tbl);
+  pos = NaClDescTableSetAvail(&nap->desc_tbl, ndp);
 
-  if (pos > INT32_MAX) {
+  if (pos < 0) {
     NaClLog(LOG_FATAL,
-            ("NaClSetAvailMu: DynArrayFirstAvail returned a value"
-             " that is greather than 2**31-1.\n"));
+            "NaClSetAvailMu: could not set descriptor to 0x%08"NACL_PRIxPTR"\n",
+            (uintptr_t) ndp);
   }
 
-  NaClSetDescMu(nap, (int) pos, ndp);
-
-  return (int32_t) pos;
+  return pos;
 }
 
+/* lock free for the readers. the writers are serialized by desc_mu */
 struct NaClDesc *NaClGetDesc(struct NaClApp *nap,
                              int            d) {
-  struct NaClDesc *res;
-
-  NaClXMutexLock(&nap->desc_mu);
-  res = NaClGetDescMu(nap, d);
-  NaClXMutexUnlock(&nap->desc_mu);
-  return res;
+  return NaClDescTableGet(&nap->desc_tbl, d);
 }
 
 void NaClSetDesc(struct NaClApp   *nap,
@@ -37,6 +37,7 @@
 #include "src/platform/nacl_threads.h"
 
 #include "src/service_runtime/dyn_array.h"
+#include "src/service_runtime/nacl_desc_table.h"
 #include "src/service_runtime/nacl_config_dangerous.h"
 #include "src/service_runtime/nacl_error_code.h"
 
@@ -57,6 +58,7 @@ struct NaClAppThread;
 struct NaClDesc;  /* see src/desc/nacl_desc_base.h */
 struct NaClDynamicRegion;
 struct NaClManifestProxy;
+struct NaClPerfCounter;  /* see src/perf_counter/nacl_perf_counter.h */
 struct NaClSecureService;
 struct NaClSecureReverseService;
 struct NaClThreadInterface;  /* see sel_ldr_thread_interface.h */
@@ -171,9 +173,9 @@ struct NaClApp {
 
   /*
    * An array of NaCl syscall handlers. The length of the array must be
-   * at least NACL_MAX_SYSCALLS.
+   * at least NACL_MAX_SYSCALLS. NULL handlers are not implemented.
    */
-  struct NaClSyscallTableEntry *syscall_table;
+  struct NaClSyscallTableEntry const *syscall_table;
 
   NaClErrorCode             module_load_status;
   int                       module_may_start;
@@ -263,7 +265,7 @@ struct NaClApp {
   int                       num_threads;  /* number actually running */ // #13 to remove
 
   struct NaClMutex          desc_mu; // #14 to remove
-  struct DynArray           desc_tbl;  /* NaClDesc pointers */ // #15 to remove
+  struct NaClDescTable      desc_tbl;  /* NaClDesc pointers */ // #15 to remove
 
   int                       enable_debug_stub;
   struct NaClDebugCallbacks *debug_stub_callbacks;
@@ -271,6 +273,8 @@ struct NaClApp {
 	/* d'b added fields */
   int                       enable_syscalls;
   struct Manifest           *manifest;
+  struct NaClPerfCounter    *perf; /* session counter, NULL if not profiled */
+  struct NaClSlab           host_descs; /* NaClHostDesc of the channels */
 
   /* fileds taken from the natp */
   void                      *signal_stack; /* Stack for signal handling, registered with sigaltstack(). */
@@ -288,13 +292,13 @@ struct NaClApp {
  * nap is a pointer to the NaCl object that is being filled in.
  *
  * table is the NaCl syscall table. The syscall table must contain at least
- * NACL_MAX_SYSCALLS valid entries.
+ * NACL_MAX_SYSCALLS entries, a NULL handler answers ENOSYS.
  *
  * Caution! Syscall handlers must be extremely careful with respect to
  * argument validation, including time-of-check vs time-of-use defense, etc.
  */
-int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
-                                struct NaClSyscallTableEntry *table) NACL_WUR;
+int NaClAppWithSyscallTableCtor(struct NaClApp                     *nap,
+                                struct NaClSyscallTableEntry const *table) NACL_WUR;
 
 int   NaClAppCtor(struct NaClApp  *nap) NACL_WUR;
 
@@ -426,7 +430,7 @@ static const uintptr_t kNaClBadAddress = (uintptr_t) -1;
  * Looks up a descriptor in the open-file table.  An additional
  * reference is taken on the returned NaClDesc object (if non-NULL).
  * The caller is responsible for invoking NaClDescUnref() on it when
- * done.
+ * done.  Lookups do not take desc_mu, see nacl_desc_table.h.
  */
 struct NaClDesc *NaClGetDesc(struct NaClApp *nap,
                              int            d);
@@ -32,6 +32,7 @@
 #include "src/service_runtime/arch/sel_ldr_arch.h"
 #include "src/service_runtime/elf_util.h"
 #include "src/service_runtime/nacl_app_thread.h"
+#include "src/service_runtime/nacl_signal.h"
 #include "src/service_runtime/nacl_switch_to_app.h"
 #include "src/service_runtime/nacl_syscall_common.h"
 #include "src/service_runtime/nacl_text.h"
@@ -43,6 +44,7 @@
 #include "src/service_runtime/sel_addrspace.h"
 #include "src/manifest/manifest_setup.h"
 #include "src/manifest/trap.h" /* d'b: PauseCpuClock(), ResumeCpuClock() */
+#include "src/manifest/phase_timer.h" /* d'b */
 #include "src/service_runtime/nacl_globals.h" /* d'b: nacl_user */
 
 /* d'b */
@@ -66,7 +68,15 @@ NORETURN void SwitchToApp(struct NaClApp  *nap, uintptr_t stack_ptr)
   /* construct "nacl_user" global */
   NaClThreadContextCtor(nacl_user, nap, nap->initial_entry_pt,
                         NaClSysToUserStackAddr(nap, stack_ptr), 0);
-  assert(NaClSignalStackAllocate(&nap->signal_stack));
+
+  /*
+   * the signals the nexe thread gets (faults, CPUMax, Timeout) must not
+   * be delivered on the untrusted stack. note: not under assert(), it
+   * is compiled out with NDEBUG
+   */
+  if(!nap->signal_stack)
+    COND_ABORT(!NaClSignalStackAllocate(&nap->signal_stack), "cannot allocate signal stack");
+  NaClSignalStackRegister(nap->signal_stack);
 
   nacl_user->sysret = nap->break_addr; /* can be set from NaClThreadContextCtor() */
   nacl_user->prog_ctr = NaClUserToSys(nap, nap->initial_entry_pt); /* which one do i need, both? */
@@ -239,8 +249,11 @@ NaClErrorCode NaClAppLoadFile(struct Gio       *gp,
   uintptr_t           max_vaddr;
   struct NaClElfImage *image = NULL;
   struct NaClPerfCounter  time_load_file;
+  int                     profiled;
 
   NaClPerfCounterCtor(&time_load_file, "NaClAppLoadFile");
+  profiled = NULL != nap->perf &&
+      NaClPerfCounterEnter(nap->perf, "LoadFile") > 0;
 
   /* NACL_MAX_ADDR_BITS < 32 */
   if (nap->addr_bits > NACL_MAX_ADDR_BITS) {
@@ -434,7 +447,9 @@ NaClErrorCode NaClAppLoadFile(struct Gio       *gp,
 
 #if 0 == NACL_DANGEROUS_DEBUG_MODE_DISABLE_INNER_SANDBOX
   NaClLog(2, "Validating image\n");
+  PhaseTimerStart(PhaseValidate);
   subret = NaClValidateImage(nap);
+  PhaseTimerStop(PhaseValidate);
   NaClPerfCounterMark(&time_load_file,
                       NACL_PERF_IMPORTANT_PREFIX "ValidateImg");
   NaClPerfCounterIntervalLast(&time_load_file);
@@ -475,6 +490,8 @@ done:
 
   NaClPerfCounterMark(&time_load_file, "EndLoadFile");
   NaClPerfCounterIntervalTotal(&time_load_file);
+  NaClPerfCounterDtor(&time_load_file);
+  if (profiled) NaClPerfCounterLeave(nap->perf);
   return ret;
 }
 
@@ -31,6 +31,7 @@
 #include "src/platform/nacl_check.h"
 #include "src/platform/nacl_exit.h"
 #include "src/platform/nacl_log.h"
+#include "src/platform/nacl_log_ring.h"
 #include "src/platform/nacl_sync.h"
 #include "src/platform/nacl_sync_checked.h"
 
@@ -50,6 +51,14 @@
 #include "src/manifest/manifest_setup.h" /* d'b */
 #include "src/service_runtime/nacl_app_thread.h" /* d'b */
 #include "src/manifest/mount_channel.h" /* d'b */
+#include "src/manifest/phase_timer.h" /* d'b */
+#include "src/manifest/trap_stats.h" /* d'b */
+#include "src/manifest/trap.h" /* d'b */
+#include "src/manifest/io_ring.h" /* d'b */
+#include "src/manifest/report.h" /* d'b */
+#include "src/manifest/live_stats.h" /* d'b */
+#include "src/manifest/watchdog.h" /* d'b */
+#include "src/manifest/accounting.h" /* d'b */
 #include "src/service_runtime/outer_sandbox.h"
 #include "src/service_runtime/sel_ldr.h"
 #include "src/service_runtime/sel_qualify.h"
@@ -193,7 +202,6 @@ int main(int argc, char **argv)
   struct GioMemoryFileSnapshot  main_file; /* moved up from removed if() */
   int														i;
   char                          *ma_name = NULL;
-  char                          manifest[MAX_MANIFEST_LEN];
   int 													nexe_argc = 1;
   char 													**nexe_argv = NULL;
 
@@ -212,6 +220,7 @@ int main(int argc, char **argv)
   /* d'b end */
 
   struct NaClPerfCounter time_all_main;
+  enum NaClPerfDumpFormat perf_format = NACL_PERF_DUMP_NONE;
 //  const char **envp;
 //  struct NaClEnvCleanser env_cleanser;
   const char *sandbox_fd_string;
@@ -244,6 +253,7 @@ int main(int argc, char **argv)
     /* d'b: cannot be moved. initialization failed
    * when i tried to put it below command line parser switch
    */
+    PhaseTimerStart(PhaseInit);
     NaClAllModulesInit();
     verbosity = NaClLogGetVerbosity();
     NaClPerfCounterCtor(&time_all_main, "SelMain");
@@ -391,6 +401,8 @@ int main(int argc, char **argv)
     }
   }
 
+	PhaseTimerStop(PhaseInit);
+
 	if (debug_mode_ignore_validator == 1)
 		fprintf(stderr, "DEBUG MODE ENABLED (ignore validator)\n");
 	else if (debug_mode_ignore_validator > 1)
@@ -432,6 +444,7 @@ int main(int argc, char **argv)
 	// every variable should be initialized in nap object, main must be split into functions
 	// it will simplify main() and will remove needlessly linked code pieces
   /* process manifest file specified in cmdline */
+	PhaseTimerStart(PhaseManifest);
 	if (ma_name == NULL)
 	{
 		state.manifest = NULL;
@@ -449,6 +462,9 @@ int main(int argc, char **argv)
 		SetupUserPolicy(&state);
 		SetupSystemPolicy(&state);
 
+		/* trap/channel histograms for the report */
+		if(state.manifest->system_setup->trap_stats) TrapStatsEnable();
+
 
 		// ### this part must be completelly removed when command line will be replaced by manifest
 	  /* check if command line switches has duplicates in manifest */
@@ -503,6 +519,7 @@ int main(int argc, char **argv)
 
     /* ### channels initialization moved bellow because it is need initialized nacldesc dynarray */
 	}
+	PhaseTimerStop(PhaseManifest);
 
 	/*
 	 * change stdout/stderr to log file now, so that subsequent error
@@ -512,6 +529,14 @@ int main(int argc, char **argv)
 	 */
 	if (NULL != log_file) NaClLogSetFile(log_file);
 
+	/* d'b: from now on the log is written by its own thread */
+	if (!NaClLogRingStart())
+		NaClLog(LOG_WARNING, "cannot start the log thread, the log is synchronous\n");
+
+	/* d'b: live counters for the node agent. the session goes on w/o them */
+	if (state.manifest && state.manifest->system_setup->stats_segment)
+		LiveStatsCtor(state.manifest->system_setup->stats_segment);
+
 	state.enable_syscalls = 0; /* syscalls are disabled by default */
 	if (syscalls_behavior == NULL || !strcmp(syscalls_behavior, "0"))
 		state.enable_syscalls = 0;
@@ -571,6 +596,10 @@ int main(int argc, char **argv)
   nap = &state;
 	errcode = LOAD_OK;
 
+  /* profile loader, validator and traps if a dump was requested */
+  perf_format = NaClPerfCounterDumpFormat();
+  if(perf_format != NACL_PERF_DUMP_NONE) nap->perf = &time_all_main;
+
 	/*
    * in order to report load error to the browser plugin through the
    * secure command channel, we do not immediate jump to cleanup code
@@ -596,8 +625,11 @@ int main(int argc, char **argv)
 	NaClSignalHandlerInit();
 	if (!skip_qualification)
 	{
-		NaClErrorCode pq_error = NACL_FI_VAL("pq", NaClErrorCode,
+		NaClErrorCode pq_error;
+		PhaseTimerStart(PhaseQualify);
+		pq_error = NACL_FI_VAL("pq", NaClErrorCode,
 				NaClRunSelQualificationTests());
+		PhaseTimerStop(PhaseQualify);
 		if (LOAD_OK != pq_error)
 		{
 			errcode = pq_error;
@@ -640,6 +672,7 @@ int main(int argc, char **argv)
     NaClPerfCounterIntervalLast(&time_all_main);
   }
 
+  PhaseTimerStart(PhaseLoad);
   if (0 == GioMemoryFileSnapshotCtor(&main_file, nacl_file))
   {
     perror("sel_main");
@@ -665,6 +698,7 @@ int main(int argc, char **argv)
 
     NaClPerfCounterMark(&time_all_main, "AppLoadEnd");
     NaClPerfCounterIntervalLast(&time_all_main);
+    PhaseTimerStop(PhaseLoad);
 
     NaClXMutexLock(&nap->mu);
     nap->module_load_status = errcode;
@@ -684,11 +718,13 @@ int main(int argc, char **argv)
   if(nap->manifest)
   {
     enum ChannelType ch;
+    PhaseTimerStart(PhaseChannels);
     for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
     {
       if(ConstructChannel(nap, ch)) continue;
       MountChannel(nap, ch);
     }
+    PhaseTimerStop(PhaseChannels);
   }
   /* d'b end */
 
@@ -876,22 +912,33 @@ int main(int argc, char **argv)
   }
 
   /* set user space to max_mem */
+  PhaseTimerStart(PhasePreallocate);
   PreallocateUserMemory(nap);
+  PreallocateIoRing(nap);
+  AccountingCtor(nap);
+  PhaseTimerStop(PhasePreallocate);
 
   NaClPerfCounterMark(&time_all_main, "CreateMainThread");
   NaClPerfCounterIntervalLast(&time_all_main);
 //  DynArrayDtor(&env_vars);
 
   /* set user code trap() exit location */
+  PhaseTimerStart(PhaseRun);
   if((ret_code = setjmp(user_exit)) == 0)
   {
     /* pass control to the user code */
+    WatchdogCtor(nap);
+    StartCpuClock(nap);
     if(!NaClCreateMainThread(nap, nexe_argc, nexe_argv, NULL))
     {
       fprintf(stderr, "creating main thread failed\n");
       goto done;
     }
   }
+  StopCpuClock(nap);
+  IoRingDtor(nap);
+  AccountingSync(nap);
+  PhaseTimerStop(PhaseRun);
   /* d'b end */
 
 //  NaClEnvCleanserDtor(&env_cleanser);
@@ -901,14 +948,27 @@ int main(int argc, char **argv)
 
   NaClPerfCounterMark(&time_all_main, "SelMainEnd");
   NaClPerfCounterIntervalTotal(&time_all_main);
+  NaClPerfCounterDump(&time_all_main, NaClLogGetGio(), perf_format);
 
   /* d'b
    * manifest finalization
    */
   if(nap->manifest)
   {
+    static char report[REPORT_MAX_SIZE]; /* static: no allocations at exit */
     FILE *f = NULL;
     char *name = nap->manifest->system_setup->report;
+    int broken = 0;
+    int len;
+
+    PhaseTimerStart(PhaseUnmount);
+
+    /* sync and trim the premapped output and user_log, finish the etag */
+    {
+      enum ChannelType ch;
+      for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+        if(UnmountChannel(nap, ch)) broken = 1;
+    }
 
     /* open report file */
     if ((f = fopen(name, "w")) == NULL)
@@ -917,26 +977,36 @@ int main(int argc, char **argv)
       goto done;
     }
 
-    /* generate report, "manifest" reused for report, fix it ### */
+    /* generate report in the format requested by proxy */
     SetupReportSettings(nap);
-    nap->manifest->report->ret_code = 0;
+    nap->manifest->report->ret_code = GetStopCode();
+    if(broken && GetStopCode() == RetCodeOk)
+      nap->manifest->report->ret_code = RetCodeChannelError;
     nap->manifest->report->user_ret_code = ret_code;
-    AnswerManifestPut(nap, manifest);
+    PhaseTimerStop(PhaseUnmount);
+    PhaseTimerStart(PhaseTeardown);
+    len = ReportPut(nap, ReportFormatByName(nap->manifest->system_setup->report_format),
+        report, sizeof report);
 
     /* write it and free resources */
-    fwrite(manifest, 1, strlen(manifest), f);
+    if(len < 0) NaClLog(LOG_ERROR, "report does not fit %d bytes\n", REPORT_MAX_SIZE);
+    else fwrite(report, 1, len, f);
     fclose(f);
+    WatchdogDtor();
 
-    /* trim user_log */
-    // refactor it to premap with name: UnmountChannel(nap, channel) to avoid truncate()
-    if (nap->manifest->user_setup->channels[LogChannel].buffer)
-    {
-      char *p = (char*) NaClUserToSys(nap, (uint32_t)nap->manifest->user_setup->channels[LogChannel].buffer);
-      off_t size = strlen(p);
-      munmap(p, nap->manifest->user_setup->channels[LogChannel].bsize);
-      truncate(GetValueByKey(nap, "UserLog"), size);
-    }
+    /*
+     * release the runtime objects in bulk. the memory map goes first
+     * since its objects may return host descriptors to the slab. the
+     * nexe and the service threads are over, nothing uses them anymore
+     */
+    NaClVmmapDtor(&nap->mem_map);
+    NaClSlabDtor(&nap->host_descs);
+
+    /* teardown cannot be put to the report anymore */
+    PhaseTimerStop(PhaseTeardown);
+    NaClLog(1, "teardown took %ld ns\n", PhaseTimerGet(PhaseTeardown));
   }
+  LiveStatsDtor();
   /* d'b end */
 
   /*
@@ -947,6 +1017,8 @@ int main(int argc, char **argv)
   NaClExit(ret_code);
 
  done:
+  WatchdogDtor(); /* d'b */
+  LiveStatsDtor(); /* d'b */
   fflush(stdout);
 
   if (verbosity) {
@@ -965,6 +1037,7 @@ int main(int argc, char **argv)
   fflush(stdout);
 
   if (handle_signals) NaClSignalHandlerFini();
+  NaClPerfCounterDtor(&time_all_main);
   NaClAllModulesFini();
 
   NaClExit(ret_code);
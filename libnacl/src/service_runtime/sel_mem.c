@@ -23,45 +23,58 @@
 #include "src/service_runtime/nacl_memory_object.h"
 
 #define START_ENTRIES   5   /* tramp+text, rodata, data, bss, stack */
-#define REMOVE_MARKED_DEBUG 0
-
 
 /*
- * The memory map structure is a simple array of memory regions which
- * may have different access protections.  We do not yet merge regions
- * with the same access protections together to reduce the region
- * number, but may do so in the future.
+ * The memory map structure is a tree of memory regions which may have
+ * different access protections.  We do not yet merge regions with the
+ * same access protections together to reduce the region number, but
+ * may do so in the future.
  *
  * Regions are described by (relative) starting page number, the
  * number of pages, and the protection that the pages should have.
  *
  * Takes ownership of NaClMemObj.
  */
-struct NaClVmmapEntry *NaClVmmapEntryMake(uintptr_t             page_num,
-                                          size_t                npages,
-                                          int                   prot,
-                                          struct NaClMemObj     *nmop) {
+static struct NaClVmmapEntry *NaClVmmapEntryMake(struct NaClVmmap  *self,
+                                                 uintptr_t         page_num,
+                                                 size_t            npages,
+                                                 int               prot,
+                                                 struct NaClMemObj *nmop) {
   struct NaClVmmapEntry *entry;
 
   NaClLog(4,
           "NaClVmmapEntryMake(0x%"NACL_PRIxPTR",0x%"NACL_PRIxS","
           "0x%x,0x%"NACL_PRIxPTR")\n",
           page_num, npages, prot, (uintptr_t) nmop);
-  entry = (struct NaClVmmapEntry *) malloc(sizeof *entry);
+  entry = NaClSlabAlloc(&self->entries, sizeof *entry);
   if (NULL == entry) {
     return 0;
   }
+  self->size = self->entries.capacity;
   NaClLog(4, "entry: 0x%"NACL_PRIxPTR"\n", (uintptr_t) entry);
   entry->page_num = page_num;
   entry->npages = npages;
   entry->prot = prot;
   entry->nmop = nmop;
-  entry->removed = 0;
+  entry->parent = entry->left = entry->right = NULL;
+  entry->height = 1;
+  entry->gap = entry->map_gap = 0;
+  entry->max_gap = entry->max_map_gap = 0;
   return entry;
 }
 
 
-void  NaClVmmapEntryFree(struct NaClVmmapEntry *entry) {
+/*
+ * Returns the entry to the map storage.  Does not touch the NaClMemObj.
+ */
+static void NaClVmmapEntryRelease(struct NaClVmmap      *self,
+                                  struct NaClVmmapEntry *entry) {
+  NaClSlabFree(&self->entries, entry);
+}
+
+
+static void NaClVmmapEntryFree(struct NaClVmmap      *self,
+                               struct NaClVmmapEntry *entry) {
   NaClLog(4,
           ("NaClVmmapEntryFree(0x%08"NACL_PRIxPTR
            "): (0x%"NACL_PRIxPTR",0x%"NACL_PRIxS","
@@ -70,9 +83,9 @@ void  NaClVmmapEntryFree(struct NaClVmmapEntry *entry) {
           entry->page_num, entry->npages, entry->prot, (uintptr_t) entry->nmop);
 
   NaClMemObjSafeDtor(entry->nmop);
-  free(entry->nmop);
+  NaClSlabFree(&self->mem_objs, entry->nmop);
 
-  free(entry);
+  NaClVmmapEntryRelease(self, entry);
 }
 
 
@@ -99,157 +112,268 @@ void NaClVmmapDebug(struct NaClVmmap *self,
 
 
 int NaClVmmapCtor(struct NaClVmmap *self) {
-  self->size = START_ENTRIES;
-  if (SIZE_T_MAX / sizeof *self->vmentry < self->size) {
+  self->root = NULL;
+  self->nvalid = 0;
+  if (!NaClSlabCtor(&self->entries, sizeof *self->root, START_ENTRIES)) {
     return 0;
   }
-  self->vmentry = calloc(self->size, sizeof *self->vmentry);
-  if (!self->vmentry) {
+  if (!NaClSlabCtor(&self->mem_objs, sizeof(struct NaClMemObj),
+                    START_ENTRIES)) {
+    NaClSlabDtor(&self->entries);
     return 0;
   }
-  self->nvalid = 0;
-  self->is_sorted = 1;
+  self->size = self->entries.capacity;
   return 1;
 }
 
 
+/*
+ * Tree navigation.
+ */
+static struct NaClVmmapEntry *NaClVmmapFirst(struct NaClVmmap *self) {
+  struct NaClVmmapEntry *n = self->root;
+
+  if (NULL != n) {
+    while (NULL != n->left) n = n->left;
+  }
+  return n;
+}
+
+
+static struct NaClVmmapEntry *NaClVmmapNext(struct NaClVmmapEntry *n) {
+  if (NULL != n->right) {
+    for (n = n->right; NULL != n->left; n = n->left) {}
+    return n;
+  }
+  while (NULL != n->parent && n == n->parent->right) n = n->parent;
+  return n->parent;
+}
+
+
+static struct NaClVmmapEntry *NaClVmmapPrev(struct NaClVmmapEntry *n) {
+  if (NULL != n->left) {
+    for (n = n->left; NULL != n->right; n = n->right) {}
+    return n;
+  }
+  while (NULL != n->parent && n == n->parent->left) n = n->parent;
+  return n->parent;
+}
+
+
+/*
+ * Memory objects hold references to descriptors which must be dropped
+ * one by one, the storage itself is released in bulk.
+ */
 void NaClVmmapDtor(struct NaClVmmap *self) {
-  size_t i;
+  struct NaClVmmapEntry *n;
 
-  for (i = 0; i < self->nvalid; ++i) {
-    NaClVmmapEntryFree(self->vmentry[i]);
+  for (n = NaClVmmapFirst(self); NULL != n; n = NaClVmmapNext(n)) {
+    NaClMemObjSafeDtor(n->nmop);
   }
-  free(self->vmentry);
-  self->vmentry = 0;
+  NaClSlabDtor(&self->mem_objs);
+  NaClSlabDtor(&self->entries);
+  self->root = NULL;
+  self->nvalid = 0;
+  self->size = 0;
 }
 
+
 /*
- * Comparison function for qsort.  Should never encounter a
- * removed/invalid entry.
+ * AVL balancing.  Heights and free space maxima are recomputed on the
+ * way from the changed node up to the root.
  */
+#define NACL_VMMAP_HEIGHT(n) (NULL == (n) ? 0 : (n)->height)
+#define NACL_VMMAP_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static void NaClVmmapPull(struct NaClVmmapEntry *n) {
+  int hl = NACL_VMMAP_HEIGHT(n->left);
+  int hr = NACL_VMMAP_HEIGHT(n->right);
+
+  n->height = 1 + NACL_VMMAP_MAX(hl, hr);
+  n->max_gap = n->gap;
+  n->max_map_gap = n->map_gap;
+  if (NULL != n->left) {
+    n->max_gap = NACL_VMMAP_MAX(n->max_gap, n->left->max_gap);
+    n->max_map_gap = NACL_VMMAP_MAX(n->max_map_gap, n->left->max_map_gap);
+  }
+  if (NULL != n->right) {
+    n->max_gap = NACL_VMMAP_MAX(n->max_gap, n->right->max_gap);
+    n->max_map_gap = NACL_VMMAP_MAX(n->max_map_gap, n->right->max_map_gap);
+  }
+}
 
-static int NaClVmmapCmpEntries(void const  *vleft,
-                               void const  *vright) {
-  struct NaClVmmapEntry const *const *left =
-      (struct NaClVmmapEntry const *const *) vleft;
-  struct NaClVmmapEntry const *const *right =
-      (struct NaClVmmapEntry const *const *) vright;
 
-  return (int) ((*left)->page_num - (*right)->page_num);
+/* puts v in place of u under u's parent */
+static void NaClVmmapReplace(struct NaClVmmap      *self,
+                             struct NaClVmmapEntry *u,
+                             struct NaClVmmapEntry *v) {
+  if (NULL == u->parent) {
+    self->root = v;
+  } else if (u == u->parent->left) {
+    u->parent->left = v;
+  } else {
+    u->parent->right = v;
+  }
+  if (NULL != v) {
+    v->parent = u->parent;
+  }
 }
 
 
-static void NaClVmmapRemoveMarked(struct NaClVmmap *self) {
-  size_t  i;
-  size_t  last;
+static struct NaClVmmapEntry *NaClVmmapRotateLeft(struct NaClVmmap      *self,
+                                                  struct NaClVmmapEntry *x) {
+  struct NaClVmmapEntry *y = x->right;
 
-  if (0 == self->nvalid)
-    return;
+  NaClVmmapReplace(self, x, y);
+  x->right = y->left;
+  if (NULL != x->right) x->right->parent = x;
+  y->left = x;
+  x->parent = y;
+  NaClVmmapPull(x);
+  NaClVmmapPull(y);
+  return y;
+}
 
-#if REMOVE_MARKED_DEBUG
-  NaClVmmapDebug(self, "Before RemoveMarked");
-#endif
-  /*
-   * Linearly scan with a move-end-to-front strategy to get rid of
-   * marked-to-be-removed entries.
-   */
 
-  /*
-   * Invariant:
-   *
-   * forall j in [0, self->nvalid): NULL != self->vmentry[j]
-   */
-  for (last = self->nvalid; last > 0 && self->vmentry[--last]->removed; ) {
-    NaClVmmapEntryFree(self->vmentry[last]);
-    self->vmentry[last] = NULL;
-  }
-  if (last == 0 && self->vmentry[0]->removed) {
-    NaClLog(LOG_FATAL, "No valid entries in VM map\n");
+static struct NaClVmmapEntry *NaClVmmapRotateRight(struct NaClVmmap      *self,
+                                                   struct NaClVmmapEntry *x) {
+  struct NaClVmmapEntry *y = x->left;
+
+  NaClVmmapReplace(self, x, y);
+  x->left = y->right;
+  if (NULL != x->left) x->left->parent = x;
+  y->right = x;
+  x->parent = y;
+  NaClVmmapPull(x);
+  NaClVmmapPull(y);
+  return y;
+}
+
+
+static void NaClVmmapFixup(struct NaClVmmap      *self,
+                           struct NaClVmmapEntry *n) {
+  int balance;
+
+  for (; NULL != n; n = n->parent) {
+    NaClVmmapPull(n);
+    balance = NACL_VMMAP_HEIGHT(n->left) - NACL_VMMAP_HEIGHT(n->right);
+    if (balance > 1) {
+      if (NACL_VMMAP_HEIGHT(n->left->left) <
+          NACL_VMMAP_HEIGHT(n->left->right)) {
+        NaClVmmapRotateLeft(self, n->left);
+      }
+      n = NaClVmmapRotateRight(self, n);
+    } else if (balance < -1) {
+      if (NACL_VMMAP_HEIGHT(n->right->right) <
+          NACL_VMMAP_HEIGHT(n->right->left)) {
+        NaClVmmapRotateRight(self, n->right);
+      }
+      n = NaClVmmapRotateLeft(self, n);
+    }
   }
+}
 
-  /*
-   * Post condition of above loop:
-   *
-   * forall j in [0, last]: NULL != self->vmentry[j]
-   *
-   * 0 <= last < self->nvalid && !self->vmentry[last]->removed
-   */
-  CHECK(last < self->nvalid);
-  CHECK(!self->vmentry[last]->removed);
-  /*
-   * and,
-   *
-   * forall j in (last, self->nvalid): NULL == self->vmentry[j]
-   */
 
-  /*
-   * Loop invariant: forall j in [0, i):  !self->vmentry[j]->removed
-   */
-  for (i = 0; i < last; ++i) {
-    if (!self->vmentry[i]->removed) {
-      continue;
+/*
+ * Recomputes the hole below n (between the previous entry and n) and
+ * propagates it up.  The first entry has no hole below it.
+ */
+static void NaClVmmapSetGap(struct NaClVmmap      *self,
+                            struct NaClVmmapEntry *n) {
+  struct NaClVmmapEntry *prev;
+  uintptr_t             end_page;
+  uintptr_t             start_page;
+
+  if (NULL == n) {
+    return;
+  }
+  n->gap = n->map_gap = 0;
+  prev = NaClVmmapPrev(n);
+  if (NULL != prev) {
+    end_page = prev->page_num + prev->npages;
+    if (n->page_num > end_page) {
+      n->gap = n->page_num - end_page;
     }
-    /*
-     * post condition: self->vmentry[i]->removed
-     *
-     * swap with entry at self->vmentry[last].
-     */
-
-    NaClVmmapEntryFree(self->vmentry[i]);
-    self->vmentry[i] = self->vmentry[last];
-    self->vmentry[last] = NULL;
-
-    /*
-     * Invariants here:
-     *
-     * forall j in [last, self->nvalid): NULL == self->vmentry[j]
-     *
-     * forall j in [0, i]: !self->vmentry[j]->removed
-     */
-
-    while (--last > i && self->vmentry[last]->removed) {
-      NaClVmmapEntryFree(self->vmentry[last]);
-      self->vmentry[last] = NULL;
+    end_page = NaClRoundPageNumUpToMapMultiple(end_page);
+    start_page = NaClTruncPageNumDownToMapMultiple(n->page_num);
+    if (start_page > end_page) {
+      n->map_gap = start_page - end_page;
     }
-    /*
-     * since !self->vmentry[i]->removed, we are guaranteed that
-     * !self->vmentry[last]->removed when the while loop terminates.
-     *
-     * forall j in (last, self->nvalid):
-     *  NULL == self->vmentry[j]->removed
-     */
   }
-  /* i == last */
-  /* forall j in [0, last]: !self->vmentry[j]->removed */
-  /* forall j in (last, self->nvalid): NULL == self->vmentry[j] */
-  self->nvalid = last + 1;
+  NaClVmmapFixup(self, n);
+}
+
 
-  self->is_sorted = 0;
-#if REMOVE_MARKED_DEBUG
-  NaClVmmapDebug(self, "After RemoveMarked");
-#endif
+/*
+ * To be called after the extent of n was changed in place.  Order of
+ * the entries must not change.
+ */
+static void NaClVmmapResized(struct NaClVmmap      *self,
+                             struct NaClVmmapEntry *n) {
+  NaClVmmapSetGap(self, n);
+  NaClVmmapSetGap(self, NaClVmmapNext(n));
 }
 
 
-void NaClVmmapMakeSorted(struct NaClVmmap  *self) {
-  if (self->is_sorted)
-    return;
+static void NaClVmmapInsert(struct NaClVmmap      *self,
+                            struct NaClVmmapEntry *entry) {
+  struct NaClVmmapEntry **link = &self->root;
+  struct NaClVmmapEntry *parent = NULL;
+
+  while (NULL != *link) {
+    parent = *link;
+    link = entry->page_num < parent->page_num ? &parent->left : &parent->right;
+  }
+  entry->parent = parent;
+  *link = entry;
+  ++self->nvalid;
+  NaClVmmapResized(self, entry);
+}
 
-  NaClVmmapRemoveMarked(self);
 
-  qsort(self->vmentry,
-        self->nvalid,
-        sizeof *self->vmentry,
-        NaClVmmapCmpEntries);
-  self->is_sorted = 1;
-#if REMOVE_MARKED_DEBUG
-  NaClVmmapDebug(self, "After Sort");
-#endif
+/*
+ * Unlinks the entry from the tree.  Other entries are relinked rather
+ * than copied, so pointers to them stay valid.
+ */
+static void NaClVmmapUnlink(struct NaClVmmap      *self,
+                            struct NaClVmmapEntry *entry) {
+  struct NaClVmmapEntry *next = NaClVmmapNext(entry);
+  struct NaClVmmapEntry *fix;
+
+  if (NULL != entry->left && NULL != entry->right) {
+    /* next is the leftmost entry of the right subtree */
+    if (next->parent != entry) {
+      fix = next->parent;
+      NaClVmmapReplace(self, next, next->right);
+      next->right = entry->right;
+      next->right->parent = next;
+    } else {
+      fix = next;
+    }
+    NaClVmmapReplace(self, entry, next);
+    next->left = entry->left;
+    next->left->parent = next;
+  } else {
+    fix = entry->parent;
+    NaClVmmapReplace(self, entry, NULL != entry->left ?
+                     entry->left : entry->right);
+  }
+  --self->nvalid;
+  NaClVmmapFixup(self, fix);
+  NaClVmmapSetGap(self, next);
 }
 
 
 /*
- * Adds an entry.  Does not sort.
+ * The map is always sorted.
+ */
+void NaClVmmapMakeSorted(struct NaClVmmap  *self) {
+  UNREFERENCED_PARAMETER(self);
+}
+
+
+/*
+ * Adds an entry.
  */
 int NaClVmmapAdd(struct NaClVmmap   *self,
                  uintptr_t          page_num,
@@ -263,32 +387,40 @@ int NaClVmmapAdd(struct NaClVmmap   *self,
            "0x%"NACL_PRIxS", 0x%x, "
            "0x%08"NACL_PRIxPTR")\n"),
           (uintptr_t) self, page_num, npages, prot, (uintptr_t) nmop);
-  if (self->nvalid == self->size) {
-    size_t                    new_size = 2 * self->size;
-    struct NaClVmmapEntry     **new_map;
-
-    new_map = realloc(self->vmentry, new_size * sizeof *new_map);
-    if (NULL == new_map) {
-      return 0;
-    }
-    self->vmentry = new_map;
-    self->size = new_size;
+  entry = NaClVmmapEntryMake(self, page_num, npages, prot, nmop);
+  if (NULL == entry) {
+    return 0;
   }
-  /* self->nvalid < self->size */
-  entry = NaClVmmapEntryMake(page_num, npages, prot, nmop);
-
-  self->vmentry[self->nvalid] = entry;
-  self->is_sorted = 0;
-  ++self->nvalid;
+  NaClVmmapInsert(self, entry);
 
   return 1;
 }
 
 
 /*
- * Update the virtual memory map.  Deletion is handled by a remove
- * flag, since a NULL nmop just means that the memory is backed by the
- * system paging file.
+ * Returns the last entry starting before page_num, or the first entry
+ * if there is no such one.
+ */
+static struct NaClVmmapEntry *NaClVmmapLowerBound(struct NaClVmmap *self,
+                                                  uintptr_t        page_num) {
+  struct NaClVmmapEntry *n = self->root;
+  struct NaClVmmapEntry *found = NULL;
+
+  while (NULL != n) {
+    if (n->page_num < page_num) {
+      found = n;
+      n = n->right;
+    } else {
+      n = n->left;
+    }
+  }
+  return NULL == found ? NaClVmmapFirst(self) : found;
+}
+
+
+/*
+ * Update the virtual memory map.  Only the entries overlapping the new
+ * region are visited.
  */
 void NaClVmmapUpdate(struct NaClVmmap   *self,
                      uintptr_t          page_num,
@@ -297,7 +429,8 @@ void NaClVmmapUpdate(struct NaClVmmap   *self,
                      struct NaClMemObj  *nmop,
                      int                remove) {
   /* update existing entries or create new entry as needed */
-  size_t                i;
+  struct NaClVmmapEntry *ent;
+  struct NaClVmmapEntry *next;
   uintptr_t             new_region_end_page = page_num + npages;
 
   NaClLog(2,
@@ -306,16 +439,17 @@ void NaClVmmapUpdate(struct NaClVmmap   *self,
            "0x%x, 0x%08"NACL_PRIxPTR", %d)\n"),
           (uintptr_t) self, page_num, npages, prot, (uintptr_t) nmop,
           remove);
-  NaClVmmapMakeSorted(self);
 
   CHECK(npages > 0);
 
-  for (i = 0; i < self->nvalid; i++) {
-    struct NaClVmmapEntry *ent = self->vmentry[i];
+  for (ent = NaClVmmapLowerBound(self, page_num);
+       NULL != ent && ent->page_num < new_region_end_page;
+       ent = next) {
     uintptr_t             ent_end_page = ent->page_num + ent->npages;
     nacl_off64_t          additional_offset =
         (new_region_end_page - ent->page_num) << NACL_PAGESHIFT;
 
+    next = NaClVmmapNext(ent);
     if (ent->page_num < page_num && new_region_end_page < ent_end_page) {
       /*
        * Split existing mapping into two parts, with new mapping in
@@ -325,14 +459,17 @@ void NaClVmmapUpdate(struct NaClVmmap   *self,
                         new_region_end_page,
                         ent_end_page - new_region_end_page,
                         ent->prot,
-                        NaClMemObjSplit(ent->nmop, additional_offset))) {
+                        NaClMemObjSplit(&self->mem_objs, ent->nmop,
+                                        additional_offset))) {
         NaClLog(LOG_FATAL, "NaClVmmapUpdate: could not split entry\n");
       }
       ent->npages = page_num - ent->page_num;
+      NaClVmmapResized(self, ent);
       break;
     } else if (ent->page_num < page_num && page_num < ent_end_page) {
       /* New mapping overlaps end of existing mapping. */
       ent->npages = page_num - ent->page_num;
+      NaClVmmapResized(self, ent);
     } else if (ent->page_num < new_region_end_page &&
                new_region_end_page < ent_end_page) {
       /* New mapping overlaps start of existing mapping. */
@@ -341,11 +478,13 @@ void NaClVmmapUpdate(struct NaClVmmap   *self,
 
       ent->page_num = new_region_end_page;
       ent->npages = ent_end_page - new_region_end_page;
+      NaClVmmapResized(self, ent);
       break;
     } else if (page_num <= ent->page_num &&
                ent_end_page <= new_region_end_page) {
       /* New mapping covers all of the existing mapping. */
-      ent->removed = 1;
+      NaClVmmapUnlink(self, ent);
+      NaClVmmapEntryFree(self, ent);
     } else {
       /* No overlap */
       assert(new_region_end_page <= ent->page_num || ent_end_page <= page_num);
@@ -357,75 +496,49 @@ void NaClVmmapUpdate(struct NaClVmmap   *self,
       NaClLog(LOG_FATAL, "NaClVmmapUpdate: could not add entry\n");
     }
   }
-
-  NaClVmmapRemoveMarked(self);
 }
 
 
-static int NaClVmmapContainCmpEntries(void const *vkey,
-                                      void const *vent) {
-  struct NaClVmmapEntry const *const *key =
-      (struct NaClVmmapEntry const *const *) vkey;
-  struct NaClVmmapEntry const *const *ent =
-      (struct NaClVmmapEntry const *const *) vent;
-
-  NaClLog(5, "key->page_num   = 0x%05"NACL_PRIxPTR"\n", (*key)->page_num);
-
-  NaClLog(5, "entry->page_num = 0x%05"NACL_PRIxPTR"\n", (*ent)->page_num);
-  NaClLog(5, "entry->npages   = 0x%"NACL_PRIxS"\n", (*ent)->npages);
-
-  if ((*key)->page_num < (*ent)->page_num) return -1;
-  if ((*key)->page_num < (*ent)->page_num + (*ent)->npages) return 0;
-  return 1;
+/*
+ * Returns the entry containing pnum or NULL.
+ */
+static struct NaClVmmapEntry *NaClVmmapLookup(struct NaClVmmap *self,
+                                              uintptr_t        pnum) {
+  struct NaClVmmapEntry *n = self->root;
+  struct NaClVmmapEntry *found = NULL;
+
+  while (NULL != n) {
+    NaClLog(5, "entry->page_num = 0x%05"NACL_PRIxPTR"\n", n->page_num);
+    if (n->page_num <= pnum) {
+      found = n;
+      n = n->right;
+    } else {
+      n = n->left;
+    }
+  }
+  if (NULL != found && pnum < found->page_num + found->npages) {
+    return found;
+  }
+  return NULL;
 }
 
 struct NaClVmmapEntry const *NaClVmmapFindPage(struct NaClVmmap *self,
                                                uintptr_t        pnum) {
-  struct NaClVmmapEntry key;
-  struct NaClVmmapEntry *kptr;
-  struct NaClVmmapEntry *const *result_ptr;
-
-  NaClVmmapMakeSorted(self);
-  key.page_num = pnum;
-  kptr = &key;
-  result_ptr = ((struct NaClVmmapEntry *const *)
-                bsearch(&kptr,
-                        self->vmentry,
-                        self->nvalid,
-                        sizeof self->vmentry[0],
-                        NaClVmmapContainCmpEntries));
-  return result_ptr ? *result_ptr : NULL;
+  return NaClVmmapLookup(self, pnum);
 }
 
 
 struct NaClVmmapIter *NaClVmmapFindPageIter(struct NaClVmmap      *self,
                                             uintptr_t             pnum,
                                             struct NaClVmmapIter  *space) {
-  struct NaClVmmapEntry key;
-  struct NaClVmmapEntry *kptr;
-  struct NaClVmmapEntry **result_ptr;
-
-  NaClVmmapMakeSorted(self);
-  key.page_num = pnum;
-  kptr = &key;
-  result_ptr = ((struct NaClVmmapEntry **)
-                bsearch(&kptr,
-                        self->vmentry,
-                        self->nvalid,
-                        sizeof self->vmentry[0],
-                        NaClVmmapContainCmpEntries));
   space->vmmap = self;
-  if (NULL == result_ptr) {
-    space->entry_ix = self->nvalid;
-  } else {
-    space->entry_ix = result_ptr - self->vmentry;
-  }
+  space->entry = NaClVmmapLookup(self, pnum);
   return space;
 }
 
 
 int NaClVmmapIterAtEnd(struct NaClVmmapIter *nvip) {
-  return nvip->entry_ix >= nvip->vmmap->nvalid;
+  return NULL == nvip->entry;
 }
 
 
@@ -433,27 +546,24 @@ int NaClVmmapIterAtEnd(struct NaClVmmapIter *nvip) {
  * IterStar only permissible if not AtEnd
  */
 struct NaClVmmapEntry *NaClVmmapIterStar(struct NaClVmmapIter *nvip) {
-  return nvip->vmmap->vmentry[nvip->entry_ix];
+  return nvip->entry;
 }
 
 
 void NaClVmmapIterIncr(struct NaClVmmapIter *nvip) {
-  ++nvip->entry_ix;
+  nvip->entry = NaClVmmapNext(nvip->entry);
 }
 
 
 /*
  * Iterator becomes invalid after Erase.  We could have a version that
- * keep the iterator valid by copying forward, but it is unclear
- * whether that is needed.
+ * keep the iterator valid by moving forward, but it is unclear whether
+ * that is needed.
  */
 void NaClVmmapIterErase(struct NaClVmmapIter *nvip) {
-  struct NaClVmmap  *nvp;
-
-  nvp = nvip->vmmap;
-  free(nvp->vmentry[nvip->entry_ix]);
-  nvp->vmentry[nvip->entry_ix] = nvp->vmentry[--nvp->nvalid];
-  nvp->is_sorted = 0;
+  NaClVmmapUnlink(nvip->vmmap, nvip->entry);
+  NaClVmmapEntryRelease(nvip->vmmap, nvip->entry);
+  nvip->entry = NULL;
 }
 
 
@@ -461,38 +571,90 @@ void  NaClVmmapVisit(struct NaClVmmap *self,
                      void             (*fn)(void                  *state,
                                             struct NaClVmmapEntry *entry),
                      void             *state) {
-  size_t i;
-  size_t nentries;
+  struct NaClVmmapEntry *n;
+
+  for (n = NaClVmmapFirst(self); NULL != n; n = NaClVmmapNext(n)) {
+    (*fn)(state, n);
+  }
+}
+
+
+/*
+ * Returns the highest entry with (map_)gap of at least num_pages below
+ * it, or NULL.  Only subtrees whose maximum fits are visited.
+ */
+static struct NaClVmmapEntry *NaClVmmapHighestGap(struct NaClVmmap *self,
+                                                  size_t           num_pages,
+                                                  int              map) {
+  struct NaClVmmapEntry *n = self->root;
+
+#define GAP(n) (map ? (n)->map_gap : (n)->gap)
+#define MAX_GAP(n) (map ? (n)->max_map_gap : (n)->max_gap)
+  if (NULL == n || MAX_GAP(n) < num_pages) {
+    return NULL;
+  }
+  for (;;) {
+    if (NULL != n->right && MAX_GAP(n->right) >= num_pages) {
+      n = n->right;
+    } else if (GAP(n) >= num_pages) {
+      /* the first entry has no hole below it */
+      return NULL == NaClVmmapPrev(n) ? NULL : n;
+    } else {
+      n = n->left;
+    }
+  }
+}
+
 
-  NaClVmmapMakeSorted(self);
-  for (i = 0, nentries = self->nvalid; i < nentries; ++i) {
-    (*fn)(state, self->vmentry[i]);
+/*
+ * Returns the lowest entry after n with map_gap of at least num_pages
+ * below it, or NULL.
+ */
+static struct NaClVmmapEntry *NaClVmmapLowestMapGapAfter(
+    struct NaClVmmapEntry *n,
+    size_t                num_pages) {
+  struct NaClVmmapEntry *sub;
+
+  for (;;) {
+    sub = n->right;
+    if (NULL != sub && sub->max_map_gap >= num_pages) {
+      for (;;) {
+        if (NULL != sub->left && sub->left->max_map_gap >= num_pages) {
+          sub = sub->left;
+        } else if (sub->map_gap >= num_pages) {
+          return sub;
+        } else {
+          sub = sub->right;
+        }
+      }
+    }
+    /* go to the next ancestor on the right */
+    while (NULL != n->parent && n == n->parent->right) n = n->parent;
+    n = n->parent;
+    if (NULL == n) {
+      return NULL;
+    }
+    if (n->map_gap >= num_pages) {
+      return n;
+    }
   }
 }
+#undef GAP
+#undef MAX_GAP
 
 
 /*
- * Linear search, from high addresses down.
+ * Search from high addresses down.
  */
 uintptr_t NaClVmmapFindSpace(struct NaClVmmap *self,
                              size_t           num_pages) {
-  size_t                i;
   struct NaClVmmapEntry *vmep;
-  uintptr_t             end_page;
-  uintptr_t             start_page;
 
-  if (0 == self->nvalid)
+  vmep = NaClVmmapHighestGap(self, num_pages, 0);
+  if (NULL == vmep) {
     return 0;
-  NaClVmmapMakeSorted(self);
-  for (i = self->nvalid; --i > 0; ) {
-    vmep = self->vmentry[i-1];
-    end_page = vmep->page_num + vmep->npages;  /* end page from previous */
-    start_page = self->vmentry[i]->page_num;  /* start page from current */
-    if (start_page - end_page >= num_pages) {
-      return start_page - num_pages;
-    }
   }
-  return 0;
+  return vmep->page_num - num_pages;
   /*
    * in user addresses, page 0 is always trampoline, and user
    * addresses are contained in system addresses, so returning a
@@ -503,7 +665,7 @@ uintptr_t NaClVmmapFindSpace(struct NaClVmmap *self,
 
 
 /*
- * Linear search, from high addresses down.  For mmap, so the starting
+ * Search from high addresses down.  For mmap, so the starting
  * address of the region found must be NACL_MAP_PAGESIZE aligned.
  *
  * For general mmap it is better to use as high an address as
@@ -512,35 +674,14 @@ uintptr_t NaClVmmapFindSpace(struct NaClVmmap *self,
  */
 uintptr_t NaClVmmapFindMapSpace(struct NaClVmmap *self,
                                 size_t           num_pages) {
-  size_t                i;
   struct NaClVmmapEntry *vmep;
-  uintptr_t             end_page;
-  uintptr_t             start_page;
 
-  if (0 == self->nvalid)
-    return 0;
-  NaClVmmapMakeSorted(self);
   num_pages = NaClRoundPageNumUpToMapMultiple(num_pages);
-
-  for (i = self->nvalid; --i > 0; ) {
-    vmep = self->vmentry[i-1];
-    end_page = vmep->page_num + vmep->npages;  /* end page from previous */
-    end_page = NaClRoundPageNumUpToMapMultiple(end_page);
-
-    start_page = self->vmentry[i]->page_num;  /* start page from current */
-    if (NACL_MAP_PAGESHIFT > NACL_PAGESHIFT) {
-
-      start_page = NaClTruncPageNumDownToMapMultiple(start_page);
-
-      if (start_page <= end_page) {
-        continue;
-      }
-    }
-    if (start_page - end_page >= num_pages) {
-      return start_page - num_pages;
-    }
+  vmep = NaClVmmapHighestGap(self, num_pages, 1);
+  if (NULL == vmep) {
+    return 0;
   }
-  return 0;
+  return NaClTruncPageNumDownToMapMultiple(vmep->page_num) - num_pages;
   /*
    * in user addresses, page 0 is always trampoline, and user
    * addresses are contained in system addresses, so returning a
@@ -551,46 +692,53 @@ uintptr_t NaClVmmapFindMapSpace(struct NaClVmmap *self,
 
 
 /*
- * Linear search, from uaddr up.
+ * Search from uaddr up.
  */
 uintptr_t NaClVmmapFindMapSpaceAboveHint(struct NaClVmmap *self,
                                          uintptr_t        uaddr,
                                          size_t           num_pages) {
-  size_t                nvalid;
-  size_t                i;
-  struct NaClVmmapEntry *vmep;
+  struct NaClVmmapEntry *n = self->root;
+  struct NaClVmmapEntry *vmep = NULL;
+  struct NaClVmmapEntry *prev;
   uintptr_t             usr_page;
   uintptr_t             start_page;
   uintptr_t             end_page;
 
-  NaClVmmapMakeSorted(self);
-
   usr_page = uaddr >> NACL_PAGESHIFT;
   num_pages = NaClRoundPageNumUpToMapMultiple(num_pages);
 
-  nvalid = self->nvalid;
-
-  for (i = 1; i < nvalid; ++i) {
-    vmep = self->vmentry[i-1];
-    end_page = vmep->page_num + vmep->npages;
-    end_page = NaClRoundPageNumUpToMapMultiple(end_page);
-
-    start_page = self->vmentry[i]->page_num;
-    if (NACL_MAP_PAGESHIFT > NACL_PAGESHIFT) {
-
-      start_page = NaClTruncPageNumDownToMapMultiple(start_page);
+  /* the first entry above usr_page. the hole below it may contain usr_page */
+  while (NULL != n) {
+    if (n->page_num > usr_page) {
+      vmep = n;
+      n = n->left;
+    } else {
+      n = n->right;
+    }
+  }
+  if (NULL == vmep) {
+    return 0;
+  }
 
-      if (start_page <= end_page) {
-        continue;
+  prev = NaClVmmapPrev(vmep);
+  if (NULL != prev) {
+    end_page = NaClRoundPageNumUpToMapMultiple(prev->page_num + prev->npages);
+    start_page = NaClTruncPageNumDownToMapMultiple(vmep->page_num);
+    if (end_page < start_page) {
+      if (end_page <= usr_page && usr_page < start_page) {
+        end_page = usr_page;
+      }
+      if (usr_page <= end_page && (start_page - end_page) >= num_pages) {
+        /* found a gap at uaddr that's big enough */
+        return end_page;
       }
     }
-    if (end_page <= usr_page && usr_page < start_page) {
-      end_page = usr_page;
-    }
-    if (usr_page <= end_page && (start_page - end_page) >= num_pages) {
-      /* found a gap at or after uaddr that's big enough */
-      return end_page;
-    }
   }
-  return 0;
+
+  /* all holes above are above usr_page, the lowest one that fits */
+  vmep = NaClVmmapLowestMapGapAfter(vmep, num_pages);
+  if (NULL == vmep) {
+    return 0;
+  }
+  return NaClTruncPageNumDownToMapMultiple(vmep->page_num) - vmep->map_gap;
 }
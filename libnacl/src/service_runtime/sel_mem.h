@@ -14,6 +14,7 @@
 #include "include/portability.h"
 #include "include/nacl_base.h"
 #include "src/service_runtime/nacl_memory_object.h"
+#include "src/service_runtime/nacl_slab.h"
 
 EXTERN_C_BEGIN
 
@@ -29,8 +30,13 @@ EXTERN_C_BEGIN
  * looking at the first memory hole that fits, starting down from the
  * stack.
  *
- * The simple data structure that we use is a sorted array of valid
- * memory regions.
+ * The data structure is an AVL tree of valid memory regions ordered
+ * by page number.  Entries and their memory objects are allocated from
+ * slabs owned by the map, so the tree does not call malloc() per
+ * region and is released in bulk.  Every entry also
+ * keeps the size of the hole between the previous region and itself,
+ * and every subtree the largest such hole, so the free space queries
+ * are O(log n).
  */
 
 struct NaClVmmapEntry {
@@ -38,13 +44,23 @@ struct NaClVmmapEntry {
   size_t                npages;     /* number of pages */
   int                   prot;       /* mprotect attribute */
   struct NaClMemObj     *nmop;      /* how to get memory for move/remap */
-  int                   removed;    /* flag set in NaClVmmapUpdate */
+
+  /* tree links and free space index, private to sel_mem.c */
+  struct NaClVmmapEntry *parent;
+  struct NaClVmmapEntry *left;
+  struct NaClVmmapEntry *right;
+  int                   height;
+  size_t                gap;          /* pages free below this entry */
+  size_t                map_gap;      /* the same, NACL_MAP_PAGESIZE aligned */
+  size_t                max_gap;      /* max gap in the subtree */
+  size_t                max_map_gap;  /* max map_gap in the subtree */
 };
 
 struct NaClVmmap {
-  struct NaClVmmapEntry **vmentry;       /* must not overlap */
+  struct NaClVmmapEntry *root;
+  struct NaClSlab       entries;   /* NaClVmmapEntry storage */
+  struct NaClSlab       mem_objs;  /* NaClMemObj storage for the entries */
   size_t                nvalid, size;
-  int                   is_sorted;
 };
 
 void NaClVmmapDebug(struct NaClVmmap  *self,
@@ -55,7 +71,7 @@ void NaClVmmapDebug(struct NaClVmmap  *self,
  */
 struct NaClVmmapIter {
   struct NaClVmmap      *vmmap;
-  size_t                 entry_ix;
+  struct NaClVmmapEntry *entry;  /* NULL at end */
 };
 
 int                   NaClVmmapIterAtEnd(struct NaClVmmapIter *nvip);
@@ -67,6 +83,10 @@ int   NaClVmmapCtor(struct NaClVmmap  *self) NACL_WUR;
 
 void  NaClVmmapDtor(struct NaClVmmap  *self);
 
+/*
+ * The entries take ownership of the memory objects, which must be
+ * allocated from self->mem_objs (see NaClMemObjMake).
+ */
 int   NaClVmmapAdd(struct NaClVmmap   *self,
                    uintptr_t          page_num,
                    size_t             npages,
@@ -101,7 +121,7 @@ void  NaClVmmapVisit(struct NaClVmmap   *self,
 
 /*
  * Returns page number starting at which there is a hole of at least
- * num_pages in size.  Linear search from high addresses on down.
+ * num_pages in size.  The highest such hole is taken.
  */
 uintptr_t NaClVmmapFindSpace(struct NaClVmmap *self,
                              size_t           num_pages);
@@ -118,6 +138,9 @@ uintptr_t NaClVmmapFindMapSpaceAboveHint(struct NaClVmmap *self,
                                          uintptr_t        uaddr,
                                          size_t           num_pages);
 
+/*
+ * The map is always sorted now.  Kept for the existing callers.
+ */
 void NaClVmmapMakeSorted(struct NaClVmmap  *self);
 
 EXTERN_C_END
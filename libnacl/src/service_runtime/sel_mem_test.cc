@@ -4,8 +4,13 @@
  * be found in the LICENSE file.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
 #include "include/nacl_platform.h"
 #include "src/service_runtime/sel_mem.h"
+#include "src/service_runtime/sel_util.h"
 #include "src/platform/nacl_log.h"
 #include "gtest/gtest.h"
 
@@ -209,3 +214,125 @@ TEST_F(SelMemTest, FindSpaceTest) {
 
   NaClVmmapDtor(&mem_map);
 }
+
+// Reference implementation of NaClVmmapFindMapSpace: linear search
+// over the sorted entries from high addresses down.
+struct ReferenceState {
+  uintptr_t prev_end;
+  uintptr_t found;
+  size_t num_pages;
+  size_t count;
+  bool sorted;
+};
+
+static void ReferenceVisitor(void *state, struct NaClVmmapEntry *entry) {
+  ReferenceState *ref = reinterpret_cast<ReferenceState *>(state);
+
+  if (ref->count > 0) {
+    uintptr_t end_page = NaClRoundPageNumUpToMapMultiple(ref->prev_end);
+    uintptr_t start_page = NaClTruncPageNumDownToMapMultiple(entry->page_num);
+    if (entry->page_num < ref->prev_end) {
+      ref->sorted = false;
+    }
+    if (start_page > end_page && start_page - end_page >= ref->num_pages) {
+      ref->found = start_page - ref->num_pages;
+    }
+  }
+  ref->prev_end = entry->page_num + entry->npages;
+  ++ref->count;
+}
+
+static uintptr_t ReferenceFindMapSpace(struct NaClVmmap *mem_map,
+                                       size_t num_pages,
+                                       ReferenceState *ref) {
+  ref->prev_end = 0;
+  ref->found = 0;
+  ref->num_pages = NaClRoundPageNumUpToMapMultiple(num_pages);
+  ref->count = 0;
+  ref->sorted = true;
+  NaClVmmapVisit(mem_map, ReferenceVisitor, ref);
+  return ref->found;
+}
+
+// Allocator-like mmap/munmap churn: find space, map it, unmap a random
+// old region.  Checks the tree against the linear search.
+TEST_F(SelMemTest, ChurnTest) {
+  struct NaClVmmap mem_map;
+  ReferenceState ref;
+  uintptr_t mapped[64] = { 0 };
+  size_t sizes[64] = { 0 };
+
+  EXPECT_EQ(1, NaClVmmapCtor(&mem_map));
+  NaClVmmapUpdate(&mem_map, 0, 16, PROT_READ | PROT_EXEC,
+                  (struct NaClMemObj *) NULL, 0);
+  NaClVmmapUpdate(&mem_map, 1 << 20, 16, PROT_READ | PROT_WRITE,
+                  (struct NaClMemObj *) NULL, 0);
+
+  srand(1);
+  for (int i = 0; i < 4000; ++i) {
+    int slot = rand() % 64;
+    size_t npages = 1 + rand() % 300;
+
+    if (0 != sizes[slot]) {
+      NaClVmmapUpdate(&mem_map, mapped[slot], sizes[slot], 0,
+                      (struct NaClMemObj *) NULL, 1);
+      sizes[slot] = 0;
+    }
+    uintptr_t page = NaClVmmapFindMapSpace(&mem_map, npages);
+    ASSERT_EQ(ReferenceFindMapSpace(&mem_map, npages, &ref), page);
+    ASSERT_TRUE(ref.sorted);
+    ASSERT_EQ(ref.count, mem_map.nvalid);
+    if (0 == page) {
+      continue;
+    }
+    NaClVmmapUpdate(&mem_map, page, npages, PROT_READ | PROT_WRITE,
+                    (struct NaClMemObj *) NULL, 0);
+    EXPECT_TRUE(NULL != NaClVmmapFindPage(&mem_map, page + npages - 1));
+    mapped[slot] = page;
+    sizes[slot] = npages;
+  }
+
+  NaClVmmapDtor(&mem_map);
+}
+
+// Microbenchmark for the churn heavy workload: a large live set of
+// mappings with map/unmap pairs on top.  Prints ns per operation.
+TEST_F(SelMemTest, ChurnBenchmark) {
+  static const int kLive = 8192;
+  static const int kOps = 200000;
+  struct NaClVmmap mem_map;
+  uintptr_t *mapped = new uintptr_t[kLive];
+  struct timespec start, end;
+
+  EXPECT_EQ(1, NaClVmmapCtor(&mem_map));
+  NaClVmmapUpdate(&mem_map, 0, 16, PROT_READ | PROT_EXEC,
+                  (struct NaClMemObj *) NULL, 0);
+  NaClVmmapUpdate(&mem_map, 1 << 24, 16, PROT_READ | PROT_WRITE,
+                  (struct NaClMemObj *) NULL, 0);
+  for (int i = 0; i < kLive; ++i) {
+    mapped[i] = NaClVmmapFindMapSpace(&mem_map, 16);
+    ASSERT_NE(0U, mapped[i]);
+    NaClVmmapUpdate(&mem_map, mapped[i], 16, PROT_READ | PROT_WRITE,
+                    (struct NaClMemObj *) NULL, 0);
+  }
+
+  srand(1);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < kOps; ++i) {
+    int slot = rand() % kLive;
+    NaClVmmapUpdate(&mem_map, mapped[slot], 16, 0,
+                    (struct NaClMemObj *) NULL, 1);
+    mapped[slot] = NaClVmmapFindMapSpace(&mem_map, 16);
+    NaClVmmapUpdate(&mem_map, mapped[slot], 16, PROT_READ | PROT_WRITE,
+                    (struct NaClMemObj *) NULL, 0);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("vmmap churn: %d live entries, %.1f ns per munmap+mmap\n",
+         kLive, ((end.tv_sec - start.tv_sec) * 1e9 +
+                 (end.tv_nsec - start.tv_nsec)) / kOps);
+  EXPECT_EQ(static_cast<size_t>(kLive + 2), mem_map.nvalid);
+
+  delete[] mapped;
+  NaClVmmapDtor(&mem_map);
+}
@@ -4,6 +4,7 @@
  * found in the LICENSE file.
  */
 
+#include "src/perf_counter/nacl_perf_counter.h"
 #include "src/platform/nacl_log.h"
 #include "src/service_runtime/sel_ldr.h"
 #include "src/validator/ncvalidate.h"
@@ -87,6 +88,7 @@ NaClErrorCode NaClValidateImage(struct NaClApp  *nap) {
   uintptr_t               endp;
   size_t                  regionsize;
   NaClErrorCode           rcode;
+  int                     profiled;
 
   memp = nap->mem_start + NACL_TRAMPOLINE_END;
   endp = nap->mem_start + nap->static_text_end;
@@ -99,8 +101,11 @@ NaClErrorCode NaClValidateImage(struct NaClApp  *nap) {
     NaClLog(LOG_ERROR, "VALIDATION SKIPPED.\n");
     return LOAD_OK;
   } else {
+    profiled = NULL != nap->perf &&
+        NaClPerfCounterEnter(nap->perf, "ValidateImage") > 0;
     rcode = NaClValidateCode(nap, NACL_TRAMPOLINE_END,
                              (uint8_t *) memp, regionsize);
+    if (profiled) NaClPerfCounterLeave(nap->perf);
     if (LOAD_OK != rcode) {
       if (nap->ignore_validator_result) {
         NaClLog(LOG_ERROR, "VALIDATION FAILED: continuing anyway...\n");
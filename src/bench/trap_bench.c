@@ -0,0 +1,69 @@
+/*
+ * "One Ring" round trip benchmark nexe. makes the same call in a tight
+ * loop, the amount of rounds is given with the command line (0 - just
+ * start and exit, the baseline). the nexe is built once per call
+ * (BENCH_CALL), so the loop has nothing but the call
+ *
+ *  Created on: Jan 19, 2012
+ *      Author: d'b
+ */
+#include <stdlib.h>
+
+#define USER_SIDE
+#include "zvm.h"
+#undef USER_SIDE
+
+/* calls to benchmark */
+#define BENCH_NULL 0 /* trap rejected right after dispatch (invalid channel) */
+#define BENCH_PREAD 1 /* zvm_pread from the preloaded input */
+#define BENCH_PWRITE 2 /* zvm_pwrite to the preloaded output */
+#define BENCH_SETUP 3 /* zvm_setup */
+#define BENCH_SYSBRK 4 /* nacl syscall, not a trap: sysbrk(0) */
+#define BENCH_RING 5 /* zvm_pread through the exit-less i/o ring (IoRing) */
+
+#ifndef BENCH_CALL
+#define BENCH_CALL BENCH_NULL
+#endif
+
+#define BUFFER_SIZE 64
+
+/* sysbrk trampoline: start of trampoline + size of trampoline record * NACL_sys_sysbrk */
+static void *(*_sysbrk)(void *p) = (void *(*)(void*)) (0x10000 + 0x20 * 20);
+
+int main(int argc, char **argv)
+{
+  static char buffer[BUFFER_SIZE];
+  static struct SetupList hint;
+  int rounds = argc > 1 ? atoi(argv[1]) : 0;
+  int i;
+#if BENCH_CALL == BENCH_RING
+  struct IoCompletion completion;
+  struct IoRing *ring;
+
+  zvm_setup(&hint);
+  ring = (struct IoRing*)(uintptr_t)hint.io_ring;
+  if(ring == NULL) return 1;
+#endif
+
+  for(i = 0; i < rounds; ++i)
+  {
+#if BENCH_CALL == BENCH_NULL
+    zvm_pread(-1, buffer, BUFFER_SIZE, 0);
+#elif BENCH_CALL == BENCH_PREAD
+    zvm_pread(InputChannel, buffer, BUFFER_SIZE, 0);
+#elif BENCH_CALL == BENCH_PWRITE
+    zvm_pwrite(OutputChannel, buffer, BUFFER_SIZE, 0);
+#elif BENCH_CALL == BENCH_SETUP
+    zvm_setup(&hint);
+#elif BENCH_CALL == BENCH_SYSBRK
+    _sysbrk(NULL);
+#elif BENCH_CALL == BENCH_RING
+    zvm_ring_submit(ring, TrapRead, InputChannel, buffer, BUFFER_SIZE, 0, i);
+    zvm_ring_reap(ring, &completion);
+#else
+#error unknown BENCH_CALL
+#endif
+  }
+
+  return 0;
+}
@@ -0,0 +1,101 @@
+#!/bin/sh
+#
+# "One Ring" round trip benchmark. every nexe is run twice: with 0 rounds
+# (the baseline) and with ROUNDS rounds. the difference is split per
+# round trip (nanoseconds):
+#   trip - nexe run time (ReportPhaseTimes "run")
+#   exit - the rest of the trip: trampoline, context switch, syscall hook,
+#          cpu clock pause/resume, accounting counters
+#   trap - TrapHandler w/o i/o (ReportTrapTime)
+#   io   - pread/pwrite (ReportTrapTime)
+#   host - zerovm cpu time (ReportHostCpuTime)
+# the null trap is also run with log verbosity 4 and without trap stats
+# to show the cost of logging and of the stats themselves. "ring" reads
+# through the exit-less i/o ring, its trip has no exit unless it sleeps
+#
+# usage: trap_bench.sh [rounds]. zerovm is taken from ZEROVM
+#
+ROUNDS=${1:-1000000}
+ZEROVM=${ZEROVM:-zerovm}
+WORK=work
+
+mkdir -p $WORK
+dd if=/dev/zero of=$WORK/input bs=4096 count=1 2>/dev/null
+
+# write manifest. $1 - nexe, $2 - rounds, $3 - TrapStats
+manifest()
+{
+  cat > $WORK/$1.manifest <<EOF
+Version = 11nov2011
+Nexe = $1.nexe
+CommandLine = $2
+Report = $WORK/$1.report
+Log = $WORK/$1.log
+TrapStats = $3
+SetupCallsMax = 2147483647
+Input = $WORK/input
+InputMode = 1
+InputMax = 4096
+InputMaxGet = 9223372036854775807
+InputMaxGetCnt = 2147483647
+Output = $WORK/output
+OutputMode = 1
+OutputMax = 4096
+OutputMaxPut = 9223372036854775807
+OutputMaxPutCnt = 2147483647
+EOF
+  if [ $1 = ring ]; then echo "IoRing = 64" >> $WORK/$1.manifest; fi
+}
+
+# run nexe and print "run_ns host_ns calls trap_ns io_ns" from the report
+# $1 - nexe, $2 - rounds, $3 - TrapStats, $4 - trap name, $5 - zerovm options
+measure()
+{
+  manifest $1 $2 $3
+  rm -f $WORK/output
+  $ZEROVM -M $WORK/$1.manifest $5 > /dev/null 2>&1
+  awk -F= -v trap=$4 '
+    { sub(/ +$/, "", $1) }
+    $1 == "ReportPhaseTimes" {
+      n = split($2, p, ",")
+      for(i = 1; i <= n; ++i) if(sub(/^run:/, "", p[i])) run = p[i]
+    }
+    $1 == "ReportHostCpuTime" { host = $2 }
+    $1 == "ReportTrapTime" {
+      n = split($2, t, ";")
+      for(i = 1; i <= n; ++i)
+      {
+        split(t[i], f, ":")
+        if(f[1] == trap) { calls = f[2]; ns = f[3]; io = f[4] }
+      }
+    }
+    END { printf "%.0f %.0f %.0f %.0f %.0f\n", run, host, calls, ns, io }
+  ' $WORK/$1.report
+}
+
+# print one line of the table
+# $1 - label, $2 - nexe, $3 - TrapStats, $4 - trap name, $5 - zerovm options
+bench()
+{
+  base=`measure $2 0 $3 $4 "$5"`
+  full=`measure $2 $ROUNDS $3 $4 "$5"`
+  echo $base $full | awk -v label="$1" -v rounds=$ROUNDS '{
+    trip = ($6 - $1) / rounds
+    host = ($7 - $2) / rounds
+    calls = $8 - $3
+    io = calls ? ($10 - $5) / calls : 0
+    trap = calls ? ($9 - $4) / calls - io : 0
+    printf "%-16s %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+      label, trip, trip - trap - io, trap, io, host
+  }'
+}
+
+printf "%-16s %10s %10s %10s %10s %10s\n" call trip exit trap io host
+bench null null 1 TrapRead
+bench pread pread 1 TrapRead
+bench pwrite pwrite 1 TrapWrite
+bench setup setup 1 TrapUserSetup
+bench sysbrk sysbrk 1 none
+bench ring ring 1 TrapRead
+bench "null -v 4" null 1 TrapRead "-v 4 -l /dev/null"
+bench "null, no stats" null 0 TrapRead
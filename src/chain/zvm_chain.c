@@ -0,0 +1,130 @@
+/*
+ * in-memory pipeline of chained sandboxes. every stage is a zerovm run
+ * with its own manifest, stages are connected by anonymous channels:
+ * the launcher creates a sealable memfd per link and gives it to both
+ * stages under the same descriptor number. the producer manifest has
+ * "Output = fd:4", the consumer one "Input = fd:3" (numbers can be
+ * changed with -i/-o). the producer maps the memfd shared and seals it
+ * at exit, the consumer maps the sealed data read only. the data never
+ * touch a disk. the first stage input and the last stage output are
+ * whatever their manifests say
+ *
+ * usage: zvm_chain [-i input_fd] [-o output_fd] manifest... zerovm is
+ * taken from ZEROVM
+ *
+ *  Created on: Jan 21, 2012
+ *      Author: d'b
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#define INPUT_FD 3
+#define OUTPUT_FD 4
+
+/* create the sealable anonymous channel. return descriptor or -1 */
+static int CreateChannel(int stage)
+{
+  char name[32];
+  snprintf(name, sizeof name, "zvm_chain.%d", stage);
+  return syscall(SYS_memfd_create, name, MFD_ALLOW_SEALING);
+}
+
+/* move "fd" to the lowest free descriptor above "above". return it or -1 */
+static int MoveChannel(int fd, int above)
+{
+  int moved = fcntl(fd, F_DUPFD, above);
+  if(moved >= 0) close(fd);
+  return moved;
+}
+
+/*
+ * run zerovm with "manifest". "input" and "output" are given to it as
+ * "input_fd" and "output_fd" (-1 - none). return zerovm exit code
+ */
+static int RunStage(const char *zerovm, const char *manifest,
+    int input, int input_fd, int output, int output_fd)
+{
+  int status;
+  int above = (input_fd > output_fd ? input_fd : output_fd) + 1;
+  pid_t pid = fork();
+
+  if(pid < 0) return -1;
+  if(pid == 0)
+  {
+    /*
+     * the channels can sit on each other's numbers (e.g. input is 4 and
+     * output is 3), move them out of the way first. dup2() drops
+     * close-on-exec, zerovm inherits the channels and nothing else
+     */
+    if(input >= 0 && (input = MoveChannel(input, above)) < 0) _exit(127);
+    if(output >= 0 && (output = MoveChannel(output, above)) < 0) _exit(127);
+    if(input >= 0 && (dup2(input, input_fd) < 0 || close(input) < 0)) _exit(127);
+    if(output >= 0 && (dup2(output, output_fd) < 0 || close(output) < 0)) _exit(127);
+    execlp(zerovm, zerovm, "-M", manifest, (char*)NULL);
+    _exit(127);
+  }
+  if(waitpid(pid, &status, 0) < 0) return -1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char **argv)
+{
+  const char *zerovm = getenv("ZEROVM") ? getenv("ZEROVM") : "zerovm";
+  int input_fd = INPUT_FD;
+  int output_fd = OUTPUT_FD;
+  int input = -1;
+  int output;
+  int code;
+  int opt;
+  int i;
+
+  while((opt = getopt(argc, argv, "i:o:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'i': input_fd = atoi(optarg); break;
+      case 'o': output_fd = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-i input_fd] [-o output_fd] manifest...\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind == argc || input_fd < 0 || output_fd < 0 || input_fd == output_fd)
+  {
+    fprintf(stderr, "usage: %s [-i input_fd] [-o output_fd] manifest...\n", argv[0]);
+    return 1;
+  }
+
+  for(i = optind; i < argc; ++i)
+  {
+    /* the last stage has no anonymous output */
+    output = -1;
+    if(i + 1 < argc && (output = CreateChannel(i - optind)) < 0)
+    {
+      perror("memfd_create");
+      return 1;
+    }
+
+    code = RunStage(zerovm, argv[i], input, input_fd, output, output_fd);
+    if(code != 0)
+    {
+      fprintf(stderr, "stage %d (%s) failed with %d\n", i - optind, argv[i], code);
+      return 1;
+    }
+
+    /* the producer output is sealed, it is the next stage input */
+    if(input >= 0) close(input);
+    input = output;
+  }
+  return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# zvm_chain test w/o zerovm. the stand-in "zerovm" appends the stage
+# name to its anonymous input and writes it to its anonymous output, the
+# last stage to the result file. the channels of the middle stages swap
+# their numbers from stage to stage (3 and 4), so the chain of 5 stages
+# shows the launcher keeps them apart
+#
+# usage: zvm_chain_test.sh. exits with 0 if the chain passed the data
+#
+WORK=work/test
+STAGES="a b c d e"
+
+rm -rf $WORK
+mkdir -p $WORK
+
+# the manifest of the stand-in is the stage name
+cat > $WORK/zerovm <<'EOF'
+#!/bin/sh
+name=$(cat "$2")
+{ [ -e /proc/self/fd/3 ] && cat /proc/self/fd/3; echo $name; } > $WORK_OUT.$name
+if [ -e /proc/self/fd/4 ]; then cat $WORK_OUT.$name >&4; else cat $WORK_OUT.$name > $WORK_OUT; fi
+EOF
+chmod +x $WORK/zerovm
+
+manifests=
+for s in $STAGES; do
+  echo $s > $WORK/$s.manifest
+  manifests="$manifests $WORK/$s.manifest"
+done
+
+WORK_OUT=$WORK/result ZEROVM=$WORK/zerovm ./zvm_chain $manifests 3<&- 4>&- || exit 1
+if [ "$(cat $WORK/result)" != "$(printf 'a\nb\nc\nd\ne')" ]; then
+  echo "zvm_chain: wrong chain output:"; cat $WORK/result
+  exit 1
+fi
+echo "zvm_chain: ok"
@@ -44,19 +44,24 @@ int LogMessage(char *msg)
   return ret_code;
 }
 
-/* pointer to trampoline function */
-int32_t (*_trap)(uint64_t *in) = (int32_t (*)(uint64_t*))
+/*
+ * pointer to trampoline function. the function and its arguments are
+ * passed in the registers, zerovm takes them from there (no request
+ * array in the user memory)
+ */
+int32_t (*_trap)(uint64_t function, uint64_t arg2,
+    uint64_t arg3, uint64_t arg4, uint64_t arg5) =
+    (int32_t (*)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t))
     0x10000 /* start of trampoline */ +
     0x20 /* size of trampoline record */ *
-    3 /* onering syscall number */;
+    0 /* onering syscall number (One_ring) */;
 
 /*
  * wrapper for zerovm "TrapUserSetup"
  */
 int32_t zvm_setup(struct SetupList *hint)
 {
-  uint64_t request[] = {TrapUserSetup, 0, (uint32_t)(uintptr_t)hint};
-  return _trap(request);
+  return _trap(TrapUserSetup, (uint32_t)(uintptr_t)hint, 0, 0, 0);
 }
 
 /*
@@ -64,8 +69,7 @@ int32_t zvm_setup(struct SetupList *hint)
  */
 int32_t zvm_pread(int desc, char *buffer, int32_t size, int64_t offset)
 {
-  uint64_t request[] = {TrapRead, 0, desc, (uint32_t)(uintptr_t)buffer, size, offset};
-  return _trap(request);
+  return _trap(TrapRead, desc, (uint32_t)(uintptr_t)buffer, size, offset);
 }
 
 /*
@@ -73,6 +77,53 @@ int32_t zvm_pread(int desc, char *buffer, int32_t size, int64_t offset)
  */
 int32_t zvm_pwrite(int desc, char *buffer, int32_t size, int64_t offset)
 {
-  uint64_t request[] = {TrapWrite, 0, desc, (uint32_t)(uintptr_t)buffer, size, offset};
-  return _trap(request);
+  return _trap(TrapWrite, desc, (uint32_t)(uintptr_t)buffer, size, offset);
+}
+
+/*
+ * put request to the i/o ring. the i/o thread only needs a trap when it
+ * sleeps
+ */
+int32_t zvm_ring_submit(struct IoRing *ring, uint32_t function, int desc,
+    char *buffer, int32_t size, int64_t offset, uint64_t tag)
+{
+  uint32_t head = ring->sq_head.value;
+  struct IoRequest *request;
+
+  /* every request must have a room for its completion */
+  if(head - ring->cq_head.value >= ring->entries) return ERR_CODE;
+
+  request = &IO_RING_SQ(ring)[head & (ring->entries - 1)];
+  request->function = function;
+  request->desc = desc;
+  request->buffer = (uint32_t)(uintptr_t)buffer;
+  request->size = size;
+  request->offset = offset;
+  request->tag = tag;
+
+  /* publish the request, then check if the i/o thread must be woken */
+  __sync_synchronize();
+  ring->sq_head.value = head + 1;
+  __sync_synchronize();
+  if(ring->host_sleeping) _trap(TrapIoWait, 0, 0, 0, 0);
+  return OK_CODE;
+}
+
+/*
+ * take completion from the i/o ring. poll for a while, then sleep in
+ * zerovm until the completion is put
+ */
+int32_t zvm_ring_reap(struct IoRing *ring, struct IoCompletion *completion)
+{
+  uint32_t head = ring->cq_head.value;
+  uint32_t i;
+
+  if(head == ring->sq_head.value) return ERR_CODE;
+  for(i = 0; ring->cq_tail.value == head; ++i)
+    if(i >= ring->spins && _trap(TrapIoWait, 1, 0, 0, 0) < 0) return ERR_CODE;
+
+  __sync_synchronize();
+  *completion = IO_RING_CQ(ring)[head & (ring->entries - 1)];
+  ring->cq_head.value = head + 1;
+  return OK_CODE;
 }
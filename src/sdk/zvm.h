@@ -54,12 +54,13 @@ enum ChannelType {
 /* prefixes must answer to enum "Channels" */
 #define CHANNEL_PREFIXES {"Input", "Output", "UserLog", "NetInput", "NetOutput"}
 
-/* add new syscalls through "nanosleep trap" here */
+/* add new "One Ring" functions here */
 enum TrapCalls {
   TrapUserSetup = 17770430,
   TrapRead,
   TrapWrite,
-  TrapExit
+  TrapExit,
+  TrapIoWait /* wake the i/o ring thread, wait for completions */
 };
 
 /* nanosleep ret codes, only 2 because of nanosleep limitations */
@@ -74,7 +75,8 @@ enum TRAP_CODES {
   INSANE_OFFSET,
   INVALID_BUFFER,
   OUT_OF_BOUNDS,
-  OUT_OF_LIMITS
+  OUT_OF_LIMITS,
+  CORRUPTED_DATA /* the channel data fails the integrity check */
 };
 
 /* channel mount mode */
@@ -131,18 +133,19 @@ struct PreOpenedFileDesc
 struct SetupList
 {
   uint32_t self_size; /* size of this struct */
-  uint32_t heap_ptr; /* pointer to the start of available for user ram */
+  uint32_t heap_ptr; /* start of the user heap, grown by sysbrk up to max_mem. 0 - no MemMax */
+  uint32_t io_ring; /* exit-less i/o ring (struct IoRing). 0 - no IoRing */
 
   /* memory, cpu and other system resources limits */
   int32_t max_mem; /* max memory space available for user program < 4gb */
-  int32_t max_cpu; /* max cpu time available for user program, 0 - no limit */
+  int32_t max_cpu; /* max cpu time (milliseconds) available for user program, 0 - no limit */
   int32_t max_syscalls; /* max allowed *real* system calls, 0 - no limit */
   int32_t max_setup_calls; /* allowed calls of _trap_setup */
 
   /* memory, cpu and other system resources counters */
-  int32_t cnt_mem; /* amount of memory available for user */
-  int32_t cnt_cpu; /* n/a for user */
-  int32_t cnt_cpu_last; /* n/a for user. initially should be set when nexe start */
+  int32_t cnt_mem; /* heap in use: bytes from heap_ptr to the break */
+  int32_t cnt_cpu; /* user cpu time in milliseconds. updated on every syscall */
+  int32_t cnt_cpu_last; /* reserved */
   int32_t cnt_syscalls; /* syscalls limit */
   int32_t cnt_setup_calls;
 
@@ -165,6 +168,58 @@ struct SetupList
   struct PreOpenedFileDesc channels[CHANNELS_COUNT];
 };
 
+/*
+ * exit-less i/o ring ("IoRing" manifest key). lives in the user space
+ * at SetupList::io_ring: the header, then "entries" requests, then
+ * "entries" completions. the nexe puts TrapRead/TrapWrite requests to
+ * the submission queue, the zerovm i/o thread serves them in order with
+ * the channels limits and counters and puts the results to the
+ * completion queue. the nexe only traps (TrapIoWait) to wake the
+ * sleeping i/o thread or to sleep itself
+ */
+#define IO_RING_SPINS 4096 /* polls before going to sleep, see IoRing::spins */
+
+struct IoRequest
+{
+  uint32_t function; /* TrapRead or TrapWrite */
+  int32_t desc; /* channel */
+  int32_t buffer; /* user address */
+  int32_t size;
+  int64_t offset;
+  uint64_t tag; /* copied to the completion */
+};
+
+struct IoCompletion
+{
+  uint64_t tag; /* of the request */
+  int64_t result; /* what TrapRead/TrapWrite would return */
+};
+
+/* the ring index. every index has its own cache line */
+struct IoRingIndex
+{
+  volatile uint32_t value;
+  uint32_t pad[15];
+};
+
+struct IoRing
+{
+  uint32_t self_size; /* size of this struct */
+  uint32_t entries; /* power of 2. both queues are of this size */
+  volatile uint32_t host_sleeping; /* the i/o thread needs TrapIoWait to go on */
+  uint32_t spins; /* polls before going to sleep. 0 on a single cpu */
+  uint32_t pad[12];
+  struct IoRingIndex sq_head; /* next request to put. moved by nexe */
+  struct IoRingIndex sq_tail; /* next request to serve. moved by zerovm */
+  struct IoRingIndex cq_head; /* next completion to take. moved by nexe */
+  struct IoRingIndex cq_tail; /* next completion to put. moved by zerovm */
+};
+
+#define IO_RING_SQ(ring) ((struct IoRequest*)((char*)(ring) + sizeof(struct IoRing)))
+#define IO_RING_CQ(ring) ((struct IoCompletion*)(IO_RING_SQ(ring) + (ring)->entries))
+#define IO_RING_SIZE(entries) (sizeof(struct IoRing) \
+    + (entries) * (sizeof(struct IoRequest) + sizeof(struct IoCompletion)))
+
 #ifdef USER_SIDE
 /* "One Ring" wrappers and logger */
 
@@ -183,6 +238,19 @@ int32_t zvm_pread(int desc, char *buffer, int32_t size, int64_t offset);
  */
 int32_t zvm_pwrite(int desc, char *buffer, int32_t size, int64_t offset);
 
+/*
+ * put TrapRead/TrapWrite request to the exit-less i/o ring. return 0 if
+ * successful, -1 if the ring is full (completions must be taken first)
+ */
+int32_t zvm_ring_submit(struct IoRing *ring, uint32_t function, int desc,
+    char *buffer, int32_t size, int64_t offset, uint64_t tag);
+
+/*
+ * take the next completion from the exit-less i/o ring, wait if it is
+ * not ready. return 0 if successful, -1 if nothing was submitted
+ */
+int32_t zvm_ring_reap(struct IoRing *ring, struct IoCompletion *completion);
+
 /*
  * log message. 0 - if success. 1 - if log is full or has no space to
  * store the whole message (part of the message will be stored anyway)
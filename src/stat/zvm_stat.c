@@ -0,0 +1,150 @@
+/*
+ * live statistics reader. prints one line per sandbox from the
+ * "StatsSegment" files given in the command line, so the node agent
+ * can watch many sandboxes at once w/o signals or ptrace. a running
+ * sandbox which has not updated its heartbeat for "stale_ms" is marked
+ * "stale": zerovm itself is stuck. a "run" sandbox with traps, bytes
+ * and cpu standing still between two calls is a stuck nexe
+ *
+ * usage: zvm_stat [-v] [-s stale_ms] segment... -v adds the channels.
+ * returns 2 if any sandbox is stale, 1 if any segment is unreadable
+ *
+ *  Created on: Jan 25, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "src/manifest/live_stats.h"
+#include "src/manifest/phase_timer.h"
+
+#define STALE_MS 1000 /* 10 sampling periods */
+#define NANOS_PER_MILLI 1000000
+
+static int64_t MonotonicNow()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/*
+ * copy the segment "name" to "stats". the fields newer than the reader
+ * are dropped, the older zerovm ones are zeroed. return 0 if successful
+ */
+static int Read(const char *name, struct LiveStats *stats)
+{
+  struct stat st;
+  void *p;
+  size_t size;
+  int fd = open(name, O_RDONLY);
+
+  if(fd < 0) return -1;
+  if(fstat(fd, &st) != 0 || st.st_size < sizeof(uint32_t) * 3)
+  {
+    close(fd);
+    return -1;
+  }
+  p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED) return -1;
+
+  memset(stats, 0, sizeof *stats);
+  stats->magic = __atomic_load_n(&((struct LiveStats*)p)->magic, __ATOMIC_ACQUIRE);
+  size = ((struct LiveStats*)p)->self_size;
+  if(size > sizeof *stats) size = sizeof *stats;
+  if(size > st.st_size) size = st.st_size;
+  if(stats->magic == LIVE_STATS_MAGIC) memcpy(stats, p, size);
+  munmap(p, st.st_size);
+  return stats->magic == LIVE_STATS_MAGIC ? 0 : -1;
+}
+
+static void Print(const char *name, struct LiveStats *stats, int64_t now,
+    int64_t stale_ms, int verbose)
+{
+  static const char *phases[] = PHASE_NAMES;
+  static const char *channels[] = {"Input", "Output", "UserLog", "NetInput", "NetOutput"};
+  int64_t in = 0;
+  int64_t out = 0;
+  int64_t traps = 0;
+  int64_t age = (now - stats->heartbeat) / NANOS_PER_MILLI;
+  const char *state = "run";
+  int i;
+
+  for(i = 0; i < LIVE_STATS_CHANNELS; ++i)
+  {
+    in += stats->channels[i].get_size;
+    out += stats->channels[i].put_size;
+  }
+  for(i = 0; i < LIVE_STATS_TRAPS; ++i)
+    traps += stats->traps[i];
+  if(stats->phase == LIVE_STATS_DONE) state = "done";
+  else if(age > stale_ms) state = "stale";
+
+  printf("%-7d %-5s %-11s %8ld %9ld %9ld %9ld %10ld %12ld %12ld %s\n",
+      stats->pid, state,
+      stats->phase >= 0 && stats->phase < PHASES_COUNT ? phases[stats->phase] : "-",
+      age, stats->cpu / NANOS_PER_MILLI, stats->user_cpu / NANOS_PER_MILLI,
+      stats->rss >> 10, traps, in, out, name);
+
+  if(!verbose) return;
+  for(i = 0; i < LIVE_STATS_CHANNELS; ++i)
+  {
+    struct LiveChannel *c = &stats->channels[i];
+    if(c->gets || c->puts)
+      printf("        %-9s gets %ld (%ld bytes), puts %ld (%ld bytes)\n",
+          channels[i], c->gets, c->get_size, c->puts, c->put_size);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  struct LiveStats stats;
+  int64_t stale_ms = STALE_MS;
+  int64_t now;
+  int verbose = 0;
+  int code = 0;
+  int opt;
+  int i;
+
+  while((opt = getopt(argc, argv, "vs:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'v': verbose = 1; break;
+      case 's': stale_ms = atoll(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-v] [-s stale_ms] segment...\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind == argc)
+  {
+    fprintf(stderr, "usage: %s [-v] [-s stale_ms] segment...\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-7s %-5s %-11s %8s %9s %9s %9s %10s %12s %12s %s\n", "PID", "STATE",
+      "PHASE", "AGE_MS", "CPU_MS", "USER_MS", "RSS_KB", "TRAPS", "IN_BYTES",
+      "OUT_BYTES", "SEGMENT");
+  now = MonotonicNow();
+  for(i = optind; i < argc; ++i)
+  {
+    if(Read(argv[i], &stats) != 0)
+    {
+      fprintf(stderr, "%s: not a stats segment\n", argv[i]);
+      if(code == 0) code = 1;
+      continue;
+    }
+    Print(argv[i], &stats, now, stale_ms, verbose);
+    if(stats.phase != LIVE_STATS_DONE
+        && (now - stats.heartbeat) / NANOS_PER_MILLI > stale_ms) code = 2;
+  }
+  return code;
+}